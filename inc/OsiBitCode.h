@@ -0,0 +1,155 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core/core_c.h>
+
+/** Iris code packed in 64-bit words, with its valid bits.
+ * Bit c of row r is bit c%64 of word c/64 of the row. A bit is valid when it is in the normalized mask
+ * of the eye (repeated for each filter, as the matching does) and in the application points.
+ * Used by the indexes of the gallery, which read bits and compare codes faster than the images.
+ * @see OsiGallery
+ */
+class OsiBitCode
+{
+
+  public:
+    /** Default constructor : an empty code. */
+    OsiBitCode();
+
+    /** Pack an iris code.
+     * @param pCode The iris code (8-bit image, one band of rows per filter)
+     * @param pMask The normalized mask (same width, height of one band), 0 if all bits are valid
+     * @param pApplicationPoints The application points (same size as the mask), 0 for all points
+     * @return void
+     */
+    void pack(const IplImage *pCode, const IplImage *pMask, const CvMat *pApplicationPoints);
+
+    /** Build a short code from some bands and columns of a code.
+     * @param rCode The code
+     * @param nBands Number of bands kept, spread over the bands of the filters of the code
+     * @param step One column out of step is kept
+     * @return void
+     */
+    void downsample(const OsiBitCode &rCode, int nBands, int step);
+
+    /** Rotate the bits of the code (not its valid bits, as the matching does).
+     * @param shift Column c of the rotated code is column c + shift of the code
+     * @param rRotated [out] The rotated code
+     * @return void
+     */
+    void rotate(int shift, OsiBitCode &rRotated) const;
+
+    /** Match to another code, as OsiProcessings::match() : the code is rotated by s columns for s in [-shift, shift],
+     * and compared on the bits valid in both codes (not rotated).
+     * @param rOther The other code, of the same size
+     * @param shift Maximum shift (in columns)
+     * @return The minimum fraction of different bits, 1 if no bit is valid in both codes
+     */
+    float distance(const OsiBitCode &rOther, int shift) const;
+
+    /** Get the width of the code (number of columns). */
+    int getWidth() const
+    {
+        return mWidth;
+    }
+
+    /** Get the number of rows of the code. */
+    int getRows() const
+    {
+        return mRows;
+    }
+
+    /** Get the number of 64-bit words of a row. */
+    int getWords() const
+    {
+        return mWords;
+    }
+
+    /** Get the words of the code, row after row. */
+    const std::vector<unsigned long long> &getCode() const
+    {
+        return mCode;
+    }
+
+    /** Get the words of the valid bits, row after row (one band of rows). */
+    const std::vector<unsigned long long> &getValid() const
+    {
+        return mValid;
+    }
+
+    /** Get the number of rows of the mask (height of the band of each filter). */
+    int getMaskRows() const
+    {
+        return mMaskRows;
+    }
+
+    /** Get a bit of the code.
+     * @param row The row
+     * @param column The column, rotated into [0, width)
+     * @return The bit
+     */
+    bool getBit(int row, int column) const
+    {
+        column = ((column % mWidth) + mWidth) % mWidth;
+        return (mCode[row * mWords + column / 64] >> (column % 64)) & 1;
+    }
+
+    /** Check if a bit of the code is valid (not masked).
+     * @param row The row
+     * @param column The column, rotated into [0, width)
+     * @return True if the bit is valid
+     */
+    bool isValid(int row, int column) const
+    {
+        column = ((column % mWidth) + mWidth) % mWidth;
+        return (mValid[(row % mMaskRows) * mWords + column / 64] >> (column % 64)) & 1;
+    }
+
+    /** Get a hash of the code and of its valid bits, to detect a change of the template. */
+    unsigned long long getHash() const;
+
+    /** Count the different bits of two codes packed in rows of 64-bit words, the first code being rotated.
+     * Only the bits of the mask are compared : the rows of the mask are repeated every maskRows rows of the codes,
+     * and the mask is not rotated. Kernel of all the matchings of packed codes.
+     * @param pCode1 The words of the rotated code, row after row
+     * @param pCode2 The words of the other code
+     * @param pMask The words of the mask
+     * @param rows Number of rows of the codes
+     * @param maskRows Number of rows of the mask
+     * @param words Number of words of a row (the width of the codes is 64 * words)
+     * @param shift Column x of the rotated code is column x + shift of the first code
+     * @return The number of different bits in the mask
+     */
+    static int countDifferentBits(const unsigned long long *pCode1, const unsigned long long *pCode2,
+                                  const unsigned long long *pMask, int rows, int maskRows, int words, int shift);
+
+    /** Count the bits set in a 64-bit word. */
+    static int countBits(unsigned long long v)
+    {
+        v = v - ((v >> 1) & 0x5555555555555555ULL);
+        v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+        v = (v + (v >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+        return (int)((v * 0x0101010101010101ULL) >> 56);
+    }
+
+  private:
+    /** Size of the code, number of words per row, number of rows of the mask. */
+    int mWidth;
+    int mRows;
+    int mWords;
+    int mMaskRows;
+
+    /** Bits of the code, and valid bits (one band of rows, repeated for each filter). */
+    std::vector<unsigned long long> mCode;
+    std::vector<unsigned long long> mValid;
+
+}; // end of class
@@ -0,0 +1,91 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "OsiBloomTemplate.h"
+
+/** Index of Bloom filter templates, giving the candidates of a probe without shifting.
+ * Without tree, the probe is compared to all templates, and the most similar ones are the candidates.
+ * With trees, the templates are split into consecutive parts, each one the leaves of a binary tree
+ * whose nodes merge the filters of their children. The search goes down the nodes most similar to the probe
+ * (best first over all trees), until it has reached enough leaves.
+ * @see OsiGallery , OsiBloomTemplate
+ */
+class OsiBloomIndex
+{
+
+  public:
+    /** Default constructor. */
+    OsiBloomIndex();
+
+    /** Set the parameters and remove all templates.
+     * @param wordRows Number of rows of a word of the Bloom filters
+     * @param blockWidth Number of columns of a block of the Bloom filters
+     * @param nTrees Number of trees, 0 to compare the probe to all templates
+     * @return void
+     */
+    void init(int wordRows, int blockWidth, int nTrees);
+
+    /** Add a template (before build()).
+     * @param id Id of the template, returned by query()
+     * @param rCode Its code
+     * @return void
+     */
+    void add(int id, const OsiBitCode &rCode);
+
+    /** Build the trees.
+     * @return void
+     */
+    void build();
+
+    /** Get the candidates of a probe.
+     * @param rProbe The code of the probe
+     * @param nCandidates Number of candidates
+     * @param rIds [out] The ids of the candidates, in increasing order
+     * @return void
+     */
+    void query(const OsiBitCode &rProbe, int nCandidates, std::vector<int> &rIds) const;
+
+    /** Get the size of the templates and of the nodes (bytes). */
+    double getSize() const;
+
+  private:
+    /** Node of a tree : a template (leaf), or the union of two nodes. */
+    struct Node
+    {
+        OsiBloomTemplate filters;
+        int leaf;
+        int left;
+        int right;
+    };
+
+    /** Parameters. */
+    int mWordRows;
+    int mBlockWidth;
+    int mTrees;
+
+    /** Templates and their ids, nodes of the trees, and roots. */
+    std::vector<OsiBloomTemplate> mTemplates;
+    std::vector<int> mIds;
+    std::vector<Node> mNodes;
+    std::vector<int> mRoots;
+
+    /** Build the tree of consecutive templates.
+     * @param first First template
+     * @param last Last template (excluded)
+     * @return The root of the tree
+     */
+    int buildNode(int first, int last);
+
+    /** Get the filters of a node (the template of a leaf, or the union). */
+    const OsiBloomTemplate &getFilters(int node) const;
+
+}; // end of class
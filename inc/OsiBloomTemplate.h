@@ -0,0 +1,64 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "OsiBitCode.h"
+
+/** Iris code encoded as Bloom filters, compared in a single pass without shifting.
+ * The band of each Gabor filter is split into words of consecutive rows, and the columns into blocks.
+ * Each column of a block sets, in the Bloom filter of the block, the bit indexed by its word :
+ * the filter is the set of the words of the block, whatever their order. A rotation moves only
+ * the few columns at the borders of the blocks, so the filters are locally rotation invariant.
+ * Columns with a masked bit set nothing.\n
+ * The dissimilarity of two filters is |a xor b| / (|a| + |b|), averaged over the blocks.
+ * Merged templates (union of the filters) are the nodes of the trees of OsiBloomIndex.
+ * @see OsiBloomIndex , OsiBitCode
+ */
+class OsiBloomTemplate
+{
+
+  public:
+    /** Default constructor : no filter. */
+    OsiBloomTemplate();
+
+    /** Encode an iris code.
+     * @param rCode The iris code, with its valid bits
+     * @param wordRows Number of rows of a word (6 to 16), the filters have 2^wordRows bits
+     * @param blockWidth Number of columns of a block
+     * @return void
+     */
+    void build(const OsiBitCode &rCode, int wordRows, int blockWidth);
+
+    /** Add the words of another template (union of the filters).
+     * @param rOther A template built with the same parameters
+     * @return void
+     */
+    void merge(const OsiBloomTemplate &rOther);
+
+    /** Compare to another template.
+     * @param rOther A template built with the same parameters
+     * @return The dissimilarity between 0 (same words) and 1 (no common word)
+     */
+    float compare(const OsiBloomTemplate &rOther) const;
+
+    /** Get the size of the filters (bytes). */
+    int getSize() const;
+
+  private:
+    /** Number of filters (blocks of all bands), and number of 64-bit words of a filter. */
+    int mFilters;
+    int mFilterWords;
+
+    /** Bits of the filters, and number of bits set in each filter. */
+    std::vector<unsigned long long> mBits;
+    std::vector<int> mCounts;
+
+}; // end of class
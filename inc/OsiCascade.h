@@ -0,0 +1,89 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "OsiBitCode.h"
+
+/** Cascade of short codes ranking the gallery before the matching of the full iris codes.
+ * Each stage keeps some bands of the filters and one column out of a step : the short codes of all templates
+ * are stored one after the other, small enough to stay in the caches. A stage matches the probe against
+ * the templates kept by the previous stage (masked hamming distance, minimum over the shifts divided by
+ * the step) and keeps the best fraction of them.
+ * The stages are given as "bands:step:fraction", for example "1:4:0.1 3:2:0.3".
+ * @see OsiGallery , OsiBitCode::downsample()
+ */
+class OsiCascade
+{
+
+  public:
+    /** Default constructor : no stage. */
+    OsiCascade();
+
+    /** Set the stages and remove all templates.
+     * @param rStages The stages, as "bands:step:fraction" separated by spaces
+     * @return void
+     */
+    void init(const std::string &rStages);
+
+    /** Add a template. The ids of the templates are their order of addition.
+     * @param rCode Its code
+     * @return void
+     */
+    void add(const OsiBitCode &rCode);
+
+    /** Get the templates kept by the last stage.
+     * @param rProbe The code of the probe
+     * @param shift Maximum shift of the matching of the full codes (in columns)
+     * @param nMin Minimum number of templates kept by a stage
+     * @param rIds [out] The ids of the templates, in increasing order
+     * @return void
+     */
+    void query(const OsiBitCode &rProbe, int shift, int nMin, std::vector<int> &rIds) const;
+
+    /** Get the size of the short codes (bytes). */
+    double getSize() const;
+
+  private:
+    /** A stage : parameters, size of a short code, and short codes of the templates. */
+    struct Stage
+    {
+        int bands;
+        int step;
+        float fraction;
+        int codeWords;
+        int validWords;
+        std::vector<unsigned long long> code;
+        std::vector<unsigned long long> valid;
+    };
+
+    std::vector<Stage> mStages;
+    int mTemplates;
+
+    /** Build the short code of the probe for a stage, rotated for each shift of the stage.
+     * @param rStage The stage
+     * @param rProbe The code of the probe
+     * @param shift Maximum shift of the matching of the full codes (in columns)
+     * @param rRotations [out] The short code rotated by -shift to shift columns of the stage
+     * @return void
+     */
+    void rotateProbe(const Stage &rStage, const OsiBitCode &rProbe, int shift,
+                     std::vector<OsiBitCode> &rRotations) const;
+
+    /** Score a template at a stage : minimum over the rotations of the fraction of different valid bits.
+     * @param rStage The stage
+     * @param id The id of the template
+     * @param rRotations The rotations of the probe given by rotateProbe()
+     * @return The score, 1 if no bit is valid in both codes
+     */
+    float matchStage(const Stage &rStage, int id, const std::vector<OsiBitCode> &rRotations) const;
+
+}; // end of class
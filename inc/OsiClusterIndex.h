@@ -0,0 +1,145 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "OsiBitCode.h"
+
+/** Inverted file of iris codes : the templates are clustered around medoids, and a probe scans only
+ * the clusters of its closest medoids.
+ * The clusters are built offline by k-medoids under the matching of the packed codes (OsiBitCode::distance) :
+ * seeds drawn far from each other (k-medoids++), then alternately each template goes to its closest medoid
+ * and each cluster takes as medoid the member closest to the others (on samples of the large clusters).\n
+ * The templates are laid out cluster after cluster : the gallery stores its eyes in the order given by getOrder(),
+ * and query() returns positions in this layout. The packed codes are kept in the same layout, so that match()
+ * scans a cluster in consecutive memory with the kernel of OsiBitCode::countDifferentBits().
+ * The layout is saved with the name and the hash of each template. When it is loaded, the templates
+ * which are not in the file go to the cluster of their closest medoid, and the missing ones are removed.
+ * @see OsiGallery , OsiBitCode::distance()
+ */
+class OsiClusterIndex
+{
+
+  public:
+    /** Default constructor. */
+    OsiClusterIndex();
+
+    /** Set the parameters and remove all templates.
+     * @param nClusters Number of clusters
+     * @param shift Maximum shift of the distance between templates
+     * @return void
+     */
+    void init(int nClusters, int shift);
+
+    /** Add a template (before build() or load()).
+     * @param rName Name of the template
+     * @param rCode Its code
+     * @param matchShift Maximum shift of the matching of the template (lower if it was processed with cheaper settings)
+     * @return void
+     */
+    void add(const std::string &rName, const OsiBitCode &rCode, int matchShift);
+
+    /** Cluster the templates.
+     * @param nThreads Number of threads computing the distances
+     * @return void
+     */
+    void build(int nThreads);
+
+    /** Load the clusters saved by save(), and put the new templates in the closest clusters.
+     * @param rFilename The file of the clusters
+     * @return False if there is no file, or if it was saved with another shift or if a medoid changed
+     */
+    bool load(const std::string &rFilename);
+
+    /** Save the clusters.
+     * @param rFilename The file of the clusters
+     * @return void
+     */
+    void save(const std::string &rFilename) const;
+
+    /** Get the layout of the templates.
+     * @param rOrder [out] The templates (in order of addition), cluster after cluster
+     * @return void
+     */
+    void getOrder(std::vector<int> &rOrder) const;
+
+    /** Get the templates of the clusters closest to a probe.
+     * @param rProbe The code of the probe
+     * @param shift Maximum shift of the matching of the probe
+     * @param nProbe Number of clusters scanned
+     * @param rPositions [out] The positions of the templates in the layout, in increasing order
+     * @return void
+     */
+    void query(const OsiBitCode &rProbe, int shift, int nProbe, std::vector<int> &rPositions) const;
+
+    /** Match a probe with templates, as OsiEye::compare() : the shift is the lower of the shifts of both codes.
+     * @param rProbe The code of the probe
+     * @param shift Maximum shift of the matching of the probe
+     * @param rPositions The positions of the templates in the layout, given by query()
+     * @param rScores [out] The scores of the templates
+     * @return void
+     */
+    void match(const OsiBitCode &rProbe, int shift, const std::vector<int> &rPositions,
+               std::vector<float> &rScores) const;
+
+    /** Get the number of clusters. */
+    int getClusters() const;
+
+    /** Get the number of templates put in a cluster by the last load(), and removed by it. */
+    int getAssignedTemplates() const;
+    int getRemovedTemplates() const;
+
+  private:
+    /** Parameters. */
+    int mClusters;
+    int mShift;
+
+    /** Templates : names, hashes, codes (kept until the clusters are known) and shifts of matching. */
+    std::vector<std::string> mNames;
+    std::vector<unsigned long long> mHashes;
+    std::vector<OsiBitCode> mCodes;
+    std::vector<int> mMatchShifts;
+
+    /** Clusters : medoid (template and code), and members. */
+    std::vector<int> mMedoids;
+    std::vector<OsiBitCode> mMedoidCodes;
+    std::vector<std::vector<int>> mMembers;
+
+    /** Layout : first position of each cluster, and one more for the end. */
+    std::vector<int> mOffsets;
+
+    /** Size of the codes : rows, words per row, rows of the valid bits. */
+    int mRows;
+    int mWords;
+    int mMaskRows;
+
+    /** Words of the codes, of their valid bits, and shifts of matching, position after position. */
+    std::vector<unsigned long long> mLayoutCodes;
+    std::vector<unsigned long long> mLayoutValid;
+    std::vector<int> mLayoutShifts;
+
+    /** Templates assigned and removed by load(). */
+    int mAssigned;
+    int mRemoved;
+
+    /** Put each template in the cluster of its closest medoid.
+     * @param rTemplates The templates
+     * @param nThreads Number of threads
+     * @return void
+     */
+    void assign(const std::vector<int> &rTemplates, int nThreads);
+
+    /** Keep the codes of the medoids, and lay out the codes cluster after cluster.
+     * @return void
+     */
+    void finish();
+
+}; // end of class
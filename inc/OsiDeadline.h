@@ -0,0 +1,90 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+// Fractions of the budget after which the processing switches to cheaper settings
+#define OSI_DEGRADATION_FRACTION_1 0.4f
+#define OSI_DEGRADATION_FRACTION_2 0.7f
+
+// Number of degradation levels (0 = no degradation)
+#define OSI_DEGRADATION_LEVELS 3
+
+/** Compute budget of one eye.
+ * Acts as a cancellation token : the long loops of the processing functions
+ * are cut short once the budget is exceeded, and the eye stops (exception)
+ * at the next stage.\n
+ * Before that, when the budget is at risk, the degradation level rises
+ * and the processing functions switch to cheaper settings.
+ * The level never decreases, it tags the result of the eye.
+ * @see OsiProcessings
+ * @see OsiEye
+ */
+class OsiDeadline
+{
+
+  public:
+    /** Default constructor.
+     * @param budget The budget in milliseconds, 0 for no limit
+     */
+    OsiDeadline(int budget = 0);
+
+    /** Default destructor. */
+    ~OsiDeadline();
+
+    /** Restart the clock with a new budget.
+     * @param budget The budget in milliseconds, 0 for no limit
+     * @return void
+     */
+    void start(int budget);
+
+    /** Get the time spent since the start.
+     * @return Elapsed time in milliseconds
+     */
+    double getElapsed() const;
+
+    /** Check if the budget is exceeded.
+     * @return True if there is a budget and it is exceeded
+     */
+    bool isExpired() const;
+
+    /** Stop the processing if the budget is exceeded.
+     * @param rStage The name of the current stage, used in the error message
+     * @return void
+     */
+    void check(const std::string &rStage) const;
+
+    /** Update and get the degradation level.
+     * The level depends on the fraction of budget already used, and never decreases.
+     * @return The degradation level, from 0 (full settings) to OSI_DEGRADATION_LEVELS-1 (cheapest settings)
+     */
+    int getDegradationLevel();
+
+    /** Get the highest degradation level reached, without updating it. */
+    int getReachedLevel() const;
+
+    /** Restore the level reached by an eye processed elsewhere (template sent to a worker).
+     * @param level The degradation level
+     * @return void
+     */
+    void setReachedLevel(int level);
+
+  private:
+    /** The budget in milliseconds (0 = no limit). */
+    int mBudget;
+
+    /** The start time. */
+    std::chrono::steady_clock::time_point mStart;
+
+    /** The highest level reached. */
+    int mLevel;
+
+}; // end of class
@@ -0,0 +1,76 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <vector>
+
+/** Evaluation of matching scores.
+ * Collects the scores of genuine comparisons (same eye) and impostor comparisons
+ * (different eyes) and computes the error rates. Scores are hamming distances :
+ * the lower, the more similar.
+ * @see OsiManager
+ */
+class OsiEvaluation
+{
+
+  public:
+    /** Default constructor. */
+    OsiEvaluation();
+
+    /** Default destructor. */
+    ~OsiEvaluation();
+
+    /** Forget all scores.
+     * @return void
+     */
+    void clear();
+
+    /** Add the score of a comparison between two images of the same eye. */
+    void addGenuineScore(float score);
+
+    /** Add the score of a comparison between images of different eyes. */
+    void addImpostorScore(float score);
+
+    /** Get the number of genuine scores. */
+    int getNumberOfGenuineScores() const;
+
+    /** Get the number of impostor scores. */
+    int getNumberOfImpostorScores() const;
+
+    /** Compute the Equal Error Rate.
+     * The threshold is swept over all scores, the EER is taken where the false acceptance rate
+     * (impostors under the threshold) and the false rejection rate (genuines above the threshold) are the closest.
+     * @param pThreshold [out] Optional, the threshold of the EER
+     * @return The EER between 0 and 1, or -1 if genuine or impostor scores are missing
+     */
+    float computeEER(float *pThreshold = 0) const;
+
+    /** Get the mean of the genuine scores (0 if there is none). */
+    float getMeanGenuineScore() const;
+
+    /** Get the mean of the impostor scores (0 if there is none). */
+    float getMeanImpostorScore() const;
+
+    /** Compute the decidability d' = |mean impostor - mean genuine| / sqrt((var genuine + var impostor) / 2).
+     * Measures how well the two distributions of scores are separated, even when the EER is 0.
+     * @return The decidability, or -1 if genuine or impostor scores are missing
+     */
+    float computeDecidability() const;
+
+  private:
+    /** The scores of genuine comparisons. */
+    std::vector<float> mGenuineScores;
+
+    /** The scores of impostor comparisons. */
+    std::vector<float> mImpostorScores;
+
+    /** Compute the mean and the variance of scores (0 if there is none). */
+    static void computeStatistics(const std::vector<float> &rScores, double &rMean, double &rVariance);
+
+}; // end of class
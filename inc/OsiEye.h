@@ -11,6 +11,12 @@
 #include <iostream>
 
 #include "OsiCircle.h"
+#include "OsiDeadline.h"
+#include "OsiMappedImage.h"
+#include "OsiPackFile.h"
+#include "OsiProfile.h"
+#include "OsiSegmentationPlan.h"
+#include "OsiTracker.h"
 
 /** Eye handler.
  * Allows to process one eye, and to load/save
@@ -36,87 +42,117 @@ class OsiEye
     ~OsiEye();
 
     /** Load the original image corresponding to the eye.
+     * Uncompressed 8-bit BMP, PGM and raw files are mapped in memory and used in place,
+     * other files are decoded.
      * @param rFilename Complete path of the image
+     * @param rRawSize Size of raw files (files without header), (0,0) if raw files are not expected
+     * @return void
+     * @see OsiMappedImage
+     */
+    void loadOriginalImage(const std::string &rFilename, const CvSize &rRawSize = cvSize(0, 0));
+
+    /** Set the original image from an image already in memory (frame of a sequence).
+     * @param pImage A grayscale 8-bit image, which is copied
      * @return void
-     * @see loadImage()
      */
-    void loadOriginalImage(const std::string &rFilename);
+    void setOriginalImage(const IplImage *pImage);
+
+    /** Set the original image from an encoded file already in memory (member of an archive).
+     * @param rName The name of the file, for messages
+     * @param rData The content of the file : any format known by OpenCV, or raw pixels
+     * @param rRawSize Size of raw images, which are recognized by their number of bytes
+     * @return void
+     * @see OsiTarReader
+     */
+    void decodeOriginalImage(const std::string &rName, const std::vector<unsigned char> &rData,
+                             const CvSize &rRawSize = cvSize(0, 0));
 
     /** Load the binary mask corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see loadImage()
      */
-    void loadMask(const std::string &rFilename);
+    void loadMask(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Load the normalized image corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see loadImage()
      */
-    void loadNormalizedImage(const std::string &rFilename);
+    void loadNormalizedImage(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Load the normalized mask corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see loadImage()
      */
-    void loadNormalizedMask(const std::string &rFilename);
+    void loadNormalizedMask(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Load the iris code (stored as an image) corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see loadImage()
      */
-    void loadIrisCode(const std::string &rFilename);
+    void loadIrisCode(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Load the contour parameters corresponding to the eye.
      * @param rFilename Complete path of the textfile
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      */
-    void loadParameters(const std::string &rFilename);
+    void loadParameters(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Save the segmented color image corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see saveImage()
      */
-    void saveSegmentedImage(const std::string &rFilename);
+    void saveSegmentedImage(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Save the binary mask corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see saveImage()
      */
-    void saveMask(const std::string &rFilename);
+    void saveMask(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Save the normalized image corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see saveImage()
      */
-    void saveNormalizedImage(const std::string &rFilename);
+    void saveNormalizedImage(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Save the normalized mask corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see saveImage()
      */
-    void saveNormalizedMask(const std::string &rFilename);
+    void saveNormalizedMask(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Save the iris code (stored as an image) corresponding to the eye.
      * @param rFilename Complete path of the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see saveImage()
      */
-    void saveIrisCode(const std::string &rFilename);
+    void saveIrisCode(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Save the contours parameters corresponding to the eye.
      * @param rFilename Complete path of the textfile
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      * @see saveImage()
      */
-    void saveParameters(const std::string &rFilename);
+    void saveParameters(const std::string &rFilename, OsiPackFile *pPack = 0);
 
     /** Initialize the mask.
      * Create the mask and set all pixels to 255.
@@ -126,6 +162,16 @@ class OsiEye
      */
     void initMask();
 
+    /** Assess the quality of the original image, before segmentation.
+     * @param minPupilDiameter The minimum diameter of the pupil
+     * @param rFocus [out] The focus measure
+     * @param rOcclusion [out] The occlusion measure
+     * @param rContrast [out] The contrast measure
+     * @return void
+     * @see OsiProcessings::assessQuality()
+     */
+    void assessQuality(int minPupilDiameter, float &rFocus, float &rOcclusion, float &rContrast);
+
     /** Segment the eye.
      * Initialize the mask if they have not been created yet.\n
      * Call the function OsiProcessings::segment().\n
@@ -140,6 +186,66 @@ class OsiEye
      */
     void segment(int minIrisDiameter, int minPupilDiameter, int maxIrisDiameter, int maxPupilDiameter);
 
+    /** Segment the eye using a precomputed plan.
+     * Same as the other segment() function, but the diameters, kernels
+     * and angle tables come from the plan (shared by all eyes of a batch).\n
+     * If scale is lower than 1, the segmentation runs on the original image downsampled
+     * by scale (canonical resolution), then circles, contours and mask are mapped back
+     * to the resolution of the original image. Normalization still samples the original image.
+     * @param rPlan A plan built for the size of the original image multiplied by scale
+     * @param scale The ratio between the canonical and the original resolutions
+     * @param pTracker An optional tracker, when the eye is a frame of a sequence
+     * @return void
+     * @see OsiSegmentationPlan , OsiTracker
+     */
+    void segment(const OsiSegmentationPlan &rPlan, float scale = 1, OsiTracker *pTracker = 0);
+
+    /** Get the size of the original image.
+     * @return The size of the original image, or 0x0 if it is not loaded
+     */
+    CvSize getOriginalImageSize() const;
+
+    /** Get the original image.
+     * @return The original image, or 0 if it is not loaded
+     */
+    const IplImage *getOriginalImage() const;
+
+    /** Get the iris code.
+     * @return The iris code, or 0 if it is neither computed nor loaded
+     */
+    const IplImage *getIrisCode() const;
+
+    /** Get the normalized mask.
+     * @return The normalized mask, or 0 if it is neither computed nor loaded
+     */
+    const IplImage *getNormalizedMask() const;
+
+    /** Set the speed/accuracy profile used to segment and match the eye.
+     * @param rProfile The profile ("balanced" by default)
+     * @return void
+     * @see OsiProfile
+     */
+    void setProfile(const OsiProfile &rProfile);
+
+    /** Start the clock of the eye with a compute budget.
+     * Segmentation, normalization and encoding switch to cheaper settings when the budget is at risk,
+     * and stop (exception) when it is exceeded.
+     * @param budget The budget in milliseconds, 0 for no limit
+     * @return void
+     * @see OsiDeadline
+     */
+    void setTimeBudget(int budget);
+
+    /** Get the time spent since the clock of the eye was started.
+     * @return Elapsed time in milliseconds
+     */
+    double getElapsedTime() const;
+
+    /** Get the highest degradation level reached by the processing of the eye.
+     * @return 0 if the eye was processed with full settings
+     */
+    int getDegradationLevel() const;
+
     /** Normalize image and mask.
      * If the mask is not already initialized, the function does intialize it to 255.
      * Use the Daugman's rubber-sheet method.
@@ -150,6 +256,12 @@ class OsiEye
      */
     void normalize(int widthOfNormalizedIris, int heightOfNormalizedIris);
 
+    /** Release all images except the normalized image and the normalized mask.
+     * Used to keep many normalized eyes in memory : the eye can then only be encoded and matched.
+     * @return void
+     */
+    void keepNormalizedImages();
+
     /** Encode the normalized image.
      * Use a bank of Gabor filters.
      * @param rGaborFilters The gabor filters used to extract iris texture
@@ -158,6 +270,32 @@ class OsiEye
      */
     void encode(const std::vector<CvMat *> &rGaborFilters);
 
+    /** Normalize and encode in one pass.
+     * Same iris code and normalized mask as normalize() followed by encode(),
+     * but the normalized image is not built (it cannot be saved).
+     * If the mask is not already initialized, the function does intialize it to 255.
+     * @param widthOfNormalizedIris Width of normalized iris
+     * @param heightOfNormalizedIris Height of normalized iris
+     * @param rGaborFilters The gabor filters used to extract iris texture
+     * @return void
+     * @see OsiProcessings::normalizeAndEncode()
+     */
+    void normalizeAndEncode(int widthOfNormalizedIris, int heightOfNormalizedIris,
+                            const std::vector<CvMat *> &rGaborFilters);
+
+    /** Count the bits of the iris code that differ from the code given by other filters.
+     * Used to validate the fixed-point encoding against the floating-point encoding.
+     * The reference code is computed from the normalized image if there is one,
+     * else from the original image and the contours.
+     * @param widthOfNormalizedIris Width of normalized iris
+     * @param heightOfNormalizedIris Height of normalized iris
+     * @param rReferenceFilters The filters giving the reference code
+     * @return The number of different bits
+     * @see OsiProcessings::quantizeFilters()
+     */
+    int countBitErrors(int widthOfNormalizedIris, int heightOfNormalizedIris,
+                       const std::vector<CvMat *> &rReferenceFilters);
+
     /** Match two eyes (hamming distance between iris codes).
      * Normalized masks are used.\n
      * If normalized mask is not already initialized,
@@ -170,10 +308,57 @@ class OsiEye
      */
     float match(OsiEye &rEye, const CvMat *pApplicationPoints);
 
+    /** Match two eyes without changing them : a missing normalized mask is considered as full.
+     * Gives the score of match(), and can be called from several threads at the same time.
+     * @param rEye The other eye to match
+     * @param pApplicationPoints A binary image indicating which pixels will be considered for the matching
+     * @return The hamming distance between the two eyes
+     * @see match()
+     */
+    float compare(const OsiEye &rEye, const CvMat *pApplicationPoints) const;
+
+    /** Compute the iris code of the normalized image with a bank of filters, without changing the eye.
+     * Several banks can be evaluated at the same time on the same eye.
+     * @param rGaborFilters The filters used to extract iris texture
+     * @return A new iris code, to be released by the caller
+     * @see encode()
+     */
+    IplImage *computeIrisCode(const std::vector<CvMat *> &rGaborFilters) const;
+
+    /** Match iris codes given by computeIrisCode(), with the normalized masks of both eyes.
+     * A missing normalized mask is considered as full (the eyes are not changed).
+     * @param pIrisCode The iris code of this eye
+     * @param rEye The other eye
+     * @param pOtherIrisCode The iris code of the other eye
+     * @param pApplicationPoints A binary image indicating which pixels will be considered for the matching
+     * @return The hamming distance between the two codes
+     * @see match()
+     */
+    float matchIrisCodes(const IplImage *pIrisCode, const OsiEye &rEye, const IplImage *pOtherIrisCode,
+                         const CvMat *pApplicationPoints) const;
+
+    /** Write what the matching needs (iris code, normalized mask if any, degradation level) in a buffer.
+     * Used to send a probe to the workers of a distributed search.
+     * @param rData [out] The template
+     * @return void
+     * @see loadTemplate() , OsiSearchCluster
+     */
+    void saveTemplate(std::vector<unsigned char> &rData) const;
+
+    /** Read a template written by saveTemplate().
+     * The eye then matches as the eye which wrote the template.
+     * @param rData The template
+     * @return void
+     */
+    void loadTemplate(const std::vector<unsigned char> &rData);
+
   private:
     /** The original image corresponding to the eye (input only). */
     IplImage *mpOriginalImage;
 
+    /** The mapped file of the original image, when it is used in place. */
+    OsiMappedImage mOriginalMapping;
+
     /** The segmented image (color) corresponding to the eye (output only). */
     IplImage *mpSegmentedImage;
 
@@ -207,18 +392,38 @@ class OsiEye
     /** The theta sampling for iris coarse contour. */
     std::vector<float> mThetaCoarseIris;
 
+    /** The compute budget of the eye. */
+    OsiDeadline mDeadline;
+
+    /** The speed/accuracy profile. */
+    OsiProfile mProfile;
+
     /** Generic function to save the image-like attributes of the eye.
      * @param rFilename The complete path of the image
      * @param ppImage A pointer of pointer on the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
+     * @return void
+     */
+    void loadImage(const std::string &rFilename, IplImage **ppImage, OsiPackFile *pPack = 0);
+
+    /** Decode an image file (any format known by OpenCV) into an 8-bit grayscale image.
+     * @param rFilename The complete path of the image
+     * @param ppImage A pointer of pointer on the image (0 on entry)
+     * @return void
+     */
+    void decodeImage(const std::string &rFilename, IplImage **ppImage);
+
+    /** Release the original image, or unmap its file.
      * @return void
      */
-    void loadImage(const std::string &rFilename, IplImage **ppImage);
+    void releaseOriginalImage();
 
     /** Generic function to load the image-like attributes of the eye.
      * @param rFilename The complete path of the image
      * @param pImage A pointer on the image
+     * @param pPack Optional pack file, rFilename is then the name of an entry of the pack
      * @return void
      */
-    void saveImage(const std::string &rFilename, const IplImage *pImage);
+    void saveImage(const std::string &rFilename, const IplImage *pImage, OsiPackFile *pPack = 0);
 
 }; // End of class
@@ -0,0 +1,251 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/core/core_c.h>
+
+#include "OsiBitCode.h"
+
+// Geometry for which the kernels are specialized (stock configuration)
+#define OSI_DEFAULT_NORMALIZED_WIDTH 512
+#define OSI_DEFAULT_NORMALIZED_HEIGHT 64
+
+// Stock filter bank : 3 pairs (real, imaginary) of 9 rows and 15, 27, 51 columns
+#define OSI_DEFAULT_NUMBER_OF_FILTERS 6
+#define OSI_DEFAULT_FILTER_ROWS 9
+#define OSI_DEFAULT_MAX_HALF_WIDTH 25
+
+/** Stock filter bank (data/OsirisParam/filters.txt) and kernels specialized for it.
+ * The stock filters are separable and piecewise constant :
+ * coefficient(r, c) = 0.25 * row weight(r) * column weight(c), with row weights 1 1 1 2 2 2 1 1 1
+ * and column weights made of three blocks of equal width. The bank is embedded as constexpr functions.\n
+ * The specialized encoding sums the rows once for all filters, then computes each filter
+ * from prefix sums of the columns (a few additions per pixel, whatever the filter width),
+ * in integer arithmetic. The specialized matching packs the codes in 64-bit words and counts the bits.\n
+ * The generic cvFilter2D/match path is kept for custom filter files and other sizes.
+ * @see OsiProcessings::encode() , OsiProcessings::match()
+ */
+class OsiFilterBank
+{
+
+  public:
+    /** Get the width of the blocks of the f-th stock filter (the filter has 3 blocks). */
+    static constexpr int getBlockWidth(int f)
+    {
+        return f < 2 ? 5 : (f < 4 ? 9 : 17);
+    }
+
+    /** Check if the f-th stock filter is an imaginary part (odd filter). */
+    static constexpr bool isOdd(int f)
+    {
+        return f % 2 == 1;
+    }
+
+    /** Get the weight of row r of the stock filters. */
+    static constexpr int getRowWeight(int r)
+    {
+        return (r >= 3 && r < 6) ? 2 : 1;
+    }
+
+    /** Get the weight of column c of the f-th stock filter.
+     * Real part : -1 (block), +2 (block), -1 (block).
+     * Imaginary part : +1 (block), -2 (half block), 0, +2 (half block), -1 (block).
+     */
+    static constexpr int getColumnWeight(int f, int c)
+    {
+        return c < getBlockWidth(f)       ? (isOdd(f) ? 1 : -1)
+               : c >= 2 * getBlockWidth(f) ? -1
+               : !isOdd(f)                 ? 2
+               : c - getBlockWidth(f) < (getBlockWidth(f) - 1) / 2  ? -2
+               : c - getBlockWidth(f) == (getBlockWidth(f) - 1) / 2 ? 0
+                                                                    : 2;
+    }
+
+    /** Get the coefficient (r, c) of the f-th stock filter, as in filters.txt. */
+    static constexpr float getCoefficient(int f, int r, int c)
+    {
+        return 0.25f * getRowWeight(r) * getColumnWeight(f, c);
+    }
+
+    /** Check if a bank of filters is the stock bank.
+     * @param rFilters The filters loaded from the configuration (CV_32FC1)
+     * @return True if all filters have the size and the coefficients of the stock bank
+     */
+    static bool isDefaultBank(const std::vector<CvMat *> &rFilters)
+    {
+        if (rFilters.size() != OSI_DEFAULT_NUMBER_OF_FILTERS)
+        {
+            return false;
+        }
+        for (int f = 0; f < OSI_DEFAULT_NUMBER_OF_FILTERS; f++)
+        {
+            const CvMat *filter = rFilters[f];
+            if (CV_MAT_TYPE(filter->type) != CV_32FC1 || filter->rows != OSI_DEFAULT_FILTER_ROWS ||
+                filter->cols != 3 * getBlockWidth(f))
+            {
+                return false;
+            }
+            for (int r = 0; r < filter->rows; r++)
+            {
+                for (int c = 0; c < filter->cols; c++)
+                {
+                    if (CV_MAT_ELEM(*filter, float, r, c) != getCoefficient(f, r, c))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    /** Encode a 512x64 normalized iris with the stock bank.
+     * @param pBordered The normalized iris with wrapping borders of at least OSI_DEFAULT_MAX_HALF_WIDTH columns
+     * @param border The width of the borders
+     * @param pDst The binary iris code (512 x 64*6)
+     * @return void
+     * @see OsiProcessings::encodeWithBorders()
+     */
+    static void encode(const IplImage *pBordered, int border, IplImage *pDst)
+    {
+        const int width = OSI_DEFAULT_NORMALIZED_WIDTH;
+        const int height = OSI_DEFAULT_NORMALIZED_HEIGHT;
+        const int half_rows = OSI_DEFAULT_FILTER_ROWS / 2;
+        int bordered_width = width + 2 * border;
+
+        // Prefix sums of the weighted sums of rows : prefix[x+1] - prefix[x] = sum_r weight(r) * src(y+r-4, x)
+        std::vector<int> prefix(bordered_width + 1);
+
+        for (int y = 0; y < height; y++)
+        {
+            // Rows out of the image are replicated, as cvFilter2D does
+            const uchar *rows[OSI_DEFAULT_FILTER_ROWS];
+            for (int r = 0; r < OSI_DEFAULT_FILTER_ROWS; r++)
+            {
+                int i = std::min(std::max(y + r - half_rows, 0), height - 1);
+                rows[r] = (const uchar *)(pBordered->imageData + i * pBordered->widthStep);
+            }
+
+            prefix[0] = 0;
+            for (int x = 0; x < bordered_width; x++)
+            {
+                int sum = 0;
+                for (int r = 0; r < OSI_DEFAULT_FILTER_ROWS; r++)
+                {
+                    sum += getRowWeight(r) * rows[r][x];
+                }
+                prefix[x + 1] = prefix[x] + sum;
+            }
+
+            // The 6 filters from the same prefix sums
+            encodeRow<5, false>(&prefix[0], border, rowOfCode(pDst, 0, y));
+            encodeRow<5, true>(&prefix[0], border, rowOfCode(pDst, 1, y));
+            encodeRow<9, false>(&prefix[0], border, rowOfCode(pDst, 2, y));
+            encodeRow<9, true>(&prefix[0], border, rowOfCode(pDst, 3, y));
+            encodeRow<17, false>(&prefix[0], border, rowOfCode(pDst, 4, y));
+            encodeRow<17, true>(&prefix[0], border, rowOfCode(pDst, 5, y));
+        }
+    }
+
+    /** Match two iris codes of width 512, with bits packed in 64-bit words.
+     * Same score as OsiProcessings::match() (codes and mask are binary images).
+     * @param image1 First binary iris code
+     * @param image2 Second binary iris code
+     * @param mask Mask of matching
+     * @param shift Maximum shift (in pixels), lower than the width
+     * @return The matching score between 0 (completely similar) and 1 (completely different)
+     */
+    static float match(const IplImage *image1, const IplImage *image2, const IplImage *mask, int shift)
+    {
+        return matchPacked<OSI_DEFAULT_NORMALIZED_WIDTH>(image1, image2, mask, shift);
+    }
+
+  private:
+    /** Get a row of the part of the iris code given by the f-th filter. */
+    static uchar *rowOfCode(IplImage *pCode, int f, int y)
+    {
+        return (uchar *)(pCode->imageData + (f * OSI_DEFAULT_NORMALIZED_HEIGHT + y) * pCode->widthStep);
+    }
+
+    /** Convolve one row with a stock filter (from the prefix sums) and threshold.
+     * Block is the width of the 3 blocks, Odd selects the imaginary part.
+     */
+    template <int Block, bool Odd> static void encodeRow(const int *pPrefix, int border, uchar *pDst)
+    {
+        const int anchor = (3 * Block - 1) / 2;
+        const int half = (Block - 1) / 2;
+
+        for (int x = 0; x < OSI_DEFAULT_NORMALIZED_WIDTH; x++)
+        {
+            const int *p = pPrefix + x + border - anchor;
+            int left = p[Block] - p[0];
+            int right = p[3 * Block] - p[2 * Block];
+            int value;
+            if (Odd)
+            {
+                value = left - right - 2 * (p[Block + half] - p[Block]) + 2 * (p[2 * Block] - p[Block + half + 1]);
+            }
+            else
+            {
+                value = 2 * (p[2 * Block] - p[Block]) - left - right;
+            }
+            pDst[x] = value > 0 ? 255 : 0;
+        }
+    }
+
+    /** Pack the rows of a binary image in 64-bit words (bit b of word k is column 64k+b). */
+    template <int Width> static void pack(const IplImage *pImage, std::vector<unsigned long long> &rWords)
+    {
+        const int words = Width / 64;
+        rWords.assign(pImage->height * words, 0);
+        for (int i = 0; i < pImage->height; i++)
+        {
+            const uchar *row = (const uchar *)(pImage->imageData + i * pImage->widthStep);
+            for (int x = 0; x < Width; x++)
+            {
+                if (row[x])
+                {
+                    rWords[i * words + x / 64] |= 1ULL << (x % 64);
+                }
+            }
+        }
+    }
+
+    /** Match packed codes : the rows of image1 are rotated by s columns, for s in [-shift, shift]. */
+    template <int Width>
+    static float matchPacked(const IplImage *image1, const IplImage *image2, const IplImage *mask, int shift)
+    {
+        const int words = Width / 64;
+        std::vector<unsigned long long> code1, code2, bits;
+        pack<Width>(image1, code1);
+        pack<Width>(image2, code2);
+        pack<Width>(mask, bits);
+
+        int n_bits = 0;
+        for (int k = 0; k < bits.size(); k++)
+        {
+            n_bits += OsiBitCode::countBits(bits[k]);
+        }
+
+        float score = 1;
+        for (int s = -shift; s <= shift; s++)
+        {
+            int n_different =
+                OsiBitCode::countDifferentBits(&code1[0], &code2[0], &bits[0], image1->height, mask->height, words, s);
+            float mean = (double)n_different / n_bits;
+            score = std::min(score, mean);
+        }
+
+        return score;
+    }
+
+}; // end of class
@@ -0,0 +1,343 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "OsiBloomIndex.h"
+#include "OsiCascade.h"
+#include "OsiClusterIndex.h"
+#include "OsiEye.h"
+#include "OsiLshIndex.h"
+#include "OsiProfile.h"
+#include "OsiVpTree.h"
+
+/** A gallery image found by a search, with its matching score. */
+struct OsiCandidate
+{
+    /** Name of the gallery image, as in the gallery list. */
+    std::string name;
+
+    /** Position of the image in the gallery list. */
+    int index;
+
+    /** Matching score (hamming distance). */
+    float score;
+
+    /** Order of the candidates : best score first, then first in the gallery list (ties). */
+    bool operator<(const OsiCandidate &rOther) const
+    {
+        return score < rOther.score || (score == rOther.score && index < rOther.index);
+    }
+};
+
+/** Enrolled templates searched by identification (1:N matching).
+ * Each probe is matched against every enrolled eye, with the same function as the matching of pairs,
+ * and the best candidates are kept. The gallery can hold only a part of the gallery list :
+ * the candidates keep their position in the whole list, so that the partial results of several
+ * galleries merge into the result of the whole gallery.\n
+ * The gallery can be searched by several threads, each one owning a consecutive part of the eyes.
+ * On a NUMA machine (Linux), the threads are spread over the nodes and pinned to the CPUs of their node,
+ * and each thread copies its eyes itself, so that they are allocated in the memory of its node (first touch).\n
+ * An index can give a shortlist of the eyes for each probe : only these eyes are matched.
+ * Some searches can also be done without the index, to measure the recall of the index.
+ * @see OsiSearchCluster , OsiLshIndex , OsiBloomIndex , OsiCascade , OsiVpTree , OsiClusterIndex ,
+ * OsiManager::identify()
+ */
+class OsiGallery
+{
+
+  public:
+    /** Default constructor. */
+    OsiGallery();
+
+    /** Default destructor.
+     * Stop the threads.
+     */
+    ~OsiGallery();
+
+    /** Set what the matching needs besides the templates.
+     * @param rProfile The profile of the probes sent as templates
+     * @param pApplicationPoints A binary image indicating which pixels will be considered for the matching
+     * @return void
+     */
+    void setMatching(const OsiProfile &rProfile, const CvMat *pApplicationPoints);
+
+    /** Enroll an eye (before start()).
+     * @param rName Name of the image
+     * @param index Position of the image in the gallery list
+     * @param rpEye The eye, with its iris code (and its normalized mask if any)
+     * @return void
+     */
+    void add(const std::string &rName, int index, const std::shared_ptr<OsiEye> &rpEye);
+
+    /** Get the number of enrolled eyes. */
+    int getSize() const;
+
+    /** Stop the threads and remove all eyes.
+     * @return void
+     */
+    void clear();
+
+    /** Start the threads searching the enrolled eyes.
+     * Without this, the caller searches all eyes itself.
+     * @param nThreads Number of threads (at least one per NUMA node)
+     * @param numa True to spread the threads over the NUMA nodes
+     * @return void
+     */
+    void start(int nThreads, bool numa);
+
+    /** Stop the threads.
+     * @return void
+     */
+    void stop();
+
+    /** Set the index giving the shortlist of each probe.
+     * @param rType "none" (all eyes are matched), "lsh" (locality-sensitive hashing), "bloom" (Bloom filters)
+     * "cascade" (short codes), "vptree" (vantage-point tree) or "ivf" (clusters)
+     * @param rFilename File in which the LSH index, the tree or the clusters are saved,
+     * and from which they are loaded ("" : not saved)
+     * @param recallPeriod Every recallPeriod searches, the search is also done without index
+     * to measure the recall (0 : never)
+     * @return void
+     */
+    void setIndex(const std::string &rType, const std::string &rFilename, int recallPeriod);
+
+    /** Set the parameters of the LSH index.
+     * @param nTables Number of tables (more tables : better recall)
+     * @param nBits Number of bits per key (more bits : shorter shortlists)
+     * @param maxMaskedBits Maximum number of masked bits per key
+     * @return void
+     * @see OsiLshIndex
+     */
+    void setLshParameters(int nTables, int nBits, int maxMaskedBits);
+
+    /** Set the parameters of the Bloom filter index.
+     * @param wordRows Number of rows of a word (the filters have 2^wordRows bits)
+     * @param blockWidth Number of columns of a block (the rotation tolerated by a block)
+     * @param nTrees Number of trees, 0 to compare the probe to all Bloom templates
+     * @param nCandidates Number of eyes of the shortlist
+     * @return void
+     * @see OsiBloomIndex
+     */
+    void setBloomParameters(int wordRows, int blockWidth, int nTrees, int nCandidates);
+
+    /** Set the stages of the cascade of short codes.
+     * @param rStages The stages, as "bands:step:fraction" separated by spaces
+     * @return void
+     * @see OsiCascade
+     */
+    void setCascadeStages(const std::string &rStages);
+
+    /** Set the parameters of the vantage-point tree.
+     * The searches with the tree are range queries : only the eyes under the radius are candidates.
+     * @param radius Maximum matching score of the candidates
+     * @param slack Margin added to the bounds of the triangle inequality
+     * @param nThreads Number of threads building the tree
+     * @return void
+     * @see OsiVpTree
+     */
+    void setTreeParameters(float radius, float slack, int nThreads);
+
+    /** Set the parameters of the clusters.
+     * @param nClusters Number of clusters
+     * @param nProbe Number of clusters scanned for a probe, the closest ones
+     * @param nThreads Number of threads building the clusters
+     * @return void
+     * @see OsiClusterIndex
+     */
+    void setClusterParameters(int nClusters, int nProbe, int nThreads);
+
+    /** Build the index of the enrolled eyes (after add()), or update the saved index.
+     * With clusters, the eyes are then stored cluster after cluster.
+     * @param rebuild True to build the index even if it is saved
+     * @return void
+     */
+    void buildIndex(bool rebuild);
+
+    /** Show the recall and the speed of the index, for eyes of the gallery searched as probes
+     * (each one without itself). With clusters, for a number of scanned clusters doubling up to all clusters.
+     * @param nProbes Number of eyes searched
+     * @param k Number of candidates
+     * @return void
+     */
+    void reportIndex(int nProbes, int k);
+
+    /** Show the searches done with the index (eyes matched, time, recall)
+     * and by each NUMA node (eyes, bytes of templates scanned, bandwidth).
+     * @return void
+     */
+    void showStatistics() const;
+
+    /** Search a probe in the gallery.
+     * @param rProbe The probe, with its iris code
+     * @param k Number of candidates, 0 for all eyes of the gallery
+     * @param rCandidates [out] The best candidates, best first
+     * @return void
+     */
+    void search(const OsiEye &rProbe, int k, std::vector<OsiCandidate> &rCandidates);
+
+    /** Search a probe sent as a template.
+     * @param rTemplate The template of the probe
+     * @param k Number of candidates, 0 for all eyes of the gallery
+     * @param rCandidates [out] The best candidates, best first
+     * @return void
+     * @see OsiEye::saveTemplate()
+     */
+    void searchTemplate(const std::vector<unsigned char> &rTemplate, int k, std::vector<OsiCandidate> &rCandidates);
+
+    /** Keep the best candidates, best first.
+     * @param rCandidates [in,out] The candidates
+     * @param k Number of candidates kept, 0 for all
+     * @return void
+     */
+    static void keepBest(std::vector<OsiCandidate> &rCandidates, int k);
+
+  private:
+    /** Not copyable : the object owns the threads. */
+    OsiGallery(const OsiGallery &);
+    OsiGallery &operator=(const OsiGallery &);
+
+    /** Consecutive eyes searched by one thread. */
+    struct Partition
+    {
+        /** The NUMA node of the thread, and its CPUs (empty : the thread is not pinned). */
+        int node;
+        std::vector<int> cpus;
+
+        /** The eyes of the partition, from first to last (excluded). */
+        int first;
+        int last;
+
+        /** The candidates of the last search, or its error. */
+        std::vector<OsiCandidate> candidates;
+        std::string error;
+
+        /** Size of the templates of the eyes, and number of searches. */
+        double bytes;
+        int searches;
+
+        std::thread thread;
+    };
+
+    /** The enrolled eyes, their names and their positions in the gallery list. */
+    std::vector<std::shared_ptr<OsiEye>> mEyes;
+    std::vector<std::string> mNames;
+    std::vector<int> mIndices;
+
+    /** The profile of the probes sent as templates. */
+    OsiProfile mProfile;
+
+    /** The application points (not owned). */
+    const CvMat *mpApplicationPoints;
+
+    /** The threads, the current search (probe, number of candidates, generation), and the time spent searching. */
+    std::vector<Partition> mPartitions;
+    const OsiEye *mpProbe;
+    int mK;
+    int mGeneration;
+    int mPending;
+    bool mStopping;
+    double mSearchTime;
+    std::mutex mMutex;
+    std::condition_variable mStartCondition;
+    std::condition_variable mDoneCondition;
+
+    /** The index, its file, and its parameters. */
+    std::string mIndexType;
+    std::string mIndexFilename;
+    int mRecallPeriod;
+    OsiLshIndex mLshIndex;
+    int mLshTables;
+    int mLshBits;
+    int mLshMaskedBits;
+    OsiBloomIndex mBloomIndex;
+    int mBloomWordRows;
+    int mBloomBlockWidth;
+    int mBloomTrees;
+    int mBloomCandidates;
+    OsiCascade mCascade;
+    std::string mCascadeStages;
+    OsiVpTree mVpTree;
+    float mTreeRadius;
+    float mTreeSlack;
+    int mTreeThreads;
+    OsiClusterIndex mClusterIndex;
+    int mClusters;
+    int mClusterProbe;
+    int mClusterThreads;
+
+    /** Searches done with the index : number, eyes matched, time, and searches compared to the exhaustive search
+     * (candidates found, searches finding the same best candidate). */
+    int mIndexedSearches;
+    double mMatchedEyes;
+    double mIndexTime;
+    int mMeasuredSearches;
+    double mExpectedCandidates;
+    double mFoundCandidates;
+    int mSameBest;
+    double mExhaustiveTime;
+
+    /** Search all eyes of the gallery, with the threads if any.
+     * @param rProbe The probe
+     * @param k Number of candidates, 0 for all eyes
+     * @param rCandidates [out] The best candidates, best first
+     * @return void
+     */
+    void searchAll(const OsiEye &rProbe, int k, std::vector<OsiCandidate> &rCandidates);
+
+    /** Get the shortlist of a probe from the index.
+     * @param rProbe The probe
+     * @param k Number of candidates searched
+     * @param rEyes [out] The positions of the eyes in the gallery, in increasing order
+     * @return void
+     */
+    void getShortlist(const OsiEye &rProbe, int k, std::vector<int> &rEyes);
+
+    /** Keep an eye if it is one of the best candidates.
+     * @param score The score of the eye matched with the probe
+     * @param e Position of the eye in the gallery
+     * @param k Number of candidates, 0 for all eyes
+     * @param rCandidates [in,out] The best candidates so far, as a max-heap
+     * @return void
+     */
+    void addCandidate(float score, int e, int k, std::vector<OsiCandidate> &rCandidates) const;
+
+    /** Search consecutive eyes.
+     * @param rProbe The probe
+     * @param k Number of candidates, 0 for all eyes
+     * @param first First eye
+     * @param last Last eye (excluded)
+     * @param rCandidates [out] The best candidates, best first
+     * @return void
+     */
+    void searchEyes(const OsiEye &rProbe, int k, int first, int last, std::vector<OsiCandidate> &rCandidates) const;
+
+    /** Search some eyes. With the ivf index, they are matched in the packed codes of the index.
+     * @param rProbe The probe
+     * @param k Number of candidates, 0 for all eyes
+     * @param rEyes Positions of the eyes in the gallery
+     * @param rCandidates [out] The best candidates, best first
+     * @return void
+     */
+    void searchEyes(const OsiEye &rProbe, int k, const std::vector<int> &rEyes,
+                    std::vector<OsiCandidate> &rCandidates) const;
+
+    /** Loop of a thread : copy the eyes of the partition, then search them for each probe.
+     * @param rPartition The partition of the thread
+     * @return void
+     */
+    void runPartition(Partition &rPartition);
+
+}; // end of class
@@ -0,0 +1,113 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "OsiBitCode.h"
+
+/** Bit-sampling locality-sensitive hashing of iris codes.
+ * Each table samples bits of the code among the application points : two codes with the same sampled bits
+ * fall in the same bucket of the table. The gallery verifies only the templates sharing a bucket with the probe.
+ * - Masks : a masked bit matches both values (the key is expanded), up to a number of masked bits per key.
+ * A template with more masked bits is left out of the table, and a template left out of all tables
+ * is always verified.
+ * - Rotation : the probe is hashed once for each shift of the matching.\n
+ * More tables find more true matches (recall), more bits per key verify fewer templates (speed).\n
+ * The index is saved with the name and the hash of each template : when it is loaded again,
+ * only the new or changed templates are hashed.
+ * @see OsiGallery , OsiBitCode
+ */
+class OsiLshIndex
+{
+
+  public:
+    /** Default constructor. */
+    OsiLshIndex();
+
+    /** Draw the sampled bits of the tables and remove all templates.
+     * @param nTables Number of tables
+     * @param nBits Number of sampled bits per table (key), up to 32
+     * @param maxMaskedBits Maximum number of masked bits of a key, expanded to both values
+     * @param rCode A code giving the geometry (width, rows) and the valid bits of the application points
+     * @return void
+     */
+    void init(int nTables, int nBits, int maxMaskedBits, const OsiBitCode &rCode);
+
+    /** Read the templates of an index saved by save().
+     * They are kept aside, and reused by add() for the templates with the same name and hash.
+     * @param rFilename The file of the index
+     * @return False if there is no file, or if it was saved with other parameters
+     */
+    bool load(const std::string &rFilename);
+
+    /** Save the index.
+     * @param rFilename The file of the index
+     * @return void
+     */
+    void save(const std::string &rFilename) const;
+
+    /** Add a template.
+     * @param id Id of the template, returned by query()
+     * @param rName Name of the template (used to reuse a loaded template)
+     * @param rCode Its code
+     * @return True if the template was hashed, false if it was reused from the loaded index
+     */
+    bool add(int id, const std::string &rName, const OsiBitCode &rCode);
+
+    /** Get the templates sharing a bucket with a probe.
+     * @param rProbe The code of the probe
+     * @param shift Maximum shift of the matching (in columns)
+     * @param rIds [out] The ids of the templates, in increasing order
+     * @return void
+     */
+    void query(const OsiBitCode &rProbe, int shift, std::vector<int> &rIds) const;
+
+    /** Get the number of loaded templates which were not added again (removed from the gallery). */
+    int getRemovedTemplates() const;
+
+  private:
+    /** Keys of a template in each table. */
+    struct Entry
+    {
+        std::string name;
+        unsigned long long hash;
+        std::vector<std::vector<unsigned int>> keys;
+    };
+
+    /** Parameters, and sampled bits (row and column) of each table. */
+    int mTables;
+    int mBits;
+    int mMaxMaskedBits;
+    int mWidth;
+    int mRows;
+    std::vector<int> mSampledRows;
+    std::vector<int> mSampledColumns;
+
+    /** Templates by id, buckets of each table, templates in no table. */
+    std::map<int, Entry> mEntries;
+    std::vector<std::unordered_map<unsigned int, std::vector<int>>> mBuckets;
+    std::vector<int> mUnhashed;
+
+    /** Templates of the loaded index, by name. */
+    std::map<std::string, Entry> mLoaded;
+
+    /** Get the keys of a code in a table.
+     * @param rCode The code
+     * @param table The table
+     * @param shift The rotation of the code (in columns)
+     * @param rKeys [out] The keys : one, or one per value of the masked bits, or none if too many bits are masked
+     * @return void
+     */
+    void getKeys(const OsiBitCode &rCode, int table, int shift, std::vector<unsigned int> &rKeys) const;
+
+}; // end of class
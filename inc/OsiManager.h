@@ -8,11 +8,20 @@
 
 #pragma once
 
+#include <fstream>
 #include <iostream>
 #include <map>
 #include <vector>
 
+#include <opencv2/core.hpp>
+
+#include "OsiEvaluation.h"
 #include "OsiEye.h"
+#include "OsiGallery.h"
+#include "OsiPrefetcher.h"
+#include "OsiProfile.h"
+#include "OsiScoreWriter.h"
+#include "OsiSearchCluster.h"
 
 /** Overall manager.
  * This class manages all the files, configuration, saving
@@ -32,7 +41,8 @@ class OsiManager
 
     /** Default destructor.
      * Release matrix containing the application points.\n
-     * Release the bank of Gabor Filters.
+     * Release the bank of Gabor Filters.\n
+     * Release the segmentation plans.
      */
     ~OsiManager();
 
@@ -55,6 +65,50 @@ class OsiManager
      */
     void run();
 
+    /** Resume the run from its checkpoint (option "--resume" of the command line).
+     * The entries of the list done before the checkpoint are skipped,
+     * and the scores and reports are appended to the files of the previous run.
+     * @param resume True to resume
+     * @return void
+     */
+    void setResume(bool resume);
+
+    /** Process only a part of the list (option "--shard i/N" of the command line).
+     * The list (or the list of pairs, for matching) is cut in N consecutive parts, of equal number of entries,
+     * or of equal cost ("Shard balancing" : size of the original images, or time in a previous processing log).
+     * The outputs of the shard (files of scores and reports, pack files, checkpoint, result cache)
+     * are named after the shard : "scores.txt" becomes "scores.shard2of8.txt".
+     * @param rShard "i/N", with i from 1 to N
+     * @return void
+     * @see mergeShards()
+     */
+    void setShard(const std::string &rShard);
+
+    /** Merge the outputs of all shards (option "--merge N" of the command line).
+     * The scores, reports and pack files of the shards are gathered in the outputs of the configuration,
+     * as a single run would have written them.
+     * @param nShards Number of shards
+     * @return void
+     */
+    void mergeShards(int nShards);
+
+    /** Serve the gallery to the coordinator of a distributed identification (option "--serve <address>").
+     * The worker owns the part "--shard i/N" of the gallery list (the whole gallery without shard),
+     * and answers the searches until the process is stopped.
+     * @param rAddress "unix:<path>" or "tcp:<host>:<port>"
+     * @return void
+     * @see OsiSearchCluster
+     */
+    void serveGallery(const std::string &rAddress);
+
+    /** Build the index of the gallery and save it (option "--build-index" of the command line),
+     * then show its recall and speed for eyes of the gallery searched as probes.
+     * The index of the part "--shard i/N" of the gallery list is built (the whole gallery without shard).
+     * @return void
+     * @see OsiGallery::reportIndex()
+     */
+    void buildGalleryIndex();
+
   private:
     // Commands
     bool mProcessSegmentation;
@@ -62,6 +116,9 @@ class OsiManager
     bool mProcessEncoding;
     bool mProcessMatching;
     bool mUseMask;
+    bool mProcessSequences;
+    bool mAssessQuality;
+    bool mFixedPointEncoding;
 
     // Inputs
     std::string mFilenameListOfImages;
@@ -72,6 +129,13 @@ class OsiManager
     std::string mInputDirNormalizedImages;
     std::string mInputDirNormalizedMasks;
     std::string mInputDirIrisCodes;
+    int mRawImageWidth;
+    int mRawImageHeight;
+
+    // Original images read in advance
+    int mPrefetchedImages;
+    int mPrefetchingThreads;
+    OsiPrefetcher mPrefetcher;
 
     // Outputs
     std::string mOutputDirSegmentedImages;
@@ -81,18 +145,92 @@ class OsiManager
     std::string mOutputDirNormalizedMasks;
     std::string mOutputDirIrisCodes;
     std::string mOutputFileMatchingScores;
+    std::string mMatchingScoresFormat;
+    int mBestScoresPerProbe;
+    float mMaxMatchingScore;
+    std::string mOutputFileQuality;
+    std::ofstream mQualityReport;
+    std::string mOutputFileProcessingLog;
+    std::ofstream mProcessingLog;
+    std::string mFilenameImpostorPairs;
+    std::string mOutputFileBenchmark;
+    std::string mFilenameFilterBanks;
+    std::string mOutputFileSweep;
+
+    // Pack files used instead of directories, by path
+    std::map<std::string, OsiPackFile *> mPacks;
+
+    // Results of previous runs, by hash of the original image and of the settings of each stage
+    std::string mFilenameResultCache;
+    OsiPackFile mResultCache;
+    std::string mSegmentationSettings;
+    std::string mNormalizationSettings;
+    std::string mEncodingSettings;
+
+    // Progress of the run, saved periodically to resume it
+    std::string mFilenameCheckpoint;
+    int mCheckpointPeriod;
+    bool mResume;
+
+    // Part of the list processed by this run, from 1 to the number of shards (0 : the whole list)
+    int mShard;
+    int mNumberOfShards;
+    std::string mShardBalancing;
+    std::string mFilenameTimingLog;
+    std::string mOutputFileFixedPoint;
+    std::ofstream mFixedPointReport;
+    double mBitErrors;
+    double mComparedBits;
+
+    // Identification : each eye of the list is searched in the gallery, or by the workers which own its parts
+    std::string mFilenameGallery;
+    std::string mInputDirGalleryIrisCodes;
+    std::string mInputDirGalleryNormalizedMasks;
+    int mNumberOfCandidates;
+    std::string mSearchWorkers;
+    int mSearchThreads;
+    bool mNumaSearch;
+    std::string mGalleryIndex;
+    std::string mFilenameGalleryIndex;
+    int mLshTables;
+    int mLshBits;
+    int mLshMaskedBits;
+    int mBloomWordRows;
+    int mBloomBlockWidth;
+    int mBloomTrees;
+    int mBloomCandidates;
+    std::string mCascadeStages;
+    float mTreeSlack;
+    int mClusters;
+    int mClusterProbe;
+    int mIndexReportProbes;
+    int mRecallPeriod;
+    OsiGallery mGallery;
+    OsiSearchCluster mSearchCluster;
 
     // Parameters
     int mMinPupilDiameter;
     int mMaxPupilDiameter;
     int mMinIrisDiameter;
     int mMaxIrisDiameter;
+    int mCanonicalWidth;
+    float mTrackingConfidence;
+    int mNumberOfBestFrames;
+    float mMinFocus;
+    float mMaxOcclusion;
+    float mMinContrast;
+    int mMaxTimePerImage;
+    std::string mProfileName;
+    OsiProfile mProfile;
+    std::string mBenchmarkProfiles;
     int mWidthOfNormalizedIris;
     int mHeightOfNormalizedIris;
     std::string mFilenameGaborFilters;
     std::vector<CvMat *> mGaborFilters;
+    std::vector<CvMat *> mQuantizedGaborFilters;
     std::string mFilenameApplicationPoints;
     CvMat *mpApplicationPoints;
+    std::map<std::pair<int, int>, OsiSegmentationPlan *> mSegmentationPlans;
 
     // Suffix for filenames
     std::string mSuffixSegmentedImages;
@@ -105,6 +243,7 @@ class OsiManager
     // Maps to associate a string (conf file) to a variable (not the value of the variable !)
     std::map<std::string, bool *> mMapBool;
     std::map<std::string, int *> mMapInt;
+    std::map<std::string, float *> mMapFloat;
     std::map<std::string, std::string *> mMapString;
 
     // Private methods
@@ -115,6 +254,9 @@ class OsiManager
      * - For all directory/textfile paths : ""
      * - Minimum and maximum diameter for the pupil : 21 - 91 pixels
      * - Minimum and maximum diameter for the iris : 99 - 399 pixels
+     * - No canonical width : segmentation at native resolution
+     * - Entries of the list are images, not sequences (tracking confidence is 0.7 for sequences)
+     * - No quality assessment, thresholds accept all images, all frames of a sequence are processed
      * - Size of normalized iris : 512 x 64
      * - Gabor filter bank is empty
      * - Application points matrix is blank
@@ -144,6 +286,41 @@ class OsiManager
      */
     void loadGaborFilters();
 
+    /** Load a bank of filters from a textfile (same structure as the Gabor filters).
+     * @param rFilename The textfile
+     * @param rFilters [out] The filters, to be released by the caller
+     * @return void
+     * @see loadGaborFilters()
+     */
+    static void loadFilterBank(const std::string &rFilename, std::vector<CvMat *> &rFilters);
+
+    /** Get the pack file used instead of a directory of the configuration.
+     * A directory is a pack file when its name ends with ".pack" :
+     * the files are then entries of the pack. The pack is opened (or created) the first time.
+     * @param rDir The directory of an option "Load ..." or "Save ..."
+     * @return The pack file, or 0 if rDir is a directory
+     * @see OsiPackFile
+     */
+    OsiPackFile *getPack(const std::string &rDir);
+
+    /** Get the path of a file in a directory of the configuration.
+     * @param rDir The directory (or pack file) of an option "Load ..." or "Save ..."
+     * @param rName The name of the file
+     * @return The complete path, or the name of the entry if rDir is a pack file
+     */
+    std::string getPath(const std::string &rDir, const std::string &rName) const;
+
+    /** Close all pack files (and save their index).
+     * @return void
+     */
+    void closePacks();
+
+    /** Load the impostor pairs (list of names, read two by two).
+     * @param rPairs [out] The names of the impostor pairs (empty if there is no file)
+     * @return void
+     */
+    void loadImpostorPairs(std::vector<std::string> &rPairs);
+
     /** Load the application points.
      * The application points are stored in a textfile
      * according to a specific structure (see documentation of Osiris).
@@ -152,12 +329,200 @@ class OsiManager
      */
     void loadApplicationPoints();
 
+    /** Get the scale of segmentation for an image size.
+     * Images wider than the canonical width are segmented at the canonical width,
+     * so that the cost of segmentation does not depend on the resolution of the sensor.
+     * @param rSize The size of the original image
+     * @return The ratio between canonical and original resolutions (1 if there is no canonical width)
+     * @see OsiEye::segment()
+     */
+    float getSegmentationScale(const CvSize &rSize);
+
+    /** Get the segmentation plan for an image size.
+     * The plan is built from the diameters of the configuration the first time it is needed,
+     * then kept for its image size : a list mixing several sizes builds one plan per size.\n
+     * For images larger than the canonical width, the plan is built at the canonical resolution.
+     * @param rSize The size of the original image
+     * @return The segmentation plan
+     * @see OsiSegmentationPlan
+     */
+    const OsiSegmentationPlan &getSegmentationPlan(const CvSize &rSize);
+
     /** Load, segment, normalize, encode, and save according to user configuration.
+     * The original image is not loaded if the eye already has one (frame of a sequence).
+     * The clock of the eye is started with the maximum time per image, the result
+     * (elapsed time, degradation level, status) is written in the processing log (if any).
      * @param rName The eye name (used to name the loading/saving files)
      * @param rEye The eye to be processed
-     * @return void
+     * @param pTracker An optional tracker, when the eye is a frame of a sequence
+     * @param checkEyeQuality False if the quality was already checked
+     * @return True if the eye is accepted, false if its quality is rejected (no iris code is built)
      * @see OsiEye
      */
-    void processOneEye(const std::string &rName, OsiEye &rEye);
+    bool processOneEye(const std::string &rName, OsiEye &rEye, OsiTracker *pTracker = 0,
+                       bool checkEyeQuality = true);
+
+    /** Check the quality of an eye before segmentation.
+     * Compare focus, occlusion and contrast to the thresholds of the configuration,
+     * report rejected eyes in prompt command and all eyes in the quality report (if any).
+     * @param rName The eye name
+     * @param rEye The eye, with its original image
+     * @param rScore [out] The quality score used to rank frames : focus * contrast * (1 - occlusion)
+     * @return True if the eye is accepted
+     * @see OsiEye::assessQuality()
+     */
+    bool checkQuality(const std::string &rName, OsiEye &rEye, float &rScore);
+
+    /** Keep the part of the list of the shard, and name the outputs after the shard.
+     * @return void
+     */
+    void applyShard();
+
+    /** Get the cost of each entry of the list, used to balance the shards.
+     * @param rCosts [out] The costs, in the order of the list
+     * @return void
+     */
+    void getCostsOfImages(std::vector<double> &rCosts);
+
+    /** Load the eyes of a part of the gallery list (iris codes, and normalized masks if any), and its index.
+     * @param shard Part of the gallery, from 1 to nShards (0 : the whole gallery)
+     * @param nShards Number of parts
+     * @param rebuildIndex True to build the index even if it is saved
+     * @return void
+     */
+    void loadGallery(int shard, int nShards, bool rebuildIndex);
+
+    /** Search an eye in the gallery, and save the scores of its candidates.
+     * @param rName Name of the eye in the list
+     * @param rEye The eye, with its iris code
+     * @param rScores The file of scores
+     * @return void
+     */
+    void identify(const std::string &rName, OsiEye &rEye, OsiScoreWriter &rScores);
+
+    /** Read the checkpoint of a previous run, and cut the outputs to their size at the checkpoint.
+     * The scores and reports written after the checkpoint belong to entries which are processed again.
+     * @param rNext [out] The first entry of the list which is not done
+     * @return False if there is no checkpoint
+     */
+    bool loadCheckpoint(int &rNext);
+
+    /** Save the checkpoint : the entries before rNext are done.
+     * The outputs are flushed first, then the checkpoint replaces the previous one atomically
+     * (written in a temporary file, then renamed).
+     * @param next The first entry of the list which is not done
+     * @param rScores The file of matching scores (may be closed)
+     * @return void
+     */
+    void saveCheckpoint(int next, OsiScoreWriter &rScores);
+
+    /** Open the result cache and describe the settings of each stage.
+     * The results of a stage are reused when the original image and the settings of the stage
+     * and of the previous stages are unchanged.
+     * @return void
+     */
+    void initResultCache();
+
+    /** Run the steps of processOneEye().
+     * With a result cache, the segmentation (parameters and mask), the normalization (normalized image
+     * and mask) and the encoding (iris code) are read from the cache when they are found, and saved
+     * in the cache when they are computed (unless the eye was processed with a degraded profile).
+     * @param rName The eye name
+     * @param rEye The eye to be processed
+     * @param pTracker An optional tracker
+     * @param checkEyeQuality False if the quality was already checked
+     * @return False if the eye was rejected by the quality check
+     */
+    bool processSteps(const std::string &rName, OsiEye &rEye, OsiTracker *pTracker, bool checkEyeQuality);
+
+    /** Write the result of an eye in the processing log (if any).
+     * @param rName The eye name
+     * @param rEye The processed eye
+     * @param rStatus The status ("done", "rejected" or the error message)
+     * @return void
+     */
+    void logProcessing(const std::string &rName, const OsiEye &rEye, const std::string &rStatus);
+
+    /** Get the filters used to encode : the Gabor filters, or their quantized version for the fixed-point encoding.
+     * @return The filters
+     */
+    const std::vector<CvMat *> &getEncodingFilters() const;
+
+    /** Compare the fixed-point iris code of an eye to the floating-point code, and write it in the report.
+     * @param rName The eye name
+     * @param rEye The eye, encoded in fixed point
+     * @return void
+     */
+    void validateFixedPoint(const std::string &rName, OsiEye &rEye);
+
+    /** Process one frame of a sequence.
+     * Errors are displayed and reset the tracker, so that the sequence goes on.
+     * @param rName The frame name
+     * @param rFrame The grayscale frame
+     * @param rTracker The tracker of the sequence
+     * @param checkFrameQuality False if the quality was already checked
+     * @return void
+     */
+    void processFrame(const std::string &rName, const cv::Mat &rFrame, OsiTracker &rTracker, bool checkFrameQuality);
+
+    /** Process all frames of a sequence.
+     * The sequence is a video file or numbered images (such as "burst_%03d.bmp"),
+     * in the directory of original images. Each frame is processed as an eye named
+     * after the sequence and the frame index. The pupil and iris of a frame are the prior
+     * of the next frame, the full search is run again when the tracking confidence drops.\n
+     * If a number of best frames is configured, the whole sequence is read and ranked first,
+     * then only the best frames are processed.
+     * @param rFileName The sequence name
+     * @return void
+     * @see processOneEye() , OsiTracker
+     */
+    void processSequence(const std::string &rFileName);
+
+    /** Process the images of the list streamed from a tar archive (the path of original images).
+     * The members are read and decoded in memory in the order of the archive : nothing is extracted.
+     * A member is an image of the list when its path in the archive, or its file name, is in the list.
+     * If matching is requested, an eye is kept until the other eye of its pair is read,
+     * then the pair is matched. Images of the list missing from the archive are reported at the end.
+     * @param rScores The file of matching scores (may be closed)
+     * @return void
+     * @see OsiTarReader
+     */
+    void processArchive(OsiScoreWriter &rScores);
+
+    /** Compare the speed and the accuracy of profiles.
+     * For each profile, the images of the list (genuine pairs, as for matching) and of the impostor pairs
+     * are segmented, normalized and encoded in memory (nothing is saved), then the pairs are matched.
+     * The throughput (images per second) and the EER are displayed and saved in the benchmark report (if any).
+     * @return void
+     * @see OsiProfile , OsiEvaluation
+     */
+    void runBenchmark();
+
+    /** Process an eye for the benchmark, unless it was already processed with the current profile.
+     * @param rName The image name
+     * @param rProfile The profile
+     * @param rEyes [in,out] The eyes already processed (0 for failures), owned by the caller
+     * @param rSeconds [in,out] Accumulated processing time
+     * @return The processed eye, or 0 if processing failed
+     */
+    OsiEye *processBenchmarkEye(const std::string &rName, const OsiProfile &rProfile,
+                                std::map<std::string, OsiEye *> &rEyes, double &rSeconds);
+
+    /** Compare several banks of filters on the same normalized images.
+     * The images of the list (genuine pairs) and of the impostor pairs are normalized once
+     * (or their normalized images are loaded) and kept in memory. Then each bank encodes all images
+     * and matches the pairs, several banks at the same time (one thread per bank).
+     * No iris code is saved. The score distributions and the EER of each bank are displayed
+     * and saved in the sweep report (if any).
+     * @return void
+     * @see OsiEye::computeIrisCode() , OsiEvaluation
+     */
+    void runSweep();
+
+    /** Prepare an eye for the sweep : load its normalized image, or segment and normalize it.
+     * @param rName The image name
+     * @return The eye with its normalized image, or 0 if processing failed
+     */
+    OsiEye *processSweepEye(const std::string &rName);
 
 }; // End of class
@@ -0,0 +1,107 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <string>
+
+#include <opencv2/core/core_c.h>
+
+/** Memory-mapped uncompressed grayscale image.
+ * Reads 8-bit BMP (uncompressed, gray palette), binary PGM (P5, maxval 255)
+ * and raw files (rows of bytes, size given by the caller) without decoding them :
+ * the file is mapped in memory and an image header points to its pixel rows,
+ * with the padding of the file as step.\n
+ * Rows of a bottom-up BMP are stored in reverse order : the header then gives
+ * the rows as in the file, and cloneImage() puts them back in order.\n
+ * The mapping is private : writing in the image does not change the file.
+ * @see OsiEye::loadImage()
+ */
+class OsiMappedImage
+{
+
+  public:
+    /** Default constructor. */
+    OsiMappedImage();
+
+    /** Default destructor.
+     * Unmap the file.
+     */
+    ~OsiMappedImage();
+
+    /** Map an image file.
+     * @param rFilename Complete path of the image
+     * @param rRawSize Size of raw files (files without header), (0,0) if raw files are not expected
+     * @return False if the file cannot be mapped or is not an uncompressed 8-bit grayscale image
+     * (it must then be decoded)
+     */
+    bool open(const std::string &rFilename, const CvSize &rRawSize = cvSize(0, 0));
+
+    /** Unmap the file.
+     * @return void
+     */
+    void close();
+
+    /** Check if a file is mapped. */
+    bool isOpen() const;
+
+    /** Check if the rows of the file are in reverse order (bottom-up BMP). */
+    bool isBottomUp() const;
+
+    /** Get the header of the mapped image.
+     * The rows are in the order of the file (see isBottomUp()).
+     * @return The header, valid until the file is closed, or 0 if no file is mapped
+     */
+    IplImage *getImage();
+
+    /** Copy the mapped image, with its rows in order.
+     * @return A new image, to be released by the caller, or 0 if no file is mapped
+     */
+    IplImage *cloneImage() const;
+
+  private:
+    /** Not copyable : the object owns the mapping. */
+    OsiMappedImage(const OsiMappedImage &);
+    OsiMappedImage &operator=(const OsiMappedImage &);
+
+    /** The mapped file. */
+    unsigned char *mpData;
+    size_t mSize;
+
+    /** Handle of the mapping (Windows only). */
+    void *mpMapping;
+
+    /** Header on the pixel rows. */
+    IplImage mHeader;
+    bool mBottomUp;
+
+    /** Find the pixels of a BMP file : uncompressed, 8 bits, gray palette.
+     * @return False if the file cannot be read without decoding
+     */
+    bool parseBmp();
+
+    /** Find the pixels of a binary PGM file with maxval 255.
+     * @return False if the file cannot be read without decoding
+     */
+    bool parsePgm();
+
+    /** Map the file in memory.
+     * @return False if the file cannot be opened
+     */
+    bool map(const std::string &rFilename);
+
+    /** Set the header on the pixel rows.
+     * @param offset Position of the first row in the file
+     * @param width Width of the image
+     * @param height Height of the image
+     * @param step Distance between two rows in the file
+     * @return False if the rows are not all in the file
+     */
+    bool setHeader(size_t offset, int width, int height, int step);
+
+}; // end of class
@@ -0,0 +1,114 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Pack file : many small files (images, parameters) appended in one file.
+ * The pack starts with the tag "OSIPACK1", then each entry is stored as
+ * the length of its name (4 bytes), the size of its data (8 bytes), the name and the data.
+ * An entry written again replaces the previous one (the last one is read).\n
+ * The index (name, position and size of each entry) is saved in the file "<pack>.idx"
+ * when the pack is closed, so that the entries are found without reading the pack.
+ * If the index is missing or older than the pack, the pack is scanned instead.
+ * @see OsiManager , OsiEye
+ */
+class OsiPackFile
+{
+
+  public:
+    /** Default constructor. */
+    OsiPackFile();
+
+    /** Default destructor.
+     * Close the pack (and save the index).
+     */
+    ~OsiPackFile();
+
+    /** Open a pack for reading and appending, create it if it does not exist.
+     * @param rFilename Complete path of the pack
+     * @return void
+     */
+    void open(const std::string &rFilename);
+
+    /** Save the index if entries were added, and close the pack.
+     * @return void
+     */
+    void close();
+
+    /** Check if the pack contains an entry. */
+    bool contains(const std::string &rName) const;
+
+    /** Get the number of entries. */
+    int getNumberOfEntries() const;
+
+    /** Get the names of the entries.
+     * @param rNames [out] The names, in alphabetical order
+     * @return void
+     */
+    void getNames(std::vector<std::string> &rNames) const;
+
+    /** Read an entry.
+     * @param rName The name of the entry
+     * @param rData [out] The data of the entry
+     * @return False if there is no such entry
+     */
+    bool read(const std::string &rName, std::vector<unsigned char> &rData);
+
+    /** Append an entry at the end of the pack.
+     * @param rName The name of the entry (a file name, such as "image_mask.bmp")
+     * @param rData The data of the entry
+     * @return void
+     */
+    void write(const std::string &rName, const std::vector<unsigned char> &rData);
+
+  private:
+    /** Not copyable : the object owns the file. */
+    OsiPackFile(const OsiPackFile &);
+    OsiPackFile &operator=(const OsiPackFile &);
+
+    /** Position and size of the data of an entry. */
+    struct Entry
+    {
+        unsigned long long mOffset;
+        unsigned long long mSize;
+    };
+
+    /** The pack. */
+    std::string mFilename;
+    std::fstream mFile;
+
+    /** Size of the pack (position of the next entry). */
+    unsigned long long mSize;
+
+    /** True if entries were added since the pack was opened. */
+    bool mModified;
+
+    /** The entries, by name. */
+    std::map<std::string, Entry> mEntries;
+
+    /** Load the index, if it is up to date.
+     * @return False if the pack must be scanned
+     */
+    bool loadIndex();
+
+    /** Build the index by reading the headers of all entries.
+     * @return void
+     */
+    void scan();
+
+    /** Save the index.
+     * @return void
+     */
+    void saveIndex();
+
+}; // end of class
@@ -0,0 +1,128 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/** Asynchronous read-ahead of files.
+ * The files are given in the order they will be used. A window of upcoming files is read in the background
+ * and kept in memory, so that the caller takes the content of the next file without waiting for the storage.\n
+ * On Linux, the files are read with io_uring by a single thread (flag OSI_WITH_IO_URING, set when the
+ * kernel headers are found). Without io_uring, or if the kernel refuses it, a pool of threads reads the files.
+ * @see OsiManager::processSteps()
+ */
+class OsiPrefetcher
+{
+
+  public:
+    /** Default constructor. */
+    OsiPrefetcher();
+
+    /** Default destructor.
+     * Stop the reading.
+     */
+    ~OsiPrefetcher();
+
+    /** Start reading the files.
+     * @param rFilenames Complete paths of the files, in the order they will be taken
+     * @param window Maximum number of files read in advance (in flight or in memory)
+     * @param nThreads Number of threads reading the files if io_uring is not used
+     * @return void
+     */
+    void start(const std::vector<std::string> &rFilenames, int window, int nThreads);
+
+    /** Check if the files are read with io_uring. */
+    bool usesIoUring() const;
+
+    /** Take the content of a file, waiting for the end of its reading if needed.
+     * The files before it in the order are dropped.
+     * @param rFilename Complete path of the file
+     * @param rData [out] The content of the file
+     * @return False if the file is not read in advance (not started, not in the order, or failed to read) :
+     * the caller must read it
+     */
+    bool take(const std::string &rFilename, std::vector<unsigned char> &rData);
+
+    /** Stop the reading and free the files in memory.
+     * @return void
+     */
+    void stop();
+
+  private:
+    /** Not copyable : the object owns the threads. */
+    OsiPrefetcher(const OsiPrefetcher &);
+    OsiPrefetcher &operator=(const OsiPrefetcher &);
+
+    /** The files, in order. */
+    std::vector<std::string> mFilenames;
+    int mWindow;
+
+    /** Next file to read, next file to take. */
+    int mNextToRead;
+    int mNextToTake;
+
+    /** Files read and not taken yet, and files which could not be read. */
+    std::map<int, std::vector<unsigned char>> mFiles;
+    std::set<int> mFailed;
+
+    /** Threads reading the files, and number of threads still running. */
+    std::vector<std::thread> mThreads;
+    int mRunningThreads;
+    bool mStopping;
+    std::mutex mMutex;
+    std::condition_variable mReadCondition;
+    std::condition_variable mWindowCondition;
+
+    /** The io_uring (rings shared with the kernel), if any. */
+    struct Ring;
+    Ring *mpRing;
+
+    /** Check (with the mutex locked) if a file can be read in the window, or if the reading must end. */
+    bool canRead() const;
+
+    /** Give a file read by a thread.
+     * @param index Index of the file
+     * @param rData Its content (swapped)
+     * @param success False if the reading failed
+     * @return void
+     */
+    void deliver(int index, std::vector<unsigned char> &rData, bool success);
+
+    /** Mark a thread as finished.
+     * @return void
+     */
+    void finishThread();
+
+    /** Loop of a thread of the pool : read the files one at a time.
+     * @return void
+     */
+    void runReader();
+
+    /** Create the io_uring.
+     * @return False if io_uring is not available
+     */
+    bool openRing();
+
+    /** Release the io_uring, if any.
+     * @return void
+     */
+    void closeRing();
+
+    /** Loop of the thread of the io_uring : submit the reads of the window and collect them.
+     * @return void
+     */
+    void runRing();
+
+}; // end of class
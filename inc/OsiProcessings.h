@@ -17,7 +17,20 @@
 #define OSI_MAX_RATIO_PUPIL_IRIS 0.7f
 #define OSI_MIN_RATIO_PUPIL_IRIS 0.2f
 
+// Width of the downsampled image used to assess quality
+#define OSI_QUALITY_WIDTH 320
+
+// Width of the tiles of normalized iris convolved at once when encoding
+#define OSI_ENCODING_TILE_WIDTH 128
+
+// Number of fractional bits of the quantized filters (fixed-point encoding)
+#define OSI_FILTER_FRACTION_BITS 8
+
 #include "OsiCircle.h"
+#include "OsiDeadline.h"
+#include "OsiProfile.h"
+#include "OsiSegmentationPlan.h"
+#include "OsiTracker.h"
 
 /** Image processing functions.
  * Public functions are the main steps for iris recognition :
@@ -34,6 +47,22 @@ class OsiProcessings
     /** Default destructor. */
     ~OsiProcessings();
 
+    /** Attach a compute budget.
+     * Long loops (reconstruction, smoothing, pupil detection) are cut short when it is exceeded,
+     * and cheaper settings are used when its degradation level rises.
+     * @param pDeadline The budget, or 0 for none (default)
+     * @return void
+     * @see OsiDeadline
+     */
+    void setDeadline(OsiDeadline *pDeadline);
+
+    /** Set the speed/accuracy profile used by the segmentation.
+     * @param rProfile The profile ("balanced" by default)
+     * @return void
+     * @see OsiProfile
+     */
+    void setProfile(const OsiProfile &rProfile);
+
     /** Find inner and outer boundaries of iris.
      * Detect and locate the pupil. Smooth the image using the Anisotropic Smoothing.
      * Extract the radial gradients using Sobel operator.
@@ -61,6 +90,43 @@ class OsiProcessings
                  int minIrisDiameter = OSI_SMALLEST_IRIS, int minPupilDiameter = OSI_SMALLEST_PUPIL,
                  int maxIrisDiameter = 0, int maxPupilDiameter = 0);
 
+    /** Find inner and outer boundaries of iris using a precomputed plan.
+     * Same as the other segment() function, but kernels, structuring elements
+     * and angle tables are read from the plan instead of being built for each image.
+     * @param [in] pSrc An eye image
+     * @param [out] pMask The mask of iris. Must be created before the function segment
+     * @param [out] rPupil The circle for the pupil
+     * @param [out] rIris The circle for the iris
+     * @param [in] rPlan A plan built for the size of pSrc
+     * @param [in,out] pTracker An optional tracker (sequence of frames). If it knows a previous frame,
+     * the pupil is searched around the previous pupil and the contour bands are narrowed,
+     * unless the response of the detector is not confident enough. Updated with the result.
+     * @return void
+     * @see OsiSegmentationPlan , OsiTracker
+     */
+    void segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &rPupil, OsiCircle &rIris,
+                 std::vector<float> &rThetaCoarsePupil, std::vector<float> &rThetaCoarseIris,
+                 std::vector<CvPoint> &rCoarsePupilContour, std::vector<CvPoint> &rCoarseIrisContour,
+                 const OsiSegmentationPlan &rPlan, OsiTracker *pTracker = 0);
+
+    /** Assess the quality of an eye image before segmentation.
+     * All measures are computed on the image downsampled to OSI_QUALITY_WIDTH pixels wide, so they are cheap
+     * compared to segment().\n
+     * - focus : standard deviation of the Laplacian (grey levels). Low for blurred images\n
+     * - occlusion : mean of the darkest pupil-sized disk divided by the mean of the image.
+     * Close to 1 when no dark pupil is visible (closed eye, strongly off-axis gaze)\n
+     * - contrast : range between the 5th and 95th percentiles of grey levels, divided by 255
+     * @param [in] pSrc An eye image
+     * @param [in] minPupilDiameter The minimum diameter of the pupil in pSrc
+     * @param [out] rFocus The focus measure
+     * @param [out] rOcclusion The occlusion measure, between 0 and 1
+     * @param [out] rContrast The contrast measure, between 0 and 1
+     * @return void
+     * @see segment() , OsiEye::assessQuality()
+     */
+    void assessQuality(const IplImage *pSrc, int minPupilDiameter, float &rFocus, float &rOcclusion,
+                       float &rContrast);
+
     /** Normalize iris by Daugman's rubber sheet method.
      * Use the function segment() to obtain pupil and iris contours.
      * @param pSrc The source image
@@ -90,6 +156,9 @@ class OsiProcessings
                         const float theta);
 
     /** Encode the iris texture into a binary image.
+     * Filters of type CV_32FC1 are applied in floating point, filters of type CV_16SC1
+     * (see quantizeFilters()) are applied in fixed point : 8-bit pixels times 16-bit coefficients,
+     * accumulated in 32-bit integers.
      * @param pSrc The normalized iris obtained by function normalize()
      * @param pDst The binary iris code. Must be created BEFORE this function.
      * @param rFilters The bank of Gabor filters used to encode the iris texture.
@@ -98,16 +167,77 @@ class OsiProcessings
      */
     void encode(const IplImage *pSrc, IplImage *pDst, const std::vector<CvMat *> &rFilters);
 
+    /** Normalize and encode in one pass, without materializing the normalized image.
+     * The rubber sheet is sampled once, directly into a buffer with wrapping borders
+     * (the left and right borders of the normalized iris are the two ends of the same circle),
+     * then the Gabor filters are applied to this buffer tile by tile.
+     * The iris code is the same as normalizeFromContour() followed by encode().
+     * @param pSrc The source image
+     * @param pMask The mask of the source image
+     * @param pDstCode The binary iris code. Must be created BEFORE this function
+     * (height = normalized height * number of filters).
+     * @param pDstMask The normalized mask. Must be created BEFORE this function.
+     * @param rPupil The circle modeling the pupil
+     * @param rIris The circle modeling the iris
+     * @param rThetaCoarsePupil The angles of the pupil coarse contour
+     * @param rThetaCoarseIris The angles of the iris coarse contour
+     * @param rPupilCoarseContour The pupil coarse contour
+     * @param rIrisCoarseContour The iris coarse contour
+     * @param rFilters The bank of Gabor filters used to encode the iris texture
+     * @return void
+     * @see normalizeFromContour() , encode() , OsiEye::normalizeAndEncode()
+     */
+    void normalizeAndEncode(const IplImage *pSrc, const IplImage *pMask, IplImage *pDstCode, IplImage *pDstMask,
+                            const OsiCircle &rPupil, const OsiCircle &rIris,
+                            const std::vector<float> &rThetaCoarsePupil, const std::vector<float> &rThetaCoarseIris,
+                            const std::vector<CvPoint> &rPupilCoarseContour,
+                            const std::vector<CvPoint> &rIrisCoarseContour, const std::vector<CvMat *> &rFilters);
+
     /** Match two iris codes.
      * @param image1 First binary iris code, obtained by function encode()
      * @param image2 Second binary iris code, obtained by function encode()
      * @param mask Mask of matching. Same size as image1 and image2.
+     * @param shift Maximum shift (in pixels) tested to compensate the rotation of the eye
      * @return The macthing score between 0 (completely similar) and 1 (completely different)
      * @see encode() , OsiEye::match()
      */
-    float match(const IplImage *image1, const IplImage *image2, const IplImage *mask);
+    float match(const IplImage *image1, const IplImage *image2, const IplImage *mask, int shift = 10);
+
+    /** Quantize a bank of filters for the fixed-point encoding.
+     * Coefficients are rounded to OSI_FILTER_FRACTION_BITS fractional bits (fewer if the filter is large,
+     * so that the convolution of 8-bit pixels cannot overflow 32 bits). Only the sign of the convolution
+     * is used by the encoding, so the scale of each filter does not need to be kept.
+     * @param rFilters [in] The filters, CV_32FC1
+     * @param rQuantized [out] The quantized filters, CV_16SC1, to be released by the caller
+     * @return void
+     * @see encode()
+     */
+    void quantizeFilters(const std::vector<CvMat *> &rFilters, std::vector<CvMat *> &rQuantized);
+
+    /** Count the bits that differ between two iris codes.
+     * @param pCode1 First binary iris code
+     * @param pCode2 Second binary iris code, same size
+     * @return The number of different pixels
+     */
+    int countDifferentBits(const IplImage *pCode1, const IplImage *pCode2);
 
   private:
+    /** Optional compute budget (not owned). */
+    OsiDeadline *mpDeadline;
+
+    /** Speed/accuracy profile. */
+    OsiProfile mProfile;
+
+    /** Check if the long loops must stop.
+     * @return True if a budget is attached and it is exceeded
+     */
+    bool isCancelled() const;
+
+    /** Get the settings to use now : the profile, degraded if the budget is at risk.
+     * @return The current settings
+     */
+    OsiProfile getSettings();
+
     /** Add borders on left and right of unwrapped image.
      * @param pImage The original image
      * @param width The border width
@@ -116,6 +246,37 @@ class OsiProcessings
      */
     IplImage *addBorders(const IplImage *pImage, int width);
 
+    /** Get the half-width of the widest filter of a bank.
+     * @param rFilters The bank of filters
+     * @return The half-width, which is the width of the wrapping borders needed to convolve
+     */
+    int getMaxHalfWidth(const std::vector<CvMat *> &rFilters);
+
+    /** Encode a normalized iris which already has its wrapping borders.
+     * The convolution is computed on tiles of OSI_ENCODING_TILE_WIDTH columns (plus the borders),
+     * and thresholded directly in the iris code.
+     * @param pBordered The normalized iris with wrapping borders on left and right
+     * @param border The width of the borders, at least the half-width of the widest filter
+     * @param pDst The binary iris code. Must be created BEFORE this function.
+     * @param rFilters The bank of Gabor filters
+     * @return void
+     * @see encode() , normalizeAndEncode() , addBorders()
+     */
+    void encodeWithBorders(const IplImage *pBordered, int border, IplImage *pDst, const std::vector<CvMat *> &rFilters);
+
+    /** Convolve a tile with a quantized filter and threshold the result.
+     * Rows out of the image are replicated, as cvFilter2D does.
+     * @param pSrc The tile with its left and right borders, 8-bit
+     * @param border The width of the borders
+     * @param pFilter The quantized filter, CV_16SC1
+     * @param pDst The part of the iris code corresponding to the tile (without borders)
+     * @param rAccumulator A buffer for one row of 32-bit sums
+     * @return void
+     * @see encodeWithBorders() , quantizeFilters()
+     */
+    void filterFixedPoint(const CvMat *pSrc, int border, const CvMat *pFilter, IplImage *pDst,
+                          std::vector<int> &rAccumulator);
+
     /** Convert polar coordinates to cartesian coordinates.
      * @param rCenter The reference center in cartesian coordinates
      * @param rRadius The radius coordinate
@@ -128,30 +289,35 @@ class OsiProcessings
      * @param pMarker [in] A binary image. The "on" pixels are to be reconstructed
      * @param pMask [in] A binary image. The "off" pixels will not be reconstructed
      * @param pDst [out] The destination image. Must be created BEFORE this function.
+     * @param pStructuringElement [in] An optional 3x3 elliptic structuring element (built if not provided)
      * @return void
      * @see fillWhiteHoles()
      */
-    void reconstructMarkerByMask(const IplImage *pMarker, const IplImage *pMask, IplImage *pDst);
+    void reconstructMarkerByMask(const IplImage *pMarker, const IplImage *pMask, IplImage *pDst,
+                                 IplConvKernel *pStructuringElement = 0);
 
     /** Fill white holes such as spotlights (specular reflections).
      * @param pSrc [in] The source image
      * @param pDst [out] The destination image
+     * @param pStructuringElement [in] An optional 3x3 elliptic structuring element (built if not provided)
      * @return void
      * @see reconstructMarkerByMask()
      */
-    void fillWhiteHoles(const IplImage *pSrc, IplImage *pDst);
+    void fillWhiteHoles(const IplImage *pSrc, IplImage *pDst, IplConvKernel *pStructuringElement = 0);
 
     /** Detect a pupil inside an image.
-     * The optional arguments limit the search domain.
+     * The plan gives the downsampling scale and the kernels for each tested radius.
+     * The optional prior limits the search domain to a window around the prior center
+     * and to radii close to the prior radius.
      * @param pSrc [in] The source image
      * @param rPupil [out] The detected pupil
-     * @param minPupilDiameter [in] The minimum diameter for detecting the pupil
-     * @param maxPupilDiameter [in] The maximum diameter for detecting the pupil
-     * @return void
-     * @see segment() , fillWhiteHoles()
+     * @param rPlan [in] The segmentation plan
+     * @param pPrior [in] An optional prior for the pupil (previous frame)
+     * @return The response of the detector (contour + darkness) for the detected pupil
+     * @see segment() , fillWhiteHoles() , OsiSegmentationPlan
      */
-    void detectPupil(const IplImage *pSrc, OsiCircle &rPupil, int minPupilDiameter = OSI_SMALLEST_PUPIL,
-                     int maxPupilDiameter = 0);
+    double detectPupil(const IplImage *pSrc, OsiCircle &rPupil, const OsiSegmentationPlan &rPlan,
+                       const OsiCircle *pPrior = 0);
 
     /** Show an image (rescale if needed).
      * @param pImage An image
@@ -0,0 +1,69 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <string>
+
+/** Speed/accuracy profile.
+ * Gathers the cost parameters of the processing functions under a name :
+ * - "fast" : fewer smoothing iterations, narrower bands, coarser contours, fewer shifts
+ * - "balanced" : the historical settings of Osiris (default)
+ * - "accurate" : more smoothing iterations, wider bands, more shifts\n
+ * A profile can also be degraded when the time budget of an eye is at risk.
+ * @see OsiProcessings , OsiDeadline
+ */
+class OsiProfile
+{
+
+  public:
+    /** Build a named profile.
+     * @param rName One of "fast", "balanced", "accurate"
+     */
+    OsiProfile(const std::string &rName = "balanced");
+
+    /** Default destructor. */
+    ~OsiProfile();
+
+    /** Get the name of the profile. */
+    const std::string &getName() const;
+
+    /** Get the number of iterations of the anisotropic smoothing (contours). */
+    int getSmoothingIterations() const;
+
+    /** Get the half-width (in pixels) of the band in which the pupil contours are searched. */
+    int getPupilBand() const;
+
+    /** Get the factor applied to the angular step of the contours (1 = one sample per pixel). */
+    float getThetaStepFactor() const;
+
+    /** Get the maximum shift (in pixels) tested at matching. */
+    int getMatchShift() const;
+
+    /** Get the threshold of the noise mask, as a multiple of the standard deviation of the iris. */
+    float getNoiseThreshold() const;
+
+    /** Get a cheaper version of the profile.
+     * @param degradationLevel The degradation level, 0 for the profile itself
+     * @return The degraded profile
+     * @see OsiDeadline
+     */
+    OsiProfile getDegraded(int degradationLevel) const;
+
+  private:
+    /** The name of the profile. */
+    std::string mName;
+
+    /** Cost parameters. */
+    int mSmoothingIterations;
+    int mPupilBand;
+    float mThetaStepFactor;
+    int mMatchShift;
+    float mNoiseThreshold;
+
+}; // end of class
@@ -0,0 +1,57 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "OsiScoreWriter.h"
+
+/** Reader of the files of matching scores written by OsiScoreWriter.
+ * The scores are read one at a time, in the order of the file, in the text or in the binary format.
+ * @see OsiScoreWriter , OsiManager::mergeShards()
+ */
+class OsiScoreReader
+{
+
+  public:
+    /** Default constructor. */
+    OsiScoreReader();
+
+    /** Open a file of scores.
+     * @param rFilename Complete path of the file
+     * @param format OSI_SCORES_TEXT or OSI_SCORES_BINARY
+     * @return void
+     */
+    void open(const std::string &rFilename, int format = OSI_SCORES_TEXT);
+
+    /** Read the next score.
+     * @param rProbe [out] Name of the first image
+     * @param rGallery [out] Name of the second image
+     * @param rScore [out] The matching score
+     * @return False at the end of the file
+     */
+    bool read(std::string &rProbe, std::string &rGallery, float &rScore);
+
+    /** Close the file.
+     * @return void
+     */
+    void close();
+
+  private:
+    /** The file of scores. */
+    std::string mFilename;
+    std::ifstream mFile;
+    int mFormat;
+
+    /** Names by id (binary format). */
+    std::vector<std::string> mNames;
+
+}; // end of class
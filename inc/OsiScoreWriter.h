@@ -0,0 +1,124 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Formats of the file of matching scores
+#define OSI_SCORES_TEXT 0
+#define OSI_SCORES_BINARY 1
+
+// Size of the buffer of the file of matching scores
+#define OSI_SCORES_BUFFER_SIZE (1 << 20)
+
+/** Writer of matching scores.
+ * Scores are written through a large buffer, in one of two formats :
+ * - text : one line "probe gallery score" per comparison
+ * - binary : the tag "OSISCOR1", then 12 bytes per comparison (id of the probe, id of the gallery image
+ * as 32-bit integers, score as a 32-bit float, little-endian). The names are listed in "<file>.names",
+ * one per line : the id is the line number, starting from 0.\n
+ * Scores above a maximum are dropped. If a number of best scores is given, only the best (lowest)
+ * scores of each probe are kept, and written in increasing order when the writer is closed.
+ * @see OsiManager::run()
+ */
+class OsiScoreWriter
+{
+
+  public:
+    /** Default constructor. */
+    OsiScoreWriter();
+
+    /** Default destructor.
+     * Close the file.
+     */
+    ~OsiScoreWriter();
+
+    /** Get the format given by its name in the configuration.
+     * @param rName "text" or "binary"
+     * @return OSI_SCORES_TEXT or OSI_SCORES_BINARY
+     */
+    static int getFormat(const std::string &rName);
+
+    /** Create the file of scores.
+     * @param rFilename Complete path of the file
+     * @param format OSI_SCORES_TEXT or OSI_SCORES_BINARY
+     * @param bestScoresPerProbe Number of scores kept for each probe, 0 to keep all scores
+     * @param maxScore Scores above are dropped
+     * @param append True to add the scores at the end of an existing file (the names already listed keep their id)
+     * @return void
+     */
+    void open(const std::string &rFilename, int format = OSI_SCORES_TEXT, int bestScoresPerProbe = 0,
+              float maxScore = 1, bool append = false);
+
+    /** Check if the file is open. */
+    bool isOpen() const;
+
+    /** Add the score of a comparison.
+     * @param rProbe Name of the first image
+     * @param rGallery Name of the second image
+     * @param score The matching score
+     * @return void
+     */
+    void write(const std::string &rProbe, const std::string &rGallery, float score);
+
+    /** Write the buffered scores in the file (the kept best scores are only written by close()).
+     * @return void
+     */
+    void flush();
+
+    /** Write the best scores of all probes (if they are kept) and close the file.
+     * @return void
+     */
+    void close();
+
+  private:
+    /** Not copyable : the object owns the file. */
+    OsiScoreWriter(const OsiScoreWriter &);
+    OsiScoreWriter &operator=(const OsiScoreWriter &);
+
+    /** The file of scores, and its buffer. */
+    std::string mFilename;
+    std::ofstream mFile;
+    std::vector<char> mBuffer;
+
+    /** The list of names (binary format). */
+    std::ofstream mNamesFile;
+
+    /** Options. */
+    int mFormat;
+    int mBestScoresPerProbe;
+    float mMaxScore;
+
+    /** Ids of the images, by name, and names by id. */
+    std::map<std::string, int> mIds;
+    std::vector<std::string> mNames;
+
+    /** Best scores (and id of the gallery image) of each probe, as max-heaps, and probes in order of arrival. */
+    std::vector<std::vector<std::pair<float, int>>> mBestScores;
+    std::vector<int> mProbes;
+
+    /** Get the id of an image, a new one the first time.
+     * @param rName The name of the image
+     * @return The id
+     */
+    int getId(const std::string &rName);
+
+    /** Write a score in the file.
+     * @param probe Id of the probe
+     * @param gallery Id of the gallery image
+     * @param score The score
+     * @return void
+     */
+    void output(int probe, int gallery, float score);
+
+}; // end of class
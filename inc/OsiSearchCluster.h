@@ -0,0 +1,75 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "OsiGallery.h"
+
+/** Identification distributed over worker processes.
+ * Each worker owns a part of the gallery and serves it on a socket. The coordinator sends each probe
+ * (its template) to all workers at once, then merges their best candidates : the scores and the order
+ * of the candidates are the ones of a search in the whole gallery.\n
+ * The addresses are "unix:<path>" for a Unix socket, or "tcp:<host>:<port>" (or "<host>:<port>").
+ * A worker serves one coordinator at a time. Sockets are not available on Windows.
+ * @see OsiGallery , OsiManager::serveGallery()
+ */
+class OsiSearchCluster
+{
+
+  public:
+    /** Default constructor. */
+    OsiSearchCluster();
+
+    /** Default destructor.
+     * Close the connections.
+     */
+    ~OsiSearchCluster();
+
+    /** Connect to the workers.
+     * @param rAddresses Addresses of the workers, separated by spaces or commas
+     * @return void
+     */
+    void connect(const std::string &rAddresses);
+
+    /** Check if the coordinator is connected to workers. */
+    bool isConnected() const;
+
+    /** Search a probe in the galleries of all workers.
+     * @param rProbe The probe, with its iris code
+     * @param k Number of candidates, 0 for all eyes of the galleries
+     * @param rCandidates [out] The best candidates, best first
+     * @return void
+     */
+    void search(const OsiEye &rProbe, int k, std::vector<OsiCandidate> &rCandidates);
+
+    /** Close the connections.
+     * @return void
+     */
+    void close();
+
+    /** Serve a gallery (worker) until the process is stopped.
+     * The statistics of the gallery are shown each time a coordinator disconnects.
+     * @param rGallery The part of the gallery owned by the worker
+     * @param rAddress Address on which the worker listens
+     * @return void
+     */
+    static void serve(OsiGallery &rGallery, const std::string &rAddress);
+
+  private:
+    /** Not copyable : the object owns the connections. */
+    OsiSearchCluster(const OsiSearchCluster &);
+    OsiSearchCluster &operator=(const OsiSearchCluster &);
+
+    /** Connections to the workers, and their addresses. */
+    std::vector<int> mSockets;
+    std::vector<std::string> mAddresses;
+
+}; // end of class
@@ -0,0 +1,172 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <vector>
+
+#include "OsiCircle.h"
+
+// Kinds of angle tables used by the segmentation
+#define OSI_THETA_PUPIL_ACCURATE 0
+#define OSI_THETA_PUPIL_COARSE 1
+#define OSI_THETA_IRIS_COARSE 2
+#define OSI_THETA_IRIS_ACCURATE 3
+#define OSI_THETA_KINDS 4
+
+/** Segmentation plan.
+ * Contains everything the segmentation needs that only depends on
+ * the diameter ranges and on the image size : the checked diameters,
+ * the directional kernels and ring/disk masks used to detect the pupil,
+ * the structuring elements and the angle tables used to find the contours.\n
+ * A plan is built once, then only read : the same plan can be shared
+ * by all eyes of a batch (and by several threads).
+ * @see OsiProcessings::segment()
+ * @see OsiManager
+ */
+class OsiSegmentationPlan
+{
+
+  public:
+    /** Build the plan.
+     * Check the diameters exactly as the segmentation does
+     * (warnings are displayed once here instead of once per image),
+     * then precompute all kernels, masks and tables.
+     * @param width Width of the images to segment
+     * @param height Height of the images to segment
+     * @param minIrisDiameter The minimum diameter for segmenting the iris
+     * @param minPupilDiameter The minimum diameter for segmenting the pupil
+     * @param maxIrisDiameter The maximum diameter for segmenting the iris
+     * @param maxPupilDiameter The maximum diameter for segmenting the pupil
+     */
+    OsiSegmentationPlan(int width, int height, int minIrisDiameter, int minPupilDiameter, int maxIrisDiameter = 0,
+                        int maxPupilDiameter = 0);
+
+    /** Default destructor.
+     * Release all kernels, masks and structuring elements.
+     */
+    ~OsiSegmentationPlan();
+
+    /** Check if the plan can be used for an image.
+     * @param width Width of the image
+     * @param height Height of the image
+     * @return True if the plan was built for this image size
+     */
+    bool isCompatible(int width, int height) const;
+
+    /** Get the checked minimum diameter for the iris (odd). */
+    int getMinIrisDiameter() const;
+
+    /** Get the checked maximum diameter for the iris (odd). */
+    int getMaxIrisDiameter() const;
+
+    /** Get the scale used to downsample the image when detecting the pupil. */
+    float getPupilScale() const;
+
+    /** Get the number of radii tested when detecting the pupil. */
+    int getNumberOfPupilRadii() const;
+
+    /** Get the smallest radius tested when detecting the pupil (downsampled image). */
+    int getFirstPupilRadius() const;
+
+    /** Get the horizontal directional kernel restricted to the ring of the n-th radius. */
+    const CvMat *getHorizontalRingFilter(int n) const;
+
+    /** Get the vertical directional kernel restricted to the ring of the n-th radius. */
+    const CvMat *getVerticalRingFilter(int n) const;
+
+    /** Get the disk-shaped mask of the n-th radius. */
+    const CvMat *getDiskFilter(int n) const;
+
+    /** Get the normalization factor of the ring of the n-th radius (1/number of pixels). */
+    double getRingNormalization(int n) const;
+
+    /** Get the normalization factor of the disk of the n-th radius (1/number of pixels). */
+    double getDiskNormalization(int n) const;
+
+    /** Get the 3x3 elliptic structuring element (reconstruction, gradient). */
+    IplConvKernel *getSmallElement() const;
+
+    /** Get the 21x21 elliptic structuring element used to dilate the mask of iris. */
+    IplConvKernel *getIrisElement() const;
+
+    /** Get the 21x21 horizontal line-shape structuring element used to dilate the mask of pupil. */
+    IplConvKernel *getPupilElement() const;
+
+    /** Get the 11x11 elliptic structuring element used to erode the safe area. */
+    IplConvKernel *getSafeAreaElement() const;
+
+    /** Get an angle table.
+     * The table is read from the plan if it was precomputed for this radius and step,
+     * else it is computed in the buffer.
+     * @param kind One of OSI_THETA_PUPIL_ACCURATE, OSI_THETA_PUPIL_COARSE, OSI_THETA_IRIS_COARSE,
+     * OSI_THETA_IRIS_ACCURATE
+     * @param radius The radius of the contour
+     * @param rBuffer Storage used when the table is not precomputed
+     * @param stepFactor Multiplies the angular step (coarser sampling). Only tables with factor 1 are precomputed
+     * @return A vector of angles in radians
+     */
+    const std::vector<float> &getTheta(int kind, int radius, std::vector<float> &rBuffer, float stepFactor = 1) const;
+
+    /** Compute an angle table (sampling of the contour).
+     * @param kind One of OSI_THETA_PUPIL_ACCURATE, OSI_THETA_PUPIL_COARSE, OSI_THETA_IRIS_COARSE,
+     * OSI_THETA_IRIS_ACCURATE
+     * @param radius The radius of the contour
+     * @param rTheta [out] A vector of angles in radians
+     * @param stepFactor Multiplies the angular step (coarser sampling)
+     * @return void
+     */
+    static void computeTheta(int kind, int radius, std::vector<float> &rTheta, float stepFactor = 1);
+
+  private:
+    /** Not copyable : the plan owns its kernels. */
+    OsiSegmentationPlan(const OsiSegmentationPlan &);
+    OsiSegmentationPlan &operator=(const OsiSegmentationPlan &);
+
+    /** Size of the images. */
+    int mWidth;
+    int mHeight;
+
+    /** Checked diameters. */
+    int mMinIrisDiameter;
+    int mMaxIrisDiameter;
+
+    /** Downsampling scale for the pupil detection. */
+    float mPupilScale;
+
+    /** Smallest radius tested for the pupil (downsampled image). */
+    int mFirstPupilRadius;
+
+    /** Directional kernels masked by a ring, for each radius. */
+    std::vector<CvMat *> mHorizontalRingFilters;
+    std::vector<CvMat *> mVerticalRingFilters;
+
+    /** Disk-shaped masks, for each radius. */
+    std::vector<CvMat *> mDiskFilters;
+
+    /** Normalization factors, for each radius. */
+    std::vector<double> mRingNormalizations;
+    std::vector<double> mDiskNormalizations;
+
+    /** Structuring elements. */
+    IplConvKernel *mpSmallElement;
+    IplConvKernel *mpIrisElement;
+    IplConvKernel *mpPupilElement;
+    IplConvKernel *mpSafeAreaElement;
+
+    /** Angle tables, indexed by kind then by radius. */
+    std::vector<std::vector<float>> mThetas[OSI_THETA_KINDS];
+
+    /** Check the diameters and precompute the kernels of the pupil detection.
+     * @param minPupilDiameter The minimum diameter for detecting the pupil
+     * @param maxPupilDiameter The maximum diameter for detecting the pupil
+     * @return void
+     */
+    void buildPupilFilters(int minPupilDiameter, int maxPupilDiameter);
+
+}; // end of class
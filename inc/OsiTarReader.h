@@ -0,0 +1,96 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Compressions of archives
+#define OSI_TAR_NONE 0
+#define OSI_TAR_GZIP 1
+#define OSI_TAR_ZSTD 2
+
+/** Sequential reader of tar archives.
+ * The members (regular files) are read one after the other, in the order of the archive,
+ * and their data is given in memory : nothing is extracted to disk.
+ * Long names (GNU and pax headers) are supported.\n
+ * Archives compressed with gzip (".tar.gz", ".tgz") need zlib, archives compressed with zstd
+ * (".tar.zst", ".tzst") need libzstd : support is built when the library is found
+ * (flags OSI_WITH_ZLIB and OSI_WITH_ZSTD).
+ * @see OsiManager::processArchive()
+ */
+class OsiTarReader
+{
+
+  public:
+    /** Default constructor. */
+    OsiTarReader();
+
+    /** Default destructor.
+     * Close the archive.
+     */
+    ~OsiTarReader();
+
+    /** Check if a path of the configuration is an archive (by its extension).
+     * @param rFilename The path
+     * @return True for ".tar", ".tar.gz", ".tgz", ".tar.zst" and ".tzst"
+     */
+    static bool isArchive(const std::string &rFilename);
+
+    /** Open an archive.
+     * @param rFilename Complete path of the archive
+     * @return void
+     */
+    void open(const std::string &rFilename);
+
+    /** Read the next member of the archive (directories, links... are skipped).
+     * @param rName [out] The name of the member, with its path in the archive
+     * @param rData [out] The data of the member
+     * @return False at the end of the archive
+     */
+    bool next(std::string &rName, std::vector<unsigned char> &rData);
+
+    /** Close the archive.
+     * @return void
+     */
+    void close();
+
+  private:
+    /** Not copyable : the object owns the archive. */
+    OsiTarReader(const OsiTarReader &);
+    OsiTarReader &operator=(const OsiTarReader &);
+
+    /** The archive. */
+    std::string mFilename;
+    int mCompression;
+    FILE *mpFile;
+
+    /** Decompression state (gzFile or ZSTD_DStream). */
+    void *mpStream;
+
+    /** Compressed data waiting for zstd, and its position. */
+    std::vector<unsigned char> mInput;
+    size_t mInputSize;
+    size_t mInputPos;
+
+    /** Read decompressed bytes.
+     * @param pData Destination
+     * @param size Number of bytes
+     * @return False if the archive ends before
+     */
+    bool read(void *pData, size_t size);
+
+    /** Skip decompressed bytes.
+     * @param size Number of bytes
+     * @return False if the archive ends before
+     */
+    bool skip(size_t size);
+
+}; // end of class
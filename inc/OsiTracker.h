@@ -0,0 +1,88 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include "OsiCircle.h"
+
+/** Tracker of pupil and iris along a sequence of frames.
+ * Remembers the circles found in the previous frame, which are used as a prior
+ * to restrict the search of the pupil and the bands of the contours in the next frame.\n
+ * The response of the pupil detector is compared to the response of the last full search :
+ * when it drops under a ratio (the confidence), the tracking is lost and a full search is run.\n
+ * Circles are expressed at the resolution of segmentation.
+ * @see OsiProcessings::segment()
+ */
+class OsiTracker
+{
+
+  public:
+    /** Default constructor.
+     * @param minConfidence Minimum ratio between the tracked response and the reference response
+     */
+    OsiTracker(float minConfidence = 0.7f);
+
+    /** Default destructor. */
+    ~OsiTracker();
+
+    /** Forget the previous frame : next frame will be fully searched.
+     * @return void
+     */
+    void reset();
+
+    /** Check if a previous frame can be used as a prior.
+     * @return True if circles of a previous frame are known
+     */
+    bool hasPrior() const;
+
+    /** Get the pupil of the previous frame. */
+    const OsiCircle &getPupil() const;
+
+    /** Get the iris of the previous frame. */
+    const OsiCircle &getIris() const;
+
+    /** Check if the response of a tracked pupil is high enough to trust the tracking.
+     * @param response The response of the pupil detector around the prior
+     * @return True if the tracking is confident
+     */
+    bool isConfident(double response) const;
+
+    /** Remember the result of a frame.
+     * @param rPupil The pupil found in the frame
+     * @param rIris The iris found in the frame
+     * @param response The response of the pupil detector
+     * @param tracked True if the frame was segmented around the prior, false for a full search
+     * @return void
+     */
+    void update(const OsiCircle &rPupil, const OsiCircle &rIris, double response, bool tracked);
+
+    /** Get the number of frames segmented around the prior. */
+    int getNumberOfTrackedFrames() const;
+
+    /** Get the number of frames that needed a full search. */
+    int getNumberOfFullSearches() const;
+
+  private:
+    /** Minimum ratio between tracked and reference responses. */
+    float mMinConfidence;
+
+    /** True if a previous frame is known. */
+    bool mHasPrior;
+
+    /** Circles of the previous frame. */
+    OsiCircle mPupil;
+    OsiCircle mIris;
+
+    /** Response of the pupil detector at the last full search. */
+    double mReferenceResponse;
+
+    /** Counters. */
+    int mTrackedFrames;
+    int mFullSearches;
+
+}; // end of class
@@ -0,0 +1,112 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "OsiBitCode.h"
+
+/** Vantage-point tree of iris codes, answering range queries ("all templates under 0.32").
+ * The distance is the matching of the packed codes (minimum over the shifts of the masked hamming distance).
+ * Each node is a template, the vantage point, with the median distance of the templates below it :
+ * the inner subtree holds the templates up to the median, the outer subtree the templates from the median.
+ * A probe at distance d of the vantage point skips the inner subtree if d - radius > median,
+ * and the outer subtree if d + radius < median (triangle inequality). The masks and the shifts make
+ * the matching nearly but not exactly a metric : a slack widens the bounds.\n
+ * The nodes are stored in order (node, inner subtree, outer subtree), so that threads build the subtrees in place.
+ * The tree is saved with the name and the hash of each template, and loaded only if no template changed.
+ * @see OsiGallery , OsiBitCode::distance()
+ */
+class OsiVpTree
+{
+
+  public:
+    /** Default constructor. */
+    OsiVpTree();
+
+    /** Set the parameters and remove all templates.
+     * @param shift Maximum shift of the distance between templates
+     * @param slack Margin added to the bounds of the triangle inequality
+     * @return void
+     */
+    void init(int shift, float slack);
+
+    /** Add a template (before build() or load()). The ids of the templates are their order of addition.
+     * @param rName Name of the template
+     * @param rCode Its code
+     * @return void
+     */
+    void add(const std::string &rName, const OsiBitCode &rCode);
+
+    /** Build the tree.
+     * @param nThreads Number of threads
+     * @return void
+     */
+    void build(int nThreads);
+
+    /** Load a tree saved by save().
+     * @param rFilename The file of the tree
+     * @return False if there is no file, or if it was saved for other templates or another shift
+     */
+    bool load(const std::string &rFilename);
+
+    /** Save the tree.
+     * @param rFilename The file of the tree
+     * @return void
+     */
+    void save(const std::string &rFilename) const;
+
+    /** Get the templates close to a probe.
+     * @param rProbe The code of the probe
+     * @param shift Maximum shift of the matching of the probe
+     * @param radius Maximum distance
+     * @param rIds [out] The ids of the templates, in increasing order
+     * @return void
+     */
+    void query(const OsiBitCode &rProbe, int shift, float radius, std::vector<int> &rIds) const;
+
+    /** Get the size of the codes and of the nodes (bytes). */
+    double getSize() const;
+
+  private:
+    /** Parameters. */
+    int mShift;
+    float mSlack;
+
+    /** Templates : names, hashes and codes. */
+    std::vector<std::string> mNames;
+    std::vector<unsigned long long> mHashes;
+    std::vector<OsiBitCode> mCodes;
+
+    /** Nodes : template and median distance of its subtrees. */
+    std::vector<int> mOrder;
+    std::vector<float> mMedians;
+
+    /** Build the subtree of the nodes from first to last (excluded).
+     * @param first First node
+     * @param last Last node (excluded)
+     * @param nThreads Number of threads building the subtree
+     * @return void
+     */
+    void buildNode(int first, int last, int nThreads);
+
+    /** Search the subtree of the nodes from first to last (excluded).
+     * @param rProbe The code of the probe
+     * @param shift Maximum shift of the matching of the probe
+     * @param radius Maximum distance
+     * @param first First node
+     * @param last Last node (excluded)
+     * @param rIds [in,out] The ids of the templates found
+     * @return void
+     */
+    void searchNode(const OsiBitCode &rProbe, int shift, float radius, int first, int last,
+                    std::vector<int> &rIds) const;
+
+}; // end of class
@@ -0,0 +1,213 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "OsiBitCode.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiBitCode::OsiBitCode()
+{
+    mWidth = 0;
+    mRows = 0;
+    mWords = 0;
+    mMaskRows = 1;
+}
+
+// OPERATORS
+////////////
+
+void OsiBitCode::pack(const IplImage *pCode, const IplImage *pMask, const CvMat *pApplicationPoints)
+{
+    mWidth = pCode->width;
+    mRows = pCode->height;
+    mWords = (mWidth + 63) / 64;
+    mMaskRows = pMask ? pMask->height : pApplicationPoints ? pApplicationPoints->rows : 1;
+    if ((pMask && pMask->width != mWidth) || (pApplicationPoints && (pApplicationPoints->cols != mWidth ||
+                                                                     pApplicationPoints->rows != mMaskRows)))
+    {
+        throw std::runtime_error("The iris code, its mask and the application points have different sizes");
+    }
+
+    mCode.assign(mRows * mWords, 0);
+    for (int r = 0; r < mRows; r++)
+    {
+        const unsigned char *row = (const unsigned char *)pCode->imageData + r * pCode->widthStep;
+        for (int c = 0; c < mWidth; c++)
+        {
+            if (row[c])
+            {
+                mCode[r * mWords + c / 64] |= 1ULL << (c % 64);
+            }
+        }
+    }
+
+    mValid.assign(mMaskRows * mWords, 0);
+    for (int r = 0; r < mMaskRows; r++)
+    {
+        const unsigned char *mask = pMask ? (const unsigned char *)pMask->imageData + r * pMask->widthStep : 0;
+        const unsigned char *points = pApplicationPoints ? pApplicationPoints->data.ptr + r * pApplicationPoints->step
+                                                         : 0;
+        for (int c = 0; c < mWidth; c++)
+        {
+            if ((!mask || mask[c]) && (!points || points[c]))
+            {
+                mValid[r * mWords + c / 64] |= 1ULL << (c % 64);
+            }
+        }
+    }
+}
+
+void OsiBitCode::downsample(const OsiBitCode &rCode, int nBands, int step)
+{
+    int n_gabor = rCode.mRows / rCode.mMaskRows;
+    if (nBands < 1 || nBands > n_gabor || step < 1)
+    {
+        throw std::invalid_argument("Cannot keep these bands and columns of the iris code");
+    }
+    mWidth = (rCode.mWidth + step - 1) / step;
+    mMaskRows = rCode.mMaskRows;
+    mRows = nBands * mMaskRows;
+    mWords = (mWidth + 63) / 64;
+
+    mCode.assign(mRows * mWords, 0);
+    for (int b = 0; b < nBands; b++)
+    {
+        int band = b * n_gabor / nBands;
+        for (int r = 0; r < mMaskRows; r++)
+        {
+            for (int c = 0; c < mWidth; c++)
+            {
+                if (rCode.getBit(band * mMaskRows + r, c * step))
+                {
+                    mCode[(b * mMaskRows + r) * mWords + c / 64] |= 1ULL << (c % 64);
+                }
+            }
+        }
+    }
+
+    mValid.assign(mMaskRows * mWords, 0);
+    for (int r = 0; r < mMaskRows; r++)
+    {
+        for (int c = 0; c < mWidth; c++)
+        {
+            if (rCode.isValid(r, c * step))
+            {
+                mValid[r * mWords + c / 64] |= 1ULL << (c % 64);
+            }
+        }
+    }
+}
+
+void OsiBitCode::rotate(int shift, OsiBitCode &rRotated) const
+{
+    rRotated = *this;
+    if (shift % mWidth == 0)
+    {
+        return;
+    }
+    rRotated.mCode.assign(mCode.size(), 0);
+    for (int r = 0; r < mRows; r++)
+    {
+        for (int c = 0; c < mWidth; c++)
+        {
+            if (getBit(r, c + shift))
+            {
+                rRotated.mCode[r * mWords + c / 64] |= 1ULL << (c % 64);
+            }
+        }
+    }
+}
+
+float OsiBitCode::distance(const OsiBitCode &rOther, int shift) const
+{
+    if (rOther.mWidth != mWidth || rOther.mRows != mRows || rOther.mMaskRows != mMaskRows)
+    {
+        throw std::runtime_error("Cannot match iris codes of different sizes");
+    }
+
+    // Bits valid in both codes, repeated for each filter
+    std::vector<unsigned long long> valid(mValid.size());
+    int n_bits = 0;
+    for (int k = 0; k < valid.size(); k++)
+    {
+        valid[k] = mValid[k] & rOther.mValid[k];
+        n_bits += countBits(valid[k]);
+    }
+    n_bits *= mRows / mMaskRows;
+    if (n_bits == 0)
+    {
+        return 1;
+    }
+
+    int best = n_bits;
+    OsiBitCode rotated;
+    for (int s = -shift; s <= shift; s++)
+    {
+        int n_different;
+        if (mWidth % 64 == 0)
+        {
+            n_different = countDifferentBits(&mCode[0], &rOther.mCode[0], &valid[0], mRows, mMaskRows, mWords, s);
+        }
+        else
+        {
+            // The width is not a whole number of words : the bits are rotated one by one
+            rotate(s, rotated);
+            n_different =
+                countDifferentBits(&rotated.mCode[0], &rOther.mCode[0], &valid[0], mRows, mMaskRows, mWords, 0);
+        }
+        best = std::min(best, n_different);
+    }
+    return (float)best / n_bits;
+}
+
+int OsiBitCode::countDifferentBits(const unsigned long long *pCode1, const unsigned long long *pCode2,
+                                   const unsigned long long *pMask, int rows, int maskRows, int words, int shift)
+{
+    // Rotation of whole rows of words : word k of the rotated row is made of words k + q and k + q + 1
+    int width = 64 * words;
+    int rotation = (shift % width + width) % width;
+    int q = rotation / 64;
+    int r = rotation % 64;
+
+    int n_different = 0;
+    for (int i = 0; i < rows; i++)
+    {
+        const unsigned long long *src = pCode1 + i * words;
+        const unsigned long long *dst = pCode2 + i * words;
+        const unsigned long long *msk = pMask + (i % maskRows) * words;
+        for (int k = 0; k < words; k++)
+        {
+            unsigned long long word = src[(k + q) % words] >> r;
+            if (r)
+            {
+                word |= src[(k + q + 1) % words] << (64 - r);
+            }
+            n_different += countBits((word ^ dst[k]) & msk[k]);
+        }
+    }
+    return n_different;
+}
+
+unsigned long long OsiBitCode::getHash() const
+{
+    // FNV-1a on the words
+    unsigned long long hash = 14695981039346656037ULL;
+    const std::vector<unsigned long long> *parts[] = {&mCode, &mValid};
+    for (int p = 0; p < 2; p++)
+    {
+        for (int k = 0; k < parts[p]->size(); k++)
+        {
+            hash = (hash ^ (*parts[p])[k]) * 1099511628211ULL;
+        }
+    }
+    return hash ^ ((unsigned long long)mWidth << 32 | mRows);
+}
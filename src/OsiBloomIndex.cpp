@@ -0,0 +1,150 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+
+#include "OsiBloomIndex.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiBloomIndex::OsiBloomIndex()
+{
+    mWordRows = 0;
+    mBlockWidth = 0;
+    mTrees = 0;
+}
+
+// OPERATORS
+////////////
+
+void OsiBloomIndex::init(int wordRows, int blockWidth, int nTrees)
+{
+    if (nTrees < 0)
+    {
+        throw std::invalid_argument("Wrong number of Bloom trees");
+    }
+    mWordRows = wordRows;
+    mBlockWidth = blockWidth;
+    mTrees = nTrees;
+    mTemplates.clear();
+    mIds.clear();
+    mNodes.clear();
+    mRoots.clear();
+}
+
+void OsiBloomIndex::add(int id, const OsiBitCode &rCode)
+{
+    mTemplates.push_back(OsiBloomTemplate());
+    mTemplates.back().build(rCode, mWordRows, mBlockWidth);
+    mIds.push_back(id);
+}
+
+void OsiBloomIndex::build()
+{
+    mNodes.clear();
+    mRoots.clear();
+    int n_trees = std::min<int>(mTrees, mTemplates.size());
+    for (int t = 0; t < n_trees; t++)
+    {
+        int first = (long long)mTemplates.size() * t / n_trees;
+        int last = (long long)mTemplates.size() * (t + 1) / n_trees;
+        mRoots.push_back(buildNode(first, last));
+    }
+}
+
+void OsiBloomIndex::query(const OsiBitCode &rProbe, int nCandidates, std::vector<int> &rIds) const
+{
+    rIds.clear();
+    OsiBloomTemplate probe;
+    probe.build(rProbe, mWordRows, mBlockWidth);
+
+    // Dissimilarity and position of the templates, or of the nodes, most similar first
+    typedef std::pair<float, int> Item;
+    if (mRoots.empty())
+    {
+        std::vector<Item> items(mTemplates.size());
+        for (int i = 0; i < mTemplates.size(); i++)
+        {
+            items[i] = Item(probe.compare(mTemplates[i]), i);
+        }
+        int n = std::min<int>(nCandidates, items.size());
+        std::partial_sort(items.begin(), items.begin() + n, items.end());
+        for (int i = 0; i < n; i++)
+        {
+            rIds.push_back(mIds[items[i].second]);
+        }
+    }
+    else
+    {
+        std::priority_queue<Item, std::vector<Item>, std::greater<Item>> nodes;
+        for (int t = 0; t < mRoots.size(); t++)
+        {
+            nodes.push(Item(probe.compare(getFilters(mRoots[t])), mRoots[t]));
+        }
+        while (!nodes.empty() && rIds.size() < nCandidates)
+        {
+            const Node &node = mNodes[nodes.top().second];
+            nodes.pop();
+            if (node.leaf >= 0)
+            {
+                rIds.push_back(mIds[node.leaf]);
+            }
+            else
+            {
+                nodes.push(Item(probe.compare(getFilters(node.left)), node.left));
+                nodes.push(Item(probe.compare(getFilters(node.right)), node.right));
+            }
+        }
+    }
+    std::sort(rIds.begin(), rIds.end());
+}
+
+double OsiBloomIndex::getSize() const
+{
+    double size = 0;
+    for (int i = 0; i < mTemplates.size(); i++)
+    {
+        size += mTemplates[i].getSize();
+    }
+    for (int n = 0; n < mNodes.size(); n++)
+    {
+        size += mNodes[n].filters.getSize();
+    }
+    return size;
+}
+
+int OsiBloomIndex::buildNode(int first, int last)
+{
+    Node node;
+    node.leaf = -1;
+    node.left = -1;
+    node.right = -1;
+    if (last - first == 1)
+    {
+        node.leaf = first;
+    }
+    else
+    {
+        int middle = (first + last) / 2;
+        node.left = buildNode(first, middle);
+        node.right = buildNode(middle, last);
+        node.filters.merge(getFilters(node.left));
+        node.filters.merge(getFilters(node.right));
+    }
+    mNodes.push_back(node);
+    return mNodes.size() - 1;
+}
+
+const OsiBloomTemplate &OsiBloomIndex::getFilters(int node) const
+{
+    return mNodes[node].leaf >= 0 ? mTemplates[mNodes[node].leaf] : mNodes[node].filters;
+}
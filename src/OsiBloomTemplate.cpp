@@ -0,0 +1,131 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "OsiBloomTemplate.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiBloomTemplate::OsiBloomTemplate()
+{
+    mFilters = 0;
+    mFilterWords = 0;
+}
+
+// OPERATORS
+////////////
+
+void OsiBloomTemplate::build(const OsiBitCode &rCode, int wordRows, int blockWidth)
+{
+    if (wordRows < 6 || wordRows > 16 || blockWidth < 1)
+    {
+        throw std::invalid_argument("Wrong parameters of Bloom filters (6 to 16 rows per word, 1 column per block)");
+    }
+    int bands = rCode.getMaskRows() / wordRows;
+    if (bands == 0)
+    {
+        throw std::invalid_argument("The words of the Bloom filters have more rows than the normalized iris");
+    }
+    int n_gabor = rCode.getRows() / rCode.getMaskRows();
+    int blocks = (rCode.getWidth() + blockWidth - 1) / blockWidth;
+    mFilters = n_gabor * bands * blocks;
+    mFilterWords = (1 << wordRows) / 64;
+    mBits.assign(mFilters * mFilterWords, 0);
+    mCounts.assign(mFilters, 0);
+
+    for (int g = 0; g < n_gabor; g++)
+    {
+        for (int b = 0; b < bands; b++)
+        {
+            int first_row = g * rCode.getMaskRows() + b * wordRows;
+            for (int k = 0; k < blocks; k++)
+            {
+                int filter = (g * bands + b) * blocks + k;
+                unsigned long long *bits = &mBits[filter * mFilterWords];
+                int last_column = std::min(rCode.getWidth(), (k + 1) * blockWidth);
+                for (int c = k * blockWidth; c < last_column; c++)
+                {
+                    // The word of the column, if none of its bits is masked
+                    int word = 0;
+                    int r = 0;
+                    while (r < wordRows && rCode.isValid(first_row + r, c))
+                    {
+                        word |= rCode.getBit(first_row + r, c) << r;
+                        r++;
+                    }
+                    if (r == wordRows)
+                    {
+                        bits[word / 64] |= 1ULL << (word % 64);
+                    }
+                }
+                for (int w = 0; w < mFilterWords; w++)
+                {
+                    mCounts[filter] += OsiBitCode::countBits(bits[w]);
+                }
+            }
+        }
+    }
+}
+
+void OsiBloomTemplate::merge(const OsiBloomTemplate &rOther)
+{
+    if (mBits.empty())
+    {
+        *this = rOther;
+        return;
+    }
+    if (rOther.mFilters != mFilters || rOther.mFilterWords != mFilterWords)
+    {
+        throw std::runtime_error("Cannot merge Bloom templates of different sizes");
+    }
+    for (int f = 0; f < mFilters; f++)
+    {
+        mCounts[f] = 0;
+        for (int w = f * mFilterWords; w < (f + 1) * mFilterWords; w++)
+        {
+            mBits[w] |= rOther.mBits[w];
+            mCounts[f] += OsiBitCode::countBits(mBits[w]);
+        }
+    }
+}
+
+float OsiBloomTemplate::compare(const OsiBloomTemplate &rOther) const
+{
+    if (rOther.mFilters != mFilters || rOther.mFilterWords != mFilterWords)
+    {
+        throw std::runtime_error("Cannot compare Bloom templates of different sizes");
+    }
+
+    // Blocks without any word (all masked) are not compared
+    double sum = 0;
+    int n_compared = 0;
+    for (int f = 0; f < mFilters; f++)
+    {
+        int n_words = mCounts[f] + rOther.mCounts[f];
+        if (n_words == 0)
+        {
+            continue;
+        }
+        int n_different = 0;
+        for (int w = f * mFilterWords; w < (f + 1) * mFilterWords; w++)
+        {
+            n_different += OsiBitCode::countBits(mBits[w] ^ rOther.mBits[w]);
+        }
+        sum += (double)n_different / n_words;
+        n_compared++;
+    }
+    return n_compared ? sum / n_compared : 1;
+}
+
+int OsiBloomTemplate::getSize() const
+{
+    return mBits.size() * sizeof(unsigned long long);
+}
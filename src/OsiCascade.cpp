@@ -0,0 +1,170 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "OsiCascade.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiCascade::OsiCascade()
+{
+    mTemplates = 0;
+}
+
+// OPERATORS
+////////////
+
+void OsiCascade::init(const std::string &rStages)
+{
+    mStages.clear();
+    mTemplates = 0;
+    std::istringstream stages(rStages);
+    std::string word;
+    while (stages >> word)
+    {
+        std::istringstream fields(word);
+        Stage stage;
+        char colon1 = 0, colon2 = 0;
+        if (!(fields >> stage.bands >> colon1 >> stage.step >> colon2 >> stage.fraction) || colon1 != ':' ||
+            colon2 != ':' || stage.bands < 1 || stage.step < 1 || stage.fraction <= 0 || stage.fraction > 1)
+        {
+            throw std::invalid_argument("Wrong stage of cascade : " + word + " (bands:step:fraction)");
+        }
+        stage.codeWords = 0;
+        stage.validWords = 0;
+        mStages.push_back(stage);
+    }
+    if (mStages.empty())
+    {
+        throw std::invalid_argument("The cascade has no stage");
+    }
+}
+
+void OsiCascade::add(const OsiBitCode &rCode)
+{
+    for (int s = 0; s < mStages.size(); s++)
+    {
+        Stage &stage = mStages[s];
+        OsiBitCode short_code;
+        short_code.downsample(rCode, stage.bands, stage.step);
+        if (mTemplates == 0)
+        {
+            stage.codeWords = short_code.getCode().size();
+            stage.validWords = short_code.getValid().size();
+        }
+        else if (short_code.getCode().size() != stage.codeWords)
+        {
+            throw std::runtime_error("The iris codes of the cascade have different sizes");
+        }
+        stage.code.insert(stage.code.end(), short_code.getCode().begin(), short_code.getCode().end());
+        stage.valid.insert(stage.valid.end(), short_code.getValid().begin(), short_code.getValid().end());
+    }
+    mTemplates++;
+}
+
+void OsiCascade::query(const OsiBitCode &rProbe, int shift, int nMin, std::vector<int> &rIds) const
+{
+    rIds.resize(mTemplates);
+    for (int t = 0; t < mTemplates; t++)
+    {
+        rIds[t] = t;
+    }
+
+    std::vector<std::pair<float, int>> scores;
+    for (int s = 0; s < mStages.size(); s++)
+    {
+        const Stage &stage = mStages[s];
+        int n_kept = std::max<int>(nMin, std::ceil(stage.fraction * rIds.size()));
+        if (n_kept >= rIds.size())
+        {
+            continue;
+        }
+
+        // Short code of the probe, rotated for each shift
+        std::vector<OsiBitCode> rotations;
+        rotateProbe(stage, rProbe, shift, rotations);
+
+        scores.resize(rIds.size());
+        for (int i = 0; i < rIds.size(); i++)
+        {
+            scores[i].first = matchStage(stage, rIds[i], rotations);
+            scores[i].second = rIds[i];
+        }
+
+        // The best fraction goes to the next stage
+        std::nth_element(scores.begin(), scores.begin() + n_kept, scores.end());
+        rIds.resize(n_kept);
+        for (int i = 0; i < n_kept; i++)
+        {
+            rIds[i] = scores[i].second;
+        }
+        std::sort(rIds.begin(), rIds.end());
+    }
+}
+
+void OsiCascade::rotateProbe(const Stage &rStage, const OsiBitCode &rProbe, int shift,
+                             std::vector<OsiBitCode> &rRotations) const
+{
+    OsiBitCode probe;
+    probe.downsample(rProbe, rStage.bands, rStage.step);
+    int stage_shift = (shift + rStage.step - 1) / rStage.step;
+    rRotations.resize(2 * stage_shift + 1);
+    for (int r = 0; r < rRotations.size(); r++)
+    {
+        probe.rotate(r - stage_shift, rRotations[r]);
+    }
+}
+
+float OsiCascade::matchStage(const Stage &rStage, int id, const std::vector<OsiBitCode> &rRotations) const
+{
+    // Masked hamming distance, the mask of both codes is not rotated
+    const unsigned long long *code = &rStage.code[(size_t)id * rStage.codeWords];
+    const unsigned long long *valid = &rStage.valid[(size_t)id * rStage.validWords];
+    const unsigned long long *probe_valid = &rRotations[0].getValid()[0];
+    int n_bits = 0;
+    for (int k = 0; k < rStage.validWords; k++)
+    {
+        n_bits += OsiBitCode::countBits(valid[k] & probe_valid[k]);
+    }
+
+    // The valid bits are repeated for each band
+    n_bits *= rStage.codeWords / rStage.validWords;
+    if (n_bits == 0)
+    {
+        return 1;
+    }
+
+    int best = n_bits;
+    for (int r = 0; r < rRotations.size(); r++)
+    {
+        const unsigned long long *rotated = &rRotations[r].getCode()[0];
+        int n_different = 0;
+        for (int k = 0; k < rStage.codeWords; k++)
+        {
+            int m = k % rStage.validWords;
+            n_different += OsiBitCode::countBits((code[k] ^ rotated[k]) & valid[m] & probe_valid[m]);
+        }
+        best = std::min(best, n_different);
+    }
+    return (float)best / n_bits;
+}
+
+double OsiCascade::getSize() const
+{
+    double size = 0;
+    for (int s = 0; s < mStages.size(); s++)
+    {
+        size += (mStages[s].code.size() + mStages[s].valid.size()) * sizeof(unsigned long long);
+    }
+    return size;
+}
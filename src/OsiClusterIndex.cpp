@@ -0,0 +1,508 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "OsiClusterIndex.h"
+
+// Tag at the beginning of a file of clusters
+#define OSI_IVF_TAG "OSIIVF01"
+#define OSI_IVF_TAG_SIZE 8
+
+// Seed of the clustering : the same templates always give the same clusters
+#define OSI_IVF_SEED 20110
+
+// Iterations of k-medoids, and samples of a cluster when its medoid is chosen
+#define OSI_IVF_ITERATIONS 8
+#define OSI_IVF_CANDIDATES 32
+#define OSI_IVF_SAMPLE 256
+
+// Write an unsigned integer in little-endian order
+static void writeNumber(std::ostream &rFile, unsigned long long value, int size)
+{
+    for (int b = 0; b < size; b++)
+    {
+        rFile.put((char)(value >> (8 * b)));
+    }
+}
+
+// Read an unsigned integer written by writeNumber()
+static unsigned long long readNumber(std::istream &rFile, int size)
+{
+    unsigned long long value = 0;
+    for (int b = 0; b < size; b++)
+    {
+        value |= (unsigned long long)(unsigned char)rFile.get() << (8 * b);
+    }
+    if (!rFile)
+    {
+        throw std::runtime_error("Truncated file of clusters");
+    }
+    return value;
+}
+
+// Run a function on consecutive parts [first, last) of [0, n), one part per thread
+static void runParallel(int n, int nThreads, const std::function<void(int, int)> &rFunction)
+{
+    nThreads = std::max(1, std::min(nThreads, n));
+    std::vector<std::thread> threads;
+    for (int t = 1; t < nThreads; t++)
+    {
+        threads.push_back(std::thread(rFunction, (int)((long long)n * t / nThreads),
+                                      (int)((long long)n * (t + 1) / nThreads)));
+    }
+    rFunction(0, (int)((long long)n / nThreads));
+    for (int t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+}
+
+// Draw at most n elements of a list
+static void drawSample(const std::vector<int> &rList, int n, std::mt19937 &rRandom, std::vector<int> &rSample)
+{
+    rSample = rList;
+    if (rSample.size() <= n)
+    {
+        return;
+    }
+    for (int i = 0; i < n; i++)
+    {
+        std::swap(rSample[i], rSample[i + rRandom() % (rSample.size() - i)]);
+    }
+    rSample.resize(n);
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiClusterIndex::OsiClusterIndex()
+{
+    mClusters = 0;
+    mShift = 0;
+    mAssigned = 0;
+    mRemoved = 0;
+    mRows = 0;
+    mWords = 0;
+    mMaskRows = 1;
+}
+
+// OPERATORS
+////////////
+
+void OsiClusterIndex::init(int nClusters, int shift)
+{
+    if (nClusters < 1)
+    {
+        throw std::invalid_argument("Wrong number of clusters");
+    }
+    mClusters = nClusters;
+    mShift = shift;
+    mNames.clear();
+    mHashes.clear();
+    mCodes.clear();
+    mMatchShifts.clear();
+    mMedoids.clear();
+    mMedoidCodes.clear();
+    mMembers.clear();
+    mOffsets.assign(1, 0);
+    mLayoutCodes.clear();
+    mLayoutValid.clear();
+    mLayoutShifts.clear();
+    mAssigned = 0;
+    mRemoved = 0;
+}
+
+void OsiClusterIndex::add(const std::string &rName, const OsiBitCode &rCode, int matchShift)
+{
+    if (!mCodes.empty() && (rCode.getWidth() != mCodes[0].getWidth() || rCode.getRows() != mCodes[0].getRows() ||
+                            rCode.getMaskRows() != mCodes[0].getMaskRows()))
+    {
+        throw std::runtime_error("The iris code of " + rName + " has not the size of the clusters");
+    }
+    mNames.push_back(rName);
+    mHashes.push_back(rCode.getHash());
+    mCodes.push_back(rCode);
+    mMatchShifts.push_back(matchShift);
+}
+
+void OsiClusterIndex::build(int nThreads)
+{
+    int n = mCodes.size();
+    int k = std::min(mClusters, n);
+    mMedoids.clear();
+    mMembers.clear();
+    std::mt19937 random(OSI_IVF_SEED);
+
+    // Seeds : each one drawn with a probability growing with its distance to the closest seed (k-medoids++)
+    std::vector<float> nearest(n, 2);
+    int seed = n > 0 ? random() % n : 0;
+    while (mMedoids.size() < k)
+    {
+        mMedoids.push_back(seed);
+        const OsiBitCode &medoid = mCodes[seed];
+        runParallel(n, nThreads, [&](int first, int last) {
+            for (int i = first; i < last; i++)
+            {
+                nearest[i] = std::min(nearest[i], mCodes[i].distance(medoid, mShift));
+            }
+        });
+        double total = 0;
+        for (int i = 0; i < n; i++)
+        {
+            total += nearest[i] * nearest[i];
+        }
+        if (total <= 0)
+        {
+            // The other templates are copies of the seeds
+            break;
+        }
+        do
+        {
+            double draw = std::uniform_real_distribution<double>(0, total)(random);
+            seed = 0;
+            while (seed < n - 1 && (draw -= nearest[seed] * nearest[seed]) > 0)
+            {
+                seed++;
+            }
+        } while (nearest[seed] == 0);
+    }
+    k = mMedoids.size();
+
+    // Alternately, each template goes to its closest medoid, and each cluster takes as medoid
+    // the member closest to the others
+    std::vector<int> templates(n);
+    for (int i = 0; i < n; i++)
+    {
+        templates[i] = i;
+    }
+    for (int it = 0; it < OSI_IVF_ITERATIONS; it++)
+    {
+        mMembers.assign(k, std::vector<int>());
+        assign(templates, nThreads);
+
+        std::vector<int> medoids = mMedoids;
+        runParallel(k, nThreads, [&](int first, int last) {
+            for (int c = first; c < last; c++)
+            {
+                std::mt19937 cluster_random(OSI_IVF_SEED + it * k + c);
+                std::vector<int> candidates, sample;
+                drawSample(mMembers[c], OSI_IVF_CANDIDATES, cluster_random, candidates);
+                drawSample(mMembers[c], OSI_IVF_SAMPLE, cluster_random, sample);
+                candidates.push_back(mMedoids[c]);
+                double best_sum = -1;
+                for (int i = 0; i < candidates.size(); i++)
+                {
+                    double sum = 0;
+                    for (int s = 0; s < sample.size(); s++)
+                    {
+                        sum += mCodes[sample[s]].distance(mCodes[candidates[i]], mShift);
+                    }
+                    if (best_sum < 0 || sum < best_sum || (sum == best_sum && candidates[i] == mMedoids[c]))
+                    {
+                        best_sum = sum;
+                        medoids[c] = candidates[i];
+                    }
+                }
+            }
+        });
+        if (medoids == mMedoids)
+        {
+            break;
+        }
+        mMedoids.swap(medoids);
+    }
+    mMembers.assign(k, std::vector<int>());
+    assign(templates, nThreads);
+    finish();
+}
+
+bool OsiClusterIndex::load(const std::string &rFilename)
+{
+    mMedoids.clear();
+    mMembers.clear();
+    mAssigned = 0;
+    mRemoved = 0;
+    std::ifstream file(rFilename.c_str(), std::ios::in | std::ios::binary);
+    char tag[OSI_IVF_TAG_SIZE];
+    if (!file || !file.read(tag, OSI_IVF_TAG_SIZE) || memcmp(tag, OSI_IVF_TAG, OSI_IVF_TAG_SIZE))
+    {
+        return false;
+    }
+    int shift = readNumber(file, 4);
+    int n_requested = readNumber(file, 4);
+    int n_clusters = readNumber(file, 4);
+    if (shift != mShift || n_requested != mClusters)
+    {
+        return false;
+    }
+
+    // The templates of the file, found by name and hash
+    std::map<std::string, std::vector<int>> ids;
+    for (int i = mNames.size() - 1; i >= 0; i--)
+    {
+        ids[mNames[i]].push_back(i);
+    }
+    std::vector<bool> placed(mNames.size(), false);
+    mMembers.resize(n_clusters);
+    for (int c = 0; c < n_clusters; c++)
+    {
+        unsigned int n_members = readNumber(file, 4);
+        unsigned int medoid = readNumber(file, 4);
+        mMedoids.push_back(-1);
+        for (unsigned int m = 0; m < n_members; m++)
+        {
+            std::string name(readNumber(file, 4), '\0');
+            file.read(&name[0], name.size());
+            unsigned long long hash = readNumber(file, 8);
+            std::vector<int> &same_name = ids[name];
+            int found = -1;
+            for (int i = same_name.size() - 1; i >= 0 && found < 0; i--)
+            {
+                if (mHashes[same_name[i]] == hash)
+                {
+                    found = same_name[i];
+                    same_name.erase(same_name.begin() + i);
+                }
+            }
+            if (found < 0)
+            {
+                mRemoved++;
+                continue;
+            }
+            placed[found] = true;
+            mMembers[c].push_back(found);
+            if (m == medoid)
+            {
+                mMedoids[c] = found;
+            }
+        }
+        if (mMedoids[c] < 0)
+        {
+            // The medoid was removed or changed
+            return false;
+        }
+    }
+
+    // The new templates go to the closest clusters
+    std::vector<int> templates;
+    for (int i = 0; i < placed.size(); i++)
+    {
+        if (!placed[i])
+        {
+            templates.push_back(i);
+        }
+    }
+    assign(templates, std::thread::hardware_concurrency());
+    mAssigned = templates.size();
+    finish();
+    return true;
+}
+
+void OsiClusterIndex::save(const std::string &rFilename) const
+{
+    std::ofstream file(rFilename.c_str(), std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot create the file of clusters : " + rFilename);
+    }
+    file.write(OSI_IVF_TAG, OSI_IVF_TAG_SIZE);
+    writeNumber(file, mShift, 4);
+    writeNumber(file, mClusters, 4);
+    writeNumber(file, mMembers.size(), 4);
+    for (int c = 0; c < mMembers.size(); c++)
+    {
+        const std::vector<int> &members = mMembers[c];
+        writeNumber(file, members.size(), 4);
+        writeNumber(file, std::find(members.begin(), members.end(), mMedoids[c]) - members.begin(), 4);
+        for (int m = 0; m < members.size(); m++)
+        {
+            writeNumber(file, mNames[members[m]].size(), 4);
+            file.write(mNames[members[m]].data(), mNames[members[m]].size());
+            writeNumber(file, mHashes[members[m]], 8);
+        }
+    }
+    if (!file)
+    {
+        throw std::runtime_error("Cannot write the file of clusters : " + rFilename);
+    }
+}
+
+void OsiClusterIndex::getOrder(std::vector<int> &rOrder) const
+{
+    rOrder.clear();
+    for (int c = 0; c < mMembers.size(); c++)
+    {
+        rOrder.insert(rOrder.end(), mMembers[c].begin(), mMembers[c].end());
+    }
+}
+
+void OsiClusterIndex::query(const OsiBitCode &rProbe, int shift, int nProbe, std::vector<int> &rPositions) const
+{
+    std::vector<std::pair<float, int>> distances(mMedoidCodes.size());
+    for (int c = 0; c < distances.size(); c++)
+    {
+        distances[c].first = rProbe.distance(mMedoidCodes[c], shift);
+        distances[c].second = c;
+    }
+    int n = std::min<int>(std::max(nProbe, 1), distances.size());
+    std::partial_sort(distances.begin(), distances.begin() + n, distances.end());
+
+    rPositions.clear();
+    for (int i = 0; i < n; i++)
+    {
+        int c = distances[i].second;
+        for (int p = mOffsets[c]; p < mOffsets[c + 1]; p++)
+        {
+            rPositions.push_back(p);
+        }
+    }
+    std::sort(rPositions.begin(), rPositions.end());
+}
+
+void OsiClusterIndex::match(const OsiBitCode &rProbe, int shift, const std::vector<int> &rPositions,
+                            std::vector<float> &rScores) const
+{
+    if (rProbe.getRows() != mRows || rProbe.getWords() != mWords || rProbe.getMaskRows() != mMaskRows)
+    {
+        throw std::runtime_error("Cannot match iris codes of different sizes");
+    }
+
+    // The rows are rotated word by word, else the probe is rotated once for each shift
+    std::vector<OsiBitCode> rotations;
+    if (rProbe.getWidth() % 64)
+    {
+        rotations.resize(2 * shift + 1);
+        for (int s = -shift; s <= shift; s++)
+        {
+            rProbe.rotate(s, rotations[s + shift]);
+        }
+    }
+
+    int code_words = mRows * mWords;
+    int valid_words = mMaskRows * mWords;
+    const unsigned long long *probe_valid = &rProbe.getValid()[0];
+    std::vector<unsigned long long> valid(valid_words);
+    rScores.resize(rPositions.size());
+    for (int i = 0; i < rPositions.size(); i++)
+    {
+        int p = rPositions[i];
+        const unsigned long long *code = &mLayoutCodes[(size_t)p * code_words];
+        const unsigned long long *template_valid = &mLayoutValid[(size_t)p * valid_words];
+
+        // Bits valid in both codes, repeated for each filter
+        int n_bits = 0;
+        for (int k = 0; k < valid_words; k++)
+        {
+            valid[k] = template_valid[k] & probe_valid[k];
+            n_bits += OsiBitCode::countBits(valid[k]);
+        }
+        n_bits *= mRows / mMaskRows;
+        if (n_bits == 0)
+        {
+            rScores[i] = 1;
+            continue;
+        }
+
+        int template_shift = std::min(shift, mLayoutShifts[p]);
+        int best = n_bits;
+        for (int s = -template_shift; s <= template_shift; s++)
+        {
+            int n_different =
+                rotations.empty()
+                    ? OsiBitCode::countDifferentBits(&rProbe.getCode()[0], code, &valid[0], mRows, mMaskRows, mWords, s)
+                    : OsiBitCode::countDifferentBits(&rotations[s + shift].getCode()[0], code, &valid[0], mRows,
+                                                     mMaskRows, mWords, 0);
+            best = std::min(best, n_different);
+        }
+        rScores[i] = (float)best / n_bits;
+    }
+}
+
+int OsiClusterIndex::getClusters() const
+{
+    return mMedoidCodes.size();
+}
+
+int OsiClusterIndex::getAssignedTemplates() const
+{
+    return mAssigned;
+}
+
+int OsiClusterIndex::getRemovedTemplates() const
+{
+    return mRemoved;
+}
+
+void OsiClusterIndex::assign(const std::vector<int> &rTemplates, int nThreads)
+{
+    std::vector<int> clusters(rTemplates.size(), 0);
+    runParallel(rTemplates.size(), nThreads, [&](int first, int last) {
+        for (int i = first; i < last; i++)
+        {
+            const OsiBitCode &code = mCodes[rTemplates[i]];
+            float best = 2;
+            for (int c = 0; c < mMedoids.size(); c++)
+            {
+                float distance = code.distance(mCodes[mMedoids[c]], mShift);
+                if (distance < best)
+                {
+                    best = distance;
+                    clusters[i] = c;
+                }
+            }
+        }
+    });
+    for (int i = 0; i < rTemplates.size(); i++)
+    {
+        mMembers[clusters[i]].push_back(rTemplates[i]);
+    }
+}
+
+void OsiClusterIndex::finish()
+{
+    mMedoidCodes.resize(mMedoids.size());
+    for (int c = 0; c < mMedoids.size(); c++)
+    {
+        mMedoidCodes[c] = mCodes[mMedoids[c]];
+    }
+
+    mOffsets.assign(1, 0);
+    for (int c = 0; c < mMembers.size(); c++)
+    {
+        std::sort(mMembers[c].begin(), mMembers[c].end());
+        mOffsets.push_back(mOffsets.back() + mMembers[c].size());
+    }
+
+    // The codes are copied cluster after cluster, then the codes of the templates are freed
+    std::vector<int> order;
+    getOrder(order);
+    mRows = mCodes.empty() ? 0 : mCodes[0].getRows();
+    mWords = mCodes.empty() ? 0 : mCodes[0].getWords();
+    mMaskRows = mCodes.empty() ? 1 : mCodes[0].getMaskRows();
+    mLayoutCodes.clear();
+    mLayoutValid.clear();
+    mLayoutShifts.clear();
+    mLayoutCodes.reserve((size_t)order.size() * mRows * mWords);
+    mLayoutValid.reserve((size_t)order.size() * mMaskRows * mWords);
+    for (int p = 0; p < order.size(); p++)
+    {
+        const OsiBitCode &code = mCodes[order[p]];
+        mLayoutCodes.insert(mLayoutCodes.end(), code.getCode().begin(), code.getCode().end());
+        mLayoutValid.insert(mLayoutValid.end(), code.getValid().begin(), code.getValid().end());
+        mLayoutShifts.push_back(mMatchShifts[order[p]]);
+    }
+    std::vector<OsiBitCode>().swap(mCodes);
+}
@@ -0,0 +1,79 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "OsiDeadline.h"
+#include "OsiStringUtils.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiDeadline::OsiDeadline(int budget)
+{
+    start(budget);
+}
+
+OsiDeadline::~OsiDeadline()
+{
+    // Do nothing
+}
+
+// OPERATORS
+////////////
+
+void OsiDeadline::start(int budget)
+{
+    mBudget = budget;
+    mStart = std::chrono::steady_clock::now();
+    mLevel = 0;
+}
+
+double OsiDeadline::getElapsed() const
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - mStart).count();
+}
+
+bool OsiDeadline::isExpired() const
+{
+    return mBudget > 0 && getElapsed() > mBudget;
+}
+
+void OsiDeadline::check(const std::string &rStage) const
+{
+    if (isExpired())
+    {
+        OsiStringUtils osu;
+        throw std::runtime_error("Cancelled during " + rStage + " : budget of " + osu.toString(mBudget) +
+                                 " ms is exceeded");
+    }
+}
+
+int OsiDeadline::getDegradationLevel()
+{
+    if (mBudget > 0)
+    {
+        double fraction = getElapsed() / mBudget;
+        if (fraction >= OSI_DEGRADATION_FRACTION_2)
+            mLevel = std::max(mLevel, 2);
+        else if (fraction >= OSI_DEGRADATION_FRACTION_1)
+            mLevel = std::max(mLevel, 1);
+    }
+    return mLevel;
+}
+
+int OsiDeadline::getReachedLevel() const
+{
+    return mLevel;
+}
+
+void OsiDeadline::setReachedLevel(int level)
+{
+    mLevel = std::max(0, std::min(level, OSI_DEGRADATION_LEVELS - 1));
+}
@@ -0,0 +1,153 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cmath>
+
+#include "OsiEvaluation.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiEvaluation::OsiEvaluation()
+{
+    // Do nothing
+}
+
+OsiEvaluation::~OsiEvaluation()
+{
+    // Do nothing
+}
+
+// ACCESSORS
+////////////
+
+int OsiEvaluation::getNumberOfGenuineScores() const
+{
+    return mGenuineScores.size();
+}
+
+int OsiEvaluation::getNumberOfImpostorScores() const
+{
+    return mImpostorScores.size();
+}
+
+float OsiEvaluation::getMeanGenuineScore() const
+{
+    double mean, variance;
+    computeStatistics(mGenuineScores, mean, variance);
+    return mean;
+}
+
+float OsiEvaluation::getMeanImpostorScore() const
+{
+    double mean, variance;
+    computeStatistics(mImpostorScores, mean, variance);
+    return mean;
+}
+
+// OPERATORS
+////////////
+
+void OsiEvaluation::clear()
+{
+    mGenuineScores.clear();
+    mImpostorScores.clear();
+}
+
+void OsiEvaluation::addGenuineScore(float score)
+{
+    mGenuineScores.push_back(score);
+}
+
+void OsiEvaluation::addImpostorScore(float score)
+{
+    mImpostorScores.push_back(score);
+}
+
+float OsiEvaluation::computeEER(float *pThreshold) const
+{
+    if (mGenuineScores.empty() || mImpostorScores.empty())
+    {
+        return -1;
+    }
+
+    std::vector<float> genuine(mGenuineScores);
+    std::vector<float> impostor(mImpostorScores);
+    std::sort(genuine.begin(), genuine.end());
+    std::sort(impostor.begin(), impostor.end());
+
+    // Candidate thresholds : all scores
+    std::vector<float> thresholds(genuine);
+    thresholds.insert(thresholds.end(), impostor.begin(), impostor.end());
+    std::sort(thresholds.begin(), thresholds.end());
+
+    float best_gap = 2;
+    float eer = -1;
+    for (int t = 0; t < thresholds.size(); t++)
+    {
+        // Accepted comparisons have a score lower or equal to the threshold
+        float far = (float)(std::upper_bound(impostor.begin(), impostor.end(), thresholds[t]) - impostor.begin()) /
+                    impostor.size();
+        float frr = (float)(genuine.end() - std::upper_bound(genuine.begin(), genuine.end(), thresholds[t])) /
+                    genuine.size();
+        if (std::fabs(far - frr) < best_gap)
+        {
+            best_gap = std::fabs(far - frr);
+            eer = (far + frr) / 2;
+            if (pThreshold)
+            {
+                *pThreshold = thresholds[t];
+            }
+        }
+    }
+
+    return eer;
+}
+
+float OsiEvaluation::computeDecidability() const
+{
+    if (mGenuineScores.empty() || mImpostorScores.empty())
+    {
+        return -1;
+    }
+
+    double genuine_mean, genuine_variance, impostor_mean, impostor_variance;
+    computeStatistics(mGenuineScores, genuine_mean, genuine_variance);
+    computeStatistics(mImpostorScores, impostor_mean, impostor_variance);
+
+    double spread = std::sqrt((genuine_variance + impostor_variance) / 2);
+    if (spread <= 0)
+    {
+        // Constant scores : either no separation at all, or a perfect one
+        return genuine_mean == impostor_mean ? 0 : INFINITY;
+    }
+    return std::fabs(impostor_mean - genuine_mean) / spread;
+}
+
+void OsiEvaluation::computeStatistics(const std::vector<float> &rScores, double &rMean, double &rVariance)
+{
+    rMean = 0;
+    rVariance = 0;
+    if (rScores.empty())
+    {
+        return;
+    }
+
+    for (int i = 0; i < rScores.size(); i++)
+    {
+        rMean += rScores[i];
+    }
+    rMean /= rScores.size();
+
+    for (int i = 0; i < rScores.size(); i++)
+    {
+        rVariance += (rScores[i] - rMean) * (rScores[i] - rMean);
+    }
+    rVariance /= rScores.size();
+}
@@ -6,14 +6,72 @@
  * License : BSD
  ********************************************************/
 
+#include <algorithm>
 #include <fstream>
+#include <sstream>
 #include <stdexcept>
 
 #include <opencv2/highgui.hpp>
 
 #include "OsiEye.h"
+#include "OsiMappedImage.h"
 #include "OsiProcessings.h"
 
+// Write a 32-bit word of a template in little-endian order
+static void putTemplateWord(std::vector<unsigned char> &rData, int word)
+{
+    for (int b = 0; b < 4; b++)
+    {
+        rData.push_back((unsigned char)((unsigned int)word >> (8 * b)));
+    }
+}
+
+// Read a 32-bit word of a template
+static int getTemplateWord(const std::vector<unsigned char> &rData, size_t &rPos)
+{
+    if (rPos + 4 > rData.size())
+    {
+        throw std::runtime_error("Truncated template");
+    }
+    const unsigned char *p = &rData[rPos];
+    rPos += 4;
+    return (int)(p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24));
+}
+
+// Write an 8-bit image of a template (size, then rows without padding), or an empty size
+static void putTemplateImage(std::vector<unsigned char> &rData, const IplImage *pImage)
+{
+    putTemplateWord(rData, pImage ? pImage->width : 0);
+    putTemplateWord(rData, pImage ? pImage->height : 0);
+    for (int y = 0; pImage && y < pImage->height; y++)
+    {
+        const unsigned char *row = (const unsigned char *)pImage->imageData + y * pImage->widthStep;
+        rData.insert(rData.end(), row, row + pImage->width);
+    }
+}
+
+// Read an 8-bit image of a template (0 if its size is empty)
+static IplImage *getTemplateImage(const std::vector<unsigned char> &rData, size_t &rPos)
+{
+    int width = getTemplateWord(rData, rPos);
+    int height = getTemplateWord(rData, rPos);
+    if (width <= 0 || height <= 0)
+    {
+        return 0;
+    }
+    if ((rData.size() - rPos) / width < height)
+    {
+        throw std::runtime_error("Truncated template");
+    }
+    IplImage *image = cvCreateImage(cvSize(width, height), IPL_DEPTH_8U, 1);
+    for (int y = 0; y < height; y++)
+    {
+        std::copy(&rData[rPos], &rData[rPos] + width, (unsigned char *)image->imageData + y * image->widthStep);
+        rPos += width;
+    }
+    return image;
+}
+
 // CONSTRUCTORS & DESTRUCTORS
 /////////////////////////////
 
@@ -31,7 +89,7 @@ OsiEye::OsiEye()
 
 OsiEye::~OsiEye()
 {
-    cvReleaseImage(&mpOriginalImage);
+    releaseOriginalImage();
     cvReleaseImage(&mpSegmentedImage);
     cvReleaseImage(&mpMask);
     cvReleaseImage(&mpNormalizedImage);
@@ -42,16 +100,49 @@ OsiEye::~OsiEye()
 // Functions for loading images and parameters
 //////////////////////////////////////////////
 
-void OsiEye::loadImage(const std::string &rFilename, IplImage **ppImage)
+void OsiEye::loadImage(const std::string &rFilename, IplImage **ppImage, OsiPackFile *pPack)
 {
     // :WARNING: ppImage is a pointer of pointer
-    try
+    if (*ppImage)
     {
-        if (*ppImage)
+        cvReleaseImage(ppImage);
+    }
+
+    // Entry of a pack file
+    if (pPack)
+    {
+        std::vector<unsigned char> data;
+        if (!pPack->read(rFilename, data))
         {
-            cvReleaseImage(ppImage);
+            std::cout << "Cannot load image : " << rFilename << " is not in the pack file" << std::endl;
+            return;
         }
+        cv::Mat m = cv::imdecode(data, 0);
+        if (m.empty())
+        {
+            std::cout << "Cannot decode image : " << rFilename << std::endl;
+            return;
+        }
+        IplImage image = cvIplImage(m);
+        *ppImage = cvCloneImage(&image);
+        return;
+    }
+
+    // Uncompressed images are copied from the file without decoding
+    OsiMappedImage mapped;
+    if (mapped.open(rFilename))
+    {
+        *ppImage = mapped.cloneImage();
+        return;
+    }
+
+    decodeImage(rFilename, ppImage);
+}
 
+void OsiEye::decodeImage(const std::string &rFilename, IplImage **ppImage)
+{
+    try
+    {
         auto m = cv::imread(rFilename, 0);
         auto image = cvIplImage(m);
 
@@ -68,35 +159,108 @@ void OsiEye::loadImage(const std::string &rFilename, IplImage **ppImage)
     }
 }
 
-void OsiEye::loadOriginalImage(const std::string &rFilename)
+void OsiEye::loadOriginalImage(const std::string &rFilename, const CvSize &rRawSize)
 {
-    loadImage(rFilename, &mpOriginalImage);
+    releaseOriginalImage();
+
+    // Uncompressed images are read in place : neither decoded nor copied
+    if (mOriginalMapping.open(rFilename, rRawSize))
+    {
+        if (!mOriginalMapping.isBottomUp())
+        {
+            mpOriginalImage = mOriginalMapping.getImage();
+            return;
+        }
+
+        // Rows must be put back in order
+        mpOriginalImage = mOriginalMapping.cloneImage();
+        mOriginalMapping.close();
+        return;
+    }
+
+    decodeImage(rFilename, &mpOriginalImage);
 }
 
-void OsiEye::loadMask(const std::string &rFilename)
+void OsiEye::setOriginalImage(const IplImage *pImage)
 {
-    loadImage(rFilename, &mpMask);
+    releaseOriginalImage();
+    mpOriginalImage = cvCloneImage(pImage);
 }
 
-void OsiEye::loadNormalizedImage(const std::string &rFilename)
+void OsiEye::decodeOriginalImage(const std::string &rName, const std::vector<unsigned char> &rData,
+                                 const CvSize &rRawSize)
 {
-    loadImage(rFilename, &mpNormalizedImage);
+    releaseOriginalImage();
+
+    // Raw pixels are only copied
+    if (rRawSize.width > 0 && rRawSize.height > 0 && rData.size() == (size_t)rRawSize.width * rRawSize.height)
+    {
+        IplImage image;
+        cvInitImageHeader(&image, rRawSize, IPL_DEPTH_8U, 1);
+        cvSetData(&image, (void *)&rData[0], rRawSize.width);
+        mpOriginalImage = cvCloneImage(&image);
+        return;
+    }
+
+    cv::Mat m = rData.empty() ? cv::Mat() : cv::imdecode(rData, 0);
+    if (m.empty())
+    {
+        throw std::runtime_error("Cannot decode image : " + rName);
+    }
+    IplImage image = cvIplImage(m);
+    mpOriginalImage = cvCloneImage(&image);
 }
 
-void OsiEye::loadNormalizedMask(const std::string &rFilename)
+void OsiEye::releaseOriginalImage()
 {
-    loadImage(rFilename, &mpNormalizedMask);
+    // The header of a mapped image belongs to the mapping
+    if (mpOriginalImage && mpOriginalImage == mOriginalMapping.getImage())
+    {
+        mpOriginalImage = 0;
+    }
+    mOriginalMapping.close();
+    cvReleaseImage(&mpOriginalImage);
 }
 
-void OsiEye::loadIrisCode(const std::string &rFilename)
+void OsiEye::loadMask(const std::string &rFilename, OsiPackFile *pPack)
 {
-    loadImage(rFilename, &mpIrisCode);
+    loadImage(rFilename, &mpMask, pPack);
 }
 
-void OsiEye::loadParameters(const std::string &rFilename)
+void OsiEye::loadNormalizedImage(const std::string &rFilename, OsiPackFile *pPack)
 {
-    // Open the file
-    std::ifstream file(rFilename.c_str(), std::ios::in);
+    loadImage(rFilename, &mpNormalizedImage, pPack);
+}
+
+void OsiEye::loadNormalizedMask(const std::string &rFilename, OsiPackFile *pPack)
+{
+    loadImage(rFilename, &mpNormalizedMask, pPack);
+}
+
+void OsiEye::loadIrisCode(const std::string &rFilename, OsiPackFile *pPack)
+{
+    loadImage(rFilename, &mpIrisCode, pPack);
+}
+
+void OsiEye::loadParameters(const std::string &rFilename, OsiPackFile *pPack)
+{
+    // Open the file, or read the entry of the pack
+    std::ifstream stream;
+    std::istringstream entry;
+    std::istream &file = pPack ? (std::istream &)entry : (std::istream &)stream;
+    std::vector<unsigned char> data;
+    if (pPack)
+    {
+        if (!pPack->read(rFilename, data))
+        {
+            throw std::runtime_error("Cannot load the parameters : " + rFilename + " is not in the pack file");
+        }
+        entry.str(std::string(data.begin(), data.end()));
+    }
+    else
+    {
+        stream.open(rFilename.c_str(), std::ios::in);
+    }
 
     // If file is not opened
     if (!file)
@@ -142,14 +306,12 @@ void OsiEye::loadParameters(const std::string &rFilename)
         throw std::runtime_error("Error while loading parameters from " + rFilename);
     }
 
-    // Close the file
-    file.close();
 }
 
 // Functions for saving images and parameters
 /////////////////////////////////////////////
 
-void OsiEye::saveImage(const std::string &rFilename, const IplImage *pImage)
+void OsiEye::saveImage(const std::string &rFilename, const IplImage *pImage, OsiPackFile *pPack)
 {
     // :TODO: no exception here, but 2 error messages
     // 1. pImage does NOT exist => "image was neither comptued nor loaded"
@@ -158,41 +320,60 @@ void OsiEye::saveImage(const std::string &rFilename, const IplImage *pImage)
     {
         throw std::runtime_error("Cannot save image " + rFilename + " because this image is not built");
     }
+
+    // Entry of a pack file, encoded in the format given by the extension of its name
+    if (pPack)
+    {
+        std::vector<unsigned char> data;
+        if (!cv::imencode(rFilename.substr(rFilename.find_last_of('.')), cv::cvarrToMat(pImage), data))
+        {
+            std::cout << "Cannot encode image " << rFilename << std::endl;
+            return;
+        }
+        pPack->write(rFilename, data);
+        return;
+    }
     if (!cv::imwrite(rFilename, cv::cvarrToMat(pImage)))
     {
         std::cout << "Cannot save image as " << rFilename << std::endl;
     }
 }
 
-void OsiEye::saveSegmentedImage(const std::string &rFilename)
+void OsiEye::saveSegmentedImage(const std::string &rFilename, OsiPackFile *pPack)
 {
-    saveImage(rFilename, mpSegmentedImage);
+    saveImage(rFilename, mpSegmentedImage, pPack);
 }
 
-void OsiEye::saveMask(const std::string &rFilename)
+void OsiEye::saveMask(const std::string &rFilename, OsiPackFile *pPack)
 {
-    saveImage(rFilename, mpMask);
+    saveImage(rFilename, mpMask, pPack);
 }
 
-void OsiEye::saveNormalizedImage(const std::string &rFilename)
+void OsiEye::saveNormalizedImage(const std::string &rFilename, OsiPackFile *pPack)
 {
-    saveImage(rFilename, mpNormalizedImage);
+    saveImage(rFilename, mpNormalizedImage, pPack);
 }
 
-void OsiEye::saveNormalizedMask(const std::string &rFilename)
+void OsiEye::saveNormalizedMask(const std::string &rFilename, OsiPackFile *pPack)
 {
-    saveImage(rFilename, mpNormalizedMask);
+    saveImage(rFilename, mpNormalizedMask, pPack);
 }
 
-void OsiEye::saveIrisCode(const std::string &rFilename)
+void OsiEye::saveIrisCode(const std::string &rFilename, OsiPackFile *pPack)
 {
-    saveImage(rFilename, mpIrisCode);
+    saveImage(rFilename, mpIrisCode, pPack);
 }
 
-void OsiEye::saveParameters(const std::string &rFilename)
+void OsiEye::saveParameters(const std::string &rFilename, OsiPackFile *pPack)
 {
-    // Open the file
-    std::ofstream file(rFilename.c_str(), std::ios::out);
+    // Open the file, or build the entry of the pack
+    std::ofstream stream;
+    std::ostringstream entry;
+    std::ostream &file = pPack ? (std::ostream &)entry : (std::ostream &)stream;
+    if (!pPack)
+    {
+        stream.open(rFilename.c_str(), std::ios::out);
+    }
 
     // If file is not opened
     if (!file)
@@ -230,8 +411,12 @@ void OsiEye::saveParameters(const std::string &rFilename)
         throw std::runtime_error("Error while saving parameters in " + rFilename);
     }
 
-    // Close the file
-    file.close();
+    // Add the entry to the pack
+    if (pPack)
+    {
+        std::string text = entry.str();
+        pPack->write(rFilename, std::vector<unsigned char>(text.begin(), text.end()));
+    }
 }
 
 // Functions for processings
@@ -251,6 +436,17 @@ void OsiEye::initMask()
     cvSet(mpMask, cvScalar(255));
 }
 
+void OsiEye::assessQuality(int minPupilDiameter, float &rFocus, float &rOcclusion, float &rContrast)
+{
+    if (!mpOriginalImage)
+    {
+        throw std::runtime_error("Cannot assess quality because original image is not loaded");
+    }
+
+    OsiProcessings op;
+    op.assessQuality(mpOriginalImage, minPupilDiameter, rFocus, rOcclusion, rContrast);
+}
+
 void OsiEye::segment(int minIrisDiameter, int minPupilDiameter, int maxIrisDiameter, int maxPupilDiameter)
 {
     if (!mpOriginalImage)
@@ -258,6 +454,19 @@ void OsiEye::segment(int minIrisDiameter, int minPupilDiameter, int maxIrisDiame
         throw std::runtime_error("Cannot segment image because original image is not loaded");
     }
 
+    // Plan for this eye only
+    OsiSegmentationPlan plan(mpOriginalImage->width, mpOriginalImage->height, minIrisDiameter, minPupilDiameter,
+                             maxIrisDiameter, maxPupilDiameter);
+    segment(plan);
+}
+
+void OsiEye::segment(const OsiSegmentationPlan &rPlan, float scale, OsiTracker *pTracker)
+{
+    if (!mpOriginalImage)
+    {
+        throw std::runtime_error("Cannot segment image because original image is not loaded");
+    }
+
     // Initialize mask and segmented image
     mpMask = cvCreateImage(cvGetSize(mpOriginalImage), IPL_DEPTH_8U, 1);
     mpSegmentedImage = cvCreateImage(cvGetSize(mpOriginalImage), IPL_DEPTH_8U, 3);
@@ -265,10 +474,54 @@ void OsiEye::segment(int minIrisDiameter, int minPupilDiameter, int maxIrisDiame
 
     // Processing functions
     OsiProcessings op;
+    op.setDeadline(&mDeadline);
+    op.setProfile(mProfile);
 
-    // Segment the eye
-    op.segment(mpOriginalImage, mpMask, mPupil, mIris, mThetaCoarsePupil, mThetaCoarseIris, mCoarsePupilContour,
-               mCoarseIrisContour, minIrisDiameter, minPupilDiameter, maxIrisDiameter, maxPupilDiameter);
+    // Segment the eye at the original resolution
+    if (scale >= 1)
+    {
+        op.segment(mpOriginalImage, mpMask, mPupil, mIris, mThetaCoarsePupil, mThetaCoarseIris, mCoarsePupilContour,
+                   mCoarseIrisContour, rPlan, pTracker);
+    }
+
+    // Segment the eye at the canonical resolution, then go back to the original resolution
+    else
+    {
+        IplImage *canonical = cvCreateImage(
+            cvSize(mpOriginalImage->width * scale, mpOriginalImage->height * scale), IPL_DEPTH_8U, 1);
+        cvResize(mpOriginalImage, canonical, CV_INTER_AREA);
+        IplImage *canonical_mask = cvCreateImage(cvGetSize(canonical), IPL_DEPTH_8U, 1);
+
+        op.segment(canonical, canonical_mask, mPupil, mIris, mThetaCoarsePupil, mThetaCoarseIris,
+                   mCoarsePupilContour, mCoarseIrisContour, rPlan, pTracker);
+
+        // Exact ratios (sizes of canonical image are rounded)
+        float sx = (float)mpOriginalImage->width / canonical->width;
+        float sy = (float)mpOriginalImage->height / canonical->height;
+
+        // Circles and contours : pixel centers are mapped to pixel centers
+        mPupil.setCircle(cvRound((mPupil.getCenter().x + 0.5) * sx - 0.5),
+                         cvRound((mPupil.getCenter().y + 0.5) * sy - 0.5), cvRound(mPupil.getRadius() * sx));
+        mIris.setCircle(cvRound((mIris.getCenter().x + 0.5) * sx - 0.5), cvRound((mIris.getCenter().y + 0.5) * sy - 0.5),
+                        cvRound(mIris.getRadius() * sx));
+        for (int i = 0; i < mCoarsePupilContour.size(); i++)
+        {
+            mCoarsePupilContour[i].x = cvRound((mCoarsePupilContour[i].x + 0.5) * sx - 0.5);
+            mCoarsePupilContour[i].y = cvRound((mCoarsePupilContour[i].y + 0.5) * sy - 0.5);
+        }
+        for (int j = 0; j < mCoarseIrisContour.size(); j++)
+        {
+            mCoarseIrisContour[j].x = cvRound((mCoarseIrisContour[j].x + 0.5) * sx - 0.5);
+            mCoarseIrisContour[j].y = cvRound((mCoarseIrisContour[j].y + 0.5) * sy - 0.5);
+        }
+
+        // Mask : interpolate then binarize again
+        cvResize(canonical_mask, mpMask, CV_INTER_LINEAR);
+        cvThreshold(mpMask, mpMask, 127, 255, CV_THRESH_BINARY);
+
+        cvReleaseImage(&canonical);
+        cvReleaseImage(&canonical_mask);
+    }
 
     // Draw on segmented image
     IplImage *tmp = cvCloneImage(mpMask);
@@ -280,12 +533,62 @@ void OsiEye::segment(int minIrisDiameter, int minPupilDiameter, int maxIrisDiame
     cvReleaseImage(&tmp);
     cvCircle(mpSegmentedImage, mPupil.getCenter(), mPupil.getRadius(), cvScalar(0, 255, 0));
     cvCircle(mpSegmentedImage, mIris.getCenter(), mIris.getRadius(), cvScalar(0, 255, 0));
+
+    // The loops of the segmentation are cut short when the budget is exceeded : do not trust the result
+    mDeadline.check("segmentation");
+}
+
+CvSize OsiEye::getOriginalImageSize() const
+{
+    if (!mpOriginalImage)
+    {
+        return cvSize(0, 0);
+    }
+    return cvGetSize(mpOriginalImage);
+}
+
+const IplImage *OsiEye::getOriginalImage() const
+{
+    return mpOriginalImage;
+}
+
+const IplImage *OsiEye::getIrisCode() const
+{
+    return mpIrisCode;
+}
+
+const IplImage *OsiEye::getNormalizedMask() const
+{
+    return mpNormalizedMask;
+}
+
+void OsiEye::setProfile(const OsiProfile &rProfile)
+{
+    mProfile = rProfile;
+}
+
+void OsiEye::setTimeBudget(int budget)
+{
+    mDeadline.start(budget);
+}
+
+double OsiEye::getElapsedTime() const
+{
+    return mDeadline.getElapsed();
+}
+
+int OsiEye::getDegradationLevel() const
+{
+    return mDeadline.getReachedLevel();
 }
 
 void OsiEye::normalize(int rWidthOfNormalizedIris, int rHeightOfNormalizedIris)
 {
+    mDeadline.check("normalization");
+
     // Processing functions
     OsiProcessings op;
+    op.setDeadline(&mDeadline);
 
     // For the image
     if (!mpOriginalImage)
@@ -318,6 +621,14 @@ void OsiEye::normalize(int rWidthOfNormalizedIris, int rHeightOfNormalizedIris)
                             mCoarsePupilContour, mCoarseIrisContour);
 }
 
+void OsiEye::keepNormalizedImages()
+{
+    releaseOriginalImage();
+    cvReleaseImage(&mpSegmentedImage);
+    cvReleaseImage(&mpMask);
+    cvReleaseImage(&mpIrisCode);
+}
+
 void OsiEye::encode(const std::vector<CvMat *> &rGaborFilters)
 {
     if (!mpNormalizedImage)
@@ -325,15 +636,86 @@ void OsiEye::encode(const std::vector<CvMat *> &rGaborFilters)
         throw std::runtime_error("Cannot encode because normalized image is not loaded");
     }
 
+    mDeadline.check("encoding");
+
     // Create the image to store the iris code
     CvSize size = cvGetSize(mpNormalizedImage);
     mpIrisCode = cvCreateImage(cvSize(size.width, size.height * rGaborFilters.size()), IPL_DEPTH_8U, 1);
 
     // Encode
     OsiProcessings op;
+    op.setDeadline(&mDeadline);
     op.encode(mpNormalizedImage, mpIrisCode, rGaborFilters);
 }
 
+void OsiEye::normalizeAndEncode(int rWidthOfNormalizedIris, int rHeightOfNormalizedIris,
+                                const std::vector<CvMat *> &rGaborFilters)
+{
+    if (!mpOriginalImage)
+    {
+        throw std::runtime_error("Cannot normalize image because original image is not loaded");
+    }
+
+    if (mThetaCoarsePupil.empty() || mThetaCoarseIris.empty())
+    {
+        throw std::runtime_error("Cannot normalize image because contours are not correctly computed/loaded");
+    }
+
+    mDeadline.check("normalization");
+
+    // For the mask
+    if (!mpMask)
+    {
+        initMask();
+    }
+
+    // Create the normalized mask and the image to store the iris code
+    mpNormalizedMask = cvCreateImage(cvSize(rWidthOfNormalizedIris, rHeightOfNormalizedIris), IPL_DEPTH_8U, 1);
+    mpIrisCode = cvCreateImage(cvSize(rWidthOfNormalizedIris, rHeightOfNormalizedIris * rGaborFilters.size()),
+                               IPL_DEPTH_8U, 1);
+
+    // Normalize and encode
+    OsiProcessings op;
+    op.setDeadline(&mDeadline);
+    op.normalizeAndEncode(mpOriginalImage, mpMask, mpIrisCode, mpNormalizedMask, mPupil, mIris, mThetaCoarsePupil,
+                          mThetaCoarseIris, mCoarsePupilContour, mCoarseIrisContour, rGaborFilters);
+}
+
+int OsiEye::countBitErrors(int rWidthOfNormalizedIris, int rHeightOfNormalizedIris,
+                           const std::vector<CvMat *> &rReferenceFilters)
+{
+    if (!mpIrisCode)
+    {
+        throw std::runtime_error("Cannot compare iris codes because iris code is not computed");
+    }
+
+    if (!mpNormalizedImage && (!mpOriginalImage || mThetaCoarsePupil.empty() || mThetaCoarseIris.empty()))
+    {
+        throw std::runtime_error("Cannot compare iris codes because the normalized iris cannot be computed");
+    }
+
+    OsiProcessings op;
+    IplImage *reference = cvCreateImage(cvGetSize(mpIrisCode), IPL_DEPTH_8U, 1);
+
+    if (mpNormalizedImage)
+    {
+        op.encode(mpNormalizedImage, reference, rReferenceFilters);
+    }
+    else
+    {
+        IplImage *normalized_mask =
+            cvCreateImage(cvSize(rWidthOfNormalizedIris, rHeightOfNormalizedIris), IPL_DEPTH_8U, 1);
+        op.normalizeAndEncode(mpOriginalImage, mpMask, reference, normalized_mask, mPupil, mIris, mThetaCoarsePupil,
+                              mThetaCoarseIris, mCoarsePupilContour, mCoarseIrisContour, rReferenceFilters);
+        cvReleaseImage(&normalized_mask);
+    }
+
+    int errors = op.countDifferentBits(mpIrisCode, reference);
+    cvReleaseImage(&reference);
+
+    return errors;
+}
+
 float OsiEye::match(OsiEye &rEye, const CvMat *pApplicationPoints)
 {
     // Check that both iris codes are built
@@ -363,14 +745,61 @@ float OsiEye::match(OsiEye &rEye, const CvMat *pApplicationPoints)
         // cout << "Normalized mask of image 2 is missing for matching. All pixels are initialized to 255" << endl ;
     }
 
-    // Build the total mask = mask1 * mask2 * points
-    IplImage *temp = cvCreateImage(cvGetSize(pApplicationPoints), mpIrisCode->depth, 1);
+    return matchIrisCodes(mpIrisCode, rEye, rEye.mpIrisCode, pApplicationPoints);
+}
+
+float OsiEye::compare(const OsiEye &rEye, const CvMat *pApplicationPoints) const
+{
+    if (!mpIrisCode)
+    {
+        throw std::runtime_error("Cannot match because iris code 1 is not built (nor computed neither loaded)");
+    }
+    if (!rEye.mpIrisCode)
+    {
+        throw std::runtime_error("Cannot match because iris code 2 is not built (nor computed neither loaded)");
+    }
+
+    return matchIrisCodes(mpIrisCode, rEye, rEye.mpIrisCode, pApplicationPoints);
+}
+
+IplImage *OsiEye::computeIrisCode(const std::vector<CvMat *> &rGaborFilters) const
+{
+    if (!mpNormalizedImage)
+    {
+        throw std::runtime_error("Cannot encode because normalized image is not loaded");
+    }
+
+    CvSize size = cvGetSize(mpNormalizedImage);
+    IplImage *code = cvCreateImage(cvSize(size.width, size.height * rGaborFilters.size()), IPL_DEPTH_8U, 1);
+
+    OsiProcessings op;
+    op.encode(mpNormalizedImage, code, rGaborFilters);
+
+    return code;
+}
+
+float OsiEye::matchIrisCodes(const IplImage *pIrisCode, const OsiEye &rEye, const IplImage *pOtherIrisCode,
+                             const CvMat *pApplicationPoints) const
+{
+    // Build the total mask = mask1 * mask2 * points (missing masks are full)
+    IplImage *temp = cvCreateImage(cvGetSize(pApplicationPoints), pIrisCode->depth, 1);
     cvSet(temp, cvScalar(0));
-    cvAnd(mpNormalizedMask, rEye.mpNormalizedMask, temp, pApplicationPoints);
+    if (mpNormalizedMask && rEye.mpNormalizedMask)
+    {
+        cvAnd(mpNormalizedMask, rEye.mpNormalizedMask, temp, pApplicationPoints);
+    }
+    else if (mpNormalizedMask || rEye.mpNormalizedMask)
+    {
+        cvCopy(mpNormalizedMask ? mpNormalizedMask : rEye.mpNormalizedMask, temp, pApplicationPoints);
+    }
+    else
+    {
+        cvSet(temp, cvScalar(255), pApplicationPoints);
+    }
 
     // Copy the mask f times, where f correspond to the number of codes (= number of filters)
-    int n_codes = mpIrisCode->height / pApplicationPoints->height;
-    IplImage *total_mask = cvCreateImage(cvGetSize(mpIrisCode), IPL_DEPTH_8U, 1);
+    int n_codes = pIrisCode->height / pApplicationPoints->height;
+    IplImage *total_mask = cvCreateImage(cvGetSize(pIrisCode), IPL_DEPTH_8U, 1);
     for (int n = 0; n < n_codes; n++)
     {
         cvSetImageROI(total_mask,
@@ -379,9 +808,10 @@ float OsiEye::match(OsiEye &rEye, const CvMat *pApplicationPoints)
         cvResetImageROI(total_mask);
     }
 
-    // Match
+    // Match (fewer shifts if one of the eyes was processed with cheaper settings)
     OsiProcessings op;
-    float score = op.match(mpIrisCode, rEye.mpIrisCode, total_mask);
+    int shift = mProfile.getDegraded(std::max(getDegradationLevel(), rEye.getDegradationLevel())).getMatchShift();
+    float score = op.match(pIrisCode, pOtherIrisCode, total_mask, shift);
 
     // Free memory
     cvReleaseImage(&temp);
@@ -389,3 +819,31 @@ float OsiEye::match(OsiEye &rEye, const CvMat *pApplicationPoints)
 
     return score;
 }
+
+void OsiEye::saveTemplate(std::vector<unsigned char> &rData) const
+{
+    if (!mpIrisCode)
+    {
+        throw std::runtime_error("Cannot send the eye because iris code is not built (nor computed neither loaded)");
+    }
+
+    rData.clear();
+    putTemplateWord(rData, getDegradationLevel());
+    putTemplateImage(rData, mpIrisCode);
+    putTemplateImage(rData, mpNormalizedMask);
+}
+
+void OsiEye::loadTemplate(const std::vector<unsigned char> &rData)
+{
+    size_t pos = 0;
+    mDeadline.setReachedLevel(getTemplateWord(rData, pos));
+
+    cvReleaseImage(&mpIrisCode);
+    cvReleaseImage(&mpNormalizedMask);
+    mpIrisCode = getTemplateImage(rData, pos);
+    mpNormalizedMask = getTemplateImage(rData, pos);
+    if (!mpIrisCode)
+    {
+        throw std::runtime_error("The template has no iris code");
+    }
+}
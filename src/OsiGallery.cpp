@@ -0,0 +1,866 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <stdexcept>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
+
+#include "OsiGallery.h"
+
+// Get the NUMA nodes and their CPUs (one node without CPUs if the machine is not NUMA, or not Linux)
+static void getNumaNodes(std::vector<int> &rNodes, std::vector<std::vector<int>> &rCpus)
+{
+    rNodes.clear();
+    rCpus.clear();
+#ifdef __linux__
+    DIR *dir = opendir("/sys/devices/system/node");
+    for (dirent *entry = dir ? readdir(dir) : 0; entry; entry = readdir(dir))
+    {
+        int node = -1;
+        if (sscanf(entry->d_name, "node%d", &node) != 1)
+        {
+            continue;
+        }
+
+        // List of CPUs : "0-15,32-47"
+        std::ifstream file(("/sys/devices/system/node/" + std::string(entry->d_name) + "/cpulist").c_str());
+        std::vector<int> cpus;
+        std::string range;
+        while (std::getline(file, range, ','))
+        {
+            int from = 0, to = -1;
+            int n = sscanf(range.c_str(), "%d-%d", &from, &to);
+            for (int cpu = from; n >= 1 && cpu <= (n == 2 ? to : from); cpu++)
+            {
+                cpus.push_back(cpu);
+            }
+        }
+        if (!cpus.empty())
+        {
+            rNodes.push_back(node);
+            rCpus.push_back(cpus);
+        }
+    }
+    if (dir)
+    {
+        closedir(dir);
+    }
+#endif
+    if (rNodes.empty())
+    {
+        rNodes.push_back(0);
+        rCpus.push_back(std::vector<int>());
+    }
+
+    // Nodes in order
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    for (int n = 0; n < rNodes.size(); n++)
+    {
+        nodes.push_back(std::make_pair(rNodes[n], rCpus[n]));
+    }
+    std::sort(nodes.begin(), nodes.end());
+    for (int n = 0; n < nodes.size(); n++)
+    {
+        rNodes[n] = nodes[n].first;
+        rCpus[n] = nodes[n].second;
+    }
+}
+
+// Pin the calling thread to CPUs
+static void pinThread(const std::vector<int> &rCpus)
+{
+#ifdef __linux__
+    if (rCpus.empty())
+    {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int c = 0; c < rCpus.size(); c++)
+    {
+        if (rCpus[c] < CPU_SETSIZE)
+        {
+            CPU_SET(rCpus[c], &set);
+        }
+    }
+    if (sched_setaffinity(0, sizeof(set), &set))
+    {
+        std::cout << "Cannot pin a search thread to its NUMA node" << std::endl;
+    }
+#endif
+}
+
+// Remove the candidates whose score is higher than a maximum (range query)
+static void keepUnder(std::vector<OsiCandidate> &rCandidates, float maxScore)
+{
+    int n = 0;
+    while (n < rCandidates.size() && rCandidates[n].score <= maxScore)
+    {
+        n++;
+    }
+    rCandidates.resize(n);
+}
+
+// Remove a gallery image from the candidates, and keep the k best ones (0 : all)
+static void removeIndex(std::vector<OsiCandidate> &rCandidates, int index, int k)
+{
+    for (int c = 0; c < rCandidates.size(); c++)
+    {
+        if (rCandidates[c].index == index)
+        {
+            rCandidates.erase(rCandidates.begin() + c);
+            break;
+        }
+    }
+    if (k > 0 && rCandidates.size() > k)
+    {
+        rCandidates.resize(k);
+    }
+}
+
+// Count the expected candidates (exhaustive search) found by an indexed search, and if the best one is the same
+static void countFound(const std::vector<OsiCandidate> &rFound, const std::vector<OsiCandidate> &rExpected,
+                       double &rNumberExpected, double &rNumberFound, int &rSameBest)
+{
+    std::set<int> found;
+    for (int c = 0; c < rFound.size(); c++)
+    {
+        found.insert(rFound[c].index);
+    }
+    for (int c = 0; c < rExpected.size(); c++)
+    {
+        rNumberExpected++;
+        rNumberFound += found.count(rExpected[c].index);
+    }
+    if (rExpected.empty() || (!rFound.empty() && rFound[0].index == rExpected[0].index))
+    {
+        rSameBest++;
+    }
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiGallery::OsiGallery()
+{
+    mpApplicationPoints = 0;
+    mpProbe = 0;
+    mK = 0;
+    mGeneration = 0;
+    mPending = 0;
+    mStopping = false;
+    mSearchTime = 0;
+    mIndexType = "none";
+    mRecallPeriod = 0;
+    mLshTables = 16;
+    mLshBits = 14;
+    mLshMaskedBits = 2;
+    mBloomWordRows = 8;
+    mBloomBlockWidth = 32;
+    mBloomTrees = 4;
+    mBloomCandidates = 100;
+    mCascadeStages = "1:4:0.1 3:2:0.3";
+    mTreeRadius = 1;
+    mTreeSlack = 0;
+    mTreeThreads = 1;
+    mClusters = 256;
+    mClusterProbe = 8;
+    mClusterThreads = 1;
+    mIndexedSearches = 0;
+    mMatchedEyes = 0;
+    mIndexTime = 0;
+    mMeasuredSearches = 0;
+    mExpectedCandidates = 0;
+    mFoundCandidates = 0;
+    mSameBest = 0;
+    mExhaustiveTime = 0;
+}
+
+OsiGallery::~OsiGallery()
+{
+    stop();
+}
+
+// OPERATORS
+////////////
+
+void OsiGallery::setMatching(const OsiProfile &rProfile, const CvMat *pApplicationPoints)
+{
+    mProfile = rProfile;
+    mpApplicationPoints = pApplicationPoints;
+}
+
+void OsiGallery::add(const std::string &rName, int index, const std::shared_ptr<OsiEye> &rpEye)
+{
+    if (!mPartitions.empty())
+    {
+        throw std::logic_error("Cannot enroll an eye while the gallery is searched by threads");
+    }
+    if (!rpEye->getIrisCode())
+    {
+        throw std::invalid_argument("Cannot enroll " + rName + " : its iris code is not loaded");
+    }
+    mEyes.push_back(rpEye);
+    mNames.push_back(rName);
+    mIndices.push_back(index);
+}
+
+int OsiGallery::getSize() const
+{
+    return mEyes.size();
+}
+
+void OsiGallery::clear()
+{
+    stop();
+    mEyes.clear();
+    mNames.clear();
+    mIndices.clear();
+}
+
+void OsiGallery::start(int nThreads, bool numa)
+{
+    stop();
+
+    std::vector<int> nodes;
+    std::vector<std::vector<int>> cpus;
+    if (numa)
+    {
+        getNumaNodes(nodes, cpus);
+    }
+    else
+    {
+        nodes.assign(1, 0);
+        cpus.assign(1, std::vector<int>());
+    }
+    nThreads = std::max<int>(nThreads, nodes.size());
+    if (nThreads <= 1 || mEyes.empty())
+    {
+        return;
+    }
+
+    // Consecutive threads on the same node, consecutive eyes for each thread
+    mPartitions.resize(nThreads);
+    for (int t = 0; t < nThreads; t++)
+    {
+        Partition &partition = mPartitions[t];
+        int n = (long long)t * nodes.size() / nThreads;
+        partition.node = nodes[n];
+        partition.cpus = cpus[n];
+        partition.first = (long long)mEyes.size() * t / nThreads;
+        partition.last = (long long)mEyes.size() * (t + 1) / nThreads;
+        partition.bytes = 0;
+        partition.searches = 0;
+    }
+    mStopping = false;
+    mSearchTime = 0;
+
+    // Wait for the copies of the eyes
+    std::unique_lock<std::mutex> lock(mMutex);
+    mPending = nThreads;
+    for (int t = 0; t < nThreads; t++)
+    {
+        mPartitions[t].thread = std::thread(&OsiGallery::runPartition, this, std::ref(mPartitions[t]));
+    }
+    mDoneCondition.wait(lock, [this] { return mPending == 0; });
+
+    std::cout << "The gallery is searched by " << nThreads << " threads on " << nodes.size() << (numa ? " NUMA" : "")
+              << (nodes.size() > 1 ? " nodes" : " node") << std::endl;
+}
+
+void OsiGallery::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mStartCondition.notify_all();
+    for (int t = 0; t < mPartitions.size(); t++)
+    {
+        if (mPartitions[t].thread.joinable())
+        {
+            mPartitions[t].thread.join();
+        }
+    }
+    mPartitions.clear();
+    mStopping = false;
+}
+
+void OsiGallery::setIndex(const std::string &rType, const std::string &rFilename, int recallPeriod)
+{
+    if (rType != "none" && rType != "lsh" && rType != "bloom" && rType != "cascade" && rType != "vptree" &&
+        rType != "ivf")
+    {
+        throw std::invalid_argument("Unknown gallery index : " + rType + " (none, lsh, bloom, cascade, vptree or ivf)");
+    }
+    mIndexType = rType;
+    mIndexFilename = rFilename;
+    mRecallPeriod = recallPeriod;
+}
+
+void OsiGallery::setLshParameters(int nTables, int nBits, int maxMaskedBits)
+{
+    mLshTables = nTables;
+    mLshBits = nBits;
+    mLshMaskedBits = maxMaskedBits;
+}
+
+void OsiGallery::setBloomParameters(int wordRows, int blockWidth, int nTrees, int nCandidates)
+{
+    mBloomWordRows = wordRows;
+    mBloomBlockWidth = blockWidth;
+    mBloomTrees = nTrees;
+    mBloomCandidates = nCandidates;
+}
+
+void OsiGallery::setCascadeStages(const std::string &rStages)
+{
+    mCascadeStages = rStages;
+}
+
+void OsiGallery::setTreeParameters(float radius, float slack, int nThreads)
+{
+    mTreeRadius = radius;
+    mTreeSlack = slack;
+    mTreeThreads = nThreads;
+}
+
+void OsiGallery::setClusterParameters(int nClusters, int nProbe, int nThreads)
+{
+    mClusters = nClusters;
+    mClusterProbe = nProbe;
+    mClusterThreads = nThreads;
+}
+
+void OsiGallery::buildIndex(bool rebuild)
+{
+    mIndexedSearches = 0;
+    mMatchedEyes = 0;
+    mIndexTime = 0;
+    mMeasuredSearches = 0;
+    mExpectedCandidates = 0;
+    mFoundCandidates = 0;
+    mSameBest = 0;
+    mExhaustiveTime = 0;
+    if (mIndexType == "none" || mEyes.empty())
+    {
+        return;
+    }
+    if (!mpApplicationPoints)
+    {
+        throw std::runtime_error("Cannot index the gallery without application points");
+    }
+
+    if (mIndexType == "bloom")
+    {
+        mBloomIndex.init(mBloomWordRows, mBloomBlockWidth, mBloomTrees);
+        for (int e = 0; e < mEyes.size(); e++)
+        {
+            OsiBitCode code;
+            code.pack(mEyes[e]->getIrisCode(), mEyes[e]->getNormalizedMask(), mpApplicationPoints);
+            mBloomIndex.add(e, code);
+        }
+        mBloomIndex.build();
+        std::cout << "Bloom index of " << mEyes.size() << " eyes (" << mBloomTrees << " trees) : "
+                  << mBloomIndex.getSize() / (1024 * 1024) << " MB" << std::endl;
+        return;
+    }
+
+    if (mIndexType == "cascade")
+    {
+        mCascade.init(mCascadeStages);
+        for (int e = 0; e < mEyes.size(); e++)
+        {
+            OsiBitCode code;
+            code.pack(mEyes[e]->getIrisCode(), mEyes[e]->getNormalizedMask(), mpApplicationPoints);
+            mCascade.add(code);
+        }
+        std::cout << "Cascade of short codes of " << mEyes.size() << " eyes (" << mCascadeStages << ") : "
+                  << mCascade.getSize() / (1024 * 1024) << " MB" << std::endl;
+        return;
+    }
+
+    if (mIndexType == "vptree")
+    {
+        // The distances between eyes of the gallery use the shift of the profile
+        mVpTree.init(mProfile.getMatchShift(), mTreeSlack);
+        for (int e = 0; e < mEyes.size(); e++)
+        {
+            OsiBitCode code;
+            code.pack(mEyes[e]->getIrisCode(), mEyes[e]->getNormalizedMask(), mpApplicationPoints);
+            mVpTree.add(mNames[e], code);
+        }
+        std::cout << "Vantage-point tree of " << mEyes.size() << " eyes (" << mVpTree.getSize() / (1024 * 1024)
+                  << " MB) ";
+        if (!rebuild && mIndexFilename != "" && mVpTree.load(mIndexFilename))
+        {
+            std::cout << "loaded from " << mIndexFilename << std::endl;
+            return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        mVpTree.build(mTreeThreads);
+        std::cout << "built by " << mTreeThreads << " threads in "
+                  << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s"
+                  << std::endl;
+        if (mIndexFilename != "")
+        {
+            mVpTree.save(mIndexFilename);
+        }
+        return;
+    }
+
+    if (mIndexType == "ivf")
+    {
+        mClusterIndex.init(mClusters, mProfile.getMatchShift());
+        for (int e = 0; e < mEyes.size(); e++)
+        {
+            OsiBitCode code;
+            code.pack(mEyes[e]->getIrisCode(), mEyes[e]->getNormalizedMask(), mpApplicationPoints);
+            mClusterIndex.add(mNames[e], code, mProfile.getDegraded(mEyes[e]->getDegradationLevel()).getMatchShift());
+        }
+        std::cout << "Clusters of " << mEyes.size() << " eyes ";
+        if (!rebuild && mIndexFilename != "" && mClusterIndex.load(mIndexFilename))
+        {
+            std::cout << "loaded from " << mIndexFilename << " (" << mClusterIndex.getAssignedTemplates()
+                      << " eyes added, " << mClusterIndex.getRemovedTemplates() << " removed)";
+            if (mClusterIndex.getAssignedTemplates() > 0 || mClusterIndex.getRemovedTemplates() > 0)
+            {
+                mClusterIndex.save(mIndexFilename);
+            }
+        }
+        else
+        {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            mClusterIndex.build(mClusterThreads);
+            std::cout << "built by " << mClusterThreads << " threads in "
+                      << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() << " s";
+            if (mIndexFilename != "")
+            {
+                mClusterIndex.save(mIndexFilename);
+            }
+        }
+        std::cout << " : " << mClusterIndex.getClusters() << " clusters, " << mClusterProbe << " scanned per search"
+                  << std::endl;
+
+        // The eyes are stored cluster after cluster
+        std::vector<int> order;
+        mClusterIndex.getOrder(order);
+        std::vector<std::shared_ptr<OsiEye>> eyes(order.size());
+        std::vector<std::string> names(order.size());
+        std::vector<int> indices(order.size());
+        for (int p = 0; p < order.size(); p++)
+        {
+            eyes[p] = mEyes[order[p]];
+            names[p] = mNames[order[p]];
+            indices[p] = mIndices[order[p]];
+        }
+        mEyes.swap(eyes);
+        mNames.swap(names);
+        mIndices.swap(indices);
+        return;
+    }
+
+    // The bits sampled by the tables are application points
+    OsiBitCode points;
+    points.pack(mEyes[0]->getIrisCode(), 0, mpApplicationPoints);
+    mLshIndex.init(mLshTables, mLshBits, mLshMaskedBits, points);
+
+    // Only the new or changed templates are hashed
+    bool loaded = !rebuild && mIndexFilename != "" && mLshIndex.load(mIndexFilename);
+    int hashed = 0;
+    for (int e = 0; e < mEyes.size(); e++)
+    {
+        OsiBitCode code;
+        code.pack(mEyes[e]->getIrisCode(), mEyes[e]->getNormalizedMask(), mpApplicationPoints);
+        hashed += mLshIndex.add(e, mNames[e], code);
+    }
+    std::cout << "LSH index of " << mEyes.size() << " eyes (" << mLshTables << " tables of " << mLshBits
+              << " bits) : " << hashed << " eyes hashed";
+    if (loaded)
+    {
+        std::cout << ", " << mEyes.size() - hashed << " reused from " << mIndexFilename;
+    }
+    std::cout << std::endl;
+
+    if (mIndexFilename != "" && (!loaded || hashed > 0 || mLshIndex.getRemovedTemplates() > 0))
+    {
+        mLshIndex.save(mIndexFilename);
+    }
+}
+
+void OsiGallery::showStatistics() const
+{
+    // Eyes matched with the index, and recall against the exhaustive search
+    if (mIndexedSearches > 0)
+    {
+        std::cout << "- Index " << mIndexType << " : " << 100 * mMatchedEyes / mIndexedSearches / mEyes.size()
+                  << " % of the gallery matched, " << 1000 * mIndexTime / mIndexedSearches << " ms per search";
+        if (mMeasuredSearches > 0)
+        {
+            std::cout << ", recall " << (mExpectedCandidates > 0 ? mFoundCandidates / mExpectedCandidates : 1)
+                      << ", same best candidate in " << 100.0 * mSameBest / mMeasuredSearches << " % of the searches"
+                      << " (exhaustive search : " << 1000 * mExhaustiveTime / mMeasuredSearches
+                      << " ms per search, " << mMeasuredSearches << " searches)";
+        }
+        std::cout << std::endl;
+    }
+
+    if (mPartitions.empty() || mSearchTime <= 0)
+    {
+        return;
+    }
+
+    // Bytes of templates scanned by the threads of each node, during the time of the searches
+    std::map<int, int> threads, eyes;
+    std::map<int, double> bytes;
+    for (int t = 0; t < mPartitions.size(); t++)
+    {
+        const Partition &partition = mPartitions[t];
+        threads[partition.node]++;
+        eyes[partition.node] += partition.last - partition.first;
+        bytes[partition.node] += partition.bytes * partition.searches;
+    }
+    for (std::map<int, int>::const_iterator it = threads.begin(); it != threads.end(); it++)
+    {
+        double megabytes = bytes[it->first] / (1024 * 1024);
+        std::cout << "- Node " << it->first << " : " << it->second << " threads, " << eyes[it->first] << " eyes, "
+                  << megabytes << " MB scanned at " << megabytes / mSearchTime << " MB/s" << std::endl;
+    }
+}
+
+void OsiGallery::search(const OsiEye &rProbe, int k, std::vector<OsiCandidate> &rCandidates)
+{
+    if (!mpApplicationPoints)
+    {
+        throw std::runtime_error("Cannot search the gallery without application points");
+    }
+    if (mIndexType == "none")
+    {
+        searchAll(rProbe, k, rCandidates);
+        return;
+    }
+
+    // Match only the shortlist of the index
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<int> shortlist;
+    getShortlist(rProbe, k, shortlist);
+    searchEyes(rProbe, k, shortlist, rCandidates);
+    if (mIndexType == "vptree")
+    {
+        keepUnder(rCandidates, mTreeRadius);
+    }
+    mIndexTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    mMatchedEyes += shortlist.size();
+    mIndexedSearches++;
+
+    // Compare some searches with the exhaustive search
+    if (mRecallPeriod > 0 && mIndexedSearches % mRecallPeriod == 0)
+    {
+        start = std::chrono::steady_clock::now();
+        std::vector<OsiCandidate> exhaustive;
+        searchAll(rProbe, k, exhaustive);
+        if (mIndexType == "vptree")
+        {
+            keepUnder(exhaustive, mTreeRadius);
+        }
+        mExhaustiveTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        mMeasuredSearches++;
+        countFound(rCandidates, exhaustive, mExpectedCandidates, mFoundCandidates, mSameBest);
+    }
+}
+
+void OsiGallery::reportIndex(int nProbes, int k)
+{
+    if (mIndexType == "none" || mEyes.empty())
+    {
+        return;
+    }
+
+    // Eyes spread over the gallery, and their candidates without themselves
+    std::vector<int> probes;
+    int step = std::max<int>(1, mEyes.size() / std::max(nProbes, 1));
+    for (int e = 0; e < mEyes.size() && probes.size() < nProbes; e += step)
+    {
+        probes.push_back(e);
+    }
+    std::vector<std::vector<OsiCandidate>> expected(probes.size());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < probes.size(); i++)
+    {
+        searchAll(*mEyes[probes[i]], k > 0 ? k + 1 : 0, expected[i]);
+        removeIndex(expected[i], mIndices[probes[i]], k);
+        if (mIndexType == "vptree")
+        {
+            keepUnder(expected[i], mTreeRadius);
+        }
+    }
+    double exhaustive_time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Index " << mIndexType << " searched with " << probes.size() << " eyes of the gallery, " << k
+              << " candidates (exhaustive search : " << 1000 * exhaustive_time / std::max<int>(probes.size(), 1)
+              << " ms per search)" << std::endl;
+
+    // Number of scanned clusters doubling up to all clusters, or the settings of the index
+    std::vector<int> settings(1, mClusterProbe);
+    if (mIndexType == "ivf")
+    {
+        settings.clear();
+        for (int n = 1; n < mClusterIndex.getClusters(); n *= 2)
+        {
+            settings.push_back(n);
+        }
+        settings.push_back(mClusterIndex.getClusters());
+    }
+    int cluster_probe = mClusterProbe;
+    for (int s = 0; s < settings.size(); s++)
+    {
+        mClusterProbe = settings[s];
+        double matched = 0, n_expected = 0, n_found = 0;
+        int same_best = 0;
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < probes.size(); i++)
+        {
+            std::vector<int> shortlist;
+            getShortlist(*mEyes[probes[i]], k + 1, shortlist);
+            shortlist.erase(std::remove(shortlist.begin(), shortlist.end(), probes[i]), shortlist.end());
+            std::vector<OsiCandidate> candidates;
+            searchEyes(*mEyes[probes[i]], k, shortlist, candidates);
+            if (mIndexType == "vptree")
+            {
+                keepUnder(candidates, mTreeRadius);
+            }
+            matched += shortlist.size();
+            countFound(candidates, expected[i], n_expected, n_found, same_best);
+        }
+        double time = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "- ";
+        if (mIndexType == "ivf")
+        {
+            std::cout << settings[s] << " clusters scanned : ";
+        }
+        std::cout << 100 * matched / probes.size() / mEyes.size() << " % of the gallery matched, recall "
+                  << (n_expected > 0 ? n_found / n_expected : 1) << ", same best candidate in "
+                  << 100.0 * same_best / probes.size() << " % of the searches, " << 1000 * time / probes.size()
+                  << " ms per search" << std::endl;
+    }
+    mClusterProbe = cluster_probe;
+}
+
+void OsiGallery::searchAll(const OsiEye &rProbe, int k, std::vector<OsiCandidate> &rCandidates)
+{
+    if (mPartitions.empty())
+    {
+        searchEyes(rProbe, k, 0, mEyes.size(), rCandidates);
+        return;
+    }
+
+    // All threads search their eyes, then their candidates are merged
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    {
+        std::unique_lock<std::mutex> lock(mMutex);
+        mpProbe = &rProbe;
+        mK = k;
+        mPending = mPartitions.size();
+        mGeneration++;
+        mStartCondition.notify_all();
+        mDoneCondition.wait(lock, [this] { return mPending == 0; });
+        mpProbe = 0;
+    }
+    mSearchTime += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    rCandidates.clear();
+    for (int t = 0; t < mPartitions.size(); t++)
+    {
+        if (!mPartitions[t].error.empty())
+        {
+            throw std::runtime_error(mPartitions[t].error);
+        }
+        rCandidates.insert(rCandidates.end(), mPartitions[t].candidates.begin(), mPartitions[t].candidates.end());
+    }
+    keepBest(rCandidates, k);
+}
+
+void OsiGallery::searchTemplate(const std::vector<unsigned char> &rTemplate, int k,
+                                std::vector<OsiCandidate> &rCandidates)
+{
+    OsiEye probe;
+    probe.setProfile(mProfile);
+    probe.loadTemplate(rTemplate);
+    search(probe, k, rCandidates);
+}
+
+void OsiGallery::keepBest(std::vector<OsiCandidate> &rCandidates, int k)
+{
+    std::sort(rCandidates.begin(), rCandidates.end());
+    if (k > 0 && rCandidates.size() > k)
+    {
+        rCandidates.resize(k);
+    }
+}
+
+void OsiGallery::getShortlist(const OsiEye &rProbe, int k, std::vector<int> &rEyes)
+{
+    if (!rProbe.getIrisCode())
+    {
+        throw std::runtime_error("Cannot search the gallery because the iris code is not built");
+    }
+
+    OsiBitCode code;
+    code.pack(rProbe.getIrisCode(), rProbe.getNormalizedMask(), mpApplicationPoints);
+    if (mIndexType == "bloom")
+    {
+        mBloomIndex.query(code, mBloomCandidates, rEyes);
+        return;
+    }
+
+    // The probe is hashed, or matched, for each shift of its matching
+    int shift = mProfile.getDegraded(rProbe.getDegradationLevel()).getMatchShift();
+    if (mIndexType == "cascade")
+    {
+        mCascade.query(code, shift, std::max(k, 1), rEyes);
+        return;
+    }
+    if (mIndexType == "vptree")
+    {
+        mVpTree.query(code, shift, mTreeRadius, rEyes);
+        return;
+    }
+    if (mIndexType == "ivf")
+    {
+        mClusterIndex.query(code, shift, mClusterProbe, rEyes);
+        return;
+    }
+    mLshIndex.query(code, shift, rEyes);
+}
+
+void OsiGallery::addCandidate(float score, int e, int k, std::vector<OsiCandidate> &rCandidates) const
+{
+    // The worst candidate is on top of the heap
+    OsiCandidate candidate;
+    candidate.score = score;
+    candidate.index = mIndices[e];
+    if (k > 0 && rCandidates.size() == k)
+    {
+        if (!(candidate < rCandidates.front()))
+        {
+            return;
+        }
+        std::pop_heap(rCandidates.begin(), rCandidates.end());
+        rCandidates.pop_back();
+    }
+    candidate.name = mNames[e];
+    rCandidates.push_back(candidate);
+    std::push_heap(rCandidates.begin(), rCandidates.end());
+}
+
+void OsiGallery::searchEyes(const OsiEye &rProbe, int k, int first, int last,
+                            std::vector<OsiCandidate> &rCandidates) const
+{
+    rCandidates.clear();
+    for (int e = first; e < last; e++)
+    {
+        addCandidate(rProbe.compare(*mEyes[e], mpApplicationPoints), e, k, rCandidates);
+    }
+    std::sort_heap(rCandidates.begin(), rCandidates.end());
+}
+
+void OsiGallery::searchEyes(const OsiEye &rProbe, int k, const std::vector<int> &rEyes,
+                            std::vector<OsiCandidate> &rCandidates) const
+{
+    rCandidates.clear();
+
+    // The clusters are scanned in the packed codes of the index, laid out as the eyes
+    if (mIndexType == "ivf")
+    {
+        OsiBitCode code;
+        code.pack(rProbe.getIrisCode(), rProbe.getNormalizedMask(), mpApplicationPoints);
+        std::vector<float> scores;
+        mClusterIndex.match(code, mProfile.getDegraded(rProbe.getDegradationLevel()).getMatchShift(), rEyes, scores);
+        for (int i = 0; i < rEyes.size(); i++)
+        {
+            addCandidate(scores[i], rEyes[i], k, rCandidates);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < rEyes.size(); i++)
+        {
+            addCandidate(rProbe.compare(*mEyes[rEyes[i]], mpApplicationPoints), rEyes[i], k, rCandidates);
+        }
+    }
+    std::sort_heap(rCandidates.begin(), rCandidates.end());
+}
+
+void OsiGallery::runPartition(Partition &rPartition)
+{
+    // The copies of the eyes are allocated and written by the thread, on its node
+    pinThread(rPartition.cpus);
+    std::vector<unsigned char> data;
+    for (int e = rPartition.first; e < rPartition.last; e++)
+    {
+        mEyes[e]->saveTemplate(data);
+        rPartition.bytes += data.size();
+        try
+        {
+            std::shared_ptr<OsiEye> copy(new OsiEye);
+            copy->loadTemplate(data);
+            mEyes[e] = copy;
+        }
+        catch (std::exception &)
+        {
+            // The eye stays where it is
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(mMutex);
+    if (--mPending == 0)
+    {
+        mDoneCondition.notify_all();
+    }
+
+    int generation = mGeneration;
+    for (;;)
+    {
+        mStartCondition.wait(lock, [&] { return mStopping || mGeneration != generation; });
+        if (mStopping)
+        {
+            return;
+        }
+        generation = mGeneration;
+        const OsiEye &probe = *mpProbe;
+        int k = mK;
+        lock.unlock();
+
+        rPartition.error.clear();
+        try
+        {
+            searchEyes(probe, k, rPartition.first, rPartition.last, rPartition.candidates);
+        }
+        catch (std::exception &e)
+        {
+            rPartition.candidates.clear();
+            rPartition.error = e.what();
+        }
+        rPartition.searches++;
+
+        lock.lock();
+        if (--mPending == 0)
+        {
+            mDoneCondition.notify_all();
+        }
+    }
+}
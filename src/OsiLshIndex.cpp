@@ -0,0 +1,310 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+
+#include "OsiLshIndex.h"
+
+// Tag at the beginning of a file of LSH index
+#define OSI_LSH_TAG "OSILSH01"
+#define OSI_LSH_TAG_SIZE 8
+
+// Seed of the sampled bits : the same parameters always give the same tables
+#define OSI_LSH_SEED 20110
+
+// Write an unsigned integer in little-endian order
+static void writeNumber(std::ostream &rFile, unsigned long long value, int size)
+{
+    for (int b = 0; b < size; b++)
+    {
+        rFile.put((char)(value >> (8 * b)));
+    }
+}
+
+// Read an unsigned integer written by writeNumber()
+static unsigned long long readNumber(std::istream &rFile, int size)
+{
+    unsigned long long value = 0;
+    for (int b = 0; b < size; b++)
+    {
+        value |= (unsigned long long)(unsigned char)rFile.get() << (8 * b);
+    }
+    if (!rFile)
+    {
+        throw std::runtime_error("Truncated file of LSH index");
+    }
+    return value;
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiLshIndex::OsiLshIndex()
+{
+    mTables = 0;
+    mBits = 0;
+    mMaxMaskedBits = 0;
+    mWidth = 0;
+    mRows = 0;
+}
+
+// OPERATORS
+////////////
+
+void OsiLshIndex::init(int nTables, int nBits, int maxMaskedBits, const OsiBitCode &rCode)
+{
+    if (nTables < 1 || nBits < 1 || nBits > 32 || maxMaskedBits < 0 || maxMaskedBits > 8)
+    {
+        throw std::invalid_argument("Wrong parameters of LSH index (1 to 32 bits per key, 0 to 8 masked bits)");
+    }
+    mTables = nTables;
+    mBits = nBits;
+    mMaxMaskedBits = maxMaskedBits;
+    mWidth = rCode.getWidth();
+    mRows = rCode.getRows();
+
+    // Bits sampled among the application points (the valid bits of the code, without its own mask)
+    std::vector<std::pair<int, int>> points;
+    for (int r = 0; r < mRows; r++)
+    {
+        for (int c = 0; c < mWidth; c++)
+        {
+            if (rCode.isValid(r, c))
+            {
+                points.push_back(std::make_pair(r, c));
+            }
+        }
+    }
+    if (points.empty())
+    {
+        throw std::runtime_error("No application point to sample for the LSH index");
+    }
+    std::mt19937 random(OSI_LSH_SEED);
+    mSampledRows.resize(mTables * mBits);
+    mSampledColumns.resize(mTables * mBits);
+    for (int s = 0; s < mTables * mBits; s++)
+    {
+        const std::pair<int, int> &point = points[random() % points.size()];
+        mSampledRows[s] = point.first;
+        mSampledColumns[s] = point.second;
+    }
+
+    mEntries.clear();
+    mBuckets.assign(mTables, std::unordered_map<unsigned int, std::vector<int>>());
+    mUnhashed.clear();
+    mLoaded.clear();
+}
+
+bool OsiLshIndex::load(const std::string &rFilename)
+{
+    mLoaded.clear();
+    std::ifstream file(rFilename.c_str(), std::ios::in | std::ios::binary);
+    char tag[OSI_LSH_TAG_SIZE];
+    if (!file || !file.read(tag, OSI_LSH_TAG_SIZE) || memcmp(tag, OSI_LSH_TAG, OSI_LSH_TAG_SIZE))
+    {
+        return false;
+    }
+
+    // The tables must be the same
+    int tables = readNumber(file, 4);
+    int bits = readNumber(file, 4);
+    int masked = readNumber(file, 4);
+    int width = readNumber(file, 4);
+    int rows = readNumber(file, 4);
+    if (tables != mTables || bits != mBits || masked != mMaxMaskedBits || width != mWidth || rows != mRows)
+    {
+        return false;
+    }
+    for (int s = 0; s < mTables * mBits; s++)
+    {
+        int row = readNumber(file, 4);
+        int column = readNumber(file, 4);
+        if (row != mSampledRows[s] || column != mSampledColumns[s])
+        {
+            return false;
+        }
+    }
+
+    unsigned int n_entries = readNumber(file, 4);
+    for (unsigned int e = 0; e < n_entries; e++)
+    {
+        Entry entry;
+        entry.name.resize(readNumber(file, 4));
+        file.read(&entry.name[0], entry.name.size());
+        entry.hash = readNumber(file, 8);
+        entry.keys.resize(mTables);
+        for (int t = 0; t < mTables; t++)
+        {
+            entry.keys[t].resize(readNumber(file, 4));
+            for (int k = 0; k < entry.keys[t].size(); k++)
+            {
+                entry.keys[t][k] = readNumber(file, 4);
+            }
+        }
+        mLoaded[entry.name] = entry;
+    }
+    return true;
+}
+
+void OsiLshIndex::save(const std::string &rFilename) const
+{
+    std::ofstream file(rFilename.c_str(), std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot create the file of LSH index : " + rFilename);
+    }
+    file.write(OSI_LSH_TAG, OSI_LSH_TAG_SIZE);
+    writeNumber(file, mTables, 4);
+    writeNumber(file, mBits, 4);
+    writeNumber(file, mMaxMaskedBits, 4);
+    writeNumber(file, mWidth, 4);
+    writeNumber(file, mRows, 4);
+    for (int s = 0; s < mTables * mBits; s++)
+    {
+        writeNumber(file, mSampledRows[s], 4);
+        writeNumber(file, mSampledColumns[s], 4);
+    }
+
+    writeNumber(file, mEntries.size(), 4);
+    for (std::map<int, Entry>::const_iterator it = mEntries.begin(); it != mEntries.end(); it++)
+    {
+        const Entry &entry = it->second;
+        writeNumber(file, entry.name.size(), 4);
+        file.write(entry.name.data(), entry.name.size());
+        writeNumber(file, entry.hash, 8);
+        for (int t = 0; t < mTables; t++)
+        {
+            writeNumber(file, entry.keys[t].size(), 4);
+            for (int k = 0; k < entry.keys[t].size(); k++)
+            {
+                writeNumber(file, entry.keys[t][k], 4);
+            }
+        }
+    }
+    if (!file)
+    {
+        throw std::runtime_error("Cannot write the file of LSH index : " + rFilename);
+    }
+}
+
+bool OsiLshIndex::add(int id, const std::string &rName, const OsiBitCode &rCode)
+{
+    if (rCode.getWidth() != mWidth || rCode.getRows() != mRows)
+    {
+        throw std::runtime_error("The iris code of " + rName + " has not the size of the LSH index");
+    }
+
+    // Reuse the keys of the loaded index if the template did not change
+    Entry &entry = mEntries[id];
+    entry.name = rName;
+    entry.hash = rCode.getHash();
+    std::map<std::string, Entry>::iterator loaded = mLoaded.find(rName);
+    bool hashed = loaded == mLoaded.end() || loaded->second.hash != entry.hash;
+    if (hashed)
+    {
+        entry.keys.resize(mTables);
+        for (int t = 0; t < mTables; t++)
+        {
+            getKeys(rCode, t, 0, entry.keys[t]);
+        }
+    }
+    else
+    {
+        entry.keys.swap(loaded->second.keys);
+    }
+    if (loaded != mLoaded.end())
+    {
+        mLoaded.erase(loaded);
+    }
+
+    bool in_table = false;
+    for (int t = 0; t < mTables; t++)
+    {
+        for (int k = 0; k < entry.keys[t].size(); k++)
+        {
+            mBuckets[t][entry.keys[t][k]].push_back(id);
+            in_table = true;
+        }
+    }
+    if (!in_table)
+    {
+        mUnhashed.push_back(id);
+    }
+    return hashed;
+}
+
+void OsiLshIndex::query(const OsiBitCode &rProbe, int shift, std::vector<int> &rIds) const
+{
+    rIds = mUnhashed;
+    std::vector<unsigned int> keys;
+    for (int t = 0; t < mTables; t++)
+    {
+        for (int s = -shift; s <= shift; s++)
+        {
+            getKeys(rProbe, t, s, keys);
+            for (int k = 0; k < keys.size(); k++)
+            {
+                std::unordered_map<unsigned int, std::vector<int>>::const_iterator bucket = mBuckets[t].find(keys[k]);
+                if (bucket != mBuckets[t].end())
+                {
+                    rIds.insert(rIds.end(), bucket->second.begin(), bucket->second.end());
+                }
+            }
+        }
+    }
+    std::sort(rIds.begin(), rIds.end());
+    rIds.erase(std::unique(rIds.begin(), rIds.end()), rIds.end());
+}
+
+int OsiLshIndex::getRemovedTemplates() const
+{
+    return mLoaded.size();
+}
+
+void OsiLshIndex::getKeys(const OsiBitCode &rCode, int table, int shift, std::vector<unsigned int> &rKeys) const
+{
+    // Column c of a template is compared to column c + shift of the probe
+    rKeys.clear();
+    unsigned int key = 0;
+    std::vector<int> masked;
+    for (int b = 0; b < mBits; b++)
+    {
+        int row = mSampledRows[table * mBits + b];
+        int column = mSampledColumns[table * mBits + b] + shift;
+        if (!rCode.isValid(row, column))
+        {
+            masked.push_back(b);
+            if (masked.size() > mMaxMaskedBits)
+            {
+                return;
+            }
+        }
+        else if (rCode.getBit(row, column))
+        {
+            key |= 1U << b;
+        }
+    }
+
+    // A masked bit takes both values
+    for (int v = 0; v < (1 << masked.size()); v++)
+    {
+        unsigned int expanded = key;
+        for (int m = 0; m < masked.size(); m++)
+        {
+            if ((v >> m) & 1)
+            {
+                expanded |= 1U << masked[m];
+            }
+        }
+        rKeys.push_back(expanded);
+    }
+}
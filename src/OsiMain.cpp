@@ -71,6 +71,8 @@
  * <img src="Overview_Scheme.bmp" />
  */
 
+#include <cstdlib>
+
 #include "OsiManager.h"
 
 int main(int argc, char **argv)
@@ -79,6 +81,62 @@ int main(int argc, char **argv)
     {
         OsiManager osi;
         osi.loadConfiguration(argv[1]);
+
+        // Options of the command line, after the configuration file
+        int merged_shards = 0;
+        std::string served_address;
+        bool build_index = false;
+        for (int a = 2; a < argc; a++)
+        {
+            std::string option = argv[a];
+            if (option == "--resume")
+            {
+                osi.setResume(true);
+            }
+            else if (option == "--shard" && a + 1 < argc)
+            {
+                osi.setShard(argv[++a]);
+            }
+            else if (option == "--merge" && a + 1 < argc)
+            {
+                merged_shards = atoi(argv[++a]);
+            }
+            else if (option == "--serve" && a + 1 < argc)
+            {
+                served_address = argv[++a];
+            }
+            else if (option == "--build-index")
+            {
+                build_index = true;
+            }
+            else
+            {
+                throw std::invalid_argument("Unknown option : " + option +
+                                            " (--resume, --shard i/N, --merge N, --serve address, --build-index)");
+            }
+        }
+
+        // Serve a part of the gallery to the coordinator of an identification instead of processing
+        if (served_address != "")
+        {
+            osi.serveGallery(served_address);
+            return 0;
+        }
+
+        // Build the index of the gallery instead of processing
+        if (build_index)
+        {
+            osi.buildGalleryIndex();
+            return 0;
+        }
+
+        // Merge the outputs of the shards instead of processing
+        if (merged_shards > 0)
+        {
+            osi.mergeShards(merged_shards);
+            return 0;
+        }
+
         osi.showConfiguration();
         osi.run();
     }
@@ -6,12 +6,202 @@
  * License : BSD
  ********************************************************/
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
 #include <fstream>
+#include <iomanip>
 #include <iterator>
+#include <memory>
+#include <set>
+#include <sstream>
 #include <stdexcept>
+#include <thread>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <fcntl.h>
+#include <io.h>
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
 
 #include "OsiManager.h"
+#include "OsiProcessings.h"
+#include "OsiScoreReader.h"
 #include "OsiStringUtils.h"
+#include "OsiTarReader.h"
+
+// Hash of bytes (64-bit FNV-1a), continued from a previous hash
+static unsigned long long hashBytes(const void *pData, size_t size, unsigned long long hash = 14695981039346656037ULL)
+{
+    const unsigned char *p = (const unsigned char *)pData;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Key of a stage in the result cache : hash of the key of the previous stage and of the settings of the stage
+static std::string getCacheKey(const std::string &rPrevious, const std::string &rSettings)
+{
+    unsigned long long hash = hashBytes(rPrevious.data(), rPrevious.size());
+    hash = hashBytes(rSettings.data(), rSettings.size(), hash);
+    std::ostringstream key;
+    key << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return key.str();
+}
+
+// Size of a file, 0 if it does not exist
+static unsigned long long getFileSize(const std::string &rFilename)
+{
+    std::ifstream file(rFilename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+    return file ? (unsigned long long)file.tellg() : 0;
+}
+
+// Cut a file to the size it had at a checkpoint
+static void cutFile(const std::string &rFilename, unsigned long long size)
+{
+    unsigned long long current = getFileSize(rFilename);
+    if (current < size)
+    {
+        throw std::runtime_error("Cannot resume : " + rFilename + " is shorter than at the checkpoint");
+    }
+    if (current == size)
+    {
+        return;
+    }
+#ifdef _WIN32
+    int fd = _open(rFilename.c_str(), _O_RDWR | _O_BINARY);
+    bool done = fd >= 0 && _chsize_s(fd, size) == 0;
+    if (fd >= 0)
+    {
+        _close(fd);
+    }
+#else
+    bool done = truncate(rFilename.c_str(), size) == 0;
+#endif
+    if (!done)
+    {
+        throw std::runtime_error("Cannot resume : " + rFilename + " cannot be cut to its size at the checkpoint");
+    }
+}
+
+// Replace a file by another one in a single step
+static bool replaceFile(const std::string &rFrom, const std::string &rTo)
+{
+#ifdef _WIN32
+    return MoveFileExA(rFrom.c_str(), rTo.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    return rename(rFrom.c_str(), rTo.c_str()) == 0;
+#endif
+}
+
+// Name of an output of a shard : "scores.txt" becomes "scores.shard2of8.txt"
+static std::string getShardPath(const std::string &rPath, int shard, int nShards)
+{
+    std::ostringstream tag;
+    tag << ".shard" << shard << "of" << nShards;
+    size_t dot = rPath.find_last_of('.');
+    size_t slash = rPath.find_last_of('/');
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return rPath + tag.str();
+    }
+    return rPath.substr(0, dot) + tag.str() + rPath.substr(dot);
+}
+
+// Merge the reports of the shards : the header of the first shard, the lines of all shards, and the sum of the totals
+static void mergeReports(const std::string &rFilename, int nShards)
+{
+    std::ofstream merged(rFilename.c_str(), std::ios::out);
+    if (!merged)
+    {
+        throw std::runtime_error("Cannot create the file " + rFilename);
+    }
+
+    double totals[2] = {0, 0};
+    bool has_total = false;
+    for (int s = 1; s <= nShards; s++)
+    {
+        std::string filename = getShardPath(rFilename, s, nShards);
+        std::ifstream file(filename.c_str(), std::ios::in);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot read the output of the shard : " + filename);
+        }
+
+        std::string line;
+        bool header = true;
+        while (std::getline(file, line))
+        {
+            if (line.compare(0, 8, "# total ") == 0)
+            {
+                double values[2] = {0, 0};
+                std::istringstream(line.substr(8)) >> values[0] >> values[1];
+                totals[0] += values[0];
+                totals[1] += values[1];
+                has_total = true;
+            }
+            else if (header && line.compare(0, 1, "#") == 0)
+            {
+                if (s == 1)
+                {
+                    merged << line << "\n";
+                }
+            }
+            else
+            {
+                header = false;
+                merged << line << "\n";
+            }
+        }
+    }
+
+    if (has_total)
+    {
+        double ratio = totals[1] > 0 ? totals[0] / totals[1] : 0;
+        merged << "# total " << std::setprecision(17) << totals[0] << " " << totals[1] << " " << std::setprecision(6)
+               << ratio << "\n";
+    }
+}
+
+// Merge the pack files of the shards
+static void mergePacks(const std::string &rFilename, int nShards)
+{
+    // The merged pack is built again
+    std::remove(rFilename.c_str());
+    std::remove((rFilename + ".idx").c_str());
+    OsiPackFile merged;
+    merged.open(rFilename);
+
+    for (int s = 1; s <= nShards; s++)
+    {
+        std::string filename = getShardPath(rFilename, s, nShards);
+        if (getFileSize(filename) == 0)
+        {
+            throw std::runtime_error("Cannot read the output of the shard : " + filename);
+        }
+        OsiPackFile shard;
+        shard.open(filename);
+
+        std::vector<std::string> names;
+        std::vector<unsigned char> data;
+        shard.getNames(names);
+        for (int n = 0; n < names.size(); n++)
+        {
+            shard.read(names[n], data);
+            merged.write(names[n], data);
+        }
+    }
+    merged.close();
+}
 
 // CONSTRUCTORS & DESTRUCTORS
 /////////////////////////////
@@ -25,6 +215,9 @@ OsiManager::OsiManager()
     mMapBool["Process encoding"] = &mProcessEncoding;
     mMapBool["Process matching"] = &mProcessMatching;
     mMapBool["Use the mask provided by osiris"] = &mUseMask;
+    mMapBool["Process sequences"] = &mProcessSequences;
+    mMapBool["Assess quality"] = &mAssessQuality;
+    mMapBool["Fixed-point encoding"] = &mFixedPointEncoding;
     mMapString["Load List of images"] = &mFilenameListOfImages;
     mMapString["Load original images"] = &mInputDirOriginalImages;
     mMapString["Load parameters"] = &mInputDirParameters;
@@ -39,10 +232,60 @@ OsiManager::OsiManager()
     mMapString["Save normalized masks"] = &mOutputDirNormalizedMasks;
     mMapString["Save iris codes"] = &mOutputDirIrisCodes;
     mMapString["Save matching scores"] = &mOutputFileMatchingScores;
+    mMapString["Format of matching scores"] = &mMatchingScoresFormat;
+    mMapInt["Number of best scores per probe"] = &mBestScoresPerProbe;
+    mMapFloat["Maximum matching score"] = &mMaxMatchingScore;
+    mMapString["Save quality report"] = &mOutputFileQuality;
+    mMapString["Save processing log"] = &mOutputFileProcessingLog;
+    mMapString["Load impostor pairs"] = &mFilenameImpostorPairs;
+    mMapString["Save benchmark report"] = &mOutputFileBenchmark;
+    mMapString["Load filter banks"] = &mFilenameFilterBanks;
+    mMapString["Save sweep report"] = &mOutputFileSweep;
+    mMapString["Save result cache"] = &mFilenameResultCache;
+    mMapString["Save checkpoint"] = &mFilenameCheckpoint;
+    mMapInt["Checkpoint period"] = &mCheckpointPeriod;
+    mMapString["Shard balancing"] = &mShardBalancing;
+    mMapString["Load timing log"] = &mFilenameTimingLog;
+    mMapString["Load gallery"] = &mFilenameGallery;
+    mMapString["Load gallery iris codes"] = &mInputDirGalleryIrisCodes;
+    mMapString["Load gallery normalized masks"] = &mInputDirGalleryNormalizedMasks;
+    mMapInt["Number of candidates"] = &mNumberOfCandidates;
+    mMapString["Search workers"] = &mSearchWorkers;
+    mMapInt["Number of search threads"] = &mSearchThreads;
+    mMapBool["Search on NUMA nodes"] = &mNumaSearch;
+    mMapString["Gallery index"] = &mGalleryIndex;
+    mMapString["Save gallery index"] = &mFilenameGalleryIndex;
+    mMapInt["Number of LSH tables"] = &mLshTables;
+    mMapInt["Number of bits per LSH key"] = &mLshBits;
+    mMapInt["Number of masked bits per LSH key"] = &mLshMaskedBits;
+    mMapInt["Number of rows per Bloom word"] = &mBloomWordRows;
+    mMapInt["Width of Bloom blocks"] = &mBloomBlockWidth;
+    mMapInt["Number of Bloom trees"] = &mBloomTrees;
+    mMapInt["Number of Bloom candidates"] = &mBloomCandidates;
+    mMapString["Cascade stages"] = &mCascadeStages;
+    mMapFloat["Metric tree slack"] = &mTreeSlack;
+    mMapInt["Number of clusters"] = &mClusters;
+    mMapInt["Number of scanned clusters"] = &mClusterProbe;
+    mMapInt["Number of probes of index report"] = &mIndexReportProbes;
+    mMapInt["Period of recall measurement"] = &mRecallPeriod;
+    mMapString["Save fixed-point report"] = &mOutputFileFixedPoint;
+    mMapString["Profile"] = &mProfileName;
+    mMapString["Benchmark profiles"] = &mBenchmarkProfiles;
+    mMapInt["Width of raw images"] = &mRawImageWidth;
+    mMapInt["Height of raw images"] = &mRawImageHeight;
+    mMapInt["Number of prefetched images"] = &mPrefetchedImages;
+    mMapInt["Number of prefetching threads"] = &mPrefetchingThreads;
     mMapInt["Minimum diameter for pupil"] = &mMinPupilDiameter;
     mMapInt["Maximum diameter for pupil"] = &mMaxPupilDiameter;
     mMapInt["Minimum diameter for iris"] = &mMinIrisDiameter;
     mMapInt["Maximum diameter for iris"] = &mMaxIrisDiameter;
+    mMapInt["Canonical width for segmentation"] = &mCanonicalWidth;
+    mMapFloat["Tracking confidence"] = &mTrackingConfidence;
+    mMapInt["Number of best frames"] = &mNumberOfBestFrames;
+    mMapFloat["Minimum focus"] = &mMinFocus;
+    mMapFloat["Maximum occlusion"] = &mMaxOcclusion;
+    mMapFloat["Minimum contrast"] = &mMinContrast;
+    mMapInt["Maximum time per image"] = &mMaxTimePerImage;
     mMapInt["Width of normalized image"] = &mWidthOfNormalizedIris;
     mMapInt["Height of normalized image"] = &mHeightOfNormalizedIris;
     mMapString["Load Gabor filters"] = &mFilenameGaborFilters;
@@ -72,6 +315,22 @@ OsiManager::~OsiManager()
     {
         cvReleaseMat(&mGaborFilters[f]);
     }
+
+    // Release matrix for quantized Gabor filters
+    for (int f = 0; f < mQuantizedGaborFilters.size(); f++)
+    {
+        cvReleaseMat(&mQuantizedGaborFilters[f]);
+    }
+
+    // Release the segmentation plans
+    for (std::map<std::pair<int, int>, OsiSegmentationPlan *>::iterator it = mSegmentationPlans.begin();
+         it != mSegmentationPlans.end(); it++)
+    {
+        delete it->second;
+    }
+
+    // Close the pack files
+    closePacks();
 }
 
 // OPERATORS
@@ -86,6 +345,9 @@ void OsiManager::initConfiguration()
     mProcessEncoding = false;
     mProcessMatching = false;
     mUseMask = true;
+    mProcessSequences = false;
+    mAssessQuality = false;
+    mFixedPointEncoding = false;
 
     // Inputs
     mListOfImages.clear();
@@ -96,6 +358,10 @@ void OsiManager::initConfiguration()
     mInputDirNormalizedImages = "";
     mInputDirNormalizedMasks = "";
     mInputDirIrisCodes = "";
+    mRawImageWidth = 0;
+    mRawImageHeight = 0;
+    mPrefetchedImages = 0;
+    mPrefetchingThreads = 4;
 
     // Outputs
     mOutputDirSegmentedImages = "";
@@ -105,18 +371,70 @@ void OsiManager::initConfiguration()
     mOutputDirNormalizedMasks = "";
     mOutputDirIrisCodes = "";
     mOutputFileMatchingScores = "";
+    mMatchingScoresFormat = "text";
+    mBestScoresPerProbe = 0;
+    mMaxMatchingScore = 1;
+    mOutputFileQuality = "";
+    mOutputFileProcessingLog = "";
+    mFilenameImpostorPairs = "";
+    mOutputFileBenchmark = "";
+    mFilenameFilterBanks = "";
+    mOutputFileSweep = "";
+    mFilenameResultCache = "";
+    mFilenameCheckpoint = "";
+    mCheckpointPeriod = 100;
+    mResume = false;
+    mShard = 0;
+    mNumberOfShards = 0;
+    mShardBalancing = "count";
+    mFilenameTimingLog = "";
+    mFilenameGallery = "";
+    mInputDirGalleryIrisCodes = "";
+    mInputDirGalleryNormalizedMasks = "";
+    mNumberOfCandidates = 10;
+    mSearchWorkers = "";
+    mSearchThreads = 1;
+    mNumaSearch = false;
+    mGalleryIndex = "none";
+    mFilenameGalleryIndex = "";
+    mLshTables = 16;
+    mLshBits = 14;
+    mLshMaskedBits = 2;
+    mBloomWordRows = 8;
+    mBloomBlockWidth = 32;
+    mBloomTrees = 4;
+    mBloomCandidates = 100;
+    mCascadeStages = "1:4:0.1 3:2:0.3";
+    mTreeSlack = 0;
+    mClusters = 256;
+    mClusterProbe = 8;
+    mIndexReportProbes = 100;
+    mRecallPeriod = 0;
+    mOutputFileFixedPoint = "";
 
     // Parameters
     mMinPupilDiameter = 21;
     mMaxPupilDiameter = 91;
     mMinIrisDiameter = 99;
     mMaxIrisDiameter = 399;
+    mCanonicalWidth = 0;
+    mTrackingConfidence = 0.7f;
+    mNumberOfBestFrames = 0;
+    mMinFocus = 0;
+    mMaxOcclusion = 1;
+    mMinContrast = 0;
+    mMaxTimePerImage = 0;
+    mProfileName = "balanced";
+    mProfile = OsiProfile(mProfileName);
+    mBenchmarkProfiles = "";
     mWidthOfNormalizedIris = 512;
     mHeightOfNormalizedIris = 64;
     mFilenameGaborFilters = "./filters.txt";
     mFilenameApplicationPoints = "./points.txt";
     mGaborFilters.clear();
+    mQuantizedGaborFilters.clear();
     mpApplicationPoints = 0;
+    mSegmentationPlans.clear();
 
     // Suffix for filenames
     mSuffixSegmentedImages = "_segm.bmp";
@@ -185,6 +503,10 @@ void OsiManager::loadConfiguration(const std::string &sConfigPath)
                     else if (mMapInt.find(key) != mMapInt.end())
                         *mMapInt[key] = osu.fromString<int>(value);
 
+                    // Option is type float
+                    else if (mMapFloat.find(key) != mMapFloat.end())
+                        *mMapFloat[key] = osu.fromString<float>(value);
+
                     // Option is type string
                     else if (mMapString.find(key) != mMapString.end())
                     {
@@ -206,6 +528,16 @@ void OsiManager::loadConfiguration(const std::string &sConfigPath)
         }
     }
 
+    // Check the name of the profile and the format of scores
+    mProfile = OsiProfile(mProfileName);
+    OsiScoreWriter::getFormat(mMatchingScoresFormat);
+
+    // The best scores of each probe are only written at the end : they cannot be resumed
+    if (mFilenameCheckpoint != "" && mBestScoresPerProbe > 0)
+    {
+        throw std::invalid_argument("Checkpoints cannot be used with a number of best scores per probe");
+    }
+
     // Load the list containing all images
     loadListOfImages();
 
@@ -213,10 +545,17 @@ void OsiManager::loadConfiguration(const std::string &sConfigPath)
     if (mProcessEncoding && mFilenameGaborFilters != "")
     {
         loadGaborFilters();
+
+        // Quantized filters for the fixed-point encoding
+        if (mFixedPointEncoding)
+        {
+            OsiProcessings op;
+            op.quantizeFilters(mGaborFilters, mQuantizedGaborFilters);
+        }
     }
 
-    // Load the application points
-    if (mProcessMatching && mFilenameApplicationPoints != "")
+    // Load the application points (also needed to match in the sweep of filter banks)
+    if ((mProcessMatching || mFilenameFilterBanks != "") && mFilenameApplicationPoints != "")
     {
         loadApplicationPoints();
     }
@@ -254,15 +593,65 @@ void OsiManager::showConfiguration()
     }
     std::cout << std::endl;
 
+    if (mProcessSequences)
+    {
+        std::cout << "- Each entry of the list is a sequence of frames (video or numbered images),"
+                  << " tracked with a confidence of " << mTrackingConfidence << std::endl;
+        if (mNumberOfBestFrames > 0)
+        {
+            std::cout << "- Only the " << mNumberOfBestFrames << " best frames of each sequence are processed"
+                      << std::endl;
+        }
+    }
+
+    if (mAssessQuality)
+    {
+        std::cout << "- Images are rejected if focus < " << mMinFocus << " or occlusion > " << mMaxOcclusion
+                  << " or contrast < " << mMinContrast << std::endl;
+    }
+
+    std::cout << "- Profile : " << mProfile.getName() << std::endl;
+    if (mFixedPointEncoding)
+    {
+        std::cout << "- Iris codes are computed in fixed point" << std::endl;
+    }
+    if (mBenchmarkProfiles != "")
+    {
+        std::cout << "- Benchmark of profiles : " << mBenchmarkProfiles << std::endl;
+    }
+    if (mFilenameFilterBanks != "")
+    {
+        std::cout << "- Sweep of the filter banks listed in : " << mFilenameFilterBanks << std::endl;
+    }
+
+    if (mMaxTimePerImage > 0)
+    {
+        std::cout << "- Each image is processed in at most " << mMaxTimePerImage
+                  << " ms (cheaper settings when the budget is at risk)" << std::endl;
+    }
+
     std::cout << "- List of images " << mFilenameListOfImages << " contains " << mListOfImages.size() << " images"
               << std::endl;
 
     std::cout << std::endl;
 
-    if (mInputDirOriginalImages != "")
+    if (OsiTarReader::isArchive(mInputDirOriginalImages))
+    {
+        std::cout << "- Original images will be streamed from the archive : " << mInputDirOriginalImages << std::endl;
+    }
+    else if (mInputDirOriginalImages != "")
     {
         std::cout << "- Original images will be loaded from : " << mInputDirOriginalImages << std::endl;
     }
+    if (mRawImageWidth > 0 && mRawImageHeight > 0)
+    {
+        std::cout << "- Raw original images are " << mRawImageWidth << " x " << mRawImageHeight << " pixels"
+                  << std::endl;
+    }
+    if (mPrefetchedImages > 0)
+    {
+        std::cout << "- Up to " << mPrefetchedImages << " original images will be read in advance" << std::endl;
+    }
     if (mInputDirMasks != "")
     {
         std::cout << "- Masks will be loaded from : " << mInputDirMasks << std::endl;
@@ -317,7 +706,60 @@ void OsiManager::showConfiguration()
     }
     if (mProcessMatching && mOutputFileMatchingScores != "")
     {
-        std::cout << "- Matching scores will be saved in : " << mOutputFileMatchingScores << std::endl;
+        std::cout << "- Matching scores will be saved in : " << mOutputFileMatchingScores << " ("
+                  << mMatchingScoresFormat << ")" << std::endl;
+        if (mBestScoresPerProbe > 0)
+        {
+            std::cout << "- Only the " << mBestScoresPerProbe << " best scores of each probe are saved" << std::endl;
+        }
+        if (mMaxMatchingScore < 1)
+        {
+            std::cout << "- Only the scores lower than " << mMaxMatchingScore << " are saved" << std::endl;
+        }
+        if (mFilenameGallery != "")
+        {
+            std::cout << "- Each image is searched in the gallery " << mFilenameGallery << " (" << mNumberOfCandidates
+                      << " candidates)";
+            if (mSearchWorkers != "")
+            {
+                std::cout << " by the workers " << mSearchWorkers;
+            }
+            else if (mSearchThreads > 1 || mNumaSearch)
+            {
+                std::cout << " by " << mSearchThreads << " threads" << (mNumaSearch ? " spread over the NUMA nodes" : "");
+            }
+            if (mGalleryIndex != "none")
+            {
+                std::cout << " with the index " << mGalleryIndex;
+            }
+            std::cout << std::endl;
+        }
+    }
+    if (mOutputFileQuality != "")
+    {
+        std::cout << "- Quality measures will be saved in : " << mOutputFileQuality << std::endl;
+    }
+    if (mOutputFileProcessingLog != "")
+    {
+        std::cout << "- Processing log will be saved in : " << mOutputFileProcessingLog << std::endl;
+    }
+    if (mFilenameResultCache != "")
+    {
+        std::cout << "- Results of previous runs will be reused from : " << mFilenameResultCache << std::endl;
+    }
+    if (mFilenameCheckpoint != "")
+    {
+        std::cout << "- Progress will be saved every " << mCheckpointPeriod << " images in : " << mFilenameCheckpoint
+                  << (mResume ? " (the run is resumed)" : "") << std::endl;
+    }
+    if (mFixedPointEncoding && mOutputFileFixedPoint != "")
+    {
+        std::cout << "- Fixed-point encoding will be validated in : " << mOutputFileFixedPoint << std::endl;
+    }
+    if (mNumberOfShards > 0)
+    {
+        std::cout << "- Only the shard " << mShard << " / " << mNumberOfShards << " of the list will be processed ("
+                  << mShardBalancing << " balancing), its outputs are named after it" << std::endl;
     }
 
     std::cout << std::endl;
@@ -326,6 +768,11 @@ void OsiManager::showConfiguration()
     {
         std::cout << "- Pupil diameter ranges from " << mMinPupilDiameter << " to " << mMaxPupilDiameter << std::endl;
         std::cout << "- Iris diameter ranges from " << mMinIrisDiameter << " to " << mMaxIrisDiameter << std::endl;
+        if (mCanonicalWidth > 0)
+        {
+            std::cout << "- Larger images are segmented at a canonical width of " << mCanonicalWidth << " pixels"
+                      << std::endl;
+        }
     }
 
     if (mProcessNormalization || mProcessMatching || mProcessEncoding)
@@ -355,18 +802,25 @@ void OsiManager::showConfiguration()
 
 // Load the Gabor filters (matrix coefficients) from a textfile
 void OsiManager::loadGaborFilters()
+{
+    loadFilterBank(mFilenameGaborFilters, mGaborFilters);
+
+} // end of function
+
+// Load a bank of filters from a textfile
+void OsiManager::loadFilterBank(const std::string &rFilename, std::vector<CvMat *> &rFilters)
 {
     // Open text file containing the filters
-    std::ifstream file(mFilenameGaborFilters.c_str(), std::ios::in);
+    std::ifstream file(rFilename.c_str(), std::ios::in);
     if (!file)
     {
-        throw std::runtime_error("Cannot load Gabor filters in file " + mFilenameGaborFilters);
+        throw std::runtime_error("Cannot load Gabor filters in file " + rFilename);
     }
 
     // Get the number of filters
     int n_filters;
     file >> n_filters;
-    mGaborFilters.resize(n_filters);
+    rFilters.resize(n_filters);
 
     // Size of filter
     int rows, cols;
@@ -379,14 +833,14 @@ void OsiManager::loadGaborFilters()
         file >> cols;
 
         // Temporary filter. Will be destroyed at the end of loop
-        mGaborFilters[f] = cvCreateMat(rows, cols, CV_32FC1);
+        rFilters[f] = cvCreateMat(rows, cols, CV_32FC1);
 
         // Set the value at coordinates r,c
         for (int r = 0; r < rows; r++)
         {
             for (int c = 0; c < cols; c++)
             {
-                file >> mGaborFilters[f]->data.fl[r * cols + c];
+                file >> rFilters[f]->data.fl[r * cols + c];
             }
         }
 
@@ -397,6 +851,185 @@ void OsiManager::loadGaborFilters()
 
 } // end of function
 
+// Check if a directory of the configuration is a pack file
+static bool isPackFile(const std::string &rDir)
+{
+    const std::string extension = ".pack";
+    return rDir.size() > extension.size() &&
+           rDir.compare(rDir.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+// Get the pack file used instead of a directory
+OsiPackFile *OsiManager::getPack(const std::string &rDir)
+{
+    if (!isPackFile(rDir))
+    {
+        return 0;
+    }
+
+    // Opened once, shared by all options using the same pack
+    std::map<std::string, OsiPackFile *>::iterator it = mPacks.find(rDir);
+    if (it != mPacks.end())
+    {
+        return it->second;
+    }
+
+    OsiPackFile *pack = new OsiPackFile;
+    mPacks[rDir] = pack;
+    pack->open(rDir);
+    return pack;
+
+} // end of function
+
+// Get the path of a file in a directory or a pack file
+std::string OsiManager::getPath(const std::string &rDir, const std::string &rName) const
+{
+    return isPackFile(rDir) ? rName : rDir + rName;
+
+} // end of function
+
+// Read the checkpoint of a previous run and cut the outputs
+bool OsiManager::loadCheckpoint(int &rNext)
+{
+    std::ifstream file(mFilenameCheckpoint.c_str(), std::ios::in);
+    if (!file)
+    {
+        return false;
+    }
+
+    // One line per value : "<key> <values>"
+    std::map<std::string, std::string> values;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        std::string key, value;
+        if (line != "" && line[0] != '#' && fields >> key && std::getline(fields >> std::ws, value))
+        {
+            values[key] = value;
+        }
+    }
+
+    // Sizes of the outputs, 0 for the outputs started after the checkpoint
+    auto size = [&](const std::string &rKey) {
+        unsigned long long bytes = 0;
+        std::istringstream(values[rKey]) >> bytes;
+        return bytes;
+    };
+
+    OsiStringUtils osu;
+    if (values["images"] != osu.toString(mListOfImages.size()) || values["next"] == "")
+    {
+        throw std::runtime_error("The checkpoint " + mFilenameCheckpoint + " was saved for another list of images");
+    }
+    rNext = osu.fromString<int>(values["next"]);
+
+    if (mProcessMatching && mOutputFileMatchingScores != "")
+    {
+        cutFile(mOutputFileMatchingScores, size("scores"));
+        cutFile(mOutputFileMatchingScores + ".names", size("names"));
+    }
+    if (mOutputFileQuality != "")
+    {
+        cutFile(mOutputFileQuality, size("quality"));
+    }
+    if (mOutputFileProcessingLog != "")
+    {
+        cutFile(mOutputFileProcessingLog, size("log"));
+    }
+    if (mFixedPointEncoding && mOutputFileFixedPoint != "")
+    {
+        unsigned long long size = 0;
+        std::istringstream fixed_point(values["fixedpoint"]);
+        fixed_point >> size >> mBitErrors >> mComparedBits;
+        cutFile(mOutputFileFixedPoint, size);
+    }
+    return true;
+
+} // end of function
+
+// Save the checkpoint
+void OsiManager::saveCheckpoint(int next, OsiScoreWriter &rScores)
+{
+    // The outputs must contain the results of all entries done
+    rScores.flush();
+    if (mQualityReport.is_open())
+    {
+        mQualityReport.flush();
+    }
+    if (mProcessingLog.is_open())
+    {
+        mProcessingLog.flush();
+    }
+    if (mFixedPointReport.is_open())
+    {
+        mFixedPointReport.flush();
+    }
+
+    std::string temporary = mFilenameCheckpoint + ".tmp";
+    std::ofstream file(temporary.c_str(), std::ios::out);
+    file << "# Checkpoint of osiris : the entries of the list before \"next\" are done" << "\n";
+    file << "# and the outputs had these sizes (in bytes)" << "\n";
+    file << "images " << mListOfImages.size() << "\n";
+    file << "next " << next << "\n";
+    if (rScores.isOpen())
+    {
+        file << "scores " << getFileSize(mOutputFileMatchingScores) << "\n";
+        file << "names " << getFileSize(mOutputFileMatchingScores + ".names") << "\n";
+    }
+    if (mQualityReport.is_open())
+    {
+        file << "quality " << getFileSize(mOutputFileQuality) << "\n";
+    }
+    if (mProcessingLog.is_open())
+    {
+        file << "log " << getFileSize(mOutputFileProcessingLog) << "\n";
+    }
+    if (mFixedPointReport.is_open())
+    {
+        file << "fixedpoint " << getFileSize(mOutputFileFixedPoint) << " " << std::setprecision(17) << mBitErrors << " "
+             << mComparedBits << "\n";
+    }
+    file.close();
+
+    // The previous checkpoint stays valid until it is replaced
+    if (!file || !replaceFile(temporary, mFilenameCheckpoint))
+    {
+        throw std::runtime_error("Cannot save the checkpoint in " + mFilenameCheckpoint);
+    }
+
+} // end of function
+
+// Close all pack files
+void OsiManager::closePacks()
+{
+    for (std::map<std::string, OsiPackFile *>::iterator it = mPacks.begin(); it != mPacks.end(); it++)
+    {
+        delete it->second;
+    }
+    mPacks.clear();
+
+} // end of function
+
+// Load the impostor pairs from a textfile
+void OsiManager::loadImpostorPairs(std::vector<std::string> &rPairs)
+{
+    rPairs.clear();
+    if (mFilenameImpostorPairs == "")
+    {
+        return;
+    }
+
+    std::ifstream file(mFilenameImpostorPairs.c_str(), std::ios::in);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot load the impostor pairs in " + mFilenameImpostorPairs);
+    }
+    std::copy(std::istream_iterator<std::string>(file), std::istream_iterator<std::string>(),
+              std::back_inserter(rPairs));
+
+} // end of function
+
 // Load the application points (build a binary matrix) from a textfile
 void OsiManager::loadApplicationPoints()
 {
@@ -467,8 +1100,36 @@ void OsiManager::loadListOfImages()
 
 } // end of function
 
+// Get the scale of segmentation (canonical resolution) for an image size
+float OsiManager::getSegmentationScale(const CvSize &rSize)
+{
+    if (mCanonicalWidth > 0 && rSize.width > mCanonicalWidth)
+    {
+        return (float)mCanonicalWidth / rSize.width;
+    }
+    return 1;
+
+} // end of function
+
+// Get the segmentation plan, build it if there is none for this image size
+const OsiSegmentationPlan &OsiManager::getSegmentationPlan(const CvSize &rSize)
+{
+    OsiSegmentationPlan *&plan = mSegmentationPlans[std::make_pair(rSize.width, rSize.height)];
+    if (!plan)
+    {
+        // The plan works at the canonical resolution, diameters are rescaled accordingly
+        float scale = getSegmentationScale(rSize);
+        plan = new OsiSegmentationPlan(rSize.width * scale, rSize.height * scale, cvRound(mMinIrisDiameter * scale),
+                                       cvRound(mMinPupilDiameter * scale), cvRound(mMaxIrisDiameter * scale),
+                                       cvRound(mMaxPupilDiameter * scale));
+    }
+    return *plan;
+
+} // end of function
+
 // Load, segment, normalize, encode, and save according to user configuration
-void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
+bool OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye, OsiTracker *pTracker,
+                               bool checkEyeQuality)
 {
     std::cout << "Process " << rFileName << std::endl;
 
@@ -478,73 +1139,226 @@ void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
     // Get eye name
     std::string short_name = osu.extractFileName(rFileName);
 
-    // Load original image only if segmentation or normalization is requested
-    if (mProcessSegmentation || mProcessNormalization)
+    // Start the clock of the eye
+    rEye.setProfile(mProfile);
+    rEye.setTimeBudget(mMaxTimePerImage);
+
+    bool accepted;
+    try
     {
-        if (mInputDirOriginalImages != "")
-        {
-            rEye.loadOriginalImage(mInputDirOriginalImages + rFileName);
-        }
-        else
-        {
-            throw std::runtime_error("Cannot segmente/normalize without loading original image");
-        }
+        accepted = processSteps(rFileName, rEye, pTracker, checkEyeQuality);
+        logProcessing(short_name, rEye, accepted ? "done" : "rejected");
     }
-
-    /////////////////////////////////////////////////////////////////
-    // SEGMENTATION : process, load
-    /////////////////////////////////////////////////////////////////
-
-    // Segmentation step
-    if (mProcessSegmentation)
+    catch (std::exception &e)
     {
-        rEye.segment(mMinIrisDiameter, mMinPupilDiameter, mMaxIrisDiameter, mMaxPupilDiameter);
-
-        // Save segmented image
-        if (mOutputDirSegmentedImages != "")
-        {
-            rEye.saveSegmentedImage(mOutputDirSegmentedImages + short_name + mSuffixSegmentedImages);
-        }
-
-        // If user don't want to use the mask provided by Osiris
-        if (!mUseMask)
-        {
-            rEye.initMask();
-        }
+        logProcessing(short_name, rEye, e.what());
+        throw;
     }
 
-    // Load parameters
-    if (mInputDirParameters != "")
+    if (rEye.getDegradationLevel() > 0)
     {
-        rEye.loadParameters(mInputDirParameters + short_name + mSuffixParameters);
+        std::cout << "Processed " << short_name << " with degradation level " << rEye.getDegradationLevel() << " in "
+                  << rEye.getElapsedTime() << " ms" << std::endl;
+    }
+
+    return accepted;
+
+} // end of function
+
+// Open the result cache and describe the settings of each stage
+void OsiManager::initResultCache()
+{
+    mResultCache.open(mFilenameResultCache);
+    std::cout << "Result cache " << mFilenameResultCache << " contains " << mResultCache.getNumberOfEntries()
+              << " results" << std::endl;
+
+    std::ostringstream segmentation;
+    segmentation << "segmentation " << mMinPupilDiameter << " " << mMaxPupilDiameter << " " << mMinIrisDiameter << " "
+                 << mMaxIrisDiameter << " " << mCanonicalWidth << " " << mProfileName << " " << mUseMask;
+    mSegmentationSettings = segmentation.str();
+
+    std::ostringstream normalization;
+    normalization << "normalization " << mWidthOfNormalizedIris << " " << mHeightOfNormalizedIris;
+    mNormalizationSettings = normalization.str();
+
+    // The filters are described by their values
+    unsigned long long filters = hashBytes(0, 0);
+    for (int f = 0; f < mGaborFilters.size(); f++)
+    {
+        const CvMat *filter = mGaborFilters[f];
+        for (int r = 0; r < filter->rows; r++)
+        {
+            filters = hashBytes(filter->data.ptr + r * filter->step, filter->cols * sizeof(float), filters);
+        }
+        filters = hashBytes(&filter->cols, sizeof(filter->cols), filters);
+    }
+    std::ostringstream encoding;
+    encoding << "encoding " << mGaborFilters.size() << " " << filters << " " << mFixedPointEncoding;
+    mEncodingSettings = encoding.str();
+
+} // end of function
+
+// Steps of processOneEye
+bool OsiManager::processSteps(const std::string &rFileName, OsiEye &rEye, OsiTracker *pTracker, bool checkEyeQuality)
+{
+    // Strings handle
+    OsiStringUtils osu;
+
+    // Get eye name
+    std::string short_name = osu.extractFileName(rFileName);
+
+    // Load original image only if segmentation or normalization is requested (and if it is not a frame)
+    if ((mProcessSegmentation || mProcessNormalization) && rEye.getOriginalImageSize().width == 0)
+    {
+        std::vector<unsigned char> data;
+        if (mPrefetcher.take(mInputDirOriginalImages + rFileName, data))
+        {
+            rEye.decodeOriginalImage(rFileName, data, cvSize(mRawImageWidth, mRawImageHeight));
+        }
+        else if (mInputDirOriginalImages != "")
+        {
+            rEye.loadOriginalImage(mInputDirOriginalImages + rFileName, cvSize(mRawImageWidth, mRawImageHeight));
+        }
+        else
+        {
+            throw std::runtime_error("Cannot segmente/normalize without loading original image");
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // QUALITY : reject hopeless images before any costly step
+    /////////////////////////////////////////////////////////////////
+
+    if (mAssessQuality && checkEyeQuality && mProcessSegmentation)
+    {
+        float score = 0;
+        if (!checkQuality(short_name, rEye, score))
+        {
+            return false;
+        }
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // CACHE : keys of the results of each stage for this image
+    /////////////////////////////////////////////////////////////////
+
+    // The results must only depend on the original image : frames of a sequence (which depend on the tracking)
+    // and eyes whose intermediate results are loaded are not cached
+    bool cache = mFilenameResultCache != "" && !pTracker && rEye.getOriginalImage() && mProcessSegmentation &&
+                 mInputDirParameters == "" && mInputDirMasks == "" && mInputDirNormalizedImages == "" &&
+                 mInputDirNormalizedMasks == "";
+    std::string segmentation_key, normalization_key, encoding_key;
+    if (cache)
+    {
+        const IplImage *image = rEye.getOriginalImage();
+        unsigned long long pixels = hashBytes(0, 0);
+        for (int y = 0; y < image->height; y++)
+        {
+            pixels = hashBytes(image->imageData + y * image->widthStep, image->width * image->nChannels, pixels);
+        }
+        std::ostringstream original;
+        original << pixels << " " << image->width << " " << image->height << " " << image->nChannels;
+        segmentation_key = getCacheKey(original.str(), mSegmentationSettings);
+        normalization_key = getCacheKey(segmentation_key, mNormalizationSettings);
+        encoding_key = getCacheKey(normalization_key, mEncodingSettings);
+    }
+
+    /////////////////////////////////////////////////////////////////
+    // SEGMENTATION : process, load
+    /////////////////////////////////////////////////////////////////
+
+    // Segmentation step (the segmented image is not cached)
+    if (mProcessSegmentation)
+    {
+        if (cache && mOutputDirSegmentedImages == "" && mResultCache.contains(segmentation_key + "_para.txt") &&
+            mResultCache.contains(segmentation_key + "_mask.png"))
+        {
+            rEye.loadParameters(segmentation_key + "_para.txt", &mResultCache);
+            rEye.loadMask(segmentation_key + "_mask.png", &mResultCache);
+        }
+        else
+        {
+            CvSize size = rEye.getOriginalImageSize();
+            rEye.segment(getSegmentationPlan(size), getSegmentationScale(size), pTracker);
+
+            // Save segmented image
+            if (mOutputDirSegmentedImages != "")
+            {
+                rEye.saveSegmentedImage(getPath(mOutputDirSegmentedImages, short_name + mSuffixSegmentedImages),
+                                        getPack(mOutputDirSegmentedImages));
+            }
+
+            // If user don't want to use the mask provided by Osiris
+            if (!mUseMask)
+            {
+                rEye.initMask();
+            }
+
+            if (cache && rEye.getDegradationLevel() == 0)
+            {
+                rEye.saveParameters(segmentation_key + "_para.txt", &mResultCache);
+                rEye.saveMask(segmentation_key + "_mask.png", &mResultCache);
+            }
+        }
+    }
+
+    // Load parameters
+    if (mInputDirParameters != "")
+    {
+        rEye.loadParameters(getPath(mInputDirParameters, short_name + mSuffixParameters), getPack(mInputDirParameters));
     }
 
     // Load mask
     if (mInputDirMasks != "")
     {
-        rEye.loadMask(mInputDirMasks + short_name + mSuffixMasks);
+        rEye.loadMask(getPath(mInputDirMasks, short_name + mSuffixMasks), getPack(mInputDirMasks));
     }
 
     /////////////////////////////////////////////////////////////////
     // NORMALIZATION : process, load
     /////////////////////////////////////////////////////////////////
 
+    // Normalization and encoding in one pass, when the normalized image is neither saved nor loaded
+    // (nor cached, so that a change of the filters only costs the encoding)
+    bool fused = mProcessNormalization && mProcessEncoding && mOutputDirNormalizedImages == "" &&
+                 mInputDirNormalizedImages == "" && mInputDirNormalizedMasks == "" && !cache;
+    if (fused)
+    {
+        rEye.normalizeAndEncode(mWidthOfNormalizedIris, mHeightOfNormalizedIris, getEncodingFilters());
+    }
+
     // Normalization step
-    if (mProcessNormalization)
+    else if (mProcessNormalization)
     {
-        rEye.normalize(mWidthOfNormalizedIris, mHeightOfNormalizedIris);
+        if (cache && mResultCache.contains(normalization_key + "_imno.png") &&
+            mResultCache.contains(normalization_key + "_mano.png"))
+        {
+            rEye.loadNormalizedImage(normalization_key + "_imno.png", &mResultCache);
+            rEye.loadNormalizedMask(normalization_key + "_mano.png", &mResultCache);
+        }
+        else
+        {
+            rEye.normalize(mWidthOfNormalizedIris, mHeightOfNormalizedIris);
+            if (cache && rEye.getDegradationLevel() == 0)
+            {
+                rEye.saveNormalizedImage(normalization_key + "_imno.png", &mResultCache);
+                rEye.saveNormalizedMask(normalization_key + "_mano.png", &mResultCache);
+            }
+        }
     }
 
     // Load normalized image
     if (mInputDirNormalizedImages != "")
     {
-        rEye.loadNormalizedImage(mInputDirNormalizedImages + short_name + mSuffixNormalizedImages);
+        rEye.loadNormalizedImage(getPath(mInputDirNormalizedImages, short_name + mSuffixNormalizedImages),
+                                 getPack(mInputDirNormalizedImages));
     }
 
     // Load normalized mask
     if (mInputDirNormalizedMasks != "")
     {
-        rEye.loadNormalizedMask(mInputDirNormalizedMasks + short_name + mSuffixNormalizedMasks);
+        rEye.loadNormalizedMask(getPath(mInputDirNormalizedMasks, short_name + mSuffixNormalizedMasks),
+                                getPack(mInputDirNormalizedMasks));
     }
 
     /////////////////////////////////////////////////////////////////
@@ -552,15 +1366,32 @@ void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
     /////////////////////////////////////////////////////////////////
 
     // Encoding step
-    if (mProcessEncoding)
+    if (mProcessEncoding && !fused)
+    {
+        if (cache && mResultCache.contains(encoding_key + "_code.png"))
+        {
+            rEye.loadIrisCode(encoding_key + "_code.png", &mResultCache);
+        }
+        else
+        {
+            rEye.encode(getEncodingFilters());
+            if (cache && rEye.getDegradationLevel() == 0)
+            {
+                rEye.saveIrisCode(encoding_key + "_code.png", &mResultCache);
+            }
+        }
+    }
+
+    // Compare the fixed-point code to the floating-point code
+    if (mProcessEncoding && mFixedPointEncoding && mFixedPointReport.is_open())
     {
-        rEye.encode(mGaborFilters);
+        validateFixedPoint(short_name, rEye);
     }
 
     // Load iris code
     if (mInputDirIrisCodes != "")
     {
-        rEye.loadIrisCode(mInputDirIrisCodes + short_name + mSuffixIrisCodes);
+        rEye.loadIrisCode(getPath(mInputDirIrisCodes, short_name + mSuffixIrisCodes), getPack(mInputDirIrisCodes));
     }
 
     /////////////////////////////////////////////////////////////////
@@ -576,7 +1407,8 @@ void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
         }
         else
         {
-            rEye.saveParameters(mOutputDirParameters + short_name + mSuffixParameters);
+            rEye.saveParameters(getPath(mOutputDirParameters, short_name + mSuffixParameters),
+                                getPack(mOutputDirParameters));
         }
     }
 
@@ -589,7 +1421,7 @@ void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
         }
         else
         {
-            rEye.saveMask(mOutputDirMasks + short_name + mSuffixMasks);
+            rEye.saveMask(getPath(mOutputDirMasks, short_name + mSuffixMasks), getPack(mOutputDirMasks));
         }
     }
 
@@ -602,7 +1434,8 @@ void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
         }
         else
         {
-            rEye.saveNormalizedImage(mOutputDirNormalizedImages + short_name + mSuffixNormalizedImages);
+            rEye.saveNormalizedImage(getPath(mOutputDirNormalizedImages, short_name + mSuffixNormalizedImages),
+                                     getPack(mOutputDirNormalizedImages));
         }
     }
 
@@ -615,7 +1448,8 @@ void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
         }
         else
         {
-            rEye.saveNormalizedMask(mOutputDirNormalizedMasks + short_name + mSuffixNormalizedMasks);
+            rEye.saveNormalizedMask(getPath(mOutputDirNormalizedMasks, short_name + mSuffixNormalizedMasks),
+                                    getPack(mOutputDirNormalizedMasks));
         }
     }
 
@@ -628,87 +1462,1323 @@ void OsiManager::processOneEye(const std::string &rFileName, OsiEye &rEye)
         }
         else
         {
-            rEye.saveIrisCode(mOutputDirIrisCodes + short_name + mSuffixIrisCodes);
+            rEye.saveIrisCode(getPath(mOutputDirIrisCodes, short_name + mSuffixIrisCodes),
+                              getPack(mOutputDirIrisCodes));
         }
     }
 
+    return true;
+
 } // end of function
 
-// Run osiris
-void OsiManager::run()
+// Get the filters used to encode
+const std::vector<CvMat *> &OsiManager::getEncodingFilters() const
 {
-    std::cout << std::endl;
-    std::cout << "================" << std::endl;
-    std::cout << "Start processing" << std::endl;
-    std::cout << "================" << std::endl;
-    std::cout << std::endl;
+    return mFixedPointEncoding ? mQuantizedGaborFilters : mGaborFilters;
 
-    // If matching is requested, create a file
-    std::ofstream result_matching;
-    if (mProcessMatching && mOutputFileMatchingScores != "")
+} // end of function
+
+// Compare the fixed-point code of an eye to the floating-point code
+void OsiManager::validateFixedPoint(const std::string &rName, OsiEye &rEye)
+{
+    int errors = rEye.countBitErrors(mWidthOfNormalizedIris, mHeightOfNormalizedIris, mGaborFilters);
+    double bits = (double)mWidthOfNormalizedIris * mHeightOfNormalizedIris * mGaborFilters.size();
+    mBitErrors += errors;
+    mComparedBits += bits;
+    mFixedPointReport << rName << " " << errors << " " << bits << " " << errors / bits << "\n";
+
+} // end of function
+
+// Write the result of an eye in the processing log
+void OsiManager::logProcessing(const std::string &rName, const OsiEye &rEye, const std::string &rStatus)
+{
+    if (mProcessingLog.is_open())
     {
-        try
+        mProcessingLog << rName << " " << rEye.getElapsedTime() << " " << rEye.getDegradationLevel() << " "
+                       << rStatus << "\n";
+    }
+
+} // end of function
+
+// Check the quality of an eye before segmentation, and report it
+bool OsiManager::checkQuality(const std::string &rName, OsiEye &rEye, float &rScore)
+{
+    float focus, occlusion, contrast;
+    rEye.assessQuality(mMinPupilDiameter, focus, occlusion, contrast);
+    rScore = focus * contrast * (1 - occlusion);
+
+    bool accepted = (focus >= mMinFocus) && (occlusion <= mMaxOcclusion) && (contrast >= mMinContrast);
+    if (!accepted)
+    {
+        std::cout << "Rejected " << rName << " : focus = " << focus << ", occlusion = " << occlusion
+                  << ", contrast = " << contrast << std::endl;
+    }
+
+    if (mQualityReport.is_open())
+    {
+        mQualityReport << rName << " " << focus << " " << occlusion << " " << contrast << " " << rScore << " "
+                       << (accepted ? "accepted" : "rejected") << "\n";
+    }
+
+    return accepted;
+
+} // end of function
+
+// Process one frame of a sequence
+void OsiManager::processFrame(const std::string &rName, const cv::Mat &rFrame, OsiTracker &rTracker,
+                              bool checkFrameQuality)
+{
+    try
+    {
+        OsiEye eye;
+        IplImage image = cvIplImage(rFrame);
+        eye.setOriginalImage(&image);
+        processOneEye(rName, eye, &rTracker, checkFrameQuality);
+    }
+    catch (std::exception &e)
+    {
+        // The next frame must not rely on this one
+        std::cout << e.what() << std::endl;
+        rTracker.reset();
+    }
+
+} // end of function
+
+// Process all frames of a sequence, tracking the pupil from one frame to the next
+void OsiManager::processSequence(const std::string &rFileName)
+{
+    // Strings handle
+    OsiStringUtils osu;
+
+    // Video file, or numbered images such as "burst_%03d.bmp"
+    cv::VideoCapture capture(mInputDirOriginalImages + rFileName);
+    if (!capture.isOpened())
+    {
+        throw std::runtime_error("Cannot open the sequence " + mInputDirOriginalImages + rFileName);
+    }
+
+    // Name of frames : name of the sequence without its numbering pattern, followed by the frame index
+    std::string sequence_name = osu.extractFileName(rFileName);
+    int pos = sequence_name.find('%');
+    if (pos != std::string::npos)
+    {
+        sequence_name = sequence_name.substr(0, pos);
+    }
+    if (!sequence_name.empty() && sequence_name[sequence_name.length() - 1] != '_')
+    {
+        sequence_name += "_";
+    }
+
+    // The tracker lives as long as the sequence
+    OsiTracker tracker(mTrackingConfidence);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cv::Mat frame, gray;
+    int n_frames = 0;
+
+    // Best frames of the burst, ranked by quality score (only if requested)
+    std::map<int, cv::Mat> best_frames;
+    std::multimap<float, int> best_scores;
+
+    while (capture.read(frame))
+    {
+        // Frames of videos are usually in color
+        if (frame.channels() == 1)
         {
-            result_matching.open(mOutputFileMatchingScores.c_str(), std::ios::out);
+            gray = frame;
         }
-        catch (std::exception &e)
+        else
         {
-            std::cout << e.what() << std::endl;
-            throw std::runtime_error("Cannot create the file for matching scores : " + mOutputFileMatchingScores);
+            cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+        }
+
+        std::ostringstream frame_name;
+        frame_name << sequence_name << std::setw(4) << std::setfill('0') << n_frames;
+
+        // Process the frames as they come
+        if (mNumberOfBestFrames <= 0)
+        {
+            processFrame(frame_name.str(), gray, tracker, mAssessQuality);
+        }
+
+        // Or keep only the best ones, processed once the whole burst is read
+        else
+        {
+            OsiEye eye;
+            IplImage image = cvIplImage(gray);
+            eye.setOriginalImage(&image);
+            float score = 0;
+            if (checkQuality(frame_name.str(), eye, score))
+            {
+                if (best_scores.size() < mNumberOfBestFrames)
+                {
+                    best_scores.insert(std::make_pair(score, n_frames));
+                    best_frames[n_frames] = gray.clone();
+                }
+                else if (score > best_scores.begin()->first)
+                {
+                    best_frames.erase(best_scores.begin()->second);
+                    best_scores.erase(best_scores.begin());
+                    best_scores.insert(std::make_pair(score, n_frames));
+                    best_frames[n_frames] = gray.clone();
+                }
+            }
         }
+
+        n_frames++;
     }
 
-    for (int i = 0; i < mListOfImages.size(); i++)
+    // Process the best frames in temporal order (quality is already checked)
+    for (std::map<int, cv::Mat>::iterator it = best_frames.begin(); it != best_frames.end(); it++)
     {
-        // Message on prompt command to know the progress
-        std::cout << i + 1 << " / " << mListOfImages.size() << std::endl;
+        std::ostringstream frame_name;
+        frame_name << sequence_name << std::setw(4) << std::setfill('0') << it->first;
+        processFrame(frame_name.str(), it->second, tracker, false);
+    }
 
-        try
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "Sequence " << rFileName << " : " << n_frames << " frames (" << tracker.getNumberOfTrackedFrames()
+              << " tracked, " << tracker.getNumberOfFullSearches() << " full searches) in " << seconds << " s";
+    if (seconds > 0)
+    {
+        std::cout << " = " << n_frames / seconds << " frames/s";
+    }
+    std::cout << std::endl;
+
+} // end of function
+
+// Process an eye in memory for the benchmark
+OsiEye *OsiManager::processBenchmarkEye(const std::string &rName, const OsiProfile &rProfile,
+                                        std::map<std::string, OsiEye *> &rEyes, double &rSeconds)
+{
+    // Already processed (or failed) with this profile
+    if (rEyes.find(rName) != rEyes.end())
+    {
+        return rEyes[rName];
+    }
+
+    OsiEye *eye = new OsiEye;
+    try
+    {
+        eye->setProfile(rProfile);
+        eye->loadOriginalImage(mInputDirOriginalImages + rName, cvSize(mRawImageWidth, mRawImageHeight));
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        eye->setTimeBudget(mMaxTimePerImage);
+        CvSize size = eye->getOriginalImageSize();
+        eye->segment(getSegmentationPlan(size), getSegmentationScale(size));
+        if (!mUseMask)
         {
-            // Process the eye
-            OsiEye eye;
-            processOneEye(mListOfImages[i], eye);
+            eye->initMask();
+        }
+        eye->normalizeAndEncode(mWidthOfNormalizedIris, mHeightOfNormalizedIris, getEncodingFilters());
+        rSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    catch (std::exception &e)
+    {
+        std::cout << rName << " : " << e.what() << std::endl;
+        delete eye;
+        eye = 0;
+    }
 
-            // Process a second eye if matching is requested
-            if (mProcessMatching && (i < mListOfImages.size() - 1))
-            {
-                i++;
-                std::cout << i + 1 << " / " << mListOfImages.size() << std::endl;
-                OsiEye eye2;
-                processOneEye(mListOfImages[i], eye2);
+    rEyes[rName] = eye;
+    return eye;
 
-                // Match the two iris codes
-                float score = eye.match(eye2, mpApplicationPoints);
+} // end of function
 
-                // Save in file
-                if (result_matching)
+// Compare the speed and the accuracy of profiles
+void OsiManager::runBenchmark()
+{
+    if (!mpApplicationPoints || mGaborFilters.empty())
+    {
+        throw std::runtime_error("Benchmark needs Gabor filters and application points (encoding and matching)");
+    }
+
+    // Impostor pairs
+    std::vector<std::string> impostor_pairs;
+    loadImpostorPairs(impostor_pairs);
+
+    // Report
+    std::ofstream report;
+    if (mOutputFileBenchmark != "")
+    {
+        report.open(mOutputFileBenchmark.c_str(), std::ios::out);
+        if (!report)
+        {
+            throw std::runtime_error("Cannot create the file for benchmark report : " + mOutputFileBenchmark);
+        }
+        report << "# profile images failures seconds images_per_second genuines impostors eer threshold" << "\n";
+    }
+
+    std::istringstream profiles(mBenchmarkProfiles);
+    std::string profile_name;
+    while (profiles >> profile_name)
+    {
+        OsiProfile profile(profile_name);
+        std::cout << "Benchmark of profile " << profile_name << std::endl;
+
+        std::map<std::string, OsiEye *> eyes;
+        OsiEvaluation evaluation;
+        double seconds = 0;
+
+        // Genuine pairs (list of images) then impostor pairs
+        for (int list = 0; list < 2; list++)
+        {
+            const std::vector<std::string> &pairs = list ? impostor_pairs : mListOfImages;
+            for (int i = 0; i + 1 < pairs.size(); i += 2)
+            {
+                OsiEye *eye1 = processBenchmarkEye(pairs[i], profile, eyes, seconds);
+                OsiEye *eye2 = processBenchmarkEye(pairs[i + 1], profile, eyes, seconds);
+                if (!eye1 || !eye2)
                 {
-                    try
-                    {
-                        result_matching << mListOfImages[i - 1] << " ";
-                        result_matching << mListOfImages[i] << " ";
-                        result_matching << score << std::endl;
-                    }
-                    catch (std::exception &e)
-                    {
-                        std::cout << e.what() << std::endl;
-                        throw std::runtime_error("Error while saving result of matching in " +
-                                                 mOutputFileMatchingScores);
-                    }
+                    continue;
+                }
+
+                float score = eye1->match(*eye2, mpApplicationPoints);
+                if (list)
+                {
+                    evaluation.addImpostorScore(score);
+                }
+                else
+                {
+                    evaluation.addGenuineScore(score);
                 }
             }
         }
-        catch (std::exception &e)
+
+        // Count and release the eyes
+        int n_images = 0;
+        int n_failures = 0;
+        for (std::map<std::string, OsiEye *>::iterator it = eyes.begin(); it != eyes.end(); it++)
         {
-            std::cout << e.what() << std::endl;
+            if (it->second)
+            {
+                n_images++;
+                delete it->second;
+            }
+            else
+            {
+                n_failures++;
+            }
         }
 
-    } // end for images
+        float threshold = 0;
+        float eer = evaluation.computeEER(&threshold);
+        double throughput = seconds > 0 ? n_images / seconds : 0;
+
+        std::cout << "Profile " << profile_name << " : " << n_images << " images (" << n_failures << " failures) in "
+                  << seconds << " s = " << throughput << " images/s, EER = " << 100 * eer << " % on "
+                  << evaluation.getNumberOfGenuineScores() << " genuine and "
+                  << evaluation.getNumberOfImpostorScores() << " impostor comparisons" << std::endl;
+
+        if (report)
+        {
+            report << profile_name << " " << n_images << " " << n_failures << " " << seconds << " " << throughput
+                   << " " << evaluation.getNumberOfGenuineScores() << " " << evaluation.getNumberOfImpostorScores()
+                   << " " << eer << " " << threshold << "\n";
+        }
+    }
+
+    if (report)
+    {
+        report.close();
+    }
+
+} // end of function
+
+// Prepare an eye in memory for the sweep
+OsiEye *OsiManager::processSweepEye(const std::string &rName)
+{
+    OsiStringUtils osu;
+    std::string short_name = osu.extractFileName(rName);
+
+    OsiEye *eye = new OsiEye;
+    try
+    {
+        eye->setProfile(mProfile);
+
+        // Normalized images computed by a previous run
+        if (mInputDirNormalizedImages != "")
+        {
+            eye->loadNormalizedImage(getPath(mInputDirNormalizedImages, short_name + mSuffixNormalizedImages),
+                                     getPack(mInputDirNormalizedImages));
+            if (mInputDirNormalizedMasks != "")
+            {
+                eye->loadNormalizedMask(getPath(mInputDirNormalizedMasks, short_name + mSuffixNormalizedMasks),
+                                        getPack(mInputDirNormalizedMasks));
+            }
+            return eye;
+        }
+
+        eye->loadOriginalImage(mInputDirOriginalImages + rName, cvSize(mRawImageWidth, mRawImageHeight));
+        if (mInputDirParameters != "")
+        {
+            eye->loadParameters(getPath(mInputDirParameters, short_name + mSuffixParameters),
+                                getPack(mInputDirParameters));
+        }
+        else
+        {
+            CvSize size = eye->getOriginalImageSize();
+            eye->segment(getSegmentationPlan(size), getSegmentationScale(size));
+        }
+        if (mInputDirMasks != "")
+        {
+            eye->loadMask(getPath(mInputDirMasks, short_name + mSuffixMasks), getPack(mInputDirMasks));
+        }
+        else if (!mUseMask)
+        {
+            eye->initMask();
+        }
+        eye->normalize(mWidthOfNormalizedIris, mHeightOfNormalizedIris);
+
+        // Only the normalized images are used by the sweep
+        eye->keepNormalizedImages();
+    }
+    catch (std::exception &e)
+    {
+        std::cout << rName << " : " << e.what() << std::endl;
+        delete eye;
+        eye = 0;
+    }
+
+    return eye;
+
+} // end of function
+
+// Compare several banks of filters on the same normalized images
+void OsiManager::runSweep()
+{
+    if (!mpApplicationPoints)
+    {
+        throw std::runtime_error("Sweep of filter banks needs application points (matching)");
+    }
+
+    // Banks of filters, listed one per line (relative to the directory of the list)
+    std::ifstream list(mFilenameFilterBanks.c_str(), std::ios::in);
+    if (!list)
+    {
+        throw std::runtime_error("Cannot load the list of filter banks in " + mFilenameFilterBanks);
+    }
+    std::string list_dir = mFilenameFilterBanks.substr(0, mFilenameFilterBanks.find_last_of("/\\") + 1);
+    std::vector<std::string> bank_names;
+    std::string bank_name;
+    while (list >> bank_name)
+    {
+        bank_names.push_back(bank_name);
+    }
+
+    std::vector<std::vector<CvMat *>> banks(bank_names.size());
+    for (int b = 0; b < banks.size(); b++)
+    {
+        bool absolute = bank_names[b][0] == '/' || bank_names[b].find(':') != std::string::npos;
+        loadFilterBank(absolute ? bank_names[b] : list_dir + bank_names[b], banks[b]);
+    }
+
+    // Genuine pairs (list of images) then impostor pairs
+    std::vector<std::string> impostor_pairs;
+    loadImpostorPairs(impostor_pairs);
+
+    // Normalize all images once
+    std::map<std::string, OsiEye *> eyes;
+    for (int list_index = 0; list_index < 2; list_index++)
+    {
+        const std::vector<std::string> &pairs = list_index ? impostor_pairs : mListOfImages;
+        for (int i = 0; i < pairs.size(); i++)
+        {
+            if (eyes.find(pairs[i]) == eyes.end())
+            {
+                eyes[pairs[i]] = processSweepEye(pairs[i]);
+            }
+        }
+    }
+    std::cout << "Sweep of " << banks.size() << " filter banks on " << eyes.size() << " images" << std::endl;
+
+    // Evaluate the banks in parallel : each thread takes the next bank, encodes all eyes and matches the pairs
+    std::vector<OsiEvaluation> evaluations(banks.size());
+    std::vector<std::string> errors(banks.size());
+    std::atomic<int> next_bank(0);
+    std::vector<std::thread> threads;
+    int n_threads = std::max(1, std::min((int)banks.size(), (int)std::thread::hardware_concurrency()));
+    for (int t = 0; t < n_threads; t++)
+    {
+        threads.push_back(std::thread([&]() {
+            for (int b = next_bank++; b < banks.size(); b = next_bank++)
+            {
+                std::map<std::string, IplImage *> codes;
+                try
+                {
+                    for (std::map<std::string, OsiEye *>::iterator it = eyes.begin(); it != eyes.end(); it++)
+                    {
+                        if (it->second)
+                        {
+                            codes[it->first] = it->second->computeIrisCode(banks[b]);
+                        }
+                    }
+
+                    for (int list_index = 0; list_index < 2; list_index++)
+                    {
+                        const std::vector<std::string> &pairs = list_index ? impostor_pairs : mListOfImages;
+                        for (int i = 0; i + 1 < pairs.size(); i += 2)
+                        {
+                            // Read only : the map of eyes is shared by the threads
+                            OsiEye *eye1 = eyes.find(pairs[i])->second;
+                            OsiEye *eye2 = eyes.find(pairs[i + 1])->second;
+                            if (!eye1 || !eye2)
+                            {
+                                continue;
+                            }
+
+                            float score = eye1->matchIrisCodes(codes[pairs[i]], *eye2, codes[pairs[i + 1]],
+                                                               mpApplicationPoints);
+                            if (list_index)
+                            {
+                                evaluations[b].addImpostorScore(score);
+                            }
+                            else
+                            {
+                                evaluations[b].addGenuineScore(score);
+                            }
+                        }
+                    }
+                }
+                catch (std::exception &e)
+                {
+                    errors[b] = e.what();
+                }
+
+                for (std::map<std::string, IplImage *>::iterator it = codes.begin(); it != codes.end(); it++)
+                {
+                    cvReleaseImage(&it->second);
+                }
+            }
+        }));
+    }
+    for (int t = 0; t < threads.size(); t++)
+    {
+        threads[t].join();
+    }
+
+    // Report
+    std::ofstream report;
+    if (mOutputFileSweep != "")
+    {
+        report.open(mOutputFileSweep.c_str(), std::ios::out);
+        if (!report)
+        {
+            throw std::runtime_error("Cannot create the file for sweep report : " + mOutputFileSweep);
+        }
+        report << "# bank genuines impostors mean_genuine mean_impostor decidability eer threshold" << "\n";
+    }
+
+    for (int b = 0; b < banks.size(); b++)
+    {
+        if (errors[b] != "")
+        {
+            std::cout << "Bank " << bank_names[b] << " : " << errors[b] << std::endl;
+            continue;
+        }
+
+        const OsiEvaluation &evaluation = evaluations[b];
+        float threshold = 0;
+        float eer = evaluation.computeEER(&threshold);
+        float decidability = evaluation.computeDecidability();
+
+        std::cout << "Bank " << bank_names[b] << " : EER = " << 100 * eer << " %, d' = " << decidability
+                  << ", mean genuine " << evaluation.getMeanGenuineScore() << " / impostor "
+                  << evaluation.getMeanImpostorScore() << " on " << evaluation.getNumberOfGenuineScores()
+                  << " genuine and " << evaluation.getNumberOfImpostorScores() << " impostor comparisons"
+                  << std::endl;
+
+        if (report)
+        {
+            report << bank_names[b] << " " << evaluation.getNumberOfGenuineScores() << " "
+                   << evaluation.getNumberOfImpostorScores() << " " << evaluation.getMeanGenuineScore() << " "
+                   << evaluation.getMeanImpostorScore() << " " << decidability << " " << eer << " " << threshold
+                   << "\n";
+        }
+    }
+
+    if (report)
+    {
+        report.close();
+    }
+
+    // Release the eyes and the banks
+    for (std::map<std::string, OsiEye *>::iterator it = eyes.begin(); it != eyes.end(); it++)
+    {
+        delete it->second;
+    }
+    for (int b = 0; b < banks.size(); b++)
+    {
+        for (int f = 0; f < banks[b].size(); f++)
+        {
+            cvReleaseMat(&banks[b][f]);
+        }
+    }
+
+} // end of function
+
+// Process the images of the list streamed from an archive
+void OsiManager::processArchive(OsiScoreWriter &rScores)
+{
+    if (mProcessSequences)
+    {
+        throw std::runtime_error("Sequences cannot be read from the archive " + mInputDirOriginalImages);
+    }
+
+    // Positions of each image in the list (an image may be in several pairs)
+    std::map<std::string, std::vector<int>> positions;
+    for (int i = 0; i < mListOfImages.size(); i++)
+    {
+        positions[mListOfImages[i]].push_back(i);
+    }
+
+    // Eyes waiting for the other eye of their pair, by position in the list
+    std::map<int, std::shared_ptr<OsiEye>> waiting;
+    std::vector<bool> found(mListOfImages.size(), false);
+
+    // Positions of the rejected eyes : their pairs are not matched
+    std::vector<bool> rejected(mListOfImages.size(), false);
+    bool match_pairs = mProcessMatching && mFilenameGallery == "";
+
+    OsiTarReader archive;
+    archive.open(mInputDirOriginalImages);
+
+    std::string member;
+    std::vector<unsigned char> data;
+    int n_processed = 0;
+    while (archive.next(member, data))
+    {
+        // The member is named as in the list, with or without its directory
+        std::map<std::string, std::vector<int>>::iterator it = positions.find(member);
+        if (it == positions.end())
+        {
+            it = positions.find(member.substr(member.find_last_of('/') + 1));
+        }
+        if (it == positions.end() || found[it->second[0]])
+        {
+            continue;
+        }
+        const std::string &name = mListOfImages[it->second[0]];
+        const std::vector<int> &indices = it->second;
+        for (int k = 0; k < indices.size(); k++)
+        {
+            found[indices[k]] = true;
+        }
+
+        // The eye is only needed to be matched with eyes already rejected
+        if (match_pairs)
+        {
+            bool needed = false;
+            for (int k = 0; k < indices.size(); k++)
+            {
+                int other = indices[k] ^ 1;
+                needed = needed || other >= mListOfImages.size() || !rejected[other];
+            }
+            if (!needed)
+            {
+                std::cout << "Skip " << name << " : the other eye of its pair is rejected" << std::endl;
+                continue;
+            }
+        }
+
+        // Message on prompt command to know the progress
+        n_processed++;
+        std::cout << n_processed << " / " << positions.size() << std::endl;
+
+        std::shared_ptr<OsiEye> eye(new OsiEye);
+        try
+        {
+            // The original image is decoded only if it is used
+            if (mProcessSegmentation || mProcessNormalization)
+            {
+                eye->decodeOriginalImage(member, data, cvSize(mRawImageWidth, mRawImageHeight));
+            }
+            if (!processOneEye(name, *eye))
+            {
+                // No iris code : the eyes waiting for this one are released
+                for (int k = 0; k < indices.size(); k++)
+                {
+                    rejected[indices[k]] = true;
+                    waiting.erase(indices[k] ^ 1);
+                }
+                continue;
+            }
+
+            // Search the eye in the gallery
+            if (mProcessMatching && mFilenameGallery != "")
+            {
+                for (int k = 0; k < indices.size(); k++)
+                {
+                    identify(mListOfImages[indices[k]], *eye, rScores);
+                }
+            }
+        }
+        catch (std::exception &e)
+        {
+            std::cout << e.what() << std::endl;
+            continue;
+        }
+
+        if (!match_pairs)
+        {
+            continue;
+        }
+
+        // Match each pair of the eye whose other eye is already processed
+        for (int k = 0; k < indices.size(); k++)
+        {
+            int other = indices[k] ^ 1;
+            if (other >= mListOfImages.size() || rejected[other])
+            {
+                continue;
+            }
+            if (waiting.find(other) == waiting.end())
+            {
+                waiting[indices[k]] = eye;
+                continue;
+            }
+
+            int first = std::min(indices[k], other);
+            OsiEye &first_eye = first == other ? *waiting[other] : *eye;
+            OsiEye &second_eye = first == other ? *eye : *waiting[other];
+            try
+            {
+                float score = first_eye.match(second_eye, mpApplicationPoints);
+                if (rScores.isOpen())
+                {
+                    rScores.write(mListOfImages[first], mListOfImages[first + 1], score);
+                }
+            }
+            catch (std::exception &e)
+            {
+                std::cout << e.what() << std::endl;
+            }
+            waiting.erase(other);
+        }
+    }
+    archive.close();
+
+    // Images of the list which are not in the archive
+    std::set<std::string> missing;
+    for (int i = 0; i < mListOfImages.size(); i++)
+    {
+        if (!found[i])
+        {
+            missing.insert(mListOfImages[i]);
+        }
+    }
+    if (!missing.empty())
+    {
+        std::cout << missing.size() << " images of the list are not in the archive " << mInputDirOriginalImages
+                  << " :" << std::endl;
+        for (std::set<std::string>::const_iterator it = missing.begin(); it != missing.end(); it++)
+        {
+            std::cout << "- " << *it << std::endl;
+        }
+    }
+
+} // end of function
+
+// Process only a part of the list
+void OsiManager::setShard(const std::string &rShard)
+{
+    std::istringstream fields(rShard);
+    int shard = 0;
+    int n_shards = 0;
+    char slash = 0;
+    if (!(fields >> shard >> slash >> n_shards) || slash != '/' || shard < 1 || shard > n_shards)
+    {
+        throw std::invalid_argument("Wrong shard : " + rShard + " (i/N with i from 1 to N)");
+    }
+    mShard = shard;
+    mNumberOfShards = n_shards;
+
+} // end of function
+
+// Get the cost of each entry of the list
+void OsiManager::getCostsOfImages(std::vector<double> &rCosts)
+{
+    OsiStringUtils osu;
+    std::string balancing = osu.toLower(mShardBalancing);
+    rCosts.assign(mListOfImages.size(), 1);
+    if (balancing == "count")
+    {
+        return;
+    }
+
+    // Size of the original images (the members of an archive are not known before they are read)
+    if (balancing == "size")
+    {
+        if (mInputDirOriginalImages == "" || OsiTarReader::isArchive(mInputDirOriginalImages))
+        {
+            std::cout << "Shards are balanced by number of entries : the original images are not files" << std::endl;
+            return;
+        }
+        for (int i = 0; i < mListOfImages.size(); i++)
+        {
+            rCosts[i] = getFileSize(mInputDirOriginalImages + mListOfImages[i]);
+        }
+        return;
+    }
+
+    // Time of the images in a previous processing log : "<name> <milliseconds> <degradation> <status>"
+    if (balancing == "time")
+    {
+        std::ifstream file(mFilenameTimingLog.c_str(), std::ios::in);
+        if (!file)
+        {
+            throw std::runtime_error("Cannot load the timing log : " + mFilenameTimingLog);
+        }
+        std::map<std::string, double> times;
+        double sum = 0;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream fields(line);
+            std::string name;
+            double milliseconds = 0;
+            if (line.compare(0, 1, "#") != 0 && fields >> name >> milliseconds)
+            {
+                times[name] = milliseconds;
+                sum += milliseconds;
+            }
+        }
+
+        // The images missing from the log cost the mean time
+        double mean = times.empty() ? 1 : sum / times.size();
+        for (int i = 0; i < mListOfImages.size(); i++)
+        {
+            std::map<std::string, double>::const_iterator it = times.find(osu.extractFileName(mListOfImages[i]));
+            rCosts[i] = it != times.end() ? it->second : mean;
+        }
+        return;
+    }
+
+    throw std::invalid_argument("Unknown shard balancing : " + mShardBalancing + " (count, size or time)");
+
+} // end of function
+
+// Keep the part of the list of the shard
+void OsiManager::applyShard()
+{
+    // Pairs are not cut for matching (the identification matches single eyes)
+    int unit = mProcessMatching && mFilenameGallery == "" ? 2 : 1;
+    int n_units = (mListOfImages.size() + unit - 1) / unit;
+
+    // Cumulated cost of the units before each unit
+    std::vector<double> costs;
+    getCostsOfImages(costs);
+    std::vector<double> cumulated(n_units + 1, 0);
+    for (int i = 0; i < mListOfImages.size(); i++)
+    {
+        cumulated[i / unit + 1] += costs[i];
+    }
+    for (int u = 0; u < n_units; u++)
+    {
+        cumulated[u + 1] += cumulated[u];
+    }
+    if (cumulated[n_units] <= 0)
+    {
+        for (int u = 0; u <= n_units; u++)
+        {
+            cumulated[u] = u;
+        }
+    }
+
+    // The shard k starts at the first unit whose cumulated cost reaches (k - 1) / N of the total cost
+    int bounds[2];
+    for (int b = 0; b < 2; b++)
+    {
+        int k = mShard - 1 + b;
+        double cost = cumulated[n_units] * k / mNumberOfShards;
+        bounds[b] = k == 0 ? 0 : k == mNumberOfShards ? n_units
+                                                        : std::lower_bound(cumulated.begin(), cumulated.end(), cost) -
+                                                              cumulated.begin();
+    }
+    int first = bounds[0] * unit;
+    int last = std::min(bounds[1] * unit, (int)mListOfImages.size());
+    mListOfImages = std::vector<std::string>(mListOfImages.begin() + first, mListOfImages.begin() + last);
+    std::cout << "Shard " << mShard << " / " << mNumberOfShards << " : entries " << first + 1 << " to " << last
+              << " of the list" << std::endl;
+
+    // The outputs of the shard are named after it
+    std::string *files[] = {&mOutputFileMatchingScores, &mOutputFileQuality, &mOutputFileProcessingLog,
+                            &mOutputFileFixedPoint,     &mFilenameCheckpoint, &mFilenameResultCache};
+    for (int f = 0; f < sizeof(files) / sizeof(files[0]); f++)
+    {
+        if (*files[f] != "")
+        {
+            *files[f] = getShardPath(*files[f], mShard, mNumberOfShards);
+        }
+    }
+    std::string *dirs[] = {&mOutputDirSegmentedImages,  &mOutputDirParameters,       &mOutputDirMasks,
+                           &mOutputDirNormalizedImages, &mOutputDirNormalizedMasks, &mOutputDirIrisCodes};
+    for (int d = 0; d < sizeof(dirs) / sizeof(dirs[0]); d++)
+    {
+        if (isPackFile(*dirs[d]))
+        {
+            *dirs[d] = getShardPath(*dirs[d], mShard, mNumberOfShards);
+        }
+    }
+
+} // end of function
+
+// Merge the outputs of all shards
+void OsiManager::mergeShards(int nShards)
+{
+    if (nShards < 1)
+    {
+        throw std::invalid_argument("Wrong number of shards to merge");
+    }
+    std::cout << "Merge the outputs of " << nShards << " shards" << std::endl;
+
+    // The scores are written again in the order of the shards, that is in the order of the list
+    if (mProcessMatching && mOutputFileMatchingScores != "")
+    {
+        int format = OsiScoreWriter::getFormat(mMatchingScoresFormat);
+        OsiScoreWriter scores;
+        scores.open(mOutputFileMatchingScores, format, mBestScoresPerProbe, mMaxMatchingScore);
+        for (int s = 1; s <= nShards; s++)
+        {
+            OsiScoreReader reader;
+            reader.open(getShardPath(mOutputFileMatchingScores, s, nShards), format);
+            std::string probe, gallery;
+            float score = 0;
+            while (reader.read(probe, gallery, score))
+            {
+                scores.write(probe, gallery, score);
+            }
+        }
+        scores.close();
+    }
+
+    // Reports
+    if (mOutputFileQuality != "")
+    {
+        mergeReports(mOutputFileQuality, nShards);
+    }
+    if (mOutputFileProcessingLog != "")
+    {
+        mergeReports(mOutputFileProcessingLog, nShards);
+    }
+    if (mFixedPointEncoding && mOutputFileFixedPoint != "")
+    {
+        mergeReports(mOutputFileFixedPoint, nShards);
+    }
+
+    // Pack files (the files saved in directories are already in place)
+    std::string dirs[] = {mOutputDirSegmentedImages,  mOutputDirParameters,       mOutputDirMasks,
+                          mOutputDirNormalizedImages, mOutputDirNormalizedMasks, mOutputDirIrisCodes};
+    for (int d = 0; d < sizeof(dirs) / sizeof(dirs[0]); d++)
+    {
+        if (isPackFile(dirs[d]))
+        {
+            mergePacks(dirs[d], nShards);
+        }
+    }
+
+} // end of function
+
+// Load the eyes of a part of the gallery list
+void OsiManager::loadGallery(int shard, int nShards, bool rebuildIndex)
+{
+    std::ifstream file(mFilenameGallery.c_str(), std::ios::in);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot load the gallery in " + mFilenameGallery);
+    }
+    std::vector<std::string> names;
+    std::copy(std::istream_iterator<std::string>(file), std::istream_iterator<std::string>(),
+              std::back_inserter(names));
+    if (mInputDirGalleryIrisCodes == "")
+    {
+        throw std::invalid_argument("The gallery needs iris codes (Load gallery iris codes)");
+    }
+
+    // Consecutive parts of the gallery list
+    int first = nShards > 0 ? (long long)names.size() * (shard - 1) / nShards : 0;
+    int last = nShards > 0 ? (long long)names.size() * shard / nShards : names.size();
+
+    OsiStringUtils osu;
+    mGallery.clear();
+    mGallery.setMatching(mProfile, mpApplicationPoints);
+    for (int g = first; g < last; g++)
+    {
+        std::string short_name = osu.extractFileName(names[g]);
+        std::shared_ptr<OsiEye> eye(new OsiEye);
+        try
+        {
+            eye->loadIrisCode(getPath(mInputDirGalleryIrisCodes, short_name + mSuffixIrisCodes),
+                              getPack(mInputDirGalleryIrisCodes));
+            if (mInputDirGalleryNormalizedMasks != "")
+            {
+                eye->loadNormalizedMask(getPath(mInputDirGalleryNormalizedMasks, short_name + mSuffixNormalizedMasks),
+                                        getPack(mInputDirGalleryNormalizedMasks));
+            }
+            mGallery.add(names[g], g, eye);
+        }
+        catch (std::exception &e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+    }
+    std::cout << mGallery.getSize() << " eyes of the gallery loaded (entries " << first + 1 << " to " << last
+              << " of " << names.size() << ")" << std::endl;
+
+    // Index giving the shortlist of each probe, saved for each part of the gallery
+    std::string index_filename = mFilenameGalleryIndex;
+    if (index_filename != "" && nShards > 0)
+    {
+        index_filename = getShardPath(index_filename, shard, nShards);
+    }
+    mGallery.setIndex(mGalleryIndex, index_filename, mRecallPeriod);
+    mGallery.setLshParameters(mLshTables, mLshBits, mLshMaskedBits);
+    mGallery.setBloomParameters(mBloomWordRows, mBloomBlockWidth, mBloomTrees, mBloomCandidates);
+    mGallery.setCascadeStages(mCascadeStages);
+    mGallery.setTreeParameters(mMaxMatchingScore, mTreeSlack, mSearchThreads);
+    mGallery.setClusterParameters(mClusters, mClusterProbe, mSearchThreads);
+    mGallery.buildIndex(rebuildIndex);
+
+    // Threads searching the gallery, each one on the memory of its NUMA node
+    mGallery.start(mSearchThreads, mNumaSearch);
+
+} // end of function
+
+// Search an eye in the gallery
+void OsiManager::identify(const std::string &rName, OsiEye &rEye, OsiScoreWriter &rScores)
+{
+    std::vector<OsiCandidate> candidates;
+    if (mSearchCluster.isConnected())
+    {
+        mSearchCluster.search(rEye, mNumberOfCandidates, candidates);
+    }
+    else
+    {
+        mGallery.search(rEye, mNumberOfCandidates, candidates);
+    }
+
+    if (rScores.isOpen())
+    {
+        for (int c = 0; c < candidates.size(); c++)
+        {
+            rScores.write(rName, candidates[c].name, candidates[c].score);
+        }
+    }
+
+} // end of function
+
+// Serve a part of the gallery to a coordinator
+void OsiManager::serveGallery(const std::string &rAddress)
+{
+    if (mFilenameGallery == "")
+    {
+        throw std::invalid_argument("No gallery to serve (Load gallery)");
+    }
+    loadGallery(mShard, mNumberOfShards, false);
+    OsiSearchCluster::serve(mGallery, rAddress);
+
+} // end of function
+
+// Build the index of the gallery offline
+void OsiManager::buildGalleryIndex()
+{
+    if (mFilenameGallery == "")
+    {
+        throw std::invalid_argument("No gallery to index (Load gallery)");
+    }
+    if (mGalleryIndex == "none")
+    {
+        throw std::invalid_argument("No index to build (Gallery index)");
+    }
+    loadGallery(mShard, mNumberOfShards, true);
+    mGallery.reportIndex(mIndexReportProbes, mNumberOfCandidates);
+    mGallery.clear();
+
+} // end of function
+
+// Resume the run from its checkpoint
+void OsiManager::setResume(bool resume)
+{
+    mResume = resume;
+
+} // end of function
+
+// Run osiris
+void OsiManager::run()
+{
+    std::cout << std::endl;
+    std::cout << "================" << std::endl;
+    std::cout << "Start processing" << std::endl;
+    std::cout << "================" << std::endl;
+    std::cout << std::endl;
+
+    // Process a part of the list (the benchmark and the sweep need the whole list)
+    if (mNumberOfShards > 0)
+    {
+        if (mBenchmarkProfiles != "" || mFilenameFilterBanks != "")
+        {
+            throw std::invalid_argument("The benchmark and the sweep of filter banks cannot be sharded");
+        }
+        applyShard();
+    }
+
+    // The benchmark replaces the usual processing
+    if (mBenchmarkProfiles != "")
+    {
+        runBenchmark();
+        return;
+    }
+
+    // So does the sweep of filter banks
+    if (mFilenameFilterBanks != "")
+    {
+        runSweep();
+        return;
+    }
+
+    // Resume after the entries done by a previous run : the outputs are cut to their size at the checkpoint
+    bool from_archive = OsiTarReader::isArchive(mInputDirOriginalImages);
+    int first = 0;
+    bool resumed = false;
+    mBitErrors = 0;
+    mComparedBits = 0;
+    if (mResume)
+    {
+        if (mFilenameCheckpoint == "" || from_archive)
+        {
+            throw std::invalid_argument("Cannot resume without checkpoint (images of an archive are not checkpointed)");
+        }
+        resumed = loadCheckpoint(first);
+        if (resumed)
+        {
+            std::cout << "Resume after " << first << " / " << mListOfImages.size() << " entries" << std::endl;
+        }
+        else
+        {
+            std::cout << "No checkpoint in " << mFilenameCheckpoint << " : start from the beginning" << std::endl;
+        }
+    }
+    std::ios::openmode mode = resumed ? std::ios::out | std::ios::app : std::ios::out;
+
+    // If matching is requested, create a file
+    OsiScoreWriter result_matching;
+    if (mProcessMatching && mOutputFileMatchingScores != "")
+    {
+        result_matching.open(mOutputFileMatchingScores, OsiScoreWriter::getFormat(mMatchingScoresFormat),
+                             mBestScoresPerProbe, mMaxMatchingScore, resumed);
+    }
+
+    // If a quality report is requested, create a file
+    if (mOutputFileQuality != "")
+    {
+        bool empty = getFileSize(mOutputFileQuality) == 0;
+        mQualityReport.open(mOutputFileQuality.c_str(), mode);
+        if (!mQualityReport)
+        {
+            throw std::runtime_error("Cannot create the file for quality measures : " + mOutputFileQuality);
+        }
+        if (!resumed || empty)
+        {
+            mQualityReport << "# name focus occlusion contrast score decision" << "\n";
+        }
+    }
+
+    // If a processing log is requested, create a file
+    if (mOutputFileProcessingLog != "")
+    {
+        bool empty = getFileSize(mOutputFileProcessingLog) == 0;
+        mProcessingLog.open(mOutputFileProcessingLog.c_str(), mode);
+        if (!mProcessingLog)
+        {
+            throw std::runtime_error("Cannot create the file for processing log : " + mOutputFileProcessingLog);
+        }
+        if (!resumed || empty)
+        {
+            mProcessingLog << "# name milliseconds degradation status" << "\n";
+        }
+    }
+
+    // If a validation of the fixed-point encoding is requested, create a file
+    if (mFixedPointEncoding && mOutputFileFixedPoint != "")
+    {
+        bool empty = getFileSize(mOutputFileFixedPoint) == 0;
+        mFixedPointReport.open(mOutputFileFixedPoint.c_str(), mode);
+        if (!mFixedPointReport)
+        {
+            throw std::runtime_error("Cannot create the file for fixed-point report : " + mOutputFileFixedPoint);
+        }
+        if (!resumed || empty)
+        {
+            mFixedPointReport << "# name different_bits bits bit_error_rate" << "\n";
+        }
+    }
+
+    // Reuse the results of previous runs
+    if (mFilenameResultCache != "")
+    {
+        initResultCache();
+    }
+
+    // The eyes are searched in the gallery, or sent to the workers which own its parts
+    if (mProcessMatching && mFilenameGallery != "")
+    {
+        if (mSearchWorkers != "")
+        {
+            mSearchCluster.connect(mSearchWorkers);
+        }
+        else
+        {
+            loadGallery(0, 0, false);
+        }
+    }
+
+    // Images streamed from an archive are processed in the order of the archive
+    if (from_archive)
+    {
+        processArchive(result_matching);
+    }
+
+    // Read the original images in advance, in the order of the list
+    bool prefetch = mPrefetchedImages > 0 && !from_archive && !mProcessSequences && mInputDirOriginalImages != "" &&
+                    (mProcessSegmentation || mProcessNormalization);
+    if (prefetch)
+    {
+        std::vector<std::string> filenames;
+        for (int i = first; i < mListOfImages.size(); i++)
+        {
+            filenames.push_back(mInputDirOriginalImages + mListOfImages[i]);
+        }
+        mPrefetcher.start(filenames, mPrefetchedImages, mPrefetchingThreads);
+        std::cout << "Original images are read in advance with "
+                  << (mPrefetcher.usesIoUring() ? "io_uring" : "a pool of threads") << std::endl;
+    }
+
+    // Save the progress periodically (the entries before i are done)
+    bool checkpoint = mFilenameCheckpoint != "" && !from_archive;
+    int last_checkpoint = first;
+
+    for (int i = first; !from_archive && i < mListOfImages.size(); i++)
+    {
+        if (checkpoint && i - last_checkpoint >= mCheckpointPeriod)
+        {
+            saveCheckpoint(i, result_matching);
+            last_checkpoint = i;
+        }
+
+        // Message on prompt command to know the progress
+        std::cout << i + 1 << " / " << mListOfImages.size() << std::endl;
+
+        // Each entry is a whole sequence of frames
+        if (mProcessSequences)
+        {
+            try
+            {
+                processSequence(mListOfImages[i]);
+            }
+            catch (std::exception &e)
+            {
+                std::cout << e.what() << std::endl;
+            }
+            continue;
+        }
+
+        try
+        {
+            // Process the eye
+            OsiEye eye;
+            bool accepted = processOneEye(mListOfImages[i], eye);
+
+            // Search the eye in the gallery
+            if (mProcessMatching && mFilenameGallery != "")
+            {
+                if (accepted)
+                {
+                    identify(mListOfImages[i], eye, result_matching);
+                }
+            }
+
+            // Process a second eye if matching is requested
+            else if (mProcessMatching && (i < mListOfImages.size() - 1))
+            {
+                i++;
+                std::cout << i + 1 << " / " << mListOfImages.size() << std::endl;
+
+                // The pair cannot be matched without the first eye
+                if (!accepted)
+                {
+                    std::cout << "Skip " << mListOfImages[i] << " : the other eye of its pair is rejected" << std::endl;
+                    continue;
+                }
+
+                OsiEye eye2;
+                if (!processOneEye(mListOfImages[i], eye2))
+                {
+                    continue;
+                }
+
+                // Match the two iris codes
+                float score = eye.match(eye2, mpApplicationPoints);
+
+                // Save in file
+                if (result_matching.isOpen())
+                {
+                    result_matching.write(mListOfImages[i - 1], mListOfImages[i], score);
+                }
+            }
+        }
+        catch (std::exception &e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+
+    } // end for images
+
+    // All entries are done
+    if (checkpoint)
+    {
+        saveCheckpoint(mListOfImages.size(), result_matching);
+    }
+
+    // If matching is requested, close the file (the best scores of each probe are written now)
+    result_matching.close();
+
+    // Close the quality report
+    if (mQualityReport.is_open())
+    {
+        mQualityReport.close();
+    }
+
+    // Close the processing log
+    if (mProcessingLog.is_open())
+    {
+        mProcessingLog.close();
+    }
+
+    // Close the pack files
+    closePacks();
+
+    // Stop reading in advance
+    mPrefetcher.stop();
+
+    // Close the result cache (its index is saved)
+    mResultCache.close();
+
+    // Release the gallery, or disconnect from the workers
+    mGallery.showStatistics();
+    mGallery.clear();
+    mSearchCluster.close();
 
-    // If matching is requested, close the file
-    if (result_matching)
+    // Close the fixed-point report with the bit error rate of all eyes
+    if (mFixedPointReport.is_open())
     {
-        result_matching.close();
+        double ber = mComparedBits > 0 ? mBitErrors / mComparedBits : 0;
+        std::cout << "Fixed-point encoding : " << mBitErrors << " different bits out of " << mComparedBits
+                  << " (bit error rate = " << ber << ")" << std::endl;
+        mFixedPointReport << "# total " << std::setprecision(17) << mBitErrors << " " << mComparedBits << " "
+                          << std::setprecision(6) << ber << "\n";
+        mFixedPointReport.close();
     }
 
     std::cout << std::endl;
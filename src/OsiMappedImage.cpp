@@ -0,0 +1,278 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "OsiMappedImage.h"
+
+// Read little-endian integers of a BMP header
+static unsigned int readUnsigned(const unsigned char *p, int bytes)
+{
+    unsigned int value = 0;
+    for (int b = bytes - 1; b >= 0; b--)
+    {
+        value = (value << 8) | p[b];
+    }
+    return value;
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiMappedImage::OsiMappedImage()
+{
+    mpData = 0;
+    mSize = 0;
+    mpMapping = 0;
+    mBottomUp = false;
+}
+
+OsiMappedImage::~OsiMappedImage()
+{
+    close();
+}
+
+// ACCESSORS
+////////////
+
+bool OsiMappedImage::isOpen() const
+{
+    return mpData != 0;
+}
+
+bool OsiMappedImage::isBottomUp() const
+{
+    return mBottomUp;
+}
+
+IplImage *OsiMappedImage::getImage()
+{
+    return mpData ? &mHeader : 0;
+}
+
+// OPERATORS
+////////////
+
+bool OsiMappedImage::open(const std::string &rFilename, const CvSize &rRawSize)
+{
+    close();
+    if (!map(rFilename))
+    {
+        return false;
+    }
+
+    bool found = false;
+    if (mSize >= 2 && mpData[0] == 'B' && mpData[1] == 'M')
+    {
+        found = parseBmp();
+    }
+    else if (mSize >= 2 && mpData[0] == 'P' && mpData[1] == '5')
+    {
+        found = parsePgm();
+    }
+    else if (rRawSize.width > 0 && rRawSize.height > 0 && mSize == (size_t)rRawSize.width * rRawSize.height)
+    {
+        found = setHeader(0, rRawSize.width, rRawSize.height, rRawSize.width);
+    }
+
+    if (!found)
+    {
+        close();
+    }
+    return found;
+}
+
+void OsiMappedImage::close()
+{
+    if (mpData)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(mpData);
+        CloseHandle((HANDLE)mpMapping);
+#else
+        munmap(mpData, mSize);
+#endif
+    }
+    mpData = 0;
+    mSize = 0;
+    mpMapping = 0;
+    mBottomUp = false;
+}
+
+IplImage *OsiMappedImage::cloneImage() const
+{
+    if (!mpData)
+    {
+        return 0;
+    }
+
+    IplImage *image = cvCreateImage(cvSize(mHeader.width, mHeader.height), IPL_DEPTH_8U, 1);
+    for (int y = 0; y < mHeader.height; y++)
+    {
+        int row = mBottomUp ? mHeader.height - 1 - y : y;
+        memcpy(image->imageData + y * image->widthStep, mHeader.imageData + row * mHeader.widthStep, mHeader.width);
+    }
+    return image;
+}
+
+bool OsiMappedImage::map(const std::string &rFilename)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(rFilename.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL, 0);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    LARGE_INTEGER size;
+    HANDLE mapping = 0;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0)
+    {
+        mapping = CreateFileMappingA(file, 0, PAGE_WRITECOPY, 0, 0, 0);
+    }
+    CloseHandle(file);
+    if (!mapping)
+    {
+        return false;
+    }
+    mpData = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+    if (!mpData)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+    mSize = (size_t)size.QuadPart;
+    mpMapping = mapping;
+#else
+    int file = ::open(rFilename.c_str(), O_RDONLY);
+    if (file < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    void *data = MAP_FAILED;
+    if (fstat(file, &status) == 0 && status.st_size > 0)
+    {
+        // Private mapping : the pixels can be written without changing the file
+        data = mmap(0, status.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file, 0);
+    }
+    ::close(file);
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    mpData = (unsigned char *)data;
+    mSize = status.st_size;
+#endif
+    return true;
+}
+
+bool OsiMappedImage::parseBmp()
+{
+    // File header (14 bytes) and info header (at least 40 bytes)
+    if (mSize < 54)
+    {
+        return false;
+    }
+    size_t offset = readUnsigned(mpData + 10, 4);
+    size_t info_size = readUnsigned(mpData + 14, 4);
+    int width = (int)readUnsigned(mpData + 18, 4);
+    int height = (int)readUnsigned(mpData + 22, 4);
+    int bit_count = readUnsigned(mpData + 28, 2);
+    int compression = readUnsigned(mpData + 30, 4);
+    int colors = readUnsigned(mpData + 46, 4);
+
+    if (info_size < 40 || bit_count != 8 || compression != 0 || width <= 0 || height == 0)
+    {
+        return false;
+    }
+
+    // The palette must be gray, so that indices are intensities
+    colors = colors ? colors : 256;
+    size_t palette = 14 + info_size;
+    if (colors > 256 || palette + 4 * colors > offset)
+    {
+        return false;
+    }
+    for (int c = 0; c < colors; c++)
+    {
+        const unsigned char *entry = mpData + palette + 4 * c;
+        if (entry[0] != c || entry[1] != c || entry[2] != c)
+        {
+            return false;
+        }
+    }
+
+    // Rows are padded to 4 bytes, and stored from the bottom unless the height is negative
+    mBottomUp = height > 0;
+    return setHeader(offset, width, std::abs(height), (width + 3) / 4 * 4);
+}
+
+bool OsiMappedImage::parsePgm()
+{
+    // Magic number, then width, height and maxval separated by blanks and comments
+    size_t pos = 2;
+    int values[3];
+    for (int v = 0; v < 3; v++)
+    {
+        while (pos < mSize && (isspace(mpData[pos]) || mpData[pos] == '#'))
+        {
+            if (mpData[pos] == '#')
+            {
+                while (pos < mSize && mpData[pos] != '\n')
+                {
+                    pos++;
+                }
+            }
+            else
+            {
+                pos++;
+            }
+        }
+        if (pos >= mSize || !isdigit(mpData[pos]))
+        {
+            return false;
+        }
+        values[v] = 0;
+        while (pos < mSize && isdigit(mpData[pos]) && values[v] < (1 << 24))
+        {
+            values[v] = 10 * values[v] + (mpData[pos++] - '0');
+        }
+    }
+
+    // A single blank before the pixels. Only maxval 255 gives the intensities as they are stored
+    if (pos >= mSize || !isspace(mpData[pos]) || values[2] != 255)
+    {
+        return false;
+    }
+
+    return setHeader(pos + 1, values[0], values[1], values[0]);
+}
+
+bool OsiMappedImage::setHeader(size_t offset, int width, int height, int step)
+{
+    if (width <= 0 || height <= 0 || offset > mSize || (mSize - offset) / step < (size_t)height)
+    {
+        return false;
+    }
+
+    cvInitImageHeader(&mHeader, cvSize(width, height), IPL_DEPTH_8U, 1);
+    cvSetData(&mHeader, mpData + offset, step);
+    return true;
+}
@@ -0,0 +1,274 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#include "OsiPackFile.h"
+
+// Tag at the beginning of a pack
+#define OSI_PACK_TAG "OSIPACK1"
+#define OSI_PACK_TAG_SIZE 8
+
+// Header of an entry : length of the name (4 bytes) and size of the data (8 bytes)
+#define OSI_PACK_HEADER_SIZE 12
+
+// Write and read little-endian integers
+static void putUnsigned(unsigned char *p, unsigned long long value, int bytes)
+{
+    for (int b = 0; b < bytes; b++)
+    {
+        p[b] = (unsigned char)(value >> (8 * b));
+    }
+}
+
+static unsigned long long getUnsigned(const unsigned char *p, int bytes)
+{
+    unsigned long long value = 0;
+    for (int b = bytes - 1; b >= 0; b--)
+    {
+        value = (value << 8) | p[b];
+    }
+    return value;
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiPackFile::OsiPackFile()
+{
+    mSize = 0;
+    mModified = false;
+}
+
+OsiPackFile::~OsiPackFile()
+{
+    close();
+}
+
+// ACCESSORS
+////////////
+
+bool OsiPackFile::contains(const std::string &rName) const
+{
+    return mEntries.find(rName) != mEntries.end();
+}
+
+int OsiPackFile::getNumberOfEntries() const
+{
+    return mEntries.size();
+}
+
+void OsiPackFile::getNames(std::vector<std::string> &rNames) const
+{
+    rNames.clear();
+    for (std::map<std::string, Entry>::const_iterator it = mEntries.begin(); it != mEntries.end(); it++)
+    {
+        rNames.push_back(it->first);
+    }
+}
+
+// OPERATORS
+////////////
+
+void OsiPackFile::open(const std::string &rFilename)
+{
+    close();
+    mFilename = rFilename;
+
+    // Create the pack if it does not exist
+    mFile.open(mFilename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    if (!mFile)
+    {
+        std::ofstream created(mFilename.c_str(), std::ios::out | std::ios::binary);
+        created.write(OSI_PACK_TAG, OSI_PACK_TAG_SIZE);
+        created.close();
+        mFile.clear();
+        mFile.open(mFilename.c_str(), std::ios::in | std::ios::out | std::ios::binary);
+    }
+    if (!mFile)
+    {
+        throw std::runtime_error("Cannot open the pack file " + mFilename);
+    }
+
+    char tag[OSI_PACK_TAG_SIZE];
+    if (!mFile.read(tag, OSI_PACK_TAG_SIZE) || std::string(tag, OSI_PACK_TAG_SIZE) != OSI_PACK_TAG)
+    {
+        mFile.close();
+        throw std::runtime_error("Not a pack file : " + mFilename);
+    }
+
+    mFile.seekg(0, std::ios::end);
+    mSize = mFile.tellg();
+
+    if (!loadIndex())
+    {
+        scan();
+    }
+}
+
+void OsiPackFile::close()
+{
+    if (mFile.is_open())
+    {
+        if (mModified)
+        {
+            saveIndex();
+        }
+        mFile.close();
+    }
+    mEntries.clear();
+    mSize = 0;
+    mModified = false;
+}
+
+bool OsiPackFile::read(const std::string &rName, std::vector<unsigned char> &rData)
+{
+    std::map<std::string, Entry>::const_iterator it = mEntries.find(rName);
+    if (it == mEntries.end())
+    {
+        return false;
+    }
+
+    rData.resize(it->second.mSize);
+    mFile.clear();
+    mFile.seekg(it->second.mOffset);
+    return rData.empty() || mFile.read((char *)&rData[0], rData.size());
+}
+
+void OsiPackFile::write(const std::string &rName, const std::vector<unsigned char> &rData)
+{
+    if (!mFile.is_open())
+    {
+        throw std::runtime_error("Cannot write " + rName + " because the pack file is not open");
+    }
+
+    unsigned char header[OSI_PACK_HEADER_SIZE];
+    putUnsigned(header, rName.size(), 4);
+    putUnsigned(header + 4, rData.size(), 8);
+
+    mFile.clear();
+    mFile.seekp(mSize);
+    mFile.write((const char *)header, OSI_PACK_HEADER_SIZE);
+    mFile.write(rName.c_str(), rName.size());
+    if (!rData.empty())
+    {
+        mFile.write((const char *)&rData[0], rData.size());
+    }
+    if (!mFile)
+    {
+        throw std::runtime_error("Cannot write " + rName + " in the pack file " + mFilename);
+    }
+
+    Entry entry;
+    entry.mOffset = mSize + OSI_PACK_HEADER_SIZE + rName.size();
+    entry.mSize = rData.size();
+    mEntries[rName] = entry;
+    mSize = entry.mOffset + entry.mSize;
+    mModified = true;
+}
+
+bool OsiPackFile::loadIndex()
+{
+    std::ifstream file((mFilename + ".idx").c_str(), std::ios::in);
+    if (!file)
+    {
+        return false;
+    }
+
+    // First line : "# pack <size of the pack> <number of entries>"
+    std::string line, tag;
+    unsigned long long size = 0;
+    int n_entries = 0;
+    std::getline(file, line);
+    std::istringstream header(line);
+    if (!(header >> tag >> tag >> size >> n_entries) || size != mSize)
+    {
+        return false;
+    }
+
+    // Then one line per entry : "<position> <size> <name>"
+    while (std::getline(file, line))
+    {
+        std::istringstream fields(line);
+        Entry entry;
+        std::string name;
+        if (!(fields >> entry.mOffset >> entry.mSize) || !std::getline(fields >> std::ws, name) ||
+            entry.mOffset + entry.mSize > mSize)
+        {
+            mEntries.clear();
+            return false;
+        }
+        mEntries[name] = entry;
+    }
+
+    if (mEntries.size() != n_entries)
+    {
+        mEntries.clear();
+        return false;
+    }
+    return true;
+}
+
+void OsiPackFile::scan()
+{
+    mEntries.clear();
+    unsigned long long pos = OSI_PACK_TAG_SIZE;
+    while (pos + OSI_PACK_HEADER_SIZE <= mSize)
+    {
+        unsigned char header[OSI_PACK_HEADER_SIZE];
+        mFile.clear();
+        mFile.seekg(pos);
+        if (!mFile.read((char *)header, OSI_PACK_HEADER_SIZE))
+        {
+            break;
+        }
+        unsigned long long name_length = getUnsigned(header, 4);
+        unsigned long long size = getUnsigned(header + 4, 8);
+        if (pos + OSI_PACK_HEADER_SIZE + name_length + size > mSize)
+        {
+            break;
+        }
+
+        std::string name(name_length, ' ');
+        if (name_length > 0 && !mFile.read(&name[0], name_length))
+        {
+            break;
+        }
+
+        Entry entry;
+        entry.mOffset = pos + OSI_PACK_HEADER_SIZE + name_length;
+        entry.mSize = size;
+        mEntries[name] = entry;
+        pos = entry.mOffset + size;
+    }
+
+    // An entry cut by an interrupted run is overwritten by the next entry
+    mSize = pos;
+}
+
+void OsiPackFile::saveIndex()
+{
+    // Entries are written in the pack before the index : an index older than the pack is ignored
+    mFile.flush();
+
+    // No exception : the pack is also closed by the destructor. Without index, the pack is scanned
+    std::ofstream file((mFilename + ".idx").c_str(), std::ios::out);
+    if (!file)
+    {
+        std::cout << "Cannot save the index of the pack file " << mFilename << std::endl;
+        return;
+    }
+
+    file << "# pack " << mSize << " " << mEntries.size() << "\n";
+    for (std::map<std::string, Entry>::const_iterator it = mEntries.begin(); it != mEntries.end(); it++)
+    {
+        file << it->second.mOffset << " " << it->second.mSize << " " << it->first << "\n";
+    }
+}
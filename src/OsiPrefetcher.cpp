@@ -0,0 +1,503 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#ifdef OSI_WITH_IO_URING
+#include <cerrno>
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "OsiPrefetcher.h"
+
+// Maximum number of files read in advance
+#define OSI_PREFETCH_MAX_WINDOW 4096
+
+#ifdef OSI_WITH_IO_URING
+
+// Rings shared with the kernel (there is no liburing : the system calls are used directly)
+struct OsiPrefetcher::Ring
+{
+    int mFd;
+
+    // Memory mapped from the kernel
+    void *mpSqRing;
+    size_t mSqRingSize;
+    void *mpCqRing;
+    size_t mCqRingSize;
+    io_uring_sqe *mpSqes;
+    size_t mSqesSize;
+
+    // Submission ring
+    unsigned *mpSqTail;
+    unsigned *mpSqMask;
+    unsigned *mpSqArray;
+
+    // Completion ring
+    unsigned *mpCqHead;
+    unsigned *mpCqTail;
+    unsigned *mpCqMask;
+    io_uring_cqe *mpCqes;
+
+    // A read in flight : the file, its content and the part already read
+    struct Request
+    {
+        int mIndex;
+        int mFd;
+        std::vector<unsigned char> mData;
+        size_t mDone;
+        iovec mVector;
+    };
+
+    // The kernel may write in the reads in flight until the ring is closed : they are released with the ring
+    std::vector<Request> mRequests;
+};
+
+#else
+
+struct OsiPrefetcher::Ring
+{
+};
+
+#endif
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiPrefetcher::OsiPrefetcher()
+{
+    mWindow = 0;
+    mNextToRead = 0;
+    mNextToTake = 0;
+    mRunningThreads = 0;
+    mStopping = false;
+    mpRing = 0;
+}
+
+OsiPrefetcher::~OsiPrefetcher()
+{
+    stop();
+}
+
+// ACCESSORS
+////////////
+
+bool OsiPrefetcher::usesIoUring() const
+{
+    return mpRing != 0;
+}
+
+// OPERATORS
+////////////
+
+void OsiPrefetcher::start(const std::vector<std::string> &rFilenames, int window, int nThreads)
+{
+    stop();
+    mFilenames = rFilenames;
+    mWindow = std::max(1, std::min(window, OSI_PREFETCH_MAX_WINDOW));
+    mNextToRead = 0;
+    mNextToTake = 0;
+    mStopping = false;
+
+    if (openRing())
+    {
+        mRunningThreads = 1;
+        mThreads.push_back(std::thread(&OsiPrefetcher::runRing, this));
+        return;
+    }
+
+    mRunningThreads = std::max(1, nThreads);
+    for (int t = 0; t < mRunningThreads; t++)
+    {
+        mThreads.push_back(std::thread(&OsiPrefetcher::runReader, this));
+    }
+}
+
+bool OsiPrefetcher::take(const std::string &rFilename, std::vector<unsigned char> &rData)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    // Position of the file in the order
+    int index = mNextToTake;
+    while (index < mFilenames.size() && mFilenames[index] != rFilename)
+    {
+        index++;
+    }
+    if (index >= mFilenames.size())
+    {
+        return false;
+    }
+
+    // The files before are not used : the window moves
+    mFiles.erase(mFiles.begin(), mFiles.lower_bound(index));
+    mFailed.erase(mFailed.begin(), mFailed.lower_bound(index));
+    mNextToTake = index;
+    mWindowCondition.notify_all();
+
+    mReadCondition.wait(lock, [&]() { return mFiles.count(index) || mFailed.count(index) || mRunningThreads == 0; });
+
+    bool success = mFiles.count(index) > 0;
+    if (success)
+    {
+        rData.swap(mFiles[index]);
+        mFiles.erase(index);
+    }
+    mFailed.erase(index);
+    mNextToTake = index + 1;
+    mWindowCondition.notify_all();
+    return success;
+}
+
+void OsiPrefetcher::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mWindowCondition.notify_all();
+    for (int t = 0; t < mThreads.size(); t++)
+    {
+        mThreads[t].join();
+    }
+    mThreads.clear();
+    closeRing();
+
+    mFilenames.clear();
+    mFiles.clear();
+    mFailed.clear();
+    mNextToRead = 0;
+    mNextToTake = 0;
+    mRunningThreads = 0;
+}
+
+bool OsiPrefetcher::canRead() const
+{
+    return mStopping || mNextToRead >= mFilenames.size() || mNextToRead < mNextToTake + mWindow;
+}
+
+void OsiPrefetcher::deliver(int index, std::vector<unsigned char> &rData, bool success)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // The file may have been dropped while it was read
+    if (index >= mNextToTake && !mStopping)
+    {
+        if (success)
+        {
+            mFiles[index].swap(rData);
+        }
+        else
+        {
+            mFailed.insert(index);
+        }
+    }
+    mReadCondition.notify_all();
+}
+
+void OsiPrefetcher::finishThread()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mRunningThreads--;
+    mReadCondition.notify_all();
+}
+
+void OsiPrefetcher::runReader()
+{
+    while (true)
+    {
+        int index = 0;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mWindowCondition.wait(lock, [this]() { return canRead(); });
+            if (mStopping || mNextToRead >= mFilenames.size())
+            {
+                break;
+            }
+            index = mNextToRead++;
+        }
+
+        std::vector<unsigned char> data;
+        bool success = false;
+        std::ifstream file(mFilenames[index].c_str(), std::ios::in | std::ios::binary);
+        if (file)
+        {
+            file.seekg(0, std::ios::end);
+            std::streamoff size = file.tellg();
+            file.seekg(0, std::ios::beg);
+            if (size > 0)
+            {
+                data.resize(size);
+                success = (bool)file.read((char *)&data[0], size);
+            }
+        }
+        deliver(index, data, success);
+    }
+
+    finishThread();
+}
+
+bool OsiPrefetcher::openRing()
+{
+#ifdef OSI_WITH_IO_URING
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int fd = syscall(__NR_io_uring_setup, mWindow, &params);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    mpRing = new Ring;
+    mpRing->mFd = fd;
+    Ring::Request request;
+    request.mFd = -1;
+    mpRing->mRequests.assign(mWindow, request);
+    mpRing->mSqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    mpRing->mCqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    mpRing->mSqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+    bool single_mapping = false;
+#ifdef IORING_FEAT_SINGLE_MMAP
+    single_mapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+#endif
+    if (single_mapping)
+    {
+        mpRing->mSqRingSize = std::max(mpRing->mSqRingSize, mpRing->mCqRingSize);
+        mpRing->mCqRingSize = 0;
+    }
+
+    mpRing->mpSqRing = mmap(0, mpRing->mSqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                            IORING_OFF_SQ_RING);
+    mpRing->mpCqRing = single_mapping ? mpRing->mpSqRing
+                                      : mmap(0, mpRing->mCqRingSize, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    void *sqes = mmap(0, mpRing->mSqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                      IORING_OFF_SQES);
+    mpRing->mpSqes = sqes == MAP_FAILED ? 0 : (io_uring_sqe *)sqes;
+    if (mpRing->mpSqRing == MAP_FAILED || mpRing->mpCqRing == MAP_FAILED || !mpRing->mpSqes)
+    {
+        closeRing();
+        return false;
+    }
+
+    char *sq = (char *)mpRing->mpSqRing;
+    mpRing->mpSqTail = (unsigned *)(sq + params.sq_off.tail);
+    mpRing->mpSqMask = (unsigned *)(sq + params.sq_off.ring_mask);
+    mpRing->mpSqArray = (unsigned *)(sq + params.sq_off.array);
+
+    char *cq = (char *)mpRing->mpCqRing;
+    mpRing->mpCqHead = (unsigned *)(cq + params.cq_off.head);
+    mpRing->mpCqTail = (unsigned *)(cq + params.cq_off.tail);
+    mpRing->mpCqMask = (unsigned *)(cq + params.cq_off.ring_mask);
+    mpRing->mpCqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+    return true;
+#else
+    return false;
+#endif
+}
+
+void OsiPrefetcher::closeRing()
+{
+#ifdef OSI_WITH_IO_URING
+    if (!mpRing)
+    {
+        return;
+    }
+    if (mpRing->mpSqes)
+    {
+        munmap(mpRing->mpSqes, mpRing->mSqesSize);
+    }
+    if (mpRing->mpCqRing != MAP_FAILED && mpRing->mpCqRing != mpRing->mpSqRing)
+    {
+        munmap(mpRing->mpCqRing, mpRing->mCqRingSize);
+    }
+    if (mpRing->mpSqRing != MAP_FAILED)
+    {
+        munmap(mpRing->mpSqRing, mpRing->mSqRingSize);
+    }
+    close(mpRing->mFd);
+
+    // Files of the reads which were not collected
+    for (int s = 0; s < mpRing->mRequests.size(); s++)
+    {
+        if (mpRing->mRequests[s].mFd >= 0)
+        {
+            close(mpRing->mRequests[s].mFd);
+        }
+    }
+#endif
+    delete mpRing;
+    mpRing = 0;
+}
+
+void OsiPrefetcher::runRing()
+{
+#ifdef OSI_WITH_IO_URING
+    std::vector<Ring::Request> &requests = mpRing->mRequests;
+    std::vector<int> free_slots;
+    for (int s = mWindow - 1; s >= 0; s--)
+    {
+        free_slots.push_back(s);
+    }
+    int in_flight = 0;
+    unsigned to_submit = 0;
+
+    // Queue the reading of the rest of a file (the kernel reads it when the queue is submitted)
+    auto queue = [&](int slot) {
+        Ring::Request &r = requests[slot];
+        r.mVector.iov_base = &r.mData[r.mDone];
+        r.mVector.iov_len = r.mData.size() - r.mDone;
+
+        unsigned tail = *mpRing->mpSqTail;
+        unsigned pos = tail & *mpRing->mpSqMask;
+        io_uring_sqe *sqe = &mpRing->mpSqes[pos];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = r.mFd;
+        sqe->off = r.mDone;
+        sqe->addr = (unsigned long)&r.mVector;
+        sqe->len = 1;
+        sqe->user_data = slot;
+        mpRing->mpSqArray[pos] = pos;
+        __atomic_store_n(mpRing->mpSqTail, tail + 1, __ATOMIC_RELEASE);
+        to_submit++;
+    };
+
+    // Submit the queued reads and wait for at least one of them
+    auto wait = [&]() {
+        while (true)
+        {
+            int n = syscall(__NR_io_uring_enter, mpRing->mFd, to_submit, 1, IORING_ENTER_GETEVENTS, 0, 0);
+            if (n >= 0)
+            {
+                to_submit -= n;
+                return true;
+            }
+
+            // Short of resources, or completion ring full : the finished reads are collected before trying again
+            if (errno == EAGAIN || errno == EBUSY)
+            {
+                if (*mpRing->mpCqHead != __atomic_load_n(mpRing->mpCqTail, __ATOMIC_ACQUIRE))
+                {
+                    return true;
+                }
+                std::this_thread::yield();
+            }
+            else if (errno != EINTR)
+            {
+                return false;
+            }
+        }
+    };
+
+    // Collect the finished reads
+    auto collect = [&](bool keep) {
+        unsigned head = *mpRing->mpCqHead;
+        while (head != __atomic_load_n(mpRing->mpCqTail, __ATOMIC_ACQUIRE))
+        {
+            io_uring_cqe *cqe = &mpRing->mpCqes[head & *mpRing->mpCqMask];
+            int slot = cqe->user_data;
+            int result = cqe->res;
+            head++;
+
+            Ring::Request &r = requests[slot];
+            if (result > 0)
+            {
+                r.mDone += result;
+            }
+            if (keep && result > 0 && r.mDone < r.mData.size())
+            {
+                queue(slot);
+                continue;
+            }
+            close(r.mFd);
+            r.mFd = -1;
+            in_flight--;
+            free_slots.push_back(slot);
+            if (keep)
+            {
+                deliver(r.mIndex, r.mData, result >= 0 && r.mDone == r.mData.size());
+            }
+            r.mData.clear();
+        }
+        __atomic_store_n(mpRing->mpCqHead, head, __ATOMIC_RELEASE);
+    };
+
+    while (true)
+    {
+        int index = -1;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (in_flight == 0)
+            {
+                mWindowCondition.wait(lock, [this]() { return canRead(); });
+            }
+            if (mStopping || (in_flight == 0 && mNextToRead >= mFilenames.size()))
+            {
+                break;
+            }
+            if (!free_slots.empty() && mNextToRead < mFilenames.size() && mNextToRead < mNextToTake + mWindow)
+            {
+                index = mNextToRead++;
+            }
+        }
+
+        // Queue the next file of the window
+        if (index >= 0)
+        {
+            std::vector<unsigned char> data;
+            int fd = open(mFilenames[index].c_str(), O_RDONLY);
+            struct stat status;
+            if (fd < 0 || fstat(fd, &status) != 0 || status.st_size == 0)
+            {
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+                deliver(index, data, false);
+                continue;
+            }
+
+            int slot = free_slots.back();
+            free_slots.pop_back();
+            requests[slot].mIndex = index;
+            requests[slot].mFd = fd;
+            requests[slot].mData.resize(status.st_size);
+            requests[slot].mDone = 0;
+            queue(slot);
+            in_flight++;
+            continue;
+        }
+
+        if (!wait())
+        {
+            std::cout << "Error of io_uring : the next images are read without prefetching" << std::endl;
+            break;
+        }
+        collect(true);
+    }
+
+    // The kernel may still write in the buffers of the reads in flight : they are kept with the ring if they cannot
+    // be collected
+    while (in_flight > 0 && wait())
+    {
+        collect(false);
+    }
+#endif
+
+    finishThread();
+}
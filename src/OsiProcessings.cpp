@@ -6,12 +6,15 @@
  * License : BSD
  ********************************************************/
 
+#include <stdexcept>
+
+#include "OsiFilterBank.h"
 #include "OsiProcessings.h"
 #include "OsiStringUtils.h"
 
 OsiProcessings::OsiProcessings()
 {
-    // Do nothing
+    mpDeadline = 0;
 }
 
 OsiProcessings::~OsiProcessings()
@@ -19,113 +22,99 @@ OsiProcessings::~OsiProcessings()
     // Do nothing
 }
 
+void OsiProcessings::setDeadline(OsiDeadline *pDeadline)
+{
+    mpDeadline = pDeadline;
+}
+
+void OsiProcessings::setProfile(const OsiProfile &rProfile)
+{
+    mProfile = rProfile;
+}
+
+bool OsiProcessings::isCancelled() const
+{
+    return mpDeadline && mpDeadline->isExpired();
+}
+
+OsiProfile OsiProcessings::getSettings()
+{
+    return mpDeadline ? mProfile.getDegraded(mpDeadline->getDegradationLevel()) : mProfile;
+}
+
 void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &rPupil, OsiCircle &rIris,
                              std::vector<float> &rThetaCoarsePupil, std::vector<float> &rThetaCoarseIris,
                              std::vector<CvPoint> &rCoarsePupilContour, std::vector<CvPoint> &rCoarseIrisContour,
                              int minIrisDiameter, int minPupilDiameter, int maxIrisDiameter, int maxPupilDiameter)
 {
+    // Build a plan for this image only
+    OsiSegmentationPlan plan(pSrc->width, pSrc->height, minIrisDiameter, minPupilDiameter, maxIrisDiameter,
+                             maxPupilDiameter);
 
+    segment(pSrc, pMask, rPupil, rIris, rThetaCoarsePupil, rThetaCoarseIris, rCoarsePupilContour, rCoarseIrisContour,
+            plan);
+}
+
+void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &rPupil, OsiCircle &rIris,
+                             std::vector<float> &rThetaCoarsePupil, std::vector<float> &rThetaCoarseIris,
+                             std::vector<CvPoint> &rCoarsePupilContour, std::vector<CvPoint> &rCoarseIrisContour,
+                             const OsiSegmentationPlan &rPlan, OsiTracker *pTracker)
+{
     // Check arguments
     //////////////////
 
-    // String functions
-    OsiStringUtils str;
-
-    // Temporary int to check sizes of pupil and iris
-    int check_size = 0;
-
-    // Default value for maxIrisDiameter if user did not specify it
-    if (maxIrisDiameter == 0)
-    {
-        maxIrisDiameter = std::min(pSrc->height, pSrc->width);
-    }
-
-    // Change maxIrisDiameter if it is too big relative to image sizes
-    else if (maxIrisDiameter > (check_size = std::floor((float)std::min(pSrc->height, pSrc->width))))
-    {
-        std::cout << "Warning in function segment : maxIrisDiameter = " << maxIrisDiameter;
-        std::cout << " is replaced by " << check_size;
-        std::cout << " because image size is " << pSrc->width << "x" << pSrc->height << std::endl;
-        maxIrisDiameter = check_size;
-    }
-
-    // Default value for maxPupilDiameter if user did not specify it
-    if (maxPupilDiameter == 0)
+    if (!rPlan.isCompatible(pSrc->width, pSrc->height))
     {
-        maxPupilDiameter = OSI_MAX_RATIO_PUPIL_IRIS * maxIrisDiameter;
+        throw std::invalid_argument("Error in function segment : the segmentation plan was not built for images of "
+                                    "size " +
+                                    std::to_string(pSrc->width) + "x" + std::to_string(pSrc->height));
     }
 
-    // Change maxPupilDiameter if it is too big relative to maxIrisDiameter and OSI_MAX_RATIO_PUPIL_IRIS
-    else if (maxPupilDiameter > (check_size = OSI_MAX_RATIO_PUPIL_IRIS * maxIrisDiameter))
-    {
-        std::cout << "Warning in function segment : maxPupilDiameter = " << maxPupilDiameter;
-        std::cout << " is replaced by " << check_size;
-        std::cout << " because maxIrisDiameter = " << maxIrisDiameter;
-        std::cout << " and ratio pupil/iris is generally lower than " << OSI_MAX_RATIO_PUPIL_IRIS << std::endl;
-        maxPupilDiameter = check_size;
-    }
+    // Diameters are checked when the plan is built
+    int minIrisDiameter = rPlan.getMinIrisDiameter();
+    int maxIrisDiameter = rPlan.getMaxIrisDiameter();
 
-    // Change minIrisDiameter if it is too small relative to OSI_SMALLEST_IRIS
-    if (minIrisDiameter < (check_size = OSI_SMALLEST_IRIS))
-    {
-        std::cout << "Warning in function segment : minIrisDiameter = " << minIrisDiameter;
-        std::cout << " is replaced by " << check_size;
-        std::cout << " which is the smallest size for detecting iris" << std::endl;
-        minIrisDiameter = check_size;
-    }
+    // Start processing
+    ///////////////////
 
-    // Change minPupilDiameter if it is too small relative to minIrisDiameter and OSI_MIN_RATIO_PUPIL_IRIS
-    if (minPupilDiameter < (check_size = minIrisDiameter * OSI_MIN_RATIO_PUPIL_IRIS))
+    // Locate the pupil around the previous frame, if the tracker knows it
+    bool tracked = false;
+    double response = 0;
+    if (pTracker && pTracker->hasPrior())
     {
-        std::cout << "Warning in function segment : minPupilDiameter = " << minPupilDiameter;
-        std::cout << " is replaced by " << check_size;
-        std::cout << " because minIrisDiameter = " << minIrisDiameter;
-        std::cout << " and ratio pupil/iris is generally upper than " << OSI_MIN_RATIO_PUPIL_IRIS << std::endl;
-        minIrisDiameter = check_size;
+        response = detectPupil(pSrc, rPupil, rPlan, &pTracker->getPupil());
+        tracked = pTracker->isConfident(response);
     }
 
-    // Check that minIrisDiameter < maxIrisDiameter
-    if (minIrisDiameter > maxIrisDiameter)
+    // Else (or if the tracking is lost) locate the pupil in the whole image
+    if (!tracked)
     {
-        throw std::invalid_argument("Error in function segment : minIrisDiameter = " + str.toString(minIrisDiameter) +
-                                    " should be lower than maxIrisDiameter = " + str.toString(maxIrisDiameter));
+        response = detectPupil(pSrc, rPupil, rPlan);
     }
 
-    // Make size odds
-    minIrisDiameter += (minIrisDiameter % 2) ? 0 : -1;
-    maxIrisDiameter += (maxIrisDiameter % 2) ? 0 : +1;
-    minPupilDiameter += (minPupilDiameter % 2) ? 0 : -1;
-    maxPupilDiameter += (maxPupilDiameter % 2) ? 0 : +1;
-
-    // Start processing
-    ///////////////////
-
-    // Locate the pupil
-    detectPupil(pSrc, rPupil, minPupilDiameter, maxPupilDiameter);
+    // Half-width of the bands in which pupil contours are searched (narrower when tracking)
+    int pupil_band = tracked ? getSettings().getPupilBand() / 2 : getSettings().getPupilBand();
 
     // Fill the holes in an area surrounding pupil
     IplImage *clone_src = cvCloneImage(pSrc);
     cvSetImageROI(clone_src, cvRect(rPupil.getCenter().x - 3.0 / 4.0 * maxIrisDiameter / 2.0,
                                     rPupil.getCenter().y - 3.0 / 4.0 * maxIrisDiameter / 2.0,
                                     3.0 / 4.0 * maxIrisDiameter, 3.0 / 4.0 * maxIrisDiameter));
-    fillWhiteHoles(clone_src, clone_src);
+    fillWhiteHoles(clone_src, clone_src, rPlan.getSmallElement());
     cvResetImageROI(clone_src);
 
-    // Will contain samples of angles, in radians
-    std::vector<float> theta;
-    float theta_step = 0;
+    // Storage for the angle tables which are not in the plan
+    std::vector<float> theta_buffer;
 
     // Pupil Accurate Contour
     /////////////////////////
 
-    theta.clear();
-    theta_step = 360.0 / OSI_PI / rPupil.getRadius();
-    for (float t = 0; t < 360; t += theta_step)
-    {
-        theta.push_back(t * OSI_PI / 180);
-    }
+    const std::vector<float> &theta_pupil_accurate =
+        rPlan.getTheta(OSI_THETA_PUPIL_ACCURATE, rPupil.getRadius(), theta_buffer,
+                       getSettings().getThetaStepFactor());
     std::vector<CvPoint> pupil_accurate_contour =
-        findContour(clone_src, rPupil.getCenter(), theta, rPupil.getRadius() - 20, rPupil.getRadius() + 20);
+        findContour(clone_src, rPupil.getCenter(), theta_pupil_accurate, rPupil.getRadius() - pupil_band,
+                    rPupil.getRadius() + pupil_band);
 
     // Circle fitting on accurate contour
     rPupil.computeCircleFitting(pupil_accurate_contour);
@@ -133,18 +122,12 @@ void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &r
     // Pupil Coarse Contour
     ///////////////////////
 
-    theta.clear();
-    theta_step = 360.0 / OSI_PI / rPupil.getRadius() * 2;
-    for (float t = 0; t < 360; t += theta_step)
-    {
-        if (t > 45 && t < 135)
-            t += theta_step;
-        theta.push_back(t * OSI_PI / 180);
-    }
+    rThetaCoarsePupil = rPlan.getTheta(OSI_THETA_PUPIL_COARSE, rPupil.getRadius(), theta_buffer,
+                                       getSettings().getThetaStepFactor());
     std::vector<CvPoint> pupil_coarse_contour =
-        findContour(clone_src, rPupil.getCenter(), theta, rPupil.getRadius() - 20, rPupil.getRadius() + 20);
+        findContour(clone_src, rPupil.getCenter(), rThetaCoarsePupil, rPupil.getRadius() - pupil_band,
+                    rPupil.getRadius() + pupil_band);
 
-    rThetaCoarsePupil = theta;
     rCoarsePupilContour = pupil_coarse_contour;
 
     // Circle fitting on coarse contour
@@ -160,20 +143,25 @@ void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &r
     // Iris Coarse Contour
     //////////////////////
 
-    theta.clear();
     int min_radius = std::max<int>(rPupil.getRadius() / OSI_MAX_RATIO_PUPIL_IRIS, minIrisDiameter / 2);
     int max_radius = std::min<int>(rPupil.getRadius() / OSI_MIN_RATIO_PUPIL_IRIS, 3 * maxIrisDiameter / 4);
-    theta_step = 360.0 / OSI_PI / min_radius;
-    for (float t = 0; t < 360; t += theta_step)
+
+    // When tracking, the iris radius stays close to the one of previous frame
+    if (tracked)
     {
-        if (t < 180 || (t > 225 && t < 315))
-            t += 2 * theta_step;
-        theta.push_back(t * OSI_PI / 180);
+        int tracked_min_radius = std::max<int>(min_radius, 0.85 * pTracker->getIris().getRadius());
+        int tracked_max_radius = std::min<int>(max_radius, 1.15 * pTracker->getIris().getRadius());
+        if (tracked_min_radius < tracked_max_radius)
+        {
+            min_radius = tracked_min_radius;
+            max_radius = tracked_max_radius;
+        }
     }
+    rThetaCoarseIris = rPlan.getTheta(OSI_THETA_IRIS_COARSE, min_radius, theta_buffer,
+                                      getSettings().getThetaStepFactor());
     std::vector<CvPoint> iris_coarse_contour =
-        findContour(clone_src, rPupil.getCenter(), theta, min_radius, max_radius);
+        findContour(clone_src, rPupil.getCenter(), rThetaCoarseIris, min_radius, max_radius);
 
-    rThetaCoarseIris = theta;
     rCoarseIrisContour = iris_coarse_contour;
 
     // Circle fitting on coarse contour
@@ -194,29 +182,22 @@ void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &r
 
     // Dilate mask of iris by a disk-shape element
     IplImage *mask_iris2 = cvCloneImage(mask_iris);
-    IplConvKernel *struct_element = cvCreateStructuringElementEx(21, 21, 10, 10, CV_SHAPE_ELLIPSE);
     // cvMorphologyEx(mask_iris2,mask_iris2,mask_iris2,struct_element,CV_MOP_DILATE) ;
-    cvDilate(mask_iris2, mask_iris2, struct_element);
-    cvReleaseStructuringElement(&struct_element);
+    cvDilate(mask_iris2, mask_iris2, rPlan.getIrisElement());
 
     // Dilate the mask of pupil by a horizontal line-shape element
     IplImage *mask_pupil2 = cvCloneImage(mask_pupil);
-    struct_element = cvCreateStructuringElementEx(21, 21, 10, 1, CV_SHAPE_RECT);
     // cvMorphologyEx(mask_pupil2,mask_pupil2,mask_pupil2,struct_element,CV_MOP_DILATE) ;
-    cvDilate(mask_pupil2, mask_pupil2, struct_element);
-    cvReleaseStructuringElement(&struct_element);
+    cvDilate(mask_pupil2, mask_pupil2, rPlan.getPupilElement());
 
     // dilate(mask_iris) - dilate(mask_pupil)
     cvXor(mask_iris2, mask_pupil2, mask_iris2);
 
-    theta.clear();
-    theta_step = 360.0 / OSI_PI / rIris.getRadius();
-    for (float t = 0; t < 360; t += theta_step)
-    {
-        theta.push_back(t * OSI_PI / 180);
-    }
-    std::vector<CvPoint> iris_accurate_contour =
-        findContour(clone_src, rPupil.getCenter(), theta, rIris.getRadius() - 50, rIris.getRadius() + 20, mask_iris2);
+    const std::vector<float> &theta_iris_accurate =
+        rPlan.getTheta(OSI_THETA_IRIS_ACCURATE, rIris.getRadius(), theta_buffer,
+                       getSettings().getThetaStepFactor());
+    std::vector<CvPoint> iris_accurate_contour = findContour(clone_src, rPupil.getCenter(), theta_iris_accurate,
+                                                             rIris.getRadius() - 50, rIris.getRadius() + 20, mask_iris2);
 
     // Release memory
     cvReleaseImage(&mask_pupil2);
@@ -237,10 +218,8 @@ void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &r
     cvRectangle(safe_area, cvPoint(0, 0), cvPoint(safe_area->width - 1, rPupil.getCenter().y), cvScalar(0), -1);
     cvRectangle(safe_area, cvPoint(0, rPupil.getCenter().y + rPupil.getRadius()),
                 cvPoint(safe_area->width - 1, safe_area->height - 1), cvScalar(0), -1);
-    struct_element = cvCreateStructuringElementEx(11, 11, 5, 5, CV_SHAPE_ELLIPSE);
     // cvMorphologyEx(safe_area,safe_area,safe_area,struct_element,CV_MOP_ERODE) ;
-    cvErode(safe_area, safe_area, struct_element);
-    cvReleaseStructuringElement(&struct_element);
+    cvErode(safe_area, safe_area, rPlan.getSafeAreaElement());
 
     // Compute the mean and the variance of iris texture inside safe area
     // double iris_mean = cvMean(pSrc,safe_area) ;
@@ -256,19 +235,17 @@ void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &r
     cvReleaseImage(&variance);
     cvReleaseImage(&safe_area);
 
-    // Build mask of noise : |I-mean| > 2.35 * variance
+    // Build mask of noise : |I-mean| > threshold * variance (2.35 for the balanced profile)
     IplImage *mask_noise = cvCloneImage(pSrc);
     // cvAbsDiffS(pSrc,mask_noise,cvScalar(iris_mean)) ;
     cvAbsDiffS(pSrc, mask_noise, iris_mean);
-    cvThreshold(mask_noise, mask_noise, 2.35 * iris_variance, 255, CV_THRESH_BINARY);
+    cvThreshold(mask_noise, mask_noise, getSettings().getNoiseThreshold() * iris_variance, 255, CV_THRESH_BINARY);
     cvAnd(mask_iris, mask_noise, mask_noise);
 
     // Fusion with accurate contours
     IplImage *accurate_contours = cvCloneImage(mask_iris);
-    struct_element = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_ELLIPSE);
-    cvMorphologyEx(accurate_contours, accurate_contours, accurate_contours, struct_element, CV_MOP_GRADIENT);
-    cvReleaseStructuringElement(&struct_element);
-    reconstructMarkerByMask(accurate_contours, mask_noise, mask_noise);
+    cvMorphologyEx(accurate_contours, accurate_contours, accurate_contours, rPlan.getSmallElement(), CV_MOP_GRADIENT);
+    reconstructMarkerByMask(accurate_contours, mask_noise, mask_noise, rPlan.getSmallElement());
     cvReleaseImage(&accurate_contours);
     cvXor(mask_iris, mask_noise, pMask);
 
@@ -276,6 +253,66 @@ void OsiProcessings::segment(const IplImage *pSrc, IplImage *pMask, OsiCircle &r
     cvReleaseImage(&mask_noise);
     cvReleaseImage(&mask_pupil);
     cvReleaseImage(&mask_iris);
+    cvReleaseImage(&clone_src);
+
+    // Remember this frame for the next one
+    if (pTracker)
+    {
+        pTracker->update(rPupil, rIris, response, tracked);
+    }
+
+} // end of function
+
+void OsiProcessings::assessQuality(const IplImage *pSrc, int minPupilDiameter, float &rFocus, float &rOcclusion,
+                                   float &rContrast)
+{
+    // Downsample (never upsample)
+    float scale = std::min(1.0f, (float)OSI_QUALITY_WIDTH / pSrc->width);
+    IplImage *small = cvCreateImage(cvSize(pSrc->width * scale, pSrc->height * scale), IPL_DEPTH_8U, 1);
+    cvResize(pSrc, small, CV_INTER_AREA);
+
+    // Focus : energy of high frequencies
+    IplImage *laplacian = cvCreateImage(cvGetSize(small), IPL_DEPTH_32F, 1);
+    cvLaplace(small, laplacian);
+    CvScalar mean, deviation;
+    cvAvgSdv(laplacian, &mean, &deviation);
+    rFocus = deviation.val[0];
+    cvReleaseImage(&laplacian);
+
+    // Occlusion : is there a pupil-sized region much darker than the image ?
+    int disk_size = std::max(3, (int)(minPupilDiameter * scale));
+    disk_size += (disk_size % 2) ? 0 : 1;
+    IplImage *blurred = cvCreateImage(cvGetSize(small), IPL_DEPTH_8U, 1);
+    cvSmooth(small, blurred, CV_BLUR, disk_size, disk_size);
+    double darkest;
+    cvMinMaxLoc(blurred, &darkest, 0);
+    double image_mean = cvAvg(small).val[0];
+    rOcclusion = (image_mean > 0) ? std::min(1.0, darkest / image_mean) : 1;
+    cvReleaseImage(&blurred);
+
+    // Contrast : histogram of grey levels
+    std::vector<int> histogram(256, 0);
+    for (int i = 0; i < small->height; i++)
+    {
+        const uchar *row = (const uchar *)(small->imageData + i * small->widthStep);
+        for (int j = 0; j < small->width; j++)
+        {
+            histogram[row[j]]++;
+        }
+    }
+    int n_pixels = small->width * small->height;
+    int low = -1, high = -1, cumulated = 0;
+    for (int g = 0; g < 256; g++)
+    {
+        cumulated += histogram[g];
+        if (low < 0 && cumulated >= 0.05 * n_pixels)
+            low = g;
+        if (high < 0 && cumulated >= 0.95 * n_pixels)
+            high = g;
+    }
+    rContrast = (high - low) / 255.0f;
+
+    cvReleaseImage(&small);
 
 } // end of function
 
@@ -403,50 +440,111 @@ CvPoint OsiProcessings::interpolate(const std::vector<CvPoint> coarseContour, co
 void OsiProcessings::encode(const IplImage *pSrc, IplImage *pDst, const std::vector<CvMat *> &rFilters)
 {
     // Compute the maximum width of the filters
-    int max_width = 0;
-    for (int f = 0; f < rFilters.size(); f++)
-        if (rFilters[f]->cols > max_width)
-            max_width = rFilters[f]->cols;
-    max_width = (max_width - 1) / 2;
+    int max_width = getMaxHalfWidth(rFilters);
 
     // Add wrapping borders on the left and right of image for convolution
     IplImage *resized = addBorders(pSrc, max_width);
 
-    // Temporary images to store the result of convolution
-    IplImage *img1 = cvCreateImage(cvGetSize(resized), IPL_DEPTH_32F, 1);
-    IplImage *img2 = cvCreateImage(cvGetSize(resized), pDst->depth, 1);
+    // Convolve and threshold
+    encodeWithBorders(resized, max_width, pDst, rFilters);
 
-    // Loop on filters
-    for (int f = 0; f < rFilters.size(); f++)
+    // Free memory
+    cvReleaseImage(&resized);
+}
+
+void OsiProcessings::normalizeAndEncode(const IplImage *pSrc, const IplImage *pMask, IplImage *pDstCode,
+                                        IplImage *pDstMask, const OsiCircle &rPupil, const OsiCircle &rIris,
+                                        const std::vector<float> &rThetaCoarsePupil,
+                                        const std::vector<float> &rThetaCoarseIris,
+                                        const std::vector<CvPoint> &rPupilCoarseContour,
+                                        const std::vector<CvPoint> &rIrisCoarseContour,
+                                        const std::vector<CvMat *> &rFilters)
+{
+    // Size of the normalized iris
+    int width = pDstMask->width;
+    int height = pDstMask->height;
+
+    // Normalized iris with its wrapping borders, as built by addBorders()
+    int max_width = getMaxHalfWidth(rFilters);
+    IplImage *bordered = cvCreateImage(cvSize(width + 2 * max_width, height), IPL_DEPTH_8U, 1);
+
+    // Set to zeros all pixels
+    cvZero(bordered);
+    cvZero(pDstMask);
+
+    // Local variables
+    CvPoint point_pupil, point_iris;
+    int x, y;
+    float theta, radius;
+
+    // Loop on columns of normalized iris
+    for (int j = 0; j < width; j++)
     {
-        // Convolution
-        cvFilter2D(resized, img1, rFilters[f]);
+        // One column correspond to an angle teta
+        theta = (float)j / width * 2 * OSI_PI;
 
-        // Threshold : above or below 0
-        cvThreshold(img1, img2, 0, 255, CV_THRESH_BINARY);
-
-        // Form the iris code
-        cvSetImageROI(img2, cvRect(max_width, 0, pSrc->width, pSrc->height));
-        cvSetImageROI(pDst, cvRect(0, f * pSrc->height, pSrc->width, pSrc->height));
-        cvCopy(img2, pDst, NULL);
-        cvResetImageROI(img2);
-        cvResetImageROI(pDst);
+        // Interpolate pupil and iris radii from coarse contours (once for image and mask)
+        point_pupil = interpolate(rPupilCoarseContour, rThetaCoarsePupil, theta);
+        point_iris = interpolate(rIrisCoarseContour, rThetaCoarseIris, theta);
+
+        // Columns of the bordered buffer showing this angle : the center, and a border if the angle is near 0
+        int columns[2] = {j + max_width, -1};
+        if (j < max_width)
+        {
+            columns[1] = j + width + max_width;
+        }
+        else if (j >= width - max_width)
+        {
+            columns[1] = j - width + max_width;
+        }
+
+        // Loop on lines of normalized iris
+        for (int i = 0; i < height; i++)
+        {
+            // The radial parameter
+            radius = (float)i / height;
+
+            // Coordinates relative to both radii : iris and pupil
+            x = (1 - radius) * point_pupil.x + radius * point_iris.x;
+            y = (1 - radius) * point_pupil.y + radius * point_iris.y;
+
+            // Do not exceed src size
+            if (x >= 0 && x < pSrc->width && y >= 0 && y < pSrc->height)
+            {
+                uchar value = ((uchar *)(pSrc->imageData + y * pSrc->widthStep))[x];
+                uchar *row = (uchar *)(bordered->imageData + i * bordered->widthStep);
+                row[columns[0]] = value;
+                if (columns[1] >= 0)
+                {
+                    row[columns[1]] = value;
+                }
+                ((uchar *)(pDstMask->imageData + i * pDstMask->widthStep))[j] =
+                    ((uchar *)(pMask->imageData + y * pMask->widthStep))[x];
+            }
+        }
     }
 
+    // Convolve and threshold
+    encodeWithBorders(bordered, max_width, pDstCode, rFilters);
+
     // Free memory
-    cvReleaseImage(&img1);
-    cvReleaseImage(&img2);
-    cvReleaseImage(&resized);
+    cvReleaseImage(&bordered);
 }
 
-float OsiProcessings::match(const IplImage *image1, const IplImage *image2, const IplImage *mask)
+float OsiProcessings::match(const IplImage *image1, const IplImage *image2, const IplImage *mask, int shift)
 {
+    // Codes of the stock geometry : bits packed in 64-bit words
+    if (image1->width == OSI_DEFAULT_NORMALIZED_WIDTH && image1->depth == IPL_DEPTH_8U && image1->nChannels == 1 &&
+        shift < image1->width)
+    {
+        return OsiFilterBank::match(image1, image2, mask, shift);
+    }
+
     // Temporary matrix to store the XOR result
     IplImage *result = cvCreateImage(cvGetSize(image1), IPL_DEPTH_8U, 1);
     cvSet(result, cvScalar(0));
 
     // Add borders on the image1 in order to shift it
-    int shift = 10;
     IplImage *shifted = addBorders(image1, shift);
 
     // The minimum score will be returned
@@ -469,6 +567,49 @@ float OsiProcessings::match(const IplImage *image1, const IplImage *image2, cons
     return score;
 }
 
+void OsiProcessings::quantizeFilters(const std::vector<CvMat *> &rFilters, std::vector<CvMat *> &rQuantized)
+{
+    rQuantized.resize(rFilters.size());
+    for (int f = 0; f < rFilters.size(); f++)
+    {
+        const CvMat *filter = rFilters[f];
+
+        // Sum and maximum of absolute coefficients
+        double sum = 0, max = 0;
+        for (int k = 0; k < filter->rows * filter->cols; k++)
+        {
+            sum += std::fabs(filter->data.fl[k]);
+            max = std::max<double>(max, std::fabs(filter->data.fl[k]));
+        }
+
+        // Fractional bits : coefficients fit in 16 bits, convolution of 8-bit pixels fits in 32 bits
+        int bits = OSI_FILTER_FRACTION_BITS;
+        while (bits > 0 && (max * (1 << bits) > 32767 || sum * (1 << bits) * 255 > 2147483647.0))
+        {
+            bits--;
+        }
+
+        rQuantized[f] = cvCreateMat(filter->rows, filter->cols, CV_16SC1);
+        for (int r = 0; r < filter->rows; r++)
+        {
+            for (int c = 0; c < filter->cols; c++)
+            {
+                CV_MAT_ELEM(*rQuantized[f], short, r, c) =
+                    (short)cvRound(CV_MAT_ELEM(*filter, float, r, c) * (1 << bits));
+            }
+        }
+    }
+}
+
+int OsiProcessings::countDifferentBits(const IplImage *pCode1, const IplImage *pCode2)
+{
+    IplImage *difference = cvCreateImage(cvGetSize(pCode1), IPL_DEPTH_8U, 1);
+    cvXor(pCode1, pCode2, difference);
+    int count = cvCountNonZero(difference);
+    cvReleaseImage(&difference);
+    return count;
+}
+
 ///////////////////////////////////
 // PRIVATE METHODS
 ///////////////////////////////////
@@ -481,6 +622,122 @@ CvPoint OsiProcessings::convertPolarToCartesian(const CvPoint &rCenter, int rRad
     return cvPoint(x, y);
 }
 
+// Get the half-width of the widest filter
+int OsiProcessings::getMaxHalfWidth(const std::vector<CvMat *> &rFilters)
+{
+    int max_width = 0;
+    for (int f = 0; f < rFilters.size(); f++)
+        if (rFilters[f]->cols > max_width)
+            max_width = rFilters[f]->cols;
+    return (max_width - 1) / 2;
+}
+
+// Convolve a bordered normalized iris tile by tile and threshold in the iris code
+void OsiProcessings::encodeWithBorders(const IplImage *pBordered, int border, IplImage *pDst,
+                                       const std::vector<CvMat *> &rFilters)
+{
+    int width = pBordered->width - 2 * border;
+    int height = pBordered->height;
+
+    // Stock filter bank on a 512x64 iris : kernels specialized at compile time
+    if (width == OSI_DEFAULT_NORMALIZED_WIDTH && height == OSI_DEFAULT_NORMALIZED_HEIGHT &&
+        border >= OSI_DEFAULT_MAX_HALF_WIDTH && OsiFilterBank::isDefaultBank(rFilters))
+    {
+        OsiFilterBank::encode(pBordered, border, pDst);
+        return;
+    }
+
+    // Temporary image to store the result of convolution of one tile (with its borders)
+    IplImage *tile = cvCreateImage(cvSize(std::min(OSI_ENCODING_TILE_WIDTH, width) + 2 * border, height),
+                                   IPL_DEPTH_32F, 1);
+
+    // Sums of one row for the fixed-point convolution
+    std::vector<int> accumulator(OSI_ENCODING_TILE_WIDTH);
+
+    // Loop on tiles
+    for (int t = 0; t < width; t += OSI_ENCODING_TILE_WIDTH)
+    {
+        int tile_width = std::min(OSI_ENCODING_TILE_WIDTH, width - t);
+
+        // The tile and the columns on its left and right needed by the filters
+        CvMat src_header;
+        cvGetSubRect(pBordered, &src_header, cvRect(t, 0, tile_width + 2 * border, height));
+        cvSetImageROI(tile, cvRect(0, 0, tile_width + 2 * border, height));
+
+        // Loop on filters
+        for (int f = 0; f < rFilters.size(); f++)
+        {
+            // Fixed point : convolution and threshold at once
+            if (CV_MAT_TYPE(rFilters[f]->type) == CV_16SC1)
+            {
+                cvSetImageROI(pDst, cvRect(t, f * height, tile_width, height));
+                filterFixedPoint(&src_header, border, rFilters[f], pDst, accumulator);
+                cvResetImageROI(pDst);
+                continue;
+            }
+
+            // Convolution
+            cvFilter2D(&src_header, tile, rFilters[f]);
+
+            // Threshold : above or below 0, directly in the iris code
+            cvSetImageROI(tile, cvRect(border, 0, tile_width, height));
+            cvSetImageROI(pDst, cvRect(t, f * height, tile_width, height));
+            cvThreshold(tile, pDst, 0, 255, CV_THRESH_BINARY);
+            cvResetImageROI(pDst);
+            cvSetImageROI(tile, cvRect(0, 0, tile_width + 2 * border, height));
+        }
+    }
+
+    // Free memory
+    cvReleaseImage(&tile);
+}
+
+// Convolve a tile with a quantized filter, and keep the sign
+void OsiProcessings::filterFixedPoint(const CvMat *pSrc, int border, const CvMat *pFilter, IplImage *pDst,
+                                      std::vector<int> &rAccumulator)
+{
+    CvRect roi = cvGetImageROI(pDst);
+    int anchor_x = pFilter->cols / 2;
+    int anchor_y = pFilter->rows / 2;
+
+    for (int i = 0; i < roi.height; i++)
+    {
+        int *acc = &rAccumulator[0];
+        std::fill(acc, acc + roi.width, 0);
+
+        for (int r = 0; r < pFilter->rows; r++)
+        {
+            // Replicate the first and last rows
+            int y = std::min(std::max(i + r - anchor_y, 0), pSrc->rows - 1);
+            const uchar *src_row = pSrc->data.ptr + y * pSrc->step + border - anchor_x;
+            const short *coefficients = (const short *)(pFilter->data.ptr + r * pFilter->step);
+
+            for (int c = 0; c < pFilter->cols; c++)
+            {
+                int coefficient = coefficients[c];
+                if (!coefficient)
+                {
+                    continue;
+                }
+
+                // Plain loop on the columns : vectorized by the compiler
+                const uchar *src = src_row + c;
+                for (int j = 0; j < roi.width; j++)
+                {
+                    acc[j] += coefficient * src[j];
+                }
+            }
+        }
+
+        // Threshold : above or below 0
+        uchar *dst = (uchar *)(pDst->imageData + (roi.y + i) * pDst->widthStep) + roi.x;
+        for (int j = 0; j < roi.width; j++)
+        {
+            dst[j] = acc[j] > 0 ? 255 : 0;
+        }
+    }
+}
+
 // Add left and right borders on an unwrapped image
 IplImage *OsiProcessings::addBorders(const IplImage *pImage, int width)
 {
@@ -507,67 +764,48 @@ IplImage *OsiProcessings::addBorders(const IplImage *pImage, int width)
 }
 
 // Detect and locate a pupil inside an eye image
-void OsiProcessings::detectPupil(const IplImage *pSrc, OsiCircle &rPupil, int minPupilDiameter, int maxPupilDiameter)
+double OsiProcessings::detectPupil(const IplImage *pSrc, OsiCircle &rPupil, const OsiSegmentationPlan &rPlan,
+                                   const OsiCircle *pPrior)
 {
-    // Check arguments
-    //////////////////
-
-    // String functions
-    OsiStringUtils str;
+    // Search domain
+    ////////////////
 
-    // Default value for maxPupilDiameter, if user did not specify it
-    if (maxPupilDiameter == 0)
-    {
-        maxPupilDiameter = std::min(pSrc->height, pSrc->width) * OSI_MAX_RATIO_PUPIL_IRIS;
-    }
+    float scale = rPlan.getPupilScale();
 
-    // Change maxPupilDiameter if it is too big relative to the image size and the ratio pupil/iris
-    else if (maxPupilDiameter > std::min(pSrc->height, pSrc->width) * OSI_MAX_RATIO_PUPIL_IRIS)
-    {
-        int newmaxPupilDiameter = std::floor(std::min(pSrc->height, pSrc->width) * OSI_MAX_RATIO_PUPIL_IRIS);
-        std::cout << "Warning in function detectPupil : maxPupilDiameter = " << maxPupilDiameter;
-        std::cout << " is replaced by " << newmaxPupilDiameter;
-        std::cout << " because image size is " << pSrc->width << "x" << pSrc->height;
-        std::cout << " and ratio pupil/iris is generally lower than " << OSI_MAX_RATIO_PUPIL_IRIS << std::endl;
-        maxPupilDiameter = newmaxPupilDiameter;
-    }
+    // By default : whole image and all radii
+    CvRect window = cvRect(0, 0, pSrc->width, pSrc->height);
+    int first_radius = 0;
+    int last_radius = rPlan.getNumberOfPupilRadii() - 1;
 
-    // Change minPupilDiameter if it is too small relative to OSI_SMALLEST_PUPIL
-    if (minPupilDiameter < OSI_SMALLEST_PUPIL)
+    // Around the prior : a window twice as large as the pupil, and radii close to the prior radius
+    if (pPrior)
     {
-        std::cout << "Warning in function detectPupil : minPupilDiameter = " << minPupilDiameter;
-        std::cout << " is replaced by " << OSI_SMALLEST_PUPIL;
-        std::cout << " which is the smallest size for detecting pupil" << std::endl;
-        minPupilDiameter = OSI_SMALLEST_PUPIL;
-    }
-
-    // Check that minPupilDiameter < maxPupilDiameter
-    if (minPupilDiameter >= maxPupilDiameter)
-    {
-        throw std::invalid_argument(
-            "Error in function detectPupil : minPupilDiameter = " + str.toString(minPupilDiameter) +
-            " should be lower than maxPupilDiameter = " + str.toString(maxPupilDiameter));
+        int half = 2 * pPrior->getRadius() + 1;
+        int x0 = std::max(0, pPrior->getCenter().x - half);
+        int y0 = std::max(0, pPrior->getCenter().y - half);
+        int x1 = std::min(pSrc->width, pPrior->getCenter().x + half + 1);
+        int y1 = std::min(pSrc->height, pPrior->getCenter().y + half + 1);
+        // The rescale divides by the downsampled size minus one : keep at least two pixels each way
+        if ((int)((x1 - x0) * scale) >= 2 && (int)((y1 - y0) * scale) >= 2)
+        {
+            window = cvRect(x0, y0, x1 - x0, y1 - y0);
+        }
+        first_radius = std::max(first_radius, (int)(0.75 * pPrior->getRadius() * scale) - rPlan.getFirstPupilRadius());
+        last_radius = std::min(last_radius, (int)(1.25 * pPrior->getRadius() * scale) + 1 - rPlan.getFirstPupilRadius());
     }
 
     // Start processing
     ///////////////////
 
     // Resize image (downsample)
-    float scale = (float)OSI_SMALLEST_PUPIL / minPupilDiameter;
-    IplImage *resized = cvCreateImage(cvSize(pSrc->width * scale, pSrc->height * scale), pSrc->depth, 1);
-    cvResize(pSrc, resized);
-
-    // Rescale sizes
-    maxPupilDiameter = maxPupilDiameter * scale;
-    minPupilDiameter = minPupilDiameter * scale;
-
-    // Make sizes odd
-    maxPupilDiameter += (maxPupilDiameter % 2) ? 0 : +1;
-    minPupilDiameter += (minPupilDiameter % 2) ? 0 : -1;
+    CvMat window_header;
+    cvGetSubRect(pSrc, &window_header, window);
+    IplImage *resized = cvCreateImage(cvSize(window.width * scale, window.height * scale), pSrc->depth, 1);
+    cvResize(&window_header, resized);
 
     // Fill holes
     IplImage *filled = cvCreateImage(cvGetSize(resized), resized->depth, 1);
-    fillWhiteHoles(resized, filled);
+    fillWhiteHoles(resized, filled, rPlan.getSmallElement());
 
     // Gradients in horizontal direction
     IplImage *gh = cvCreateImage(cvGetSize(filled), IPL_DEPTH_32F, 1);
@@ -588,64 +826,32 @@ void OsiProcessings::detectPupil(const IplImage *pSrc, OsiCircle &rPupil, int mi
     cvDiv(gh, gn, gh);
     cvDiv(gv, gn, gv);
 
-    // Create the filters fh and fv
-    int filter_size = maxPupilDiameter;
-    filter_size += (filter_size % 2) ? 0 : -1;
-    CvMat *fh = cvCreateMat(filter_size, filter_size, CV_32FC1);
-    CvMat *fv = cvCreateMat(filter_size, filter_size, CV_32FC1);
-    for (int i = 0; i < fh->rows; i++)
+    double old_max_val = 0;
+
+    // Multi resolution of radius (filters fh and fv restricted to each ring are in the plan)
+    for (int n = first_radius; n <= last_radius; n++)
     {
-        float x = i - float(filter_size - 1) / 2;
-        for (int j = 0; j < fh->cols; j++)
+        // Out of budget : keep the best radius found so far
+        if (isCancelled() && old_max_val > 0)
         {
-            float y = j - float(filter_size - 1) / 2;
-            if (x != 0 || y != 0)
-            {
-                (fh->data.fl)[i * fh->cols + j] = y / std::sqrt(x * x + y * y);
-                (fv->data.fl)[i * fv->cols + j] = x / std::sqrt(x * x + y * y);
-            }
-            else
-            {
-                (fh->data.fl)[i * fh->cols + j] = 0;
-                (fv->data.fl)[i * fv->cols + j] = 0;
-            }
+            break;
         }
-    }
-
-    // Create the mask
-    CvMat *mask = cvCreateMat(filter_size, filter_size, CV_8UC1);
 
-    // Temporary matrix for masking the filter (later : tempfilter = filter * mask)
-    CvMat *temp_filter = cvCreateMat(filter_size, filter_size, CV_32FC1);
-
-    double old_max_val = 0;
-
-    // Multi resolution of radius
-    for (int r = (OSI_SMALLEST_PUPIL - 1) / 2; r < (maxPupilDiameter - 1) / 2; r++)
-    {
-        // Centred ring with radius = r and width = 2
-        cvZero(mask);
-        cvCircle(mask, cvPoint((filter_size - 1) / 2, (filter_size - 1) / 2), r, cvScalar(1), 2);
+        int r = rPlan.getFirstPupilRadius() + n;
 
         // Fh * Gh
-        cvZero(temp_filter);
-        cvCopy(fh, temp_filter, mask);
-        cvFilter2D(gh, gh2, temp_filter);
+        cvFilter2D(gh, gh2, rPlan.getHorizontalRingFilter(n));
 
         // Fv * Gv
-        cvZero(temp_filter);
-        cvCopy(fv, temp_filter, mask);
-        cvFilter2D(gv, gv2, temp_filter);
+        cvFilter2D(gv, gv2, rPlan.getVerticalRingFilter(n));
 
         // Fh*Gh + Fv*Gv
         cvAdd(gh2, gv2, gn);
-        cvScale(gn, gn, 1.0 / cvSum(mask).val[0]);
+        cvScale(gn, gn, rPlan.getRingNormalization(n));
 
         // Sum in the disk-shaped neighbourhood
-        cvZero(mask);
-        cvCircle(mask, cvPoint((filter_size - 1) / 2, (filter_size - 1) / 2), r, cvScalar(1), -1);
-        cvFilter2D(filled, gh2, mask);
-        cvScale(gh2, gh2, -1.0 / cvSum(mask).val[0] / 255.0, 1);
+        cvFilter2D(filled, gh2, rPlan.getDiskFilter(n));
+        cvScale(gh2, gh2, -rPlan.getDiskNormalization(n) / 255.0, 1);
 
         // Add the two features : contour + darkness
         cvAdd(gn, gh2, gn);
@@ -662,10 +868,11 @@ void OsiProcessings::detectPupil(const IplImage *pSrc, OsiCircle &rPupil, int mi
         }
     }
 
-    // Rescale circle
-    int x = ((float)(rPupil.getCenter().x * (pSrc->width - 1))) / (filled->width - 1) + (float)((1.0 / scale) - 1) / 2;
-    int y =
-        ((float)(rPupil.getCenter().y * (pSrc->height - 1))) / (filled->height - 1) + (float)((1.0 / scale) - 1) / 2;
+    // Rescale circle (and go back to coordinates of the whole image)
+    int x = ((float)(rPupil.getCenter().x * (window.width - 1))) / (filled->width - 1) +
+            (float)((1.0 / scale) - 1) / 2 + window.x;
+    int y = ((float)(rPupil.getCenter().y * (window.height - 1))) / (filled->height - 1) +
+            (float)((1.0 / scale) - 1) / 2 + window.y;
     int r = rPupil.getRadius() / scale;
     rPupil.setCircle(x, y, r);
 
@@ -677,15 +884,14 @@ void OsiProcessings::detectPupil(const IplImage *pSrc, OsiCircle &rPupil, int mi
     cvReleaseImage(&gh2);
     cvReleaseImage(&gv2);
     cvReleaseImage(&gn);
-    cvReleaseMat(&fh);
-    cvReleaseMat(&fv);
-    cvReleaseMat(&mask);
-    cvReleaseMat(&temp_filter);
+
+    return old_max_val;
 
 } // end of function
 
 // Morphological reconstruction
-void OsiProcessings::reconstructMarkerByMask(const IplImage *pMarker, const IplImage *pMask, IplImage *pDst)
+void OsiProcessings::reconstructMarkerByMask(const IplImage *pMarker, const IplImage *pMask, IplImage *pDst,
+                                             IplConvKernel *pStructuringElement)
 {
     // Temporary image that will inform about marker evolution
     IplImage *difference = cvCloneImage(pMask);
@@ -696,11 +902,15 @@ void OsiProcessings::reconstructMarkerByMask(const IplImage *pMarker, const IplI
     // Copy the marker
     cvCopy(pMarker, pDst);
 
-    // Structuring element for morphological operation
-    IplConvKernel *structuring_element = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_ELLIPSE);
+    // Structuring element for morphological operation (built here if not provided by a plan)
+    IplConvKernel *structuring_element = pStructuringElement;
+    if (!structuring_element)
+    {
+        structuring_element = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_ELLIPSE);
+    }
 
     // Will stop when marker does not change anymore
-    while (cvSum(difference).val[0])
+    while (cvSum(difference).val[0] && !isCancelled())
     {
         // Remind marker before processing, in order to
         // compare with the marker after processing
@@ -719,12 +929,15 @@ void OsiProcessings::reconstructMarkerByMask(const IplImage *pMarker, const IplI
     // Release memory
     cvReleaseImage(&mask);
     cvReleaseImage(&difference);
-    cvReleaseStructuringElement(&structuring_element);
+    if (!pStructuringElement)
+    {
+        cvReleaseStructuringElement(&structuring_element);
+    }
 
 } // end of function
 
 // Fill the white holes surrounded by dark pixels, such as specular reflection inside pupil area
-void OsiProcessings::fillWhiteHoles(const IplImage *pSrc, IplImage *pDst)
+void OsiProcessings::fillWhiteHoles(const IplImage *pSrc, IplImage *pDst, IplConvKernel *pStructuringElement)
 {
     int width, height;
     if (pSrc->roi)
@@ -754,7 +967,7 @@ void OsiProcessings::fillWhiteHoles(const IplImage *pSrc, IplImage *pDst)
     IplImage *result = cvCloneImage(mask);
 
     // Morphological reconstruction
-    reconstructMarkerByMask(marker, mask, result);
+    reconstructMarkerByMask(marker, mask, result, pStructuringElement);
 
     // Remove borders
     cvSetImageROI(result, cvRect(1, 1, width, height));
@@ -844,7 +1057,7 @@ void OsiProcessings::processAnisotropicSmoothing(const IplImage *pSrc, IplImage
     float tfsc, tfsn, tfss, tfse, tfsw, tfdn, tfds, tfde, tfdw;
 
     // Loop on iterations
-    for (int k = 0; k < iterations; k++)
+    for (int k = 0; k < iterations && !isCancelled(); k++)
     {
         // Odd pixels
         for (int i = 1; i < tfs->height - 1; i++)
@@ -1073,7 +1286,7 @@ std::vector<CvPoint> OsiProcessings::findContour(const IplImage *pSrc, const CvP
     IplImage *unwrapped = unwrapRing(pSrc, rCenter, minRadius, maxRadius, rTheta);
 
     // Smooth image
-    processAnisotropicSmoothing(unwrapped, unwrapped, 100, 1);
+    processAnisotropicSmoothing(unwrapped, unwrapped, getSettings().getSmoothingIterations(), 1);
 
     // Extract the gradients
     computeVerticalGradients(unwrapped, unwrapped);
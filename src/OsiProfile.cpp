@@ -0,0 +1,107 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include "OsiDeadline.h"
+#include "OsiProfile.h"
+
+// Scales of the settings for each degradation level (see OsiDeadline)
+static const float osi_smoothing_scales[OSI_DEGRADATION_LEVELS] = {1, 0.5f, 0.2f};
+static const float osi_theta_step_scales[OSI_DEGRADATION_LEVELS] = {1, 2, 3};
+static const float osi_match_shift_scales[OSI_DEGRADATION_LEVELS] = {1, 0.7f, 0.4f};
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiProfile::OsiProfile(const std::string &rName)
+{
+    mName = rName;
+
+    if (rName == "fast")
+    {
+        mSmoothingIterations = 40;
+        mPupilBand = 15;
+        mThetaStepFactor = 2;
+        mMatchShift = 6;
+        mNoiseThreshold = 2.35f;
+    }
+    else if (rName == "balanced")
+    {
+        mSmoothingIterations = 100;
+        mPupilBand = 20;
+        mThetaStepFactor = 1;
+        mMatchShift = 10;
+        mNoiseThreshold = 2.35f;
+    }
+    else if (rName == "accurate")
+    {
+        mSmoothingIterations = 200;
+        mPupilBand = 25;
+        mThetaStepFactor = 1;
+        mMatchShift = 14;
+        mNoiseThreshold = 2.35f;
+    }
+    else
+    {
+        throw std::invalid_argument("Unknown profile : " + rName + " (expected fast, balanced or accurate)");
+    }
+}
+
+OsiProfile::~OsiProfile()
+{
+    // Do nothing
+}
+
+// ACCESSORS
+////////////
+
+const std::string &OsiProfile::getName() const
+{
+    return mName;
+}
+
+int OsiProfile::getSmoothingIterations() const
+{
+    return mSmoothingIterations;
+}
+
+int OsiProfile::getPupilBand() const
+{
+    return mPupilBand;
+}
+
+float OsiProfile::getThetaStepFactor() const
+{
+    return mThetaStepFactor;
+}
+
+int OsiProfile::getMatchShift() const
+{
+    return mMatchShift;
+}
+
+float OsiProfile::getNoiseThreshold() const
+{
+    return mNoiseThreshold;
+}
+
+// OPERATORS
+////////////
+
+OsiProfile OsiProfile::getDegraded(int degradationLevel) const
+{
+    int level = std::min(std::max(degradationLevel, 0), OSI_DEGRADATION_LEVELS - 1);
+
+    OsiProfile degraded(*this);
+    degraded.mSmoothingIterations = std::max(1, (int)(mSmoothingIterations * osi_smoothing_scales[level]));
+    degraded.mThetaStepFactor = mThetaStepFactor * osi_theta_step_scales[level];
+    degraded.mMatchShift = std::max(1, (int)(mMatchShift * osi_match_shift_scales[level] + 0.5f));
+    return degraded;
+}
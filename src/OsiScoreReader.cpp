@@ -0,0 +1,111 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+#include "OsiScoreReader.h"
+
+// Tag at the beginning of a binary file of scores
+#define OSI_SCORES_TAG "OSISCOR1"
+#define OSI_SCORES_TAG_SIZE 8
+
+// Read a 32-bit word in little-endian order
+static unsigned int getWord(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiScoreReader::OsiScoreReader()
+{
+    mFormat = OSI_SCORES_TEXT;
+}
+
+// OPERATORS
+////////////
+
+void OsiScoreReader::open(const std::string &rFilename, int format)
+{
+    close();
+    mFilename = rFilename;
+    mFormat = format;
+
+    if (mFormat == OSI_SCORES_BINARY)
+    {
+        mFile.open(mFilename.c_str(), std::ios::in | std::ios::binary);
+        char tag[OSI_SCORES_TAG_SIZE];
+        if (!mFile || !mFile.read(tag, OSI_SCORES_TAG_SIZE) || memcmp(tag, OSI_SCORES_TAG, OSI_SCORES_TAG_SIZE))
+        {
+            close();
+            throw std::runtime_error("Cannot read the binary file of matching scores : " + rFilename);
+        }
+
+        // The id of a name is its line number
+        std::ifstream names((mFilename + ".names").c_str(), std::ios::in);
+        std::string name;
+        while (std::getline(names, name))
+        {
+            mNames.push_back(name);
+        }
+        return;
+    }
+
+    mFile.open(mFilename.c_str(), std::ios::in);
+    if (!mFile)
+    {
+        throw std::runtime_error("Cannot read the file of matching scores : " + rFilename);
+    }
+}
+
+bool OsiScoreReader::read(std::string &rProbe, std::string &rGallery, float &rScore)
+{
+    if (mFormat == OSI_SCORES_BINARY)
+    {
+        unsigned char record[12];
+        if (!mFile.read((char *)record, sizeof(record)))
+        {
+            return false;
+        }
+        unsigned int probe = getWord(record);
+        unsigned int gallery = getWord(record + 4);
+        unsigned int bits = getWord(record + 8);
+        if (probe >= mNames.size() || gallery >= mNames.size())
+        {
+            throw std::runtime_error("Unknown image id in " + mFilename + " (see " + mFilename + ".names)");
+        }
+        rProbe = mNames[probe];
+        rGallery = mNames[gallery];
+        memcpy(&rScore, &bits, sizeof(rScore));
+        return true;
+    }
+
+    std::string line;
+    while (std::getline(mFile, line))
+    {
+        std::istringstream fields(line);
+        if (fields >> rProbe >> rGallery >> rScore)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void OsiScoreReader::close()
+{
+    if (mFile.is_open())
+    {
+        mFile.close();
+    }
+    mFile.clear();
+    mNames.clear();
+}
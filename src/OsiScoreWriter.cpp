@@ -0,0 +1,240 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include "OsiScoreWriter.h"
+#include "OsiStringUtils.h"
+
+// Tag at the beginning of a binary file of scores
+#define OSI_SCORES_TAG "OSISCOR1"
+#define OSI_SCORES_TAG_SIZE 8
+
+// Write a 32-bit word in little-endian order
+static void putWord(char *p, unsigned int value)
+{
+    for (int b = 0; b < 4; b++)
+    {
+        p[b] = (char)(value >> (8 * b));
+    }
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiScoreWriter::OsiScoreWriter()
+{
+    mFormat = OSI_SCORES_TEXT;
+    mBestScoresPerProbe = 0;
+    mMaxScore = 1;
+}
+
+OsiScoreWriter::~OsiScoreWriter()
+{
+    close();
+}
+
+// ACCESSORS
+////////////
+
+int OsiScoreWriter::getFormat(const std::string &rName)
+{
+    OsiStringUtils osu;
+    std::string name = osu.toLower(rName);
+    if (name == "text")
+    {
+        return OSI_SCORES_TEXT;
+    }
+    if (name == "binary")
+    {
+        return OSI_SCORES_BINARY;
+    }
+    throw std::invalid_argument("Unknown format of matching scores : " + rName + " (text or binary)");
+}
+
+bool OsiScoreWriter::isOpen() const
+{
+    return mFile.is_open();
+}
+
+// OPERATORS
+////////////
+
+void OsiScoreWriter::open(const std::string &rFilename, int format, int bestScoresPerProbe, float maxScore,
+                          bool append)
+{
+    close();
+    mFilename = rFilename;
+    mFormat = format;
+    mBestScoresPerProbe = bestScoresPerProbe;
+    mMaxScore = maxScore;
+
+    // The buffer must be set before the file is opened
+    mBuffer.resize(OSI_SCORES_BUFFER_SIZE);
+    mFile.rdbuf()->pubsetbuf(&mBuffer[0], mBuffer.size());
+
+    std::ios::openmode mode = append ? std::ios::out | std::ios::app : std::ios::out;
+    if (mFormat == OSI_SCORES_BINARY)
+    {
+        // The ids of the names already listed are kept
+        std::ifstream existing(mFilename.c_str(), std::ios::in | std::ios::binary | std::ios::ate);
+        bool empty = !append || !existing || existing.tellg() == 0;
+        if (append)
+        {
+            std::ifstream names((mFilename + ".names").c_str(), std::ios::in);
+            std::string name;
+            while (std::getline(names, name))
+            {
+                mIds[name] = mNames.size();
+                mNames.push_back(name);
+            }
+        }
+
+        mFile.open(mFilename.c_str(), mode | std::ios::binary);
+        mNamesFile.open((mFilename + ".names").c_str(), mode);
+        if (empty)
+        {
+            mFile.write(OSI_SCORES_TAG, OSI_SCORES_TAG_SIZE);
+        }
+    }
+    else
+    {
+        mFile.open(mFilename.c_str(), mode);
+    }
+
+    if (!mFile || (mFormat == OSI_SCORES_BINARY && !mNamesFile))
+    {
+        close();
+        throw std::runtime_error("Cannot create the file for matching scores : " + rFilename);
+    }
+}
+
+void OsiScoreWriter::write(const std::string &rProbe, const std::string &rGallery, float score)
+{
+    if (score > mMaxScore)
+    {
+        return;
+    }
+
+    int probe = getId(rProbe);
+    int gallery = getId(rGallery);
+
+    // All scores are written at once
+    if (mBestScoresPerProbe <= 0)
+    {
+        output(probe, gallery, score);
+        return;
+    }
+
+    // Keep the best scores : the worst kept score is on top of the heap
+    if (probe >= mBestScores.size())
+    {
+        mBestScores.resize(probe + 1);
+    }
+    std::vector<std::pair<float, int>> &best = mBestScores[probe];
+    if (best.empty())
+    {
+        mProbes.push_back(probe);
+    }
+    if (best.size() < mBestScoresPerProbe)
+    {
+        best.push_back(std::make_pair(score, gallery));
+        std::push_heap(best.begin(), best.end());
+    }
+    else if (score < best.front().first)
+    {
+        std::pop_heap(best.begin(), best.end());
+        best.back() = std::make_pair(score, gallery);
+        std::push_heap(best.begin(), best.end());
+    }
+}
+
+void OsiScoreWriter::flush()
+{
+    if (mFile.is_open())
+    {
+        mFile.flush();
+    }
+    if (mNamesFile.is_open())
+    {
+        mNamesFile.flush();
+    }
+}
+
+void OsiScoreWriter::close()
+{
+    if (mFile.is_open())
+    {
+        // Best scores of each probe, in increasing order
+        for (int p = 0; p < mProbes.size(); p++)
+        {
+            std::vector<std::pair<float, int>> &best = mBestScores[mProbes[p]];
+            std::sort_heap(best.begin(), best.end());
+            for (int k = 0; k < best.size(); k++)
+            {
+                output(mProbes[p], best[k].second, best[k].first);
+            }
+        }
+
+        // No exception : the file is also closed by the destructor
+        mFile.close();
+        if (!mFile)
+        {
+            std::cout << "Error while saving the matching scores in " << mFilename << std::endl;
+        }
+    }
+    if (mNamesFile.is_open())
+    {
+        mNamesFile.close();
+    }
+
+    mIds.clear();
+    mNames.clear();
+    mBestScores.clear();
+    mProbes.clear();
+}
+
+int OsiScoreWriter::getId(const std::string &rName)
+{
+    std::map<std::string, int>::iterator it = mIds.find(rName);
+    if (it != mIds.end())
+    {
+        return it->second;
+    }
+
+    int id = mNames.size();
+    mIds[rName] = id;
+    mNames.push_back(rName);
+    if (mNamesFile.is_open())
+    {
+        mNamesFile << rName << "\n";
+    }
+    return id;
+}
+
+void OsiScoreWriter::output(int probe, int gallery, float score)
+{
+    if (mFormat == OSI_SCORES_BINARY)
+    {
+        unsigned int bits;
+        memcpy(&bits, &score, sizeof(bits));
+
+        char record[12];
+        putWord(record, probe);
+        putWord(record + 4, gallery);
+        putWord(record + 8, bits);
+        mFile.write(record, sizeof(record));
+    }
+    else
+    {
+        mFile << mNames[probe] << " " << mNames[gallery] << " " << score << "\n";
+    }
+}
@@ -0,0 +1,441 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "OsiSearchCluster.h"
+
+// Maximum size of a message (query or reply)
+#define OSI_SEARCH_MAX_MESSAGE (1 << 30)
+
+// Append a 32-bit word to a message, in little-endian order
+static void putWord(std::vector<unsigned char> &rMessage, unsigned int word)
+{
+    for (int b = 0; b < 4; b++)
+    {
+        rMessage.push_back((unsigned char)(word >> (8 * b)));
+    }
+}
+
+// Read a 32-bit word of a message
+static unsigned int getWord(const std::vector<unsigned char> &rMessage, size_t &rPos)
+{
+    if (rPos + 4 > rMessage.size())
+    {
+        throw std::runtime_error("Truncated message of the distributed search");
+    }
+    const unsigned char *p = &rMessage[rPos];
+    rPos += 4;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+}
+
+#ifdef _WIN32
+
+static int openSocket(const std::string &rAddress, bool server)
+{
+    throw std::runtime_error("The distributed search needs sockets, which are not available on Windows : " + rAddress);
+}
+
+static int acceptConnection(int server)
+{
+    return -1;
+}
+
+static bool sendAll(int socket, const unsigned char *pData, size_t size)
+{
+    return false;
+}
+
+static bool receiveAll(int socket, unsigned char *pData, size_t size)
+{
+    return false;
+}
+
+static void closeSocket(int socket)
+{
+}
+
+#else
+
+// Send the latency-bound messages without waiting to fill a packet (no effect on Unix sockets)
+static void setNoDelay(int socket)
+{
+    int on = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+}
+
+// Open a socket listening on an address (server), or connected to it
+static int openSocket(const std::string &rAddress, bool server)
+{
+    // Unix socket
+    if (rAddress.compare(0, 5, "unix:") == 0)
+    {
+        std::string path = rAddress.substr(5);
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            throw std::invalid_argument("Wrong path of Unix socket : " + rAddress);
+        }
+        strcpy(address.sun_path, path.c_str());
+
+        int s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (server)
+        {
+            // A socket file left by a previous worker is replaced
+            unlink(path.c_str());
+        }
+        if (s < 0 || (server ? bind(s, (sockaddr *)&address, sizeof(address)) || listen(s, 8)
+                             : ::connect(s, (sockaddr *)&address, sizeof(address))))
+        {
+            if (s >= 0)
+            {
+                close(s);
+            }
+            throw std::runtime_error("Cannot " + std::string(server ? "listen on " : "connect to ") + rAddress + " : " +
+                                     strerror(errno));
+        }
+        return s;
+    }
+
+    // TCP socket : "tcp:<host>:<port>" or "<host>:<port>", an empty host is any address (server) or this machine
+    std::string host = rAddress.compare(0, 4, "tcp:") == 0 ? rAddress.substr(4) : rAddress;
+    size_t colon = host.rfind(':');
+    if (colon == std::string::npos)
+    {
+        throw std::invalid_argument("Wrong address : " + rAddress + " (unix:<path> or tcp:<host>:<port>)");
+    }
+    std::string port = host.substr(colon + 1);
+    host = host.substr(0, colon);
+
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = server ? AI_PASSIVE : 0;
+    addrinfo *addresses = 0;
+    if (getaddrinfo(host.empty() ? (server ? 0 : "localhost") : host.c_str(), port.c_str(), &hints, &addresses))
+    {
+        throw std::runtime_error("Cannot resolve the address " + rAddress);
+    }
+
+    int s = -1;
+    for (addrinfo *a = addresses; a && s < 0; a = a->ai_next)
+    {
+        s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (s < 0)
+        {
+            continue;
+        }
+        int on = 1;
+        if (server)
+        {
+            setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        }
+        if (server ? bind(s, a->ai_addr, a->ai_addrlen) || listen(s, 8) : ::connect(s, a->ai_addr, a->ai_addrlen))
+        {
+            close(s);
+            s = -1;
+        }
+    }
+    freeaddrinfo(addresses);
+    if (s < 0)
+    {
+        throw std::runtime_error("Cannot " + std::string(server ? "listen on " : "connect to ") + rAddress + " : " +
+                                 strerror(errno));
+    }
+    setNoDelay(s);
+    return s;
+}
+
+// Accept a connection, -1 on error
+static int acceptConnection(int server)
+{
+    int s;
+    do
+    {
+        s = accept(server, 0, 0);
+    } while (s < 0 && errno == EINTR);
+    if (s >= 0)
+    {
+        setNoDelay(s);
+    }
+    return s;
+}
+
+static bool sendAll(int socket, const unsigned char *pData, size_t size)
+{
+#ifdef MSG_NOSIGNAL
+    int flags = MSG_NOSIGNAL;
+#else
+    int flags = 0;
+#endif
+    while (size > 0)
+    {
+        ssize_t n = send(socket, pData, size, flags);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        pData += n;
+        size -= n;
+    }
+    return true;
+}
+
+static bool receiveAll(int socket, unsigned char *pData, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = recv(socket, pData, size, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        pData += n;
+        size -= n;
+    }
+    return true;
+}
+
+static void closeSocket(int socket)
+{
+    close(socket);
+}
+
+#endif
+
+// Send a message : its size, then its content
+static bool sendMessage(int socket, const std::vector<unsigned char> &rMessage)
+{
+    std::vector<unsigned char> header;
+    putWord(header, rMessage.size());
+    return sendAll(socket, &header[0], header.size()) &&
+           (rMessage.empty() || sendAll(socket, &rMessage[0], rMessage.size()));
+}
+
+// Receive a message, false if the connection is closed
+static bool receiveMessage(int socket, std::vector<unsigned char> &rMessage)
+{
+    std::vector<unsigned char> header(4);
+    if (!receiveAll(socket, &header[0], header.size()))
+    {
+        return false;
+    }
+    size_t pos = 0;
+    unsigned int size = getWord(header, pos);
+    if (size > OSI_SEARCH_MAX_MESSAGE)
+    {
+        return false;
+    }
+    rMessage.resize(size);
+    return size == 0 || receiveAll(socket, &rMessage[0], size);
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiSearchCluster::OsiSearchCluster()
+{
+}
+
+OsiSearchCluster::~OsiSearchCluster()
+{
+    close();
+}
+
+// OPERATORS
+////////////
+
+void OsiSearchCluster::connect(const std::string &rAddresses)
+{
+    close();
+
+    std::string addresses = rAddresses;
+    for (int c = 0; c < addresses.size(); c++)
+    {
+        if (addresses[c] == ',')
+        {
+            addresses[c] = ' ';
+        }
+    }
+    std::istringstream fields(addresses);
+    std::string address;
+    while (fields >> address)
+    {
+        mSockets.push_back(openSocket(address, false));
+        mAddresses.push_back(address);
+    }
+    if (mSockets.empty())
+    {
+        throw std::invalid_argument("No address of worker in : " + rAddresses);
+    }
+}
+
+bool OsiSearchCluster::isConnected() const
+{
+    return !mSockets.empty();
+}
+
+void OsiSearchCluster::search(const OsiEye &rProbe, int k, std::vector<OsiCandidate> &rCandidates)
+{
+    // Query : number of candidates, then the template of the probe
+    std::vector<unsigned char> query, probe;
+    rProbe.saveTemplate(probe);
+    putWord(query, k > 0 ? k : 0);
+    query.insert(query.end(), probe.begin(), probe.end());
+
+    // All workers search at the same time
+    for (int w = 0; w < mSockets.size(); w++)
+    {
+        if (!sendMessage(mSockets[w], query))
+        {
+            std::string address = mAddresses[w];
+            close();
+            throw std::runtime_error("Lost the connection to the worker " + address);
+        }
+    }
+
+    // Reply : number of candidates (-1 if the worker failed, followed by the error), then the candidates.
+    // All replies are read, so that the next search starts in sync with every worker
+    rCandidates.clear();
+    std::string error;
+    std::vector<unsigned char> reply;
+    for (int w = 0; w < mSockets.size(); w++)
+    {
+        if (!receiveMessage(mSockets[w], reply))
+        {
+            std::string address = mAddresses[w];
+            close();
+            throw std::runtime_error("Lost the connection to the worker " + address);
+        }
+
+        try
+        {
+            size_t pos = 0;
+            int n_candidates = (int)getWord(reply, pos);
+            if (n_candidates < 0 && error.empty())
+            {
+                error = "Worker " + mAddresses[w] + " : " + std::string(reply.begin() + pos, reply.end());
+            }
+            for (int c = 0; c < n_candidates; c++)
+            {
+                OsiCandidate candidate;
+                unsigned int bits = getWord(reply, pos);
+                memcpy(&candidate.score, &bits, sizeof(candidate.score));
+                candidate.index = (int)getWord(reply, pos);
+                unsigned int length = getWord(reply, pos);
+                if (length > reply.size() - pos)
+                {
+                    throw std::runtime_error("Truncated message of the distributed search");
+                }
+                candidate.name.assign(reply.begin() + pos, reply.begin() + pos + length);
+                pos += length;
+                rCandidates.push_back(candidate);
+            }
+        }
+        catch (std::exception &)
+        {
+            // The replies of the other workers cannot be trusted any more
+            close();
+            throw;
+        }
+    }
+    if (!error.empty())
+    {
+        throw std::runtime_error(error);
+    }
+
+    OsiGallery::keepBest(rCandidates, k);
+}
+
+void OsiSearchCluster::close()
+{
+    for (int w = 0; w < mSockets.size(); w++)
+    {
+        closeSocket(mSockets[w]);
+    }
+    mSockets.clear();
+    mAddresses.clear();
+}
+
+void OsiSearchCluster::serve(OsiGallery &rGallery, const std::string &rAddress)
+{
+    int server = openSocket(rAddress, true);
+    std::cout << "Serve " << rGallery.getSize() << " eyes of the gallery on " << rAddress << std::endl;
+
+    std::vector<unsigned char> query, reply, probe;
+    std::vector<OsiCandidate> candidates;
+    for (;;)
+    {
+        int connection = acceptConnection(server);
+        if (connection < 0)
+        {
+            closeSocket(server);
+            throw std::runtime_error("Cannot accept a connection on " + rAddress);
+        }
+
+        // Answer the queries of the coordinator until it closes the connection
+        while (receiveMessage(connection, query))
+        {
+            reply.clear();
+            try
+            {
+                size_t pos = 0;
+                int k = (int)getWord(query, pos);
+                probe.assign(query.begin() + pos, query.end());
+                rGallery.searchTemplate(probe, k, candidates);
+
+                putWord(reply, candidates.size());
+                for (int c = 0; c < candidates.size(); c++)
+                {
+                    unsigned int bits;
+                    memcpy(&bits, &candidates[c].score, sizeof(bits));
+                    putWord(reply, bits);
+                    putWord(reply, candidates[c].index);
+                    putWord(reply, candidates[c].name.size());
+                    reply.insert(reply.end(), candidates[c].name.begin(), candidates[c].name.end());
+                }
+            }
+            catch (std::exception &e)
+            {
+                reply.clear();
+                putWord(reply, (unsigned int)-1);
+                reply.insert(reply.end(), e.what(), e.what() + strlen(e.what()));
+            }
+            if (!sendMessage(connection, reply))
+            {
+                break;
+            }
+        }
+        closeSocket(connection);
+        rGallery.showStatistics();
+    }
+}
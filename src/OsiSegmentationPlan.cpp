@@ -0,0 +1,396 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <stdexcept>
+
+#include "OsiProcessings.h"
+#include "OsiSegmentationPlan.h"
+#include "OsiStringUtils.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiSegmentationPlan::OsiSegmentationPlan(int width, int height, int minIrisDiameter, int minPupilDiameter,
+                                         int maxIrisDiameter, int maxPupilDiameter)
+{
+    mWidth = width;
+    mHeight = height;
+    mpSmallElement = 0;
+    mpIrisElement = 0;
+    mpPupilElement = 0;
+    mpSafeAreaElement = 0;
+
+    // Check arguments (same rules as before the plan existed, see OsiProcessings::segment)
+    //////////////////
+
+    // String functions
+    OsiStringUtils str;
+
+    // Temporary int to check sizes of pupil and iris
+    int check_size = 0;
+
+    // Default value for maxIrisDiameter if user did not specify it
+    if (maxIrisDiameter == 0)
+    {
+        maxIrisDiameter = std::min(height, width);
+    }
+
+    // Change maxIrisDiameter if it is too big relative to image sizes
+    else if (maxIrisDiameter > (check_size = std::floor((float)std::min(height, width))))
+    {
+        std::cout << "Warning in function segment : maxIrisDiameter = " << maxIrisDiameter;
+        std::cout << " is replaced by " << check_size;
+        std::cout << " because image size is " << width << "x" << height << std::endl;
+        maxIrisDiameter = check_size;
+    }
+
+    // Default value for maxPupilDiameter if user did not specify it
+    if (maxPupilDiameter == 0)
+    {
+        maxPupilDiameter = OSI_MAX_RATIO_PUPIL_IRIS * maxIrisDiameter;
+    }
+
+    // Change maxPupilDiameter if it is too big relative to maxIrisDiameter and OSI_MAX_RATIO_PUPIL_IRIS
+    else if (maxPupilDiameter > (check_size = OSI_MAX_RATIO_PUPIL_IRIS * maxIrisDiameter))
+    {
+        std::cout << "Warning in function segment : maxPupilDiameter = " << maxPupilDiameter;
+        std::cout << " is replaced by " << check_size;
+        std::cout << " because maxIrisDiameter = " << maxIrisDiameter;
+        std::cout << " and ratio pupil/iris is generally lower than " << OSI_MAX_RATIO_PUPIL_IRIS << std::endl;
+        maxPupilDiameter = check_size;
+    }
+
+    // Change minIrisDiameter if it is too small relative to OSI_SMALLEST_IRIS
+    if (minIrisDiameter < (check_size = OSI_SMALLEST_IRIS))
+    {
+        std::cout << "Warning in function segment : minIrisDiameter = " << minIrisDiameter;
+        std::cout << " is replaced by " << check_size;
+        std::cout << " which is the smallest size for detecting iris" << std::endl;
+        minIrisDiameter = check_size;
+    }
+
+    // Change minPupilDiameter if it is too small relative to minIrisDiameter and OSI_MIN_RATIO_PUPIL_IRIS
+    if (minPupilDiameter < (check_size = minIrisDiameter * OSI_MIN_RATIO_PUPIL_IRIS))
+    {
+        std::cout << "Warning in function segment : minPupilDiameter = " << minPupilDiameter;
+        std::cout << " is replaced by " << check_size;
+        std::cout << " because minIrisDiameter = " << minIrisDiameter;
+        std::cout << " and ratio pupil/iris is generally upper than " << OSI_MIN_RATIO_PUPIL_IRIS << std::endl;
+        minIrisDiameter = check_size;
+    }
+
+    // Check that minIrisDiameter < maxIrisDiameter
+    if (minIrisDiameter > maxIrisDiameter)
+    {
+        throw std::invalid_argument("Error in function segment : minIrisDiameter = " + str.toString(minIrisDiameter) +
+                                    " should be lower than maxIrisDiameter = " + str.toString(maxIrisDiameter));
+    }
+
+    // Make size odds
+    minIrisDiameter += (minIrisDiameter % 2) ? 0 : -1;
+    maxIrisDiameter += (maxIrisDiameter % 2) ? 0 : +1;
+    minPupilDiameter += (minPupilDiameter % 2) ? 0 : -1;
+    maxPupilDiameter += (maxPupilDiameter % 2) ? 0 : +1;
+
+    mMinIrisDiameter = minIrisDiameter;
+    mMaxIrisDiameter = maxIrisDiameter;
+
+    // Kernels for the pupil detection
+    //////////////////////////////////
+
+    buildPupilFilters(minPupilDiameter, maxPupilDiameter);
+
+    // Structuring elements
+    ///////////////////////
+
+    mpSmallElement = cvCreateStructuringElementEx(3, 3, 1, 1, CV_SHAPE_ELLIPSE);
+    mpIrisElement = cvCreateStructuringElementEx(21, 21, 10, 10, CV_SHAPE_ELLIPSE);
+    mpPupilElement = cvCreateStructuringElementEx(21, 21, 10, 1, CV_SHAPE_RECT);
+    mpSafeAreaElement = cvCreateStructuringElementEx(11, 11, 5, 5, CV_SHAPE_ELLIPSE);
+
+    // Angle tables
+    ///////////////
+
+    // Radii of the pupil contours stay below the maximum pupil diameter,
+    // radii of the iris contours stay below the maximum iris diameter.
+    // Other radii are rare, their tables are computed on the fly
+    int max_radius[OSI_THETA_KINDS];
+    max_radius[OSI_THETA_PUPIL_ACCURATE] = maxPupilDiameter;
+    max_radius[OSI_THETA_PUPIL_COARSE] = maxPupilDiameter;
+    max_radius[OSI_THETA_IRIS_COARSE] = maxIrisDiameter;
+    max_radius[OSI_THETA_IRIS_ACCURATE] = maxIrisDiameter;
+    for (int k = 0; k < OSI_THETA_KINDS; k++)
+    {
+        mThetas[k].resize(max_radius[k] + 1);
+        for (int r = 1; r <= max_radius[k]; r++)
+        {
+            computeTheta(k, r, mThetas[k][r]);
+        }
+    }
+
+} // end of function
+
+OsiSegmentationPlan::~OsiSegmentationPlan()
+{
+    for (int n = 0; n < mHorizontalRingFilters.size(); n++)
+    {
+        cvReleaseMat(&mHorizontalRingFilters[n]);
+        cvReleaseMat(&mVerticalRingFilters[n]);
+        cvReleaseMat(&mDiskFilters[n]);
+    }
+    cvReleaseStructuringElement(&mpSmallElement);
+    cvReleaseStructuringElement(&mpIrisElement);
+    cvReleaseStructuringElement(&mpPupilElement);
+    cvReleaseStructuringElement(&mpSafeAreaElement);
+}
+
+// ACCESSORS
+////////////
+
+bool OsiSegmentationPlan::isCompatible(int width, int height) const
+{
+    return width == mWidth && height == mHeight;
+}
+
+int OsiSegmentationPlan::getMinIrisDiameter() const
+{
+    return mMinIrisDiameter;
+}
+
+int OsiSegmentationPlan::getMaxIrisDiameter() const
+{
+    return mMaxIrisDiameter;
+}
+
+float OsiSegmentationPlan::getPupilScale() const
+{
+    return mPupilScale;
+}
+
+int OsiSegmentationPlan::getNumberOfPupilRadii() const
+{
+    return mHorizontalRingFilters.size();
+}
+
+int OsiSegmentationPlan::getFirstPupilRadius() const
+{
+    return mFirstPupilRadius;
+}
+
+const CvMat *OsiSegmentationPlan::getHorizontalRingFilter(int n) const
+{
+    return mHorizontalRingFilters[n];
+}
+
+const CvMat *OsiSegmentationPlan::getVerticalRingFilter(int n) const
+{
+    return mVerticalRingFilters[n];
+}
+
+const CvMat *OsiSegmentationPlan::getDiskFilter(int n) const
+{
+    return mDiskFilters[n];
+}
+
+double OsiSegmentationPlan::getRingNormalization(int n) const
+{
+    return mRingNormalizations[n];
+}
+
+double OsiSegmentationPlan::getDiskNormalization(int n) const
+{
+    return mDiskNormalizations[n];
+}
+
+IplConvKernel *OsiSegmentationPlan::getSmallElement() const
+{
+    return mpSmallElement;
+}
+
+IplConvKernel *OsiSegmentationPlan::getIrisElement() const
+{
+    return mpIrisElement;
+}
+
+IplConvKernel *OsiSegmentationPlan::getPupilElement() const
+{
+    return mpPupilElement;
+}
+
+IplConvKernel *OsiSegmentationPlan::getSafeAreaElement() const
+{
+    return mpSafeAreaElement;
+}
+
+const std::vector<float> &OsiSegmentationPlan::getTheta(int kind, int radius, std::vector<float> &rBuffer,
+                                                        float stepFactor) const
+{
+    if (stepFactor == 1 && radius >= 1 && radius < mThetas[kind].size())
+    {
+        return mThetas[kind][radius];
+    }
+    computeTheta(kind, radius, rBuffer, stepFactor);
+    return rBuffer;
+}
+
+// OPERATORS
+////////////
+
+void OsiSegmentationPlan::computeTheta(int kind, int radius, std::vector<float> &rTheta, float stepFactor)
+{
+    rTheta.clear();
+    float theta_step = 0;
+    float factor = stepFactor;
+
+    switch (kind)
+    {
+    // Regular sampling, one angle per pixel of the contour
+    case OSI_THETA_PUPIL_ACCURATE:
+    case OSI_THETA_IRIS_ACCURATE:
+        theta_step = 360.0 / OSI_PI / radius * factor;
+        for (float t = 0; t < 360; t += theta_step)
+        {
+            rTheta.push_back(t * OSI_PI / 180);
+        }
+        break;
+
+    // Half sampling, with less angles on the top (eyelid)
+    case OSI_THETA_PUPIL_COARSE:
+        theta_step = 360.0 / OSI_PI / radius * 2 * factor;
+        for (float t = 0; t < 360; t += theta_step)
+        {
+            if (t > 45 && t < 135)
+                t += theta_step;
+            rTheta.push_back(t * OSI_PI / 180);
+        }
+        break;
+
+    // Only the lower part of iris is accurately sampled (eyelids)
+    case OSI_THETA_IRIS_COARSE:
+        theta_step = 360.0 / OSI_PI / radius * factor;
+        for (float t = 0; t < 360; t += theta_step)
+        {
+            if (t < 180 || (t > 225 && t < 315))
+                t += 2 * theta_step;
+            rTheta.push_back(t * OSI_PI / 180);
+        }
+        break;
+
+    default:
+        throw std::invalid_argument("Unknown kind of angle table");
+    }
+}
+
+void OsiSegmentationPlan::buildPupilFilters(int minPupilDiameter, int maxPupilDiameter)
+{
+    // Check arguments (same rules as before the plan existed, see OsiProcessings::detectPupil)
+    //////////////////
+
+    // String functions
+    OsiStringUtils str;
+
+    // Default value for maxPupilDiameter, if user did not specify it
+    if (maxPupilDiameter == 0)
+    {
+        maxPupilDiameter = std::min(mHeight, mWidth) * OSI_MAX_RATIO_PUPIL_IRIS;
+    }
+
+    // Change maxPupilDiameter if it is too big relative to the image size and the ratio pupil/iris
+    else if (maxPupilDiameter > std::min(mHeight, mWidth) * OSI_MAX_RATIO_PUPIL_IRIS)
+    {
+        int newmaxPupilDiameter = std::floor(std::min(mHeight, mWidth) * OSI_MAX_RATIO_PUPIL_IRIS);
+        std::cout << "Warning in function detectPupil : maxPupilDiameter = " << maxPupilDiameter;
+        std::cout << " is replaced by " << newmaxPupilDiameter;
+        std::cout << " because image size is " << mWidth << "x" << mHeight;
+        std::cout << " and ratio pupil/iris is generally lower than " << OSI_MAX_RATIO_PUPIL_IRIS << std::endl;
+        maxPupilDiameter = newmaxPupilDiameter;
+    }
+
+    // Change minPupilDiameter if it is too small relative to OSI_SMALLEST_PUPIL
+    if (minPupilDiameter < OSI_SMALLEST_PUPIL)
+    {
+        std::cout << "Warning in function detectPupil : minPupilDiameter = " << minPupilDiameter;
+        std::cout << " is replaced by " << OSI_SMALLEST_PUPIL;
+        std::cout << " which is the smallest size for detecting pupil" << std::endl;
+        minPupilDiameter = OSI_SMALLEST_PUPIL;
+    }
+
+    // Check that minPupilDiameter < maxPupilDiameter
+    if (minPupilDiameter >= maxPupilDiameter)
+    {
+        throw std::invalid_argument(
+            "Error in function detectPupil : minPupilDiameter = " + str.toString(minPupilDiameter) +
+            " should be lower than maxPupilDiameter = " + str.toString(maxPupilDiameter));
+    }
+
+    // Rescale sizes for the downsampled image
+    mPupilScale = (float)OSI_SMALLEST_PUPIL / minPupilDiameter;
+    maxPupilDiameter = maxPupilDiameter * mPupilScale;
+    maxPupilDiameter += (maxPupilDiameter % 2) ? 0 : +1;
+
+    // Create the filters fh and fv
+    int filter_size = maxPupilDiameter;
+    filter_size += (filter_size % 2) ? 0 : -1;
+    CvMat *fh = cvCreateMat(filter_size, filter_size, CV_32FC1);
+    CvMat *fv = cvCreateMat(filter_size, filter_size, CV_32FC1);
+    for (int i = 0; i < fh->rows; i++)
+    {
+        float x = i - float(filter_size - 1) / 2;
+        for (int j = 0; j < fh->cols; j++)
+        {
+            float y = j - float(filter_size - 1) / 2;
+            if (x != 0 || y != 0)
+            {
+                (fh->data.fl)[i * fh->cols + j] = y / std::sqrt(x * x + y * y);
+                (fv->data.fl)[i * fv->cols + j] = x / std::sqrt(x * x + y * y);
+            }
+            else
+            {
+                (fh->data.fl)[i * fh->cols + j] = 0;
+                (fv->data.fl)[i * fv->cols + j] = 0;
+            }
+        }
+    }
+
+    // Temporary mask of ring
+    CvMat *ring = cvCreateMat(filter_size, filter_size, CV_8UC1);
+
+    // One set of filters per radius
+    mFirstPupilRadius = (OSI_SMALLEST_PUPIL - 1) / 2;
+    for (int r = mFirstPupilRadius; r < (maxPupilDiameter - 1) / 2; r++)
+    {
+        // Centred ring with radius = r and width = 2
+        cvZero(ring);
+        cvCircle(ring, cvPoint((filter_size - 1) / 2, (filter_size - 1) / 2), r, cvScalar(1), 2);
+        mRingNormalizations.push_back(1.0 / cvSum(ring).val[0]);
+
+        // Fh and Fv masked by the ring
+        CvMat *ring_fh = cvCreateMat(filter_size, filter_size, CV_32FC1);
+        cvZero(ring_fh);
+        cvCopy(fh, ring_fh, ring);
+        mHorizontalRingFilters.push_back(ring_fh);
+
+        CvMat *ring_fv = cvCreateMat(filter_size, filter_size, CV_32FC1);
+        cvZero(ring_fv);
+        cvCopy(fv, ring_fv, ring);
+        mVerticalRingFilters.push_back(ring_fv);
+
+        // Disk-shaped neighbourhood
+        CvMat *disk = cvCreateMat(filter_size, filter_size, CV_8UC1);
+        cvZero(disk);
+        cvCircle(disk, cvPoint((filter_size - 1) / 2, (filter_size - 1) / 2), r, cvScalar(1), -1);
+        mDiskNormalizations.push_back(1.0 / cvSum(disk).val[0]);
+        mDiskFilters.push_back(disk);
+    }
+
+    // Release memory
+    cvReleaseMat(&fh);
+    cvReleaseMat(&fv);
+    cvReleaseMat(&ring);
+
+} // end of function
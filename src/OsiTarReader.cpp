@@ -0,0 +1,356 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#ifdef OSI_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef OSI_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+#include "OsiTarReader.h"
+
+// Tar archives are made of blocks of 512 bytes
+#define OSI_TAR_BLOCK_SIZE 512
+
+// Check the extension of a path
+static bool endsWith(const std::string &rString, const std::string &rEnd)
+{
+    return rString.size() >= rEnd.size() && rString.compare(rString.size() - rEnd.size(), rEnd.size(), rEnd) == 0;
+}
+
+// Get a text field of a tar header (not terminated by 0 when it is full)
+static std::string getField(const unsigned char *p, int length)
+{
+    return std::string((const char *)p, std::find(p, p + length, 0) - p);
+}
+
+// Get a number field of a tar header : octal, or base-256 for large values
+static unsigned long long getNumber(const unsigned char *p, int length)
+{
+    unsigned long long value = 0;
+    if (p[0] & 0x80)
+    {
+        value = p[0] & 0x7f;
+        for (int i = 1; i < length; i++)
+        {
+            value = (value << 8) | p[i];
+        }
+        return value;
+    }
+    for (int i = 0; i < length && p[i]; i++)
+    {
+        if (p[i] >= '0' && p[i] <= '7')
+        {
+            value = 8 * value + (p[i] - '0');
+        }
+    }
+    return value;
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiTarReader::OsiTarReader()
+{
+    mCompression = OSI_TAR_NONE;
+    mpFile = 0;
+    mpStream = 0;
+    mInputSize = 0;
+    mInputPos = 0;
+}
+
+OsiTarReader::~OsiTarReader()
+{
+    close();
+}
+
+// ACCESSORS
+////////////
+
+bool OsiTarReader::isArchive(const std::string &rFilename)
+{
+    return endsWith(rFilename, ".tar") || endsWith(rFilename, ".tar.gz") || endsWith(rFilename, ".tgz") ||
+           endsWith(rFilename, ".tar.zst") || endsWith(rFilename, ".tzst");
+}
+
+// OPERATORS
+////////////
+
+void OsiTarReader::open(const std::string &rFilename)
+{
+    close();
+    mFilename = rFilename;
+    mCompression = OSI_TAR_NONE;
+    if (endsWith(rFilename, ".gz") || endsWith(rFilename, ".tgz"))
+    {
+        mCompression = OSI_TAR_GZIP;
+    }
+    if (endsWith(rFilename, ".zst") || endsWith(rFilename, ".tzst"))
+    {
+        mCompression = OSI_TAR_ZSTD;
+    }
+
+    if (mCompression == OSI_TAR_GZIP)
+    {
+#ifdef OSI_WITH_ZLIB
+        gzFile file = gzopen(rFilename.c_str(), "rb");
+        if (!file)
+        {
+            throw std::runtime_error("Cannot open the archive " + rFilename);
+        }
+        gzbuffer(file, 1 << 20);
+        mpStream = file;
+        return;
+#else
+        throw std::runtime_error("Cannot read " + rFilename + " : Osiris is built without zlib");
+#endif
+    }
+
+#ifndef OSI_WITH_ZSTD
+    if (mCompression == OSI_TAR_ZSTD)
+    {
+        throw std::runtime_error("Cannot read " + rFilename + " : Osiris is built without libzstd");
+    }
+#endif
+
+    mpFile = fopen(rFilename.c_str(), "rb");
+    if (!mpFile)
+    {
+        throw std::runtime_error("Cannot open the archive " + rFilename);
+    }
+
+#ifdef OSI_WITH_ZSTD
+    if (mCompression == OSI_TAR_ZSTD)
+    {
+        ZSTD_DStream *stream = ZSTD_createDStream();
+        ZSTD_initDStream(stream);
+        mpStream = stream;
+        mInput.resize(ZSTD_DStreamInSize());
+        mInputSize = 0;
+        mInputPos = 0;
+    }
+#endif
+}
+
+void OsiTarReader::close()
+{
+    if (mpStream)
+    {
+#ifdef OSI_WITH_ZLIB
+        if (mCompression == OSI_TAR_GZIP)
+        {
+            gzclose((gzFile)mpStream);
+        }
+#endif
+#ifdef OSI_WITH_ZSTD
+        if (mCompression == OSI_TAR_ZSTD)
+        {
+            ZSTD_freeDStream((ZSTD_DStream *)mpStream);
+        }
+#endif
+        mpStream = 0;
+    }
+    if (mpFile)
+    {
+        fclose(mpFile);
+        mpFile = 0;
+    }
+    mInput.clear();
+    mInputSize = 0;
+    mInputPos = 0;
+}
+
+bool OsiTarReader::next(std::string &rName, std::vector<unsigned char> &rData)
+{
+    // Name given by a previous header (GNU long name or pax)
+    std::string long_name;
+
+    while (true)
+    {
+        unsigned char header[OSI_TAR_BLOCK_SIZE];
+        if (!read(header, OSI_TAR_BLOCK_SIZE))
+        {
+            return false;
+        }
+
+        // The archive ends with empty blocks
+        if (std::count(header, header + OSI_TAR_BLOCK_SIZE, 0) == OSI_TAR_BLOCK_SIZE)
+        {
+            return false;
+        }
+
+        // The checksum is computed with its own field filled with blanks
+        unsigned long long checksum = 8 * ' ';
+        for (int i = 0; i < OSI_TAR_BLOCK_SIZE; i++)
+        {
+            checksum += (i < 148 || i >= 156) ? header[i] : 0;
+        }
+        if (checksum != getNumber(header + 148, 8))
+        {
+            throw std::runtime_error("Corrupted header in the archive " + mFilename);
+        }
+
+        unsigned long long size = getNumber(header + 124, 12);
+        unsigned long long padding = (OSI_TAR_BLOCK_SIZE - size % OSI_TAR_BLOCK_SIZE) % OSI_TAR_BLOCK_SIZE;
+        char type = header[156];
+
+        std::string name = getField(header, 100);
+        if (getField(header + 257, 5) == "ustar" && header[345])
+        {
+            name = getField(header + 345, 155) + "/" + name;
+        }
+        if (long_name != "")
+        {
+            name = long_name;
+            long_name = "";
+        }
+
+        // Data of the member, or of a header giving the name of the next member
+        bool regular = type == '0' || type == 0 || type == '7';
+        if (regular || type == 'L' || type == 'x')
+        {
+            rData.resize(size);
+            if ((size > 0 && !read(&rData[0], size)) || !skip(padding))
+            {
+                throw std::runtime_error("Truncated archive " + mFilename);
+            }
+        }
+        else
+        {
+            if (!skip(size + padding))
+            {
+                throw std::runtime_error("Truncated archive " + mFilename);
+            }
+            continue;
+        }
+
+        if (regular)
+        {
+            rName = name;
+            return true;
+        }
+
+        // GNU long name : the data is the name
+        if (type == 'L')
+        {
+            long_name = getField(rData.empty() ? header : &rData[0], rData.size());
+        }
+
+        // Pax header : records "<length> <key>=<value>\n"
+        else
+        {
+            size_t pos = 0;
+            while (pos < rData.size())
+            {
+                size_t length = strtoul((const char *)&rData[pos], 0, 10);
+                if (length == 0 || pos + length > rData.size())
+                {
+                    break;
+                }
+                std::string record((const char *)&rData[pos], length - 1);
+                size_t blank = record.find(' ');
+                if (blank != std::string::npos && record.compare(blank + 1, 5, "path=") == 0)
+                {
+                    long_name = record.substr(blank + 6);
+                }
+                pos += length;
+            }
+        }
+    }
+}
+
+bool OsiTarReader::read(void *pData, size_t size)
+{
+    unsigned char *p = (unsigned char *)pData;
+
+#ifdef OSI_WITH_ZLIB
+    if (mCompression == OSI_TAR_GZIP)
+    {
+        while (size > 0)
+        {
+            int n = gzread((gzFile)mpStream, p, (unsigned int)std::min(size, (size_t)1 << 30));
+            if (n <= 0)
+            {
+                return false;
+            }
+            p += n;
+            size -= n;
+        }
+        return true;
+    }
+#endif
+
+#ifdef OSI_WITH_ZSTD
+    if (mCompression == OSI_TAR_ZSTD)
+    {
+        ZSTD_outBuffer output = {p, size, 0};
+        while (output.pos < output.size)
+        {
+            if (mInputPos == mInputSize)
+            {
+                mInputSize = fread(&mInput[0], 1, mInput.size(), mpFile);
+                mInputPos = 0;
+            }
+
+            // The decoder may still give data when the file is read
+            size_t before = output.pos;
+            ZSTD_inBuffer input = {&mInput[0], mInputSize, mInputPos};
+            size_t status = ZSTD_decompressStream((ZSTD_DStream *)mpStream, &output, &input);
+            mInputPos = input.pos;
+            if (ZSTD_isError(status))
+            {
+                throw std::runtime_error("Cannot decompress the archive " + mFilename + " : " +
+                                         ZSTD_getErrorName(status));
+            }
+            if (mInputSize == 0 && output.pos == before)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+#endif
+
+    return mpFile && fread(p, 1, size, mpFile) == size;
+}
+
+bool OsiTarReader::skip(size_t size)
+{
+    // Uncompressed archive : move in the file
+    if (mCompression == OSI_TAR_NONE)
+    {
+        while (size > 0)
+        {
+            long step = (long)std::min(size, (size_t)1 << 30);
+            if (fseek(mpFile, step, SEEK_CUR) != 0)
+            {
+                return false;
+            }
+            size -= step;
+        }
+        return true;
+    }
+
+    // Compressed archive : decompress and forget
+    std::vector<unsigned char> buffer(std::min(size, (size_t)1 << 16));
+    while (size > 0)
+    {
+        size_t step = std::min(size, buffer.size());
+        if (!read(&buffer[0], step))
+        {
+            return false;
+        }
+        size -= step;
+    }
+    return true;
+}
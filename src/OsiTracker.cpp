@@ -0,0 +1,87 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include "OsiTracker.h"
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiTracker::OsiTracker(float minConfidence)
+{
+    mMinConfidence = minConfidence;
+    mTrackedFrames = 0;
+    mFullSearches = 0;
+    reset();
+}
+
+OsiTracker::~OsiTracker()
+{
+    // Do nothing
+}
+
+// ACCESSORS
+////////////
+
+bool OsiTracker::hasPrior() const
+{
+    return mHasPrior;
+}
+
+const OsiCircle &OsiTracker::getPupil() const
+{
+    return mPupil;
+}
+
+const OsiCircle &OsiTracker::getIris() const
+{
+    return mIris;
+}
+
+int OsiTracker::getNumberOfTrackedFrames() const
+{
+    return mTrackedFrames;
+}
+
+int OsiTracker::getNumberOfFullSearches() const
+{
+    return mFullSearches;
+}
+
+// OPERATORS
+////////////
+
+void OsiTracker::reset()
+{
+    mHasPrior = false;
+    mReferenceResponse = 0;
+    mPupil.setCircle(0, 0, 0);
+    mIris.setCircle(0, 0, 0);
+}
+
+bool OsiTracker::isConfident(double response) const
+{
+    return mHasPrior && response >= mMinConfidence * mReferenceResponse;
+}
+
+void OsiTracker::update(const OsiCircle &rPupil, const OsiCircle &rIris, double response, bool tracked)
+{
+    mPupil = rPupil;
+    mIris = rIris;
+    mHasPrior = true;
+
+    // The reference is only given by a full search
+    if (tracked)
+    {
+        mTrackedFrames++;
+    }
+    else
+    {
+        mReferenceResponse = response;
+        mFullSearches++;
+    }
+}
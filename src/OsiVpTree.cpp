@@ -0,0 +1,245 @@
+/*******************************************************
+ * Open Source for Iris : OSIRIS
+ * Version : 4.0
+ * Date : 2011
+ * Author : Guillaume Sutra, Telecom SudParis, France
+ * License : BSD
+ ********************************************************/
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <thread>
+
+#include "OsiVpTree.h"
+
+// Tag at the beginning of a file of vantage-point tree
+#define OSI_VP_TAG "OSIVPT01"
+#define OSI_VP_TAG_SIZE 8
+
+// Seed of the vantage points : the same templates always give the same tree
+#define OSI_VP_SEED 20110
+
+// Write an unsigned integer in little-endian order
+static void writeNumber(std::ostream &rFile, unsigned long long value, int size)
+{
+    for (int b = 0; b < size; b++)
+    {
+        rFile.put((char)(value >> (8 * b)));
+    }
+}
+
+// Read an unsigned integer written by writeNumber()
+static unsigned long long readNumber(std::istream &rFile, int size)
+{
+    unsigned long long value = 0;
+    for (int b = 0; b < size; b++)
+    {
+        value |= (unsigned long long)(unsigned char)rFile.get() << (8 * b);
+    }
+    if (!rFile)
+    {
+        throw std::runtime_error("Truncated file of vantage-point tree");
+    }
+    return value;
+}
+
+// CONSTRUCTORS & DESTRUCTORS
+/////////////////////////////
+
+OsiVpTree::OsiVpTree()
+{
+    mShift = 0;
+    mSlack = 0;
+}
+
+// OPERATORS
+////////////
+
+void OsiVpTree::init(int shift, float slack)
+{
+    mShift = shift;
+    mSlack = slack;
+    mNames.clear();
+    mHashes.clear();
+    mCodes.clear();
+    mOrder.clear();
+    mMedians.clear();
+}
+
+void OsiVpTree::add(const std::string &rName, const OsiBitCode &rCode)
+{
+    if (!mCodes.empty() && (rCode.getWidth() != mCodes[0].getWidth() || rCode.getRows() != mCodes[0].getRows() ||
+                            rCode.getMaskRows() != mCodes[0].getMaskRows()))
+    {
+        throw std::runtime_error("The iris code of " + rName + " has not the size of the vantage-point tree");
+    }
+    mNames.push_back(rName);
+    mHashes.push_back(rCode.getHash());
+    mCodes.push_back(rCode);
+}
+
+void OsiVpTree::build(int nThreads)
+{
+    mOrder.resize(mCodes.size());
+    for (int i = 0; i < mOrder.size(); i++)
+    {
+        mOrder[i] = i;
+    }
+    mMedians.assign(mCodes.size(), 0);
+    buildNode(0, mOrder.size(), std::max(nThreads, 1));
+}
+
+bool OsiVpTree::load(const std::string &rFilename)
+{
+    std::ifstream file(rFilename.c_str(), std::ios::in | std::ios::binary);
+    char tag[OSI_VP_TAG_SIZE];
+    if (!file || !file.read(tag, OSI_VP_TAG_SIZE) || memcmp(tag, OSI_VP_TAG, OSI_VP_TAG_SIZE))
+    {
+        return false;
+    }
+    int shift = readNumber(file, 4);
+    unsigned int n_nodes = readNumber(file, 4);
+    if (shift != mShift || n_nodes != mCodes.size())
+    {
+        return false;
+    }
+
+    // Each node must be a template of the gallery, unchanged
+    std::map<std::string, std::vector<int>> ids;
+    for (int i = mNames.size() - 1; i >= 0; i--)
+    {
+        ids[mNames[i]].push_back(i);
+    }
+    std::vector<int> order(n_nodes);
+    std::vector<float> medians(n_nodes);
+    for (int n = 0; n < n_nodes; n++)
+    {
+        std::string name(readNumber(file, 4), '\0');
+        file.read(&name[0], name.size());
+        unsigned long long hash = readNumber(file, 8);
+        unsigned int median = readNumber(file, 4);
+        std::map<std::string, std::vector<int>>::iterator it = ids.find(name);
+        if (it == ids.end() || it->second.empty() || mHashes[it->second.back()] != hash)
+        {
+            return false;
+        }
+        order[n] = it->second.back();
+        it->second.pop_back();
+        memcpy(&medians[n], &median, sizeof(float));
+    }
+    mOrder.swap(order);
+    mMedians.swap(medians);
+    return true;
+}
+
+void OsiVpTree::save(const std::string &rFilename) const
+{
+    std::ofstream file(rFilename.c_str(), std::ios::out | std::ios::binary);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot create the file of vantage-point tree : " + rFilename);
+    }
+    file.write(OSI_VP_TAG, OSI_VP_TAG_SIZE);
+    writeNumber(file, mShift, 4);
+    writeNumber(file, mOrder.size(), 4);
+    for (int n = 0; n < mOrder.size(); n++)
+    {
+        const std::string &name = mNames[mOrder[n]];
+        writeNumber(file, name.size(), 4);
+        file.write(name.data(), name.size());
+        writeNumber(file, mHashes[mOrder[n]], 8);
+        unsigned int median;
+        memcpy(&median, &mMedians[n], sizeof(float));
+        writeNumber(file, median, 4);
+    }
+    if (!file)
+    {
+        throw std::runtime_error("Cannot write the file of vantage-point tree : " + rFilename);
+    }
+}
+
+void OsiVpTree::query(const OsiBitCode &rProbe, int shift, float radius, std::vector<int> &rIds) const
+{
+    rIds.clear();
+    searchNode(rProbe, shift, radius, 0, mOrder.size(), rIds);
+    std::sort(rIds.begin(), rIds.end());
+}
+
+double OsiVpTree::getSize() const
+{
+    double size = mOrder.size() * (sizeof(int) + sizeof(float));
+    for (int i = 0; i < mCodes.size(); i++)
+    {
+        size += (mCodes[i].getCode().size() + mCodes[i].getValid().size()) * sizeof(unsigned long long);
+    }
+    return size;
+}
+
+void OsiVpTree::buildNode(int first, int last, int nThreads)
+{
+    if (last - first <= 1)
+    {
+        return;
+    }
+
+    // Vantage point drawn among the templates of the node
+    std::mt19937 random(OSI_VP_SEED + first);
+    std::swap(mOrder[first], mOrder[first + random() % (last - first)]);
+    const OsiBitCode &vantage = mCodes[mOrder[first]];
+
+    // The closest half of the other templates is the inner subtree
+    std::vector<std::pair<float, int>> distances(last - first - 1);
+    for (int i = 0; i < distances.size(); i++)
+    {
+        distances[i].first = vantage.distance(mCodes[mOrder[first + 1 + i]], mShift);
+        distances[i].second = mOrder[first + 1 + i];
+    }
+    int n_inner = distances.size() / 2;
+    std::nth_element(distances.begin(), distances.begin() + n_inner, distances.end());
+    mMedians[first] = distances[n_inner].first;
+    for (int i = 0; i < distances.size(); i++)
+    {
+        mOrder[first + 1 + i] = distances[i].second;
+    }
+
+    // The subtrees do not share nodes : the threads build them in place
+    int middle = first + 1 + n_inner;
+    if (nThreads > 1)
+    {
+        std::thread inner(&OsiVpTree::buildNode, this, first + 1, middle, nThreads / 2);
+        buildNode(middle, last, nThreads - nThreads / 2);
+        inner.join();
+    }
+    else
+    {
+        buildNode(first + 1, middle, 1);
+        buildNode(middle, last, 1);
+    }
+}
+
+void OsiVpTree::searchNode(const OsiBitCode &rProbe, int shift, float radius, int first, int last,
+                           std::vector<int> &rIds) const
+{
+    if (first >= last)
+    {
+        return;
+    }
+    float distance = rProbe.distance(mCodes[mOrder[first]], shift);
+    if (distance <= radius)
+    {
+        rIds.push_back(mOrder[first]);
+    }
+    int middle = first + 1 + (last - first - 1) / 2;
+    if (distance - radius - mSlack <= mMedians[first])
+    {
+        searchNode(rProbe, shift, radius, first + 1, middle, rIds);
+    }
+    if (distance + radius + mSlack >= mMedians[first])
+    {
+        searchNode(rProbe, shift, radius, middle, last, rIds);
+    }
+}